@@ -9,15 +9,23 @@
                  INCLUDE_FLAG(PATH("..", "basm", "src"))
 #define COMMON_UNITS PATH("..", "common", "sv.c"), \
                      PATH("..", "common", "arena.c"), \
+                     PATH("..", "common", "hash.c"), \
                      PATH("..", "common", "path.c")
 #define BM_UNITS   PATH("..", "bm", "src", "types.c"), \
-                   PATH("..", "bm", "src", "bm.c")
-#define BASM_UNITS PATH("..", "basm", "src", "compiler.c"), \
+                   PATH("..", "bm", "src", "bm.c"), \
+                   PATH("..", "bm", "src", "channel.c"), \
+                   PATH("..", "bm", "src", "trace.c")
+#define BASM_UNITS PATH("..", "basm", "src", "cache.c"), \
+                   PATH("..", "basm", "src", "compiler.c"), \
                    PATH("..", "basm", "src", "expr.c"), \
                    PATH("..", "basm", "src", "fl.c"), \
                    PATH("..", "basm", "src", "gas_arm64.c"), \
+                   PATH("..", "basm", "src", "intern.c"), \
                    PATH("..", "basm", "src", "linizer.c"), \
                    PATH("..", "basm", "src", "nasm_sysv_x86_64.c"), \
+                   PATH("..", "basm", "src", "object.c"), \
+                   PATH("..", "basm", "src", "optimizer.c"), \
+                   PATH("..", "basm", "src", "prefetch.c"), \
                    PATH("..", "basm", "src", "statement.c"), \
                    PATH("..", "basm", "src", "target.c"), \
                    PATH("..", "basm", "src", "tokenizer.c"), \
@@ -27,7 +35,7 @@
                    PATH("src", "bang_parser.c"), \
                    PATH("src", "bang_diag.c")
 #define UNITS BM_UNITS, COMMON_UNITS, BASM_UNITS, BANG_UNITS
-#define LIBS "-lm"
+#define LIBS "-lm", "-lpthread"
 
 int main()
 {
@@ -8,6 +8,7 @@
 #include "./path.h"
 // #include "./basm.h"
 #include "./bang_compiler.h"
+#include "./trace.h"
 
 #define BANG_DEFAULT_STACK_SIZE 4096
 
@@ -46,7 +47,10 @@ static void run_usage(FILE *stream)
 {
     fprintf(stream, "Usage: bang run [OPTIONS] <input.bang>\n");
     fprintf(stream, "OPTIONS:\n");
-    fprintf(stream, "    -t             Enable trace mode\n");
+    fprintf(stream, "    -t <trace.bmt> Record the executed instructions and the memory writes\n");
+    fprintf(stream, "                   into a binary trace. Use bmtrace to decode it.\n");
+    fprintf(stream, "    -tc <bytes>    Capacity of the trace. Only the most recent records are kept.\n");
+    fprintf(stream, "                   (default %zu)\n", (size_t) BM_TRACE_DEFAULT_CAPACITY);
     fprintf(stream, "    -s <bytes>     Local variables stack size in bytes. (default %zu)\n", (size_t) BANG_DEFAULT_STACK_SIZE);
     fprintf(stream, "    -werror        Treat warnings as errors\n");
     fprintf(stream, "    -h             Print this help to stdout\n");
@@ -58,14 +62,40 @@ static void run_subcommand(int argc, char **argv)
     static Basm basm = {0};
     static Bang bang = {0};
 
-    bool trace = false;
+    static Bm_Trace_Symbol symbols[BANG_PROCS_CAPACITY] = {0};
+
+    const char *trace_file_path = NULL;
+    uint64_t trace_capacity = BM_TRACE_DEFAULT_CAPACITY;
     const char *input_file_path = NULL;
     size_t stack_size = BANG_DEFAULT_STACK_SIZE;
 
     while (argc > 0) {
         const char *flag = shift(&argc, &argv);
         if (strcmp(flag, "-t") == 0) {
-            trace = true;
+            if (argc <= 0) {
+                run_usage(stderr);
+                fprintf(stderr, "ERROR: no value is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            trace_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-tc") == 0) {
+            if (argc <= 0) {
+                run_usage(stderr);
+                fprintf(stderr, "ERROR: no value is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+            const char *capacity_cstr = shift(&argc, &argv);
+            char *endptr = NULL;
+
+            trace_capacity = strtoumax(capacity_cstr, &endptr, 10);
+
+            if (capacity_cstr == endptr || *endptr != '\0' || trace_capacity == 0) {
+                run_usage(stderr);
+                fprintf(stderr, "ERROR: `%s` is not a valid capacity of the trace\n",
+                        capacity_cstr);
+                exit(1);
+            }
         } else if (strcmp(flag, "-h") == 0) {
             run_usage(stdout);
             exit(0);
@@ -131,44 +161,40 @@ static void run_subcommand(int argc, char **argv)
 
     for (size_t i = 0; i < bm.externals_size; ++i) {
         if (strcmp(bm.externals[i].name, "write") == 0) {
-            bm.natives[i] = native_write;
+            bm_push_native(&bm, native_write);
         } else {
             fprintf(stderr, "WARNING: unknown native `%s`\n", bm.externals[i].name);
+            bm_push_native(&bm, NULL);
         }
     }
 
-    while (!bm.halt) {
-        if (trace) {
-            const Inst inst = bm.program[bm.ip];
-            const Inst_Def def = get_inst_def(inst.type);
-            fprintf(stderr, "%s", def.name);
-            if (def.has_operand) {
-                fprintf(stderr, " %"PRIu64, inst.operand.as_u64);
-            }
-            fprintf(stderr, "\n");
-        }
-        Err err = bm_execute_inst(&bm);
-        if (trace) {
-            // TODO(#469): `bang run` needs a way to customize trace mode parameters
-#define BANG_TRACE_MEMORY_START 0
-#define BANG_TRACE_CELL_COUNT 5
-#define BANG_TRACE_CELL_SIZE 8
-            for (size_t cell = 0; cell < BANG_TRACE_CELL_COUNT; ++cell) {
-                const Memory_Addr start = BANG_TRACE_MEMORY_START + cell * BANG_TRACE_CELL_SIZE;
-                fprintf(stderr, "  %04"PRIX64":", start);
-                for (size_t byte = 0; byte < BANG_TRACE_CELL_SIZE; ++byte) {
-                    const Memory_Addr addr = start + byte;
-                    fprintf(stderr, " %02X", bm.memory[addr]);
-                }
-                fprintf(stderr, "\n");
-            }
+    Bm_Trace trace = {0};
+    if (trace_file_path != NULL) {
+        size_t symbols_size = 0;
+        for (size_t i = 0; i < bang.procs_count; ++i) {
+            const Compiled_Proc *proc = &bang.procs[i];
+            Bm_Trace_Symbol *symbol = &symbols[symbols_size++];
+            snprintf(symbol->name, sizeof(symbol->name), SV_Fmt, SV_Arg(proc->name));
+            symbol->addr = proc->addr;
         }
 
-        if (err != ERR_OK) {
-            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+        Bm_Error error = {0};
+        if (!bm_trace_open(&trace, trace_file_path, trace_capacity,
+                           &bm, symbols, symbols_size, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
             exit(1);
         }
     }
+
+    Err err = trace_file_path != NULL
+              ? bm_trace_execute_program(&trace, &bm, -1)
+              : bm_execute_program(&bm, -1);
+    bm_trace_close(&trace);
+
+    if (err != ERR_OK) {
+        fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+        exit(1);
+    }
 }
 
 static void build_subcommand(int argc, char **argv)
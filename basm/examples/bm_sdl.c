@@ -1,244 +1,328 @@
 #include <SDL2/SDL.h>
 #include "./bm.h"
 
-EXPORT Err bm_SDL_Init(Bm *bm);
-EXPORT Err bm_SDL_Quit(Bm *bm);
-EXPORT Err bm_SDL_CreateWindow(Bm *bm);
-EXPORT Err bm_SDL_CreateRenderer(Bm *bm);
-EXPORT Err bm_SDL_PollEvent(Bm *bm);
-EXPORT Err bm_SDL_SetRenderDrawColor(Bm *bm);
-EXPORT Err bm_SDL_RenderClear(Bm *bm);
-EXPORT Err bm_SDL_RenderPresent(Bm *bm);
-EXPORT Err bm_SDL_RenderFillRect(Bm *bm);
-EXPORT Err bm_SDL_Delay(Bm *bm);
-EXPORT Err bm_SDL_GetWindowSize(Bm *bm);
-EXPORT Err bm_SDL_CreateRGBSurfaceFrom(Bm *bm);
-EXPORT Err bm_SDL_CreateTextureFromSurface(Bm *bm);
-EXPORT Err bm_SDL_RenderCopy(Bm *bm);
-
-Err bm_SDL_Init(Bm *bm)
+// NOTE: All of the natives here are typed. The Virtual Machine checks the
+// stack and validates the memory ranges according to the signatures before
+// calling them, so the functions only have to call SDL.
+
+#define ARG(arg_type) {.type = (arg_type)}
+#define MEM_ARG(arg_size) {.type = TYPE_MEM_ADDR, .size = (arg_size)}
+#define READ_ONLY_MEM_ARG(arg_size) {.type = TYPE_MEM_ADDR, .size = (arg_size), .read_only = true}
+
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_Init;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_Quit;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_CreateWindow;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_CreateRenderer;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_PollEvent;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_SetRenderDrawColor;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_RenderClear;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_RenderPresent;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_RenderFillRect;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_Delay;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_GetWindowSize;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_CreateRGBSurfaceFrom;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_CreateTextureFromSurface;
+EXPORT extern const Bm_Native_Def bm_native_def_SDL_RenderCopy;
+
+static Err native_SDL_Init(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    uint64_t flags = bm->stack[bm->stack_size - 1].as_u64;
-    bm->stack[bm->stack_size - 1].as_u64 = (uint64_t) SDL_Init((Uint32) flags);
-
+    (void) bm;
+    results[0].as_u64 = (uint64_t) SDL_Init((Uint32) args[0].as_u64);
     return ERR_OK;
 }
 
-Err bm_SDL_Quit(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_Init = {
+    .signature = {
+        .args = {ARG(TYPE_UNSIGNED_INT)},
+        .args_size = 1,
+        .results = {TYPE_SIGNED_INT},
+        .results_size = 1,
+    },
+    .function = native_SDL_Init,
+};
+
+static Err native_SDL_Quit(Bm *bm, const Word *args, Word *results)
 {
     (void) bm;
+    (void) args;
+    (void) results;
     SDL_Quit();
     return ERR_OK;
 }
 
-Err bm_SDL_CreateWindow(Bm *bm)
-{
-    if (bm->stack_size < 6) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    uint64_t title_offset = bm->stack[bm->stack_size - 6].as_u64;
-    int x = (int) bm->stack[bm->stack_size - 5].as_i64;
-    int y = (int) bm->stack[bm->stack_size - 4].as_i64;
-    int w = (int) bm->stack[bm->stack_size - 3].as_i64;
-    int h = (int) bm->stack[bm->stack_size - 2].as_i64;
-    Uint32 flags = (Uint32) bm->stack[bm->stack_size - 1].as_u64;
-
-    // TODO(#292): bm_SDL_CreateWindow does not check if it's accessing valid memory of a title (vulnerability)
-    void *window = SDL_CreateWindow((void*) (bm->memory + title_offset), x, y, w, h, flags);
-
-    if (bm->stack_size >= BM_STACK_CAPACITY) {
-        return ERR_STACK_OVERFLOW;
-    }
-
-    bm->stack[bm->stack_size++].as_ptr = window;
+const Bm_Native_Def bm_native_def_SDL_Quit = {
+    .function = native_SDL_Quit,
+};
 
+static Err native_SDL_CreateWindow(Bm *bm, const Word *args, Word *results)
+{
+    (void) bm;
+    results[0].as_ptr = SDL_CreateWindow(
+                            args[0].as_ptr,
+                            (int) args[1].as_i64,
+                            (int) args[2].as_i64,
+                            (int) args[3].as_i64,
+                            (int) args[4].as_i64,
+                            (Uint32) args[5].as_u64);
     return ERR_OK;
 }
 
-Err bm_SDL_CreateRenderer(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_CreateWindow = {
+    .signature = {
+        .args = {
+            READ_ONLY_MEM_ARG(BM_NATIVE_SIZE_CSTR), // title
+            ARG(TYPE_SIGNED_INT),                   // x
+            ARG(TYPE_SIGNED_INT),                   // y
+            ARG(TYPE_SIGNED_INT),                   // w
+            ARG(TYPE_SIGNED_INT),                   // h
+            ARG(TYPE_UNSIGNED_INT),                 // flags
+        },
+        .args_size = 6,
+        .results = {TYPE_ANY},
+        .results_size = 1,
+    },
+    .function = native_SDL_CreateWindow,
+};
+
+static Err native_SDL_CreateRenderer(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
+    (void) bm;
     // TODO(#272): renderer parameters are hardcoded in bm_SDL_CreateRenderer()
-    bm->stack[bm->stack_size - 1].as_ptr = SDL_CreateRenderer(
-            bm->stack[bm->stack_size - 1].as_ptr,
-            -1,
-            SDL_RENDERER_ACCELERATED);
+    results[0].as_ptr = SDL_CreateRenderer(args[0].as_ptr, -1, SDL_RENDERER_ACCELERATED);
     return ERR_OK;
 }
 
-Err bm_SDL_PollEvent(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_CreateRenderer = {
+    .signature = {
+        .args = {ARG(TYPE_ANY)},
+        .args_size = 1,
+        .results = {TYPE_ANY},
+        .results_size = 1,
+    },
+    .function = native_SDL_CreateRenderer,
+};
+
+static Err native_SDL_PollEvent(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    // TODO(#273): bm_SDL_PollEvent does not check if it's accessing valid memory (vulnerability)
-    bm->stack[bm->stack_size - 1].as_u64 = (uint64_t) SDL_PollEvent((void*) (bm->memory + bm->stack[bm->stack_size - 1].as_u64));
-
+    (void) bm;
+    results[0].as_u64 = (uint64_t) SDL_PollEvent(args[0].as_ptr);
     return ERR_OK;
 }
 
-Err bm_SDL_SetRenderDrawColor(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_PollEvent = {
+    .signature = {
+        .args = {MEM_ARG(sizeof(SDL_Event))},
+        .args_size = 1,
+        .results = {TYPE_BOOL},
+        .results_size = 1,
+    },
+    .function = native_SDL_PollEvent,
+};
+
+static Err native_SDL_SetRenderDrawColor(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 5) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    void *renderer = bm->stack[bm->stack_size - 5].as_ptr;
-    uint8_t r = (uint8_t) bm->stack[bm->stack_size - 4].as_u64;
-    uint8_t g = (uint8_t) bm->stack[bm->stack_size - 3].as_u64;
-    uint8_t b = (uint8_t) bm->stack[bm->stack_size - 2].as_u64;
-    uint8_t a = (uint8_t) bm->stack[bm->stack_size - 1].as_u64;
-    bm->stack_size -= 5;
-    bm->stack[bm->stack_size++].as_u64 = (uint64_t) SDL_SetRenderDrawColor(renderer, r, g, b, a);
+    (void) bm;
+    results[0].as_i64 = SDL_SetRenderDrawColor(
+                            args[0].as_ptr,
+                            (Uint8) args[1].as_u64,
+                            (Uint8) args[2].as_u64,
+                            (Uint8) args[3].as_u64,
+                            (Uint8) args[4].as_u64);
     return ERR_OK;
 }
 
-Err bm_SDL_RenderClear(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_SetRenderDrawColor = {
+    .signature = {
+        .args = {
+            ARG(TYPE_ANY),          // renderer
+            ARG(TYPE_UNSIGNED_INT), // r
+            ARG(TYPE_UNSIGNED_INT), // g
+            ARG(TYPE_UNSIGNED_INT), // b
+            ARG(TYPE_UNSIGNED_INT), // a
+        },
+        .args_size = 5,
+        .results = {TYPE_SIGNED_INT},
+        .results_size = 1,
+    },
+    .function = native_SDL_SetRenderDrawColor,
+};
+
+static Err native_SDL_RenderClear(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    bm->stack[bm->stack_size - 1].as_u64 = (uint64_t) SDL_RenderClear(bm->stack[bm->stack_size - 1].as_ptr);
+    (void) bm;
+    results[0].as_i64 = SDL_RenderClear(args[0].as_ptr);
     return ERR_OK;
 }
 
-Err bm_SDL_RenderPresent(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_RenderClear = {
+    .signature = {
+        .args = {ARG(TYPE_ANY)},
+        .args_size = 1,
+        .results = {TYPE_SIGNED_INT},
+        .results_size = 1,
+    },
+    .function = native_SDL_RenderClear,
+};
+
+static Err native_SDL_RenderPresent(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    SDL_RenderPresent(bm->stack[bm->stack_size - 1].as_ptr);
-    bm->stack_size -= 1;
+    (void) bm;
+    (void) results;
+    SDL_RenderPresent(args[0].as_ptr);
     return ERR_OK;
 }
 
-Err bm_SDL_RenderFillRect(Bm *bm)
-{
-    if (bm->stack_size < 2) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    void *renderer = bm->stack[bm->stack_size - 2].as_ptr;
-    uint64_t rect_offset = bm->stack[bm->stack_size - 1].as_u64;
-    bm->stack_size -= 2;
-
-    bm->stack[bm->stack_size++].as_i64 =
-        SDL_RenderFillRect(renderer, (void*) (bm->memory + rect_offset));
+const Bm_Native_Def bm_native_def_SDL_RenderPresent = {
+    .signature = {
+        .args = {ARG(TYPE_ANY)},
+        .args_size = 1,
+    },
+    .function = native_SDL_RenderPresent,
+};
 
+static Err native_SDL_RenderFillRect(Bm *bm, const Word *args, Word *results)
+{
+    (void) bm;
+    results[0].as_i64 = SDL_RenderFillRect(args[0].as_ptr, args[1].as_ptr);
     return ERR_OK;
 }
 
-Err bm_SDL_Delay(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_RenderFillRect = {
+    .signature = {
+        .args = {
+            ARG(TYPE_ANY),                       // renderer
+            READ_ONLY_MEM_ARG(sizeof(SDL_Rect)), // rect
+        },
+        .args_size = 2,
+        .results = {TYPE_SIGNED_INT},
+        .results_size = 1,
+    },
+    .function = native_SDL_RenderFillRect,
+};
+
+static Err native_SDL_Delay(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    SDL_Delay((Uint32) bm->stack[bm->stack_size - 1].as_u64);
-    bm->stack_size -= 1;
-
+    (void) bm;
+    (void) results;
+    SDL_Delay((Uint32) args[0].as_u64);
     return ERR_OK;
 }
 
-Err bm_SDL_GetWindowSize(Bm *bm)
-{
-    if (bm->stack_size < 1) {
-        return ERR_STACK_UNDERFLOW;
-    }
+const Bm_Native_Def bm_native_def_SDL_Delay = {
+    .signature = {
+        .args = {ARG(TYPE_UNSIGNED_INT)},
+        .args_size = 1,
+    },
+    .function = native_SDL_Delay,
+};
 
+static Err native_SDL_GetWindowSize(Bm *bm, const Word *args, Word *results)
+{
+    (void) bm;
     int w, h;
-    SDL_GetWindowSize(bm->stack[bm->stack_size - 1].as_ptr, &w, &h);
-    bm->stack_size -= 1;
-
-    if (bm->stack_size + 2 >= BM_STACK_CAPACITY) {
-        return ERR_STACK_OVERFLOW;
-    }
-
-    bm->stack[bm->stack_size++].as_i64 = w;
-    bm->stack[bm->stack_size++].as_i64 = h;
-
+    SDL_GetWindowSize(args[0].as_ptr, &w, &h);
+    results[0].as_i64 = w;
+    results[1].as_i64 = h;
     return ERR_OK;
 }
 
-Err bm_SDL_CreateRGBSurfaceFrom(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_GetWindowSize = {
+    .signature = {
+        .args = {ARG(TYPE_ANY)},
+        .args_size = 1,
+        .results = {TYPE_SIGNED_INT, TYPE_SIGNED_INT},
+        .results_size = 2,
+    },
+    .function = native_SDL_GetWindowSize,
+};
+
+static Err native_SDL_CreateRGBSurfaceFrom(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 9) {
-        return ERR_STACK_UNDERFLOW;
+    const int height = (int) args[2].as_i64;
+    const int pitch  = (int) args[4].as_i64;
+
+    // NOTE: the size of the pixels depends on the other arguments, so the
+    // signature can only validate the beginning of the range. The pixels are
+    // expected to be in the regular memory, not in a mapped file.
+    if (height < 0 || pitch < 0 ||
+            (uint8_t*) args[0].as_ptr < bm->memory ||
+            (uint8_t*) args[0].as_ptr >= bm->memory + BM_MEMORY_CAPACITY ||
+            (uint64_t) height * (uint64_t) pitch >
+            (uint64_t) (bm->memory + BM_MEMORY_CAPACITY - (uint8_t*) args[0].as_ptr)) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
     }
 
-    uint64_t pixels_offset = bm->stack[bm->stack_size - 9].as_u64;
-    int width  = (int) bm->stack[bm->stack_size - 8].as_i64;
-    int height = (int) bm->stack[bm->stack_size - 7].as_i64;
-    int depth  = (int) bm->stack[bm->stack_size - 6].as_i64;
-    int pitch  = (int) bm->stack[bm->stack_size - 5].as_i64;
-    Uint32 rmask = (Uint32) bm->stack[bm->stack_size - 4].as_i64;
-    Uint32 gmask = (Uint32) bm->stack[bm->stack_size - 3].as_i64;
-    Uint32 bmask = (Uint32) bm->stack[bm->stack_size - 2].as_i64;
-    Uint32 amask = (Uint32) bm->stack[bm->stack_size - 1].as_i64;
-
-    bm->stack_size -= 9;
-
-    // TODO(#299): bm_SDL_CreateRGBSurfaceFrom does not validate pixels memory from the virtual machine
-    SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(
-                               bm->memory + pixels_offset,
-                               width,
-                               height,
-                               depth,
-                               pitch,
-                               rmask,
-                               gmask,
-                               bmask,
-                               amask);
-
-    bm->stack[bm->stack_size++].as_ptr = surface;
-
+    results[0].as_ptr = SDL_CreateRGBSurfaceFrom(
+                            args[0].as_ptr,
+                            (int) args[1].as_i64,
+                            height,
+                            (int) args[3].as_i64,
+                            pitch,
+                            (Uint32) args[5].as_u64,
+                            (Uint32) args[6].as_u64,
+                            (Uint32) args[7].as_u64,
+                            (Uint32) args[8].as_u64);
     return ERR_OK;
 }
 
-Err bm_SDL_CreateTextureFromSurface(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_CreateRGBSurfaceFrom = {
+    .signature = {
+        .args = {
+            MEM_ARG(0),             // pixels
+            ARG(TYPE_SIGNED_INT),   // width
+            ARG(TYPE_SIGNED_INT),   // height
+            ARG(TYPE_SIGNED_INT),   // depth
+            ARG(TYPE_SIGNED_INT),   // pitch
+            ARG(TYPE_UNSIGNED_INT), // rmask
+            ARG(TYPE_UNSIGNED_INT), // gmask
+            ARG(TYPE_UNSIGNED_INT), // bmask
+            ARG(TYPE_UNSIGNED_INT), // amask
+        },
+        .args_size = 9,
+        .results = {TYPE_ANY},
+        .results_size = 1,
+    },
+    .function = native_SDL_CreateRGBSurfaceFrom,
+};
+
+static Err native_SDL_CreateTextureFromSurface(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 2) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    void *renderer = bm->stack[bm->stack_size - 2].as_ptr;
-    void *surface = bm->stack[bm->stack_size - 1].as_ptr;
-    bm->stack_size -= 2;
-
-    bm->stack[bm->stack_size++].as_ptr = SDL_CreateTextureFromSurface(renderer, surface);
-
+    (void) bm;
+    results[0].as_ptr = SDL_CreateTextureFromSurface(args[0].as_ptr, args[1].as_ptr);
     return ERR_OK;
 }
 
-Err bm_SDL_RenderCopy(Bm *bm)
+const Bm_Native_Def bm_native_def_SDL_CreateTextureFromSurface = {
+    .signature = {
+        .args = {
+            ARG(TYPE_ANY), // renderer
+            ARG(TYPE_ANY), // surface
+        },
+        .args_size = 2,
+        .results = {TYPE_ANY},
+        .results_size = 1,
+    },
+    .function = native_SDL_CreateTextureFromSurface,
+};
+
+static Err native_SDL_RenderCopy(Bm *bm, const Word *args, Word *results)
 {
-    if (bm->stack_size < 4) {
-        return ERR_STACK_UNDERFLOW;
-    }
-
-    void *renderer = bm->stack[bm->stack_size - 4].as_ptr;
-    void *texture = bm->stack[bm->stack_size - 3].as_ptr;
-    uint64_t srcrect_offset = bm->stack[bm->stack_size - 2].as_u64;
-    uint64_t dstrect_offset = bm->stack[bm->stack_size - 1].as_u64;
-    bm->stack_size -= 4;
-
-    // TODO(#300): bm_SDL_RenderCopy does not validate pixels memory from the virtual machine
-    bm->stack[bm->stack_size++].as_i64 =
-        SDL_RenderCopy(renderer,
-                       texture,
-                       (void*) (bm->memory + srcrect_offset),
-                       (void*) (bm->memory + dstrect_offset));
-
+    (void) bm;
+    results[0].as_i64 = SDL_RenderCopy(args[0].as_ptr, args[1].as_ptr, args[2].as_ptr, args[3].as_ptr);
     return ERR_OK;
 }
+
+const Bm_Native_Def bm_native_def_SDL_RenderCopy = {
+    .signature = {
+        .args = {
+            ARG(TYPE_ANY),                       // renderer
+            ARG(TYPE_ANY),                       // texture
+            READ_ONLY_MEM_ARG(sizeof(SDL_Rect)), // srcrect
+            READ_ONLY_MEM_ARG(sizeof(SDL_Rect)), // dstrect
+        },
+        .args_size = 4,
+        .results = {TYPE_SIGNED_INT},
+        .results_size = 1,
+    },
+    .function = native_SDL_RenderCopy,
+};
@@ -11,17 +11,24 @@
 
 #define COMMON_UNITS PATH("..", "common", "sv.c"), \
                      PATH("..", "common", "arena.c"), \
+                     PATH("..", "common", "hash.c"), \
                      PATH("..", "common", "path.c")
 
 #define BM_UNITS     PATH("..", "bm", "src", "types.c"), \
-                     PATH("..", "bm", "src", "bm.c")
+                     PATH("..", "bm", "src", "bm.c"), \
+                     PATH("..", "bm", "src", "channel.c")
 
-#define BASM_UNITS   PATH("src", "compiler.c"), \
+#define BASM_UNITS   PATH("src", "cache.c"), \
+                     PATH("src", "compiler.c"), \
                      PATH("src", "expr.c"), \
                      PATH("src", "fl.c"), \
                      PATH("src", "gas_arm64.c"), \
+                     PATH("src", "intern.c"), \
                      PATH("src", "linizer.c"), \
                      PATH("src", "nasm_sysv_x86_64.c"), \
+                     PATH("src", "object.c"), \
+                     PATH("src", "optimizer.c"), \
+                     PATH("src", "prefetch.c"), \
                      PATH("src", "statement.c"), \
                      PATH("src", "target.c"), \
                      PATH("src", "tokenizer.c"), \
@@ -29,13 +36,14 @@
 
 #define UNITS COMMON_UNITS, BM_UNITS, BASM_UNITS
 
-#define LIBS "-lm"
+#define LIBS "-lm", "-lpthread"
 
 void build_all_bins(void)
 {
     MKDIRS("bin");
     CC("bin", "basm", PATH("src", "basm.c"));
     CC("bin", "basm2dot", PATH("src", "basm2dot.c"));
+    CC("bin", "bmld", PATH("src", "bmld.c"));
     CC("bin", "expr2dot", PATH("src", "expr2dot.c"));
 }
 
@@ -60,15 +68,108 @@ void basm_test(bool record)
         {
             const char *expected_output_path = PATH("test", "outputs", CONCAT(NOEXT(example), ".expected.out"));
             const char *bm_path = PATH("bin", "test", "cases", CONCAT(NOEXT(example), ".bm"));
+            const char *input_path = PATH("test", "inputs", CONCAT(NOEXT(example), ".in"));
 
             CMD(PATH("bin", "basm"),
                 "-I", PATH("lib"),
                 "-o", bm_path,
                 PATH("test", "cases", example));
 
+            const bool has_input = PATH_EXISTS(input_path);
+            // NOTE: probing a missing input sets errno, which FOREACH_FILE_IN_DIR
+            // would mistake for a failure of readdir()
+            errno = 0;
+
+            if (has_input) {
+                CMD(bmr_path,
+                    "-p", bm_path,
+                    "-i", input_path,
+                    record ? "-ao" : "-eo", expected_output_path);
+            } else {
+                CMD(bmr_path,
+                    "-p", bm_path,
+                    record ? "-ao" : "-eo", expected_output_path);
+            }
+
+            // NOTE: the optimized program must behave exactly the same
+            if (!record) {
+                const char *optimized_bm_path = PATH("bin", "test", "cases", CONCAT(NOEXT(example), ".O.bm"));
+
+                CMD(PATH("bin", "basm"),
+                    "-O",
+                    "-I", PATH("lib"),
+                    "-o", optimized_bm_path,
+                    PATH("test", "cases", example));
+
+                if (has_input) {
+                    CMD(bmr_path,
+                        "-p", optimized_bm_path,
+                        "-i", input_path,
+                        "-eo", expected_output_path);
+                } else {
+                    CMD(bmr_path,
+                        "-p", optimized_bm_path,
+                        "-eo", expected_output_path);
+                }
+            }
+        }
+    });
+
+    // NOTE: every directory in test/link is a program of several files that
+    // are translated separately with `basm -c` and linked with `bmld`
+    FOREACH_FILE_IN_DIR(project, PATH("test", "link"), {
+        if (*project != '.')
+        {
+            const char *expected_output_path = PATH("test", "outputs", CONCAT(project, ".expected.out"));
+            const char *bm_path = PATH("bin", "test", "link", CONCAT(project, ".bm"));
+
+            MKDIRS("bin", "test", "link", project);
+
+            Cmd link = {
+                .line = cstr_array_make(PATH("bin", "bmld"), "-o", bm_path, NULL)
+            };
+            Cmd optimized_link = {
+                .line = cstr_array_make(PATH("bin", "bmld"), "-O", NULL)
+            };
+
+            FOREACH_FILE_IN_DIR(source, PATH("test", "link", project), {
+                if (ENDS_WITH(source, ".basm"))
+                {
+                    const char *object_path = PATH("bin", "test", "link", project, CONCAT(NOEXT(source), ".bmo"));
+
+                    // NOTE: the files of the project may include each other
+                    CMD(PATH("bin", "basm"),
+                        "-I", PATH("lib"),
+                        "-I", PATH("test", "link", project),
+                        "-c",
+                        "-o", object_path,
+                        PATH("test", "link", project, source));
+
+                    link.line = cstr_array_append(link.line, object_path);
+                    optimized_link.line = cstr_array_append(optimized_link.line, object_path);
+                }
+            });
+
+            INFO("CMD: %s", cmd_show(link));
+            cmd_run_sync(link);
+
             CMD(bmr_path,
                 "-p", bm_path,
                 record ? "-ao" : "-eo", expected_output_path);
+
+            // NOTE: the optimized program must behave exactly the same
+            if (!record) {
+                const char *optimized_bm_path = PATH("bin", "test", "link", CONCAT(project, ".O.bm"));
+
+                optimized_link.line = cstr_array_append(optimized_link.line, "-o");
+                optimized_link.line = cstr_array_append(optimized_link.line, optimized_bm_path);
+                INFO("CMD: %s", cmd_show(optimized_link));
+                cmd_run_sync(optimized_link);
+
+                CMD(bmr_path,
+                    "-p", optimized_bm_path,
+                    "-eo", expected_output_path);
+            }
         }
     });
 }
@@ -2,7 +2,10 @@
 #include "./bm.h"
 #include "./path.h"
 #include "./verifier.h"
+#include "./optimizer.h"
 #include "./target.h"
+#include "./prefetch.h"
+#include "./cache.h"
 
 static void usage(FILE *stream, const char *program)
 {
@@ -13,6 +16,14 @@ static void usage(FILE *stream, const char *program)
     fprintf(stream, "    -t <target>           Output target. Default is `bm`.\n");
     fprintf(stream, "                          Provide `list` to get the list of all available targets.\n");
     fprintf(stream, "    -verify               Verify the bytecode instructions after the translation.\n");
+    fprintf(stream, "    -O                    Optimize the bytecode instructions after the translation.\n");
+    fprintf(stream, "    -c                    Translate into a relocatable object (.bmo) that is linked by `bmld`.\n");
+    fprintf(stream, "                          The names that are not bound anywhere refer to the labels of the other objects.\n");
+    fprintf(stream, "    -j <jobs>             Parse the source files on that many threads. Default is the amount of CPUs.\n");
+    fprintf(stream, "    -cache <dir/>         Reuse the output of the previous translations of the same unchanged sources.\n");
+    fprintf(stream, "                          Default is the value of the BASM_CACHE environment variable.\n");
+    fprintf(stream, "    -cache-limit <bytes>  The size limit of the cache. Default is %d.\n", BASM_CACHE_DEFAULT_LIMIT);
+    fprintf(stream, "    -cache-stats          Print the statistics of the cache to stdout\n");
     fprintf(stream, "    -h                    Print this help to stdout\n");
 }
 
@@ -39,6 +50,11 @@ int main(int argc, char **argv)
     const char *output_file_path = NULL;
     Target output_target = TARGET_BM;
     bool verify = false;
+    bool optimize = false;
+    basm.jobs = basm_default_jobs();
+    const char *cache_dir_path = getenv("BASM_CACHE");
+    size_t cache_limit = BASM_CACHE_DEFAULT_LIMIT;
+    bool cache_stats = false;
 
     while (argc > 0) {
         const char *flag = shift(&argc, &argv);
@@ -68,6 +84,34 @@ int main(int argc, char **argv)
             }
         } else if (strcmp(flag, "-verify") == 0) {
             verify = true;
+        } else if (strcmp(flag, "-O") == 0) {
+            optimize = true;
+        } else if (strcmp(flag, "-c") == 0) {
+            basm.relocatable = true;
+        } else if (strcmp(flag, "-cache") == 0) {
+            cache_dir_path = get_flag_value(&argc, &argv, flag, program);
+        } else if (strcmp(flag, "-cache-limit") == 0) {
+            const char *limit = get_flag_value(&argc, &argv, flag, program);
+            char *endptr = NULL;
+            cache_limit = strtoull(limit, &endptr, 10);
+            if (*limit == '\0' || *endptr != '\0') {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: the size limit of the cache must be a number of bytes, but got `%s`\n",
+                        limit);
+                exit(1);
+            }
+        } else if (strcmp(flag, "-cache-stats") == 0) {
+            cache_stats = true;
+        } else if (strcmp(flag, "-j") == 0) {
+            const char *jobs = get_flag_value(&argc, &argv, flag, program);
+            char *endptr = NULL;
+            basm.jobs = strtoul(jobs, &endptr, 10);
+            if (*jobs == '\0' || *endptr != '\0' || basm.jobs < 1 || basm.jobs > BASM_MAX_JOBS) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: the amount of jobs must be a number from 1 to %d, but got `%s`\n",
+                        BASM_MAX_JOBS, jobs);
+                exit(1);
+            }
         } else {
             if (input_file_path != NULL) {
                 usage(stderr, program);
@@ -78,31 +122,81 @@ int main(int argc, char **argv)
         }
     }
 
+    if (cache_stats) {
+        if (cache_dir_path == NULL) {
+            usage(stderr, program);
+            fprintf(stderr, "ERROR: no cache is provided\n");
+            exit(1);
+        }
+        basm_cache_print_stats(cache_dir_path, cache_limit, stdout);
+        exit(0);
+    }
+
     if (input_file_path == NULL) {
         usage(stderr, program);
         fprintf(stderr, "ERROR: no input file is provided\n");
         exit(1);
     }
 
+    if (basm.relocatable && output_target != TARGET_BM) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: relocatable objects can only be produced for the `%s` target\n",
+                target_name(TARGET_BM));
+        exit(1);
+    }
+
+    if (basm.relocatable && verify) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: the relocatable objects can only be verified after they are linked\n");
+        exit(1);
+    }
+
     if (output_file_path == NULL) {
         const String_View output_file_path_sv =
             SV_CONCAT(&basm.arena,
                       SV("./"),
                       file_name_of_path(input_file_path),
-                      sv_from_cstr(target_file_ext(output_target)));
+                      sv_from_cstr(basm.relocatable ? ".bmo" : target_file_ext(output_target)));
         output_file_path = arena_sv_to_cstr(&basm.arena, output_file_path_sv);
     }
 
+    Basm_Cache cache = {0};
+    if (cache_dir_path != NULL && *cache_dir_path != '\0') {
+        char options[128];
+        snprintf(options, sizeof(options), "target=%s relocatable=%d verify=%d optimize=%d",
+                 target_name(output_target), basm.relocatable, verify, optimize);
+        basm_cache_init(&cache, &basm, cache_dir_path, cache_limit, input_file_path, options);
+
+        if (basm_cache_fetch(&cache, &basm, output_file_path)) {
+            arena_free(&basm.arena);
+            return 0;
+        }
+    }
+
     basm_translate_root_source_file(&basm, sv_from_cstr(input_file_path));
 
+    if (optimize) {
+        static Optimizer optimizer = {0};
+        optimizer_optimize(&optimizer, &basm);
+    }
+
     if (verify) {
         static Verifier verifier = {0};
         verifier_verify(&verifier, &basm);
     }
 
-    basm_save_to_file_as_target(&basm, output_file_path, output_target);
+    if (basm.relocatable) {
+        basm_save_to_file_as_object(&basm, output_file_path);
+    } else {
+        basm_save_to_file_as_target(&basm, output_file_path, output_target);
+    }
+
+    basm_cache_store(&cache, &basm, output_file_path);
 
     arena_free(&basm.arena);
+    for (size_t i = 0; i < BASM_MAX_JOBS; ++i) {
+        arena_free(&basm.job_arenas[i]);
+    }
 
     return 0;
 }
@@ -0,0 +1,467 @@
+#include <inttypes.h>
+
+#include "./compiler.h"
+#include "./dynarray.h"
+#include "./object.h"
+#include "./optimizer.h"
+#include "./intern.h"
+#include "./path.h"
+
+#define BMLD_OBJECTS_CAPACITY 1024
+
+typedef struct {
+    const char *object_file_path;
+    const char *file_path;
+    uint64_t line_number;
+    Inst_Addr addr;
+} Bmld_Symbol;
+
+// NOTE: the include groups that were kept in the linked program. The
+// different translations of the same file are chained by `next`.
+typedef struct Bmld_Group Bmld_Group;
+
+struct Bmld_Group {
+    size_t object;
+    Basm_Object_Group group;
+    Bmld_Group *next;
+};
+
+static bool bmld_falls_through(Inst_Type type)
+{
+    return type != INST_JMP && type != INST_RET && type != INST_HALT;
+}
+
+// NOTE: the memory an operand of the object may refer to: the chunks that
+// contain the address or end right at it. The address right after one chunk
+// is also the beginning of the next one, so both of them are taken then.
+static bool bmld_memory_around(const Basm_Object *object, Memory_Addr addr,
+                               Memory_Addr *begin, Memory_Addr *end)
+{
+    const Basm_Object_Chunk *chunks = object->chunks;
+
+    // NOTE: the first chunk that ends at or after the address
+    size_t lo = 0;
+    size_t hi = object->meta.chunks_size;
+    while (lo < hi) {
+        const size_t middle = lo + (hi - lo) / 2;
+        if (chunks[middle].addr + chunks[middle].length < addr) {
+            lo = middle + 1;
+        } else {
+            hi = middle;
+        }
+    }
+
+    if (lo >= object->meta.chunks_size || chunks[lo].addr > addr) {
+        return false;
+    }
+
+    *begin = chunks[lo].addr;
+    *end = chunks[lo].addr + chunks[lo].length;
+    for (size_t i = lo + 1; i < object->meta.chunks_size && chunks[i].addr <= addr; ++i) {
+        *end = chunks[i].addr + chunks[i].length;
+    }
+    return true;
+}
+
+// NOTE: the groups have the same code if it does the same thing wherever it
+// is placed: the jumps stay within the group and everything else refers to
+// the same natives and symbols, and to the memory with the same contents.
+// A library that refers to the names of the object it is included into may
+// be translated into the same instructions that read different strings.
+static bool bmld_same_code(const Basm_Object *a, const Basm_Object_Reloc *a_relocs, Basm_Object_Group a_group,
+                           const Basm_Object *b, const Basm_Object_Reloc *b_relocs, Basm_Object_Group b_group)
+{
+    if (a_group.hash != b_group.hash || a_group.end - a_group.begin != b_group.end - b_group.begin) {
+        return false;
+    }
+
+    for (Inst_Addr offset = 0; offset < a_group.end - a_group.begin; ++offset) {
+        const Inst a_inst = a->program[a_group.begin + offset];
+        const Inst b_inst = b->program[b_group.begin + offset];
+        const Basm_Object_Reloc a_reloc = a_relocs[a_group.begin + offset];
+        const Basm_Object_Reloc b_reloc = b_relocs[b_group.begin + offset];
+        const uint64_t a_operand = a_inst.operand.as_u64;
+        const uint64_t b_operand = b_inst.operand.as_u64;
+
+        if (a_inst.type != b_inst.type || a_reloc.kind != b_reloc.kind) {
+            return false;
+        }
+
+        switch ((Reloc_Kind) a_reloc.kind) {
+        case RELOC_NONE:
+            if (a_operand != b_operand) {
+                return false;
+            }
+            break;
+
+        case RELOC_INST_ADDR:
+            if (a_operand < a_group.begin || a_operand >= a_group.end ||
+                    b_operand < b_group.begin || b_operand >= b_group.end ||
+                    a_operand - a_group.begin != b_operand - b_group.begin) {
+                return false;
+            }
+            break;
+
+        case RELOC_MEM_ADDR: {
+            Memory_Addr a_begin = 0, a_end = 0, b_begin = 0, b_end = 0;
+            if (!bmld_memory_around(a, a_operand, &a_begin, &a_end) ||
+                    !bmld_memory_around(b, b_operand, &b_begin, &b_end) ||
+                    a_operand - a_begin != b_operand - b_begin ||
+                    a_end - a_begin != b_end - b_begin ||
+                    memcmp(a->memory + a_begin, b->memory + b_begin, a_end - a_begin) != 0) {
+                return false;
+            }
+        }
+        break;
+
+        case RELOC_NATIVE_ID:
+            if (strcmp(a->externals[a_operand].name, b->externals[b_operand].name) != 0) {
+                return false;
+            }
+            break;
+
+        case RELOC_SYMBOL:
+            if (strcmp(a->strings + a_reloc.symbol, b->strings + b_reloc.symbol) != 0) {
+                return false;
+            }
+            break;
+
+        case RELOC_INVALID:
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s [OPTIONS] <input.bmo...>\n", program);
+    fprintf(stream, "Links the relocatable objects produced by `basm -c` into a single program.\n");
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -o <output.bm>        Provide output path\n");
+    fprintf(stream, "    -O                    Optimize the linked program (see ./src/optimizer.h)\n");
+    fprintf(stream, "    -h                    Print this help to stdout\n");
+}
+
+int main(int argc, char **argv)
+{
+    // NOTE: the linked program is put together in a Basm, so it is saved
+    // exactly like `basm` saves its programs
+    static Basm basm = {0};
+    static Basm_Object objects[BMLD_OBJECTS_CAPACITY];
+    // NOTE: the addresses of the instructions of the objects in the linked
+    // program, including the address right after the last one. A dropped
+    // instruction is at the address of its copy.
+    static Inst_Addr *inst_addrs[BMLD_OBJECTS_CAPACITY];
+    static bool *dropped[BMLD_OBJECTS_CAPACITY];
+    // NOTE: the relocations of the objects by the addresses of their
+    // instructions, RELOC_NONE where there are none
+    static Basm_Object_Reloc *inst_relocs[BMLD_OBJECTS_CAPACITY];
+    static Memory_Addr memory_bases[BMLD_OBJECTS_CAPACITY];
+    static Native_ID *native_ids[BMLD_OBJECTS_CAPACITY];
+    size_t objects_size = 0;
+
+    const char *program = shift(&argc, &argv);
+    const char *input_file_paths[BMLD_OBJECTS_CAPACITY];
+    size_t input_file_paths_size = 0;
+    const char *output_file_path = NULL;
+    bool optimize = false;
+
+    while (argc > 0) {
+        const char *flag = shift(&argc, &argv);
+
+        if (strcmp(flag, "-o") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: no value provided for flag `%s`\n", flag);
+                exit(1);
+            }
+            output_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-O") == 0) {
+            optimize = true;
+        } else if (strcmp(flag, "-h") == 0) {
+            usage(stdout, program);
+            exit(0);
+        } else {
+            if (input_file_paths_size >= BMLD_OBJECTS_CAPACITY) {
+                fprintf(stderr, "ERROR: too many objects. The limit is %d.\n",
+                        BMLD_OBJECTS_CAPACITY);
+                exit(1);
+            }
+            input_file_paths[input_file_paths_size++] = flag;
+        }
+    }
+
+    if (input_file_paths_size == 0) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: no input files are provided\n");
+        exit(1);
+    }
+
+    if (output_file_path == NULL) {
+        const String_View output_file_path_sv =
+            SV_CONCAT(&basm.arena,
+                      SV("./"),
+                      file_name_of_path(input_file_paths[0]),
+                      SV(".bm"));
+        output_file_path = arena_sv_to_cstr(&basm.arena, output_file_path_sv);
+    }
+
+    // NOTE: Bmld_Symbol* by the interned name
+    Intern_Map symbols = {0};
+    // NOTE: Native_ID* of the final program by the interned name
+    Intern_Map natives = {0};
+    // NOTE: Bmld_Group* by the interned path of the included file
+    Intern_Map groups = {0};
+    const char *entry_object_file_path = NULL;
+
+    // NOTE: lay out the objects one after another and collect their symbols
+    for (size_t i = 0; i < input_file_paths_size; ++i) {
+        Basm_Object *object = &objects[objects_size++];
+        basm_object_load(object, &basm.arena, input_file_paths[i]);
+        const Basm_Object_Meta meta = object->meta;
+
+        inst_relocs[i] = arena_alloc(&basm.arena, (meta.program_size + 1) * sizeof(*inst_relocs[i]));
+        bool layout_dependent = meta.layout_dependent;
+        for (uint64_t j = 0; j < meta.relocs_size; ++j) {
+            const Basm_Object_Reloc reloc = object->relocs[j];
+            inst_relocs[i][reloc.addr] = reloc;
+            if (reloc.kind == RELOC_INST_ADDR &&
+                    object->program[reloc.addr].operand.as_u64 > meta.program_size) {
+                layout_dependent = true;
+            }
+        }
+
+        if (layout_dependent && !basm.layout_dependent) {
+            basm.layout_dependent = true;
+            basm.layout_dependent_location = (File_Location) {
+                .file_path = sv_from_cstr(object->file_path),
+            };
+        }
+        if (meta.memory_layout_dependent) {
+            basm.memory_layout_dependent = true;
+        }
+
+        inst_addrs[i] = arena_alloc(&basm.arena, (meta.program_size + 1) * sizeof(*inst_addrs[i]));
+        dropped[i] = arena_alloc(&basm.arena, (meta.program_size + 1) * sizeof(*dropped[i]));
+
+        // NOTE: every object that includes a library has its own copy of its
+        // code. Only the first copy is kept, the later ones are dropped and
+        // whatever refers to them refers to the first one instead. The code
+        // of an object that depends on its layout is never dropped.
+        Inst_Addr dropped_end = 0;
+        for (uint64_t j = 0; j < meta.groups_size && !layout_dependent; ++j) {
+            const Basm_Object_Group group = object->groups[j];
+            // NOTE: the groups of the files included by a dropped file are
+            // dropped along with it
+            if (group.begin < dropped_end || group.begin == group.end) {
+                continue;
+            }
+
+            const String_View path = intern_sv(sv_from_cstr(object->strings + group.file_path));
+            Bmld_Group *kept = intern_map_get(&groups, path);
+            while (kept != NULL &&
+                    !bmld_same_code(&objects[kept->object], inst_relocs[kept->object], kept->group,
+                                    object, inst_relocs[i], group)) {
+                kept = kept->next;
+            }
+
+            // NOTE: the code around the group must not fall through into it or
+            // out of it, since the copy is somewhere else
+            const bool droppable =
+                (group.begin == 0 || !bmld_falls_through(object->program[group.begin - 1].type)) &&
+                !bmld_falls_through(object->program[group.end - 1].type);
+
+            if (kept != NULL && droppable) {
+                for (Inst_Addr addr = group.begin; addr < group.end; ++addr) {
+                    inst_addrs[i][addr] = inst_addrs[kept->object][kept->group.begin + (addr - group.begin)];
+                    dropped[i][addr] = true;
+                }
+                dropped_end = group.end;
+            } else if (kept == NULL) {
+                Bmld_Group *result = arena_alloc(&basm.arena, sizeof(*result));
+                *result = (Bmld_Group) {
+                    .object = i,
+                    .group = group,
+                };
+
+                Bmld_Group *first = intern_map_get(&groups, path);
+                if (first == NULL) {
+                    intern_map_put(&groups, &basm.arena, path, result);
+                } else {
+                    result->next = first->next;
+                    first->next = result;
+                }
+            }
+        }
+
+        for (uint64_t j = 0; j < meta.program_size; ++j) {
+            if (!dropped[i][j]) {
+                inst_addrs[i][j] = basm_push_inst(&basm, object->program[j].type, object->program[j].operand);
+            }
+        }
+        inst_addrs[i][meta.program_size] = basm.program_size;
+
+        if (basm.memory_size + meta.memory_size > BM_MEMORY_CAPACITY) {
+            fprintf(stderr, "ERROR: %s: the memory of the linked program does not fit into %d bytes\n",
+                    object->file_path, BM_MEMORY_CAPACITY);
+            exit(1);
+        }
+        memory_bases[i] = basm_push_buffer_to_memory(&basm, object->memory, meta.memory_size).as_u64;
+
+        native_ids[i] = arena_alloc(&basm.arena, (meta.externals_size + 1) * sizeof(Native_ID));
+        for (uint64_t j = 0; j < meta.externals_size; ++j) {
+            const String_View name = intern_sv(sv_from_cstr(object->externals[j].name));
+            Native_ID *id = intern_map_get(&natives, name);
+            if (id == NULL) {
+                id = arena_alloc(&basm.arena, sizeof(*id));
+                *id = basm_push_external_native(&basm, name);
+                intern_map_put(&natives, &basm.arena, name, id);
+            }
+            native_ids[i][j] = *id;
+        }
+
+        for (uint64_t j = 0; j < meta.exports_size; ++j) {
+            const Bm_Export export = object->exports[j];
+            for (size_t k = 0; k < basm.exports.size; ++k) {
+                if (strcmp(basm.exports.items[k].name, export.name) == 0) {
+                    fprintf(stderr, "ERROR: %s: `%s` has been already exported by another object\n",
+                            object->file_path, export.name);
+                    exit(1);
+                }
+            }
+
+            if (basm.exports.size >= BM_EXPORTS_CAPACITY) {
+                fprintf(stderr, "ERROR: %s: too many exports. The limit is %d.\n",
+                        object->file_path, BM_EXPORTS_CAPACITY);
+                exit(1);
+            }
+            DYNARRAY_PUSH(&basm.arena, basm.exports, export);
+            basm.exports.items[basm.exports.size - 1].addr = inst_addrs[i][export.addr];
+        }
+
+        if (meta.has_entry) {
+            if (basm.has_entry) {
+                fprintf(stderr, "ERROR: %s: entry point has been already set!\n",
+                        object->file_path);
+                fprintf(stderr, "%s: NOTE: the first entry point\n",
+                        entry_object_file_path);
+                exit(1);
+            }
+            basm.entry = inst_addrs[i][meta.entry];
+            basm.has_entry = true;
+            entry_object_file_path = object->file_path;
+        }
+
+        for (uint64_t j = 0; j < meta.symbols_size; ++j) {
+            const Basm_Object_Symbol symbol = object->symbols[j];
+            const String_View name = intern_sv(sv_from_cstr(object->strings + symbol.name));
+            const char *file_path = object->strings + symbol.file_path;
+
+            Bmld_Symbol *existing = intern_map_get(&symbols, name);
+            if (existing != NULL) {
+                // NOTE: the same file included into several objects defines the
+                // same labels in each of them. All the copies are equivalent,
+                // so the first one is used.
+                if (strcmp(existing->file_path, file_path) == 0 &&
+                        existing->line_number == symbol.line_number) {
+                    continue;
+                }
+
+                fprintf(stderr, "%s:%"PRIu64": ERROR: symbol `"SV_Fmt"` is defined in `%s` and in `%s`\n",
+                        file_path, symbol.line_number,
+                        SV_Arg(name),
+                        existing->object_file_path,
+                        object->file_path);
+                fprintf(stderr, "%s:%"PRIu64": NOTE: the first definition\n",
+                        existing->file_path, existing->line_number);
+                exit(1);
+            }
+
+            Bmld_Symbol *result = arena_alloc(&basm.arena, sizeof(*result));
+            *result = (Bmld_Symbol) {
+                .object_file_path = object->file_path,
+                .file_path = file_path,
+                .line_number = symbol.line_number,
+                .addr = inst_addrs[i][symbol.addr],
+            };
+            intern_map_put(&symbols, &basm.arena, name, result);
+        }
+    }
+
+    if (!basm.has_entry) {
+        fprintf(stderr, "ERROR: none of the objects provides the entry point. Use translation directive %%entry to provide it.\n");
+        exit(1);
+    }
+
+    // NOTE: now that all the objects are placed, adjust their operands
+    for (size_t i = 0; i < objects_size; ++i) {
+        const Basm_Object *object = &objects[i];
+
+        for (uint64_t j = 0; j < object->meta.relocs_size; ++j) {
+            const Basm_Object_Reloc reloc = object->relocs[j];
+            if (dropped[i][reloc.addr]) {
+                continue;
+            }
+
+            const Inst_Addr addr = inst_addrs[i][reloc.addr];
+            Word *operand = &basm.program[addr].operand;
+
+            switch ((Reloc_Kind) reloc.kind) {
+            case RELOC_INST_ADDR: {
+                const uint64_t program_size = object->meta.program_size;
+                // NOTE: past the end only when the object depends on its
+                // layout, so none of its instructions are dropped
+                operand->as_u64 = operand->as_u64 <= program_size
+                                  ? inst_addrs[i][operand->as_u64]
+                                  : inst_addrs[i][program_size] + (operand->as_u64 - program_size);
+                basm.program_relocs[addr] = RELOC_INST_ADDR;
+            }
+            break;
+
+            case RELOC_MEM_ADDR:
+                operand->as_u64 += memory_bases[i];
+                basm.program_relocs[addr] = RELOC_MEM_ADDR;
+                break;
+
+            case RELOC_NATIVE_ID:
+                operand->as_u64 = native_ids[i][operand->as_u64];
+                break;
+
+            case RELOC_SYMBOL: {
+                const String_View name = intern_sv(sv_from_cstr(object->strings + reloc.symbol));
+                const Bmld_Symbol *symbol = intern_map_get(&symbols, name);
+                if (symbol == NULL) {
+                    fprintf(stderr, "ERROR: %s: undefined symbol `"SV_Fmt"`\n",
+                            object->file_path, SV_Arg(name));
+                    exit(1);
+                }
+                operand->as_u64 = symbol->addr;
+                basm.program_relocs[addr] = RELOC_INST_ADDR;
+            }
+            break;
+
+            case RELOC_NONE:
+            case RELOC_INVALID:
+            default:
+                assert(false && "bmld: unreachable");
+                exit(1);
+            }
+        }
+    }
+
+    if (optimize) {
+        static Optimizer optimizer = {0};
+        optimizer_optimize(&optimizer, &basm);
+    }
+
+    // NOTE: the limits are checked only now, since the dropped copies and
+    // the optimizer shrink the program
+    basm_save_to_file_as_bm(&basm, output_file_path);
+
+    arena_free(&basm.arena);
+
+    return 0;
+}
@@ -0,0 +1,454 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include "./cache.h"
+#include "./hash.h"
+#include "./dynarray.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+static uint64_t cache_hash_sv(uint64_t hash, String_View sv)
+{
+    // NOTE: the size goes first, so the neighbouring strings cannot be
+    // shifted into each other
+    const uint64_t size = sv.count;
+    hash = hash_bytes_continue(hash, &size, sizeof(size));
+    return hash_bytes_continue(hash, sv.data, sv.count);
+}
+
+void basm_cache_init(Basm_Cache *cache, Basm *basm,
+                     const char *dir_path, size_t limit,
+                     const char *input_file_path, const char *options)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->limit = limit;
+
+    if (mkdir(dir_path, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "WARNING: could not create the cache directory `%s`: %s\n",
+                dir_path, strerror(errno));
+        return;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "WARNING: could not get the current directory for the cache: %s\n",
+                strerror(errno));
+        return;
+    }
+
+    // NOTE: a different build of basm may translate the same sources differently
+    uint64_t key = cache_hash_sv(HASH_FNV1A_OFFSET, SV("basm "__DATE__" "__TIME__));
+    key = cache_hash_sv(key, sv_from_cstr(cwd));
+    key = cache_hash_sv(key, sv_from_cstr(input_file_path));
+    for (size_t i = 0; i < basm->include_paths.size; ++i) {
+        key = cache_hash_sv(key, basm->include_paths.items[i]);
+    }
+    key = cache_hash_sv(key, sv_from_cstr(options));
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016"PRIx64".bmc", key);
+
+    cache->dir_path = dir_path;
+    cache->key = key;
+    cache->entry_path = CSTR_CONCAT(&basm->arena, dir_path, "/", name);
+}
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+} Cache_Stats;
+
+static void cache_stats_read(int fd, Cache_Stats *stats)
+{
+    char buffer[128];
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    if (n < 0) {
+        n = 0;
+    }
+    buffer[n] = '\0';
+
+    if (sscanf(buffer, "hits %"SCNu64" misses %"SCNu64, &stats->hits, &stats->misses) != 2) {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+static void cache_count(const Basm_Cache *cache, Arena *arena, bool hit)
+{
+    const char *stats_path = CSTR_CONCAT(arena, cache->dir_path, "/stats");
+
+    // NOTE: the statistics are not worth failing the translation over
+    int fd = open(stats_path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return;
+    }
+
+    // NOTE: several instances of basm may share the same cache
+    if (flock(fd, LOCK_EX) == 0) {
+        Cache_Stats stats = {0};
+        cache_stats_read(fd, &stats);
+        if (hit) {
+            stats.hits += 1;
+        } else {
+            stats.misses += 1;
+        }
+
+        char buffer[128];
+        const int n = snprintf(buffer, sizeof(buffer), "hits %"PRIu64"\nmisses %"PRIu64"\n",
+                               stats.hits, stats.misses);
+        if (lseek(fd, 0, SEEK_SET) == 0 && ftruncate(fd, 0) == 0) {
+            if (write(fd, buffer, (size_t) n) != n) {
+                fprintf(stderr, "WARNING: could not update `%s`: %s\n",
+                        stats_path, strerror(errno));
+            }
+        }
+    }
+
+    close(fd);
+}
+
+typedef struct {
+    const char *path;
+    uint64_t size;
+    time_t mtime;
+} Cache_Entry;
+
+typedef struct {
+    Cache_Entry *items;
+    size_t size;
+    size_t capacity;
+    uint64_t total_size;
+} Cache_Entries;
+
+static void cache_list_entries(const char *dir_path, Arena *arena, Cache_Entries *entries)
+{
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+
+    struct dirent *dp = NULL;
+    while ((dp = readdir(dir)) != NULL) {
+        if (!sv_ends_with(sv_from_cstr(dp->d_name), SV(".bmc"))) {
+            continue;
+        }
+
+        const char *path = CSTR_CONCAT(arena, dir_path, "/", dp->d_name);
+        struct stat statbuf = {0};
+        if (stat(path, &statbuf) < 0) {
+            continue;
+        }
+
+        Cache_Entry entry = {
+            .path = path,
+            .size = (uint64_t) statbuf.st_size,
+            .mtime = statbuf.st_mtime,
+        };
+        DYNARRAY_PUSH(arena, (*entries), entry);
+        entries->total_size += entry.size;
+    }
+
+    closedir(dir);
+}
+
+static int cache_entry_compare_by_mtime(const void *a, const void *b)
+{
+    const Cache_Entry *entry_a = a;
+    const Cache_Entry *entry_b = b;
+    return (entry_a->mtime > entry_b->mtime) - (entry_a->mtime < entry_b->mtime);
+}
+
+static void cache_evict(const Basm_Cache *cache, Arena *arena)
+{
+    Cache_Entries entries = {0};
+    cache_list_entries(cache->dir_path, arena, &entries);
+    if (entries.total_size <= cache->limit) {
+        return;
+    }
+
+    qsort(entries.items, entries.size, sizeof(*entries.items), cache_entry_compare_by_mtime);
+
+    for (size_t i = 0; i < entries.size && entries.total_size > cache->limit; ++i) {
+        if (unlink(entries.items[i].path) == 0) {
+            entries.total_size -= entries.items[i].size;
+        }
+    }
+}
+
+static bool cache_read(String_View *cursor, void *data, size_t size)
+{
+    if (cursor->count < size) {
+        return false;
+    }
+
+    memcpy(data, cursor->data, size);
+    sv_chop_left(cursor, size);
+    return true;
+}
+
+static bool cache_read_sv(String_View *cursor, String_View *sv)
+{
+    uint64_t count = 0;
+    if (!cache_read(cursor, &count, sizeof(count)) || cursor->count < count) {
+        return false;
+    }
+
+    *sv = sv_chop_left(cursor, count);
+    return true;
+}
+
+static bool cache_entry_is_valid(const Basm_Cache *cache, Basm *basm, String_View *output)
+{
+    String_View cursor = {0};
+    if (arena_slurp_file(&basm->arena, sv_from_cstr(cache->entry_path), &cursor) != 0) {
+        return false;
+    }
+
+    Basm_Cache_Meta meta = {0};
+    if (!cache_read(&cursor, &meta, sizeof(meta)) ||
+            meta.magic != BASM_CACHE_MAGIC ||
+            meta.version != BASM_CACHE_VERSION ||
+            meta.key != cache->key) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < meta.includes_size; ++i) {
+        String_View requested_path = {0};
+        String_View resolved_path = {0};
+        if (!cache_read_sv(&cursor, &requested_path) ||
+                !cache_read_sv(&cursor, &resolved_path)) {
+            return false;
+        }
+
+        // NOTE: resolved the same way basm_translate_include_statement() does
+        String_View path = requested_path;
+        basm_resolve_include_file_path(basm, &basm->arena, requested_path, &path);
+        if (!sv_eq(path, resolved_path)) {
+            return false;
+        }
+    }
+
+    for (uint64_t i = 0; i < meta.files_size; ++i) {
+        uint64_t hash = 0;
+        String_View path = {0};
+        if (!cache_read(&cursor, &hash, sizeof(hash)) ||
+                !cache_read_sv(&cursor, &path)) {
+            return false;
+        }
+
+        String_View content = {0};
+        if (arena_slurp_file(&basm->arena, path, &content) != 0 ||
+                hash_sv(content) != hash) {
+            return false;
+        }
+    }
+
+    if (cursor.count != meta.output_size) {
+        return false;
+    }
+
+    *output = cursor;
+    return true;
+}
+
+bool basm_cache_fetch(Basm_Cache *cache, Basm *basm, const char *output_file_path)
+{
+    if (cache->dir_path == NULL) {
+        return false;
+    }
+
+    String_View output = {0};
+    const bool hit = cache_entry_is_valid(cache, basm, &output);
+    cache_count(cache, &basm->arena, hit);
+    if (!hit) {
+        return false;
+    }
+
+    FILE *f = fopen(output_file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Could not open file `%s`: %s\n",
+                output_file_path, strerror(errno));
+        exit(1);
+    }
+
+    fwrite(output.data, 1, output.count, f);
+    if (ferror(f)) {
+        fprintf(stderr, "ERROR: Could not write to file `%s`: %s\n",
+                output_file_path, strerror(errno));
+        exit(1);
+    }
+
+    fclose(f);
+
+    // NOTE: the modification time of an entry is the time it was last used
+    utime(cache->entry_path, NULL);
+
+    return true;
+}
+
+static bool cache_write(FILE *f, const void *data, size_t size)
+{
+    fwrite(data, 1, size, f);
+    return !ferror(f);
+}
+
+static bool cache_write_sv(FILE *f, String_View sv)
+{
+    const uint64_t count = sv.count;
+    return cache_write(f, &count, sizeof(count)) && cache_write(f, sv.data, sv.count);
+}
+
+void basm_cache_store(Basm_Cache *cache, Basm *basm, const char *output_file_path)
+{
+    if (cache->dir_path == NULL) {
+        return;
+    }
+
+    String_View output = {0};
+    if (arena_slurp_file(&basm->arena, sv_from_cstr(output_file_path), &output) != 0) {
+        fprintf(stderr, "WARNING: could not read `%s` to cache it: %s\n",
+                output_file_path, strerror(errno));
+        return;
+    }
+
+    if (output.count > cache->limit) {
+        return;
+    }
+
+    Basm_Cache_Meta meta = {
+        .magic = BASM_CACHE_MAGIC,
+        .version = BASM_CACHE_VERSION,
+        .key = cache->key,
+        .includes_size = basm->include_resolutions.size,
+        .output_size = output.count,
+    };
+
+    for (size_t i = 0; i < basm->source_files.size; ++i) {
+        const Source_File *file = basm->source_files.values[i];
+        if (file->parsed) {
+            meta.files_size += 1;
+        }
+    }
+    meta.files_size += basm->embedded_files.size;
+
+    // NOTE: the entry appears under its name only once it is complete
+    char pid[32];
+    snprintf(pid, sizeof(pid), "%ld", (long) getpid());
+    const char *tmp_path = CSTR_CONCAT(&basm->arena, cache->entry_path, ".", pid, ".tmp");
+
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "WARNING: could not create the cache entry `%s`: %s\n",
+                tmp_path, strerror(errno));
+        return;
+    }
+
+    bool ok = cache_write(f, &meta, sizeof(meta));
+
+    for (size_t i = 0; ok && i < basm->include_resolutions.size; ++i) {
+        const Include_Resolution *resolution = basm->include_resolutions.values[i];
+        ok = cache_write_sv(f, resolution->requested_path) &&
+             cache_write_sv(f, resolution->resolved_path);
+    }
+
+    for (size_t i = 0; ok && i < basm->source_files.size; ++i) {
+        const Source_File *file = basm->source_files.values[i];
+        if (file->parsed) {
+            ok = cache_write(f, &file->hash, sizeof(file->hash)) &&
+                 cache_write_sv(f, file->path);
+        }
+    }
+
+    for (size_t i = 0; ok && i < basm->embedded_files.size; ++i) {
+        const Embedded_File *file = basm->embedded_files.values[i];
+        ok = cache_write(f, &file->hash, sizeof(file->hash)) &&
+             cache_write_sv(f, file->path);
+    }
+
+    ok = ok && cache_write(f, output.data, output.count);
+
+    if (fclose(f) != 0 || !ok || rename(tmp_path, cache->entry_path) < 0) {
+        fprintf(stderr, "WARNING: could not save the cache entry `%s`: %s\n",
+                cache->entry_path, strerror(errno));
+        unlink(tmp_path);
+        return;
+    }
+
+    cache_evict(cache, &basm->arena);
+}
+
+void basm_cache_print_stats(const char *dir_path, size_t limit, FILE *stream)
+{
+    Arena arena = {0};
+
+    Cache_Entries entries = {0};
+    cache_list_entries(dir_path, &arena, &entries);
+
+    Cache_Stats stats = {0};
+    int fd = open(CSTR_CONCAT(&arena, dir_path, "/stats"), O_RDONLY);
+    if (fd >= 0) {
+        if (flock(fd, LOCK_SH) == 0) {
+            cache_stats_read(fd, &stats);
+        }
+        close(fd);
+    }
+
+    const uint64_t lookups = stats.hits + stats.misses;
+
+    fprintf(stream, "Cache:    %s\n", dir_path);
+    fprintf(stream, "Entries:  %zu (%"PRIu64" bytes, the limit is %zu bytes)\n",
+            entries.size, entries.total_size, limit);
+    fprintf(stream, "Hits:     %"PRIu64"\n", stats.hits);
+    fprintf(stream, "Misses:   %"PRIu64"\n", stats.misses);
+    fprintf(stream, "Hit rate: %.1f%%\n", lookups > 0 ? 100.0 * (double) stats.hits / (double) lookups : 0.0);
+
+    arena_free(&arena);
+}
+#else
+void basm_cache_init(Basm_Cache *cache, Basm *basm,
+                     const char *dir_path, size_t limit,
+                     const char *input_file_path, const char *options)
+{
+    (void) basm;
+    (void) dir_path;
+    (void) input_file_path;
+    (void) options;
+    memset(cache, 0, sizeof(*cache));
+    cache->limit = limit;
+}
+
+bool basm_cache_fetch(Basm_Cache *cache, Basm *basm, const char *output_file_path)
+{
+    (void) cache;
+    (void) basm;
+    (void) output_file_path;
+    return false;
+}
+
+void basm_cache_store(Basm_Cache *cache, Basm *basm, const char *output_file_path)
+{
+    (void) cache;
+    (void) basm;
+    (void) output_file_path;
+}
+
+void basm_cache_print_stats(const char *dir_path, size_t limit, FILE *stream)
+{
+    (void) dir_path;
+    (void) limit;
+    fprintf(stream, "The cache is not supported on this platform\n");
+}
+#endif // _WIN32
@@ -0,0 +1,64 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "./compiler.h"
+
+// NOTE: A persistent cache of the translations. An entry is keyed by the
+// root file, the include paths, the current directory, the options that
+// affect the output and the build of basm itself. It remembers the output of
+// the translation and everything the translation has read:
+//
+// - the hashes of the contents of all the source files and of the files
+//   embedded with file(),
+// - the paths every %include resolved to, because a file that appears in an
+//   earlier include path changes the resolution without changing any of the
+//   files that were read.
+//
+// The entry is reused only if all of that still holds, so a program that
+// includes basm/lib/std.hasm is not translated again until either the
+// program or the library changes. The translation of an included file
+// depends on the scope and the addresses it is included at, so the whole
+// translation is cached rather than the individual files.
+//
+// The entries are `<key>.bmc` files in the directory of the cache. When the
+// total size of the entries exceeds the limit, the least recently used ones
+// are removed. The amount of hits and misses is kept in `stats`.
+//
+// Only POSIX systems are supported. Elsewhere nothing is ever cached.
+
+#define BASM_CACHE_MAGIC 0xa4636d62
+#define BASM_CACHE_VERSION 1
+#define BASM_CACHE_DEFAULT_LIMIT (64 * 1024 * 1024)
+
+PACK(struct Basm_Cache_Meta {
+    uint32_t magic;
+    uint16_t version;
+    uint64_t key;
+    uint64_t includes_size;
+    uint64_t files_size;
+    uint64_t output_size;
+});
+
+typedef struct Basm_Cache_Meta Basm_Cache_Meta;
+
+typedef struct {
+    const char *dir_path;
+    size_t limit;
+    uint64_t key;
+    const char *entry_path;
+} Basm_Cache;
+
+// `options` is anything else that changes the output for the same sources,
+// like the target. Must be called after the include paths are pushed.
+void basm_cache_init(Basm_Cache *cache, Basm *basm,
+                     const char *dir_path, size_t limit,
+                     const char *input_file_path, const char *options);
+// Writes the cached output into the output file and returns true if the
+// entry is still valid. Counts a hit or a miss.
+bool basm_cache_fetch(Basm_Cache *cache, Basm *basm, const char *output_file_path);
+// Remembers the output file as the result of the translation that `basm`
+// has just finished, then removes the least recently used entries.
+void basm_cache_store(Basm_Cache *cache, Basm *basm, const char *output_file_path);
+void basm_cache_print_stats(const char *dir_path, size_t limit, FILE *stream);
+
+#endif // CACHE_H_
@@ -3,6 +3,9 @@
 #include "./compiler.h"
 #include "./linizer.h"
 #include "./path.h"
+#include "./prefetch.h"
+#include "./dynarray.h"
+#include "./hash.h"
 
 Eval_Result eval_result_ok(Word value, Type type)
 {
@@ -21,15 +24,78 @@ Eval_Result eval_result_deferred(Binding *deferred_binding)
     };
 }
 
+static Eval_Result eval_result_mem_addr(Word addr)
+{
+    Eval_Result result = eval_result_ok(addr, TYPE_MEM_ADDR);
+    result.reloc = RELOC_MEM_ADDR;
+    result.mem_base = addr.as_u64;
+    return result;
+}
+
 Binding *scope_resolve_binding(Scope *scope, String_View name)
 {
-    for (size_t i = 0; i < scope->bindings_size; ++i) {
-        if (sv_eq(scope->bindings[i].name, name)) {
-            return &scope->bindings[i];
-        }
+    return intern_map_get(&scope->bindings, name);
+}
+
+static void scope_add_binding(Scope *scope, Binding binding)
+{
+    Binding *existing = scope_resolve_binding(scope, binding.name);
+    if (existing) {
+        fprintf(stderr,
+                FL_Fmt": ERROR: name `"SV_Fmt"` is already bound\n",
+                FL_Arg(binding.location),
+                SV_Arg(binding.name));
+        fprintf(stderr,
+                FL_Fmt": NOTE: first binding is located here\n",
+                FL_Arg(existing->location));
+        exit(1);
     }
 
-    return NULL;
+    Binding *result = intern_map_spare(&scope->bindings);
+    if (result == NULL) {
+        result = arena_alloc(scope->arena, sizeof(*result));
+    }
+    *result = binding;
+    intern_map_put(&scope->bindings, scope->arena, binding.name, result);
+}
+
+Scope *basm_new_scope(Basm *basm)
+{
+    if (basm->free_scopes != NULL) {
+        Scope *scope = basm->free_scopes;
+        basm->free_scopes = scope->previous;
+        scope->previous = NULL;
+        scope->id = ++basm->scopes_count;
+        return scope;
+    }
+
+    Scope *scope = arena_alloc(&basm->arena, sizeof(*scope));
+    scope->arena = &basm->arena;
+    scope->id = ++basm->scopes_count;
+    return scope;
+}
+
+Scope *basm_capture_scope(Basm *basm)
+{
+    assert(basm->scope != NULL);
+    for (Scope *scope = basm->scope;
+            scope != NULL && !scope->captured;
+            scope = scope->previous) {
+        scope->captured = true;
+    }
+    return basm->scope;
+}
+
+static void basm_release_scope(Basm *basm, Scope *scope)
+{
+    if (scope->captured) {
+        return;
+    }
+
+    intern_map_clear(&scope->bindings);
+    intern_map_clear(&scope->macrodefs);
+    scope->previous = basm->free_scopes;
+    basm->free_scopes = scope;
 }
 
 void basm_push_scope(Basm *basm, Scope *scope)
@@ -41,13 +107,15 @@ void basm_push_scope(Basm *basm, Scope *scope)
 
 void basm_push_new_scope(Basm *basm)
 {
-    basm_push_scope(basm, arena_alloc(&basm->arena, sizeof(*basm->scope)));
+    basm_push_scope(basm, basm_new_scope(basm));
 }
 
 void basm_pop_scope(Basm *basm)
 {
     assert(basm->scope != NULL);
-    basm->scope = basm->scope->previous;
+    Scope *scope = basm->scope;
+    basm->scope = scope->previous;
+    basm_release_scope(basm, scope);
 }
 
 Binding *basm_resolve_binding(Basm *basm, String_View name)
@@ -64,81 +132,64 @@ Binding *basm_resolve_binding(Basm *basm, String_View name)
     return NULL;
 }
 
-void scope_bind_value(Scope *scope, String_View name, Word value, Type type, File_Location location)
+Reloc_Kind reloc_of_type(Type type)
 {
-    Binding *existing = scope_resolve_binding(scope, name);
-    if (existing) {
-        fprintf(stderr,
-                FL_Fmt": ERROR: name `"SV_Fmt"` is already bound\n",
-                FL_Arg(location),
-                SV_Arg(name));
-        fprintf(stderr,
-                FL_Fmt": NOTE: first binding is located here\n",
-                FL_Arg(existing->location));
-        exit(1);
+    switch (type) {
+    case TYPE_INST_ADDR:
+        return RELOC_INST_ADDR;
+    case TYPE_MEM_ADDR:
+        return RELOC_MEM_ADDR;
+    case TYPE_NATIVE_ID:
+        return RELOC_NATIVE_ID;
+
+    case TYPE_ANY:
+    case TYPE_FLOAT:
+    case TYPE_SIGNED_INT:
+    case TYPE_UNSIGNED_INT:
+    case TYPE_STACK_ADDR:
+    case TYPE_BOOL:
+    case COUNT_TYPES:
+    default:
+        return RELOC_NONE;
     }
+}
 
-    assert(scope->bindings_size < BASM_BINDINGS_CAPACITY);
-    scope->bindings[scope->bindings_size++] = (Binding) {
+void scope_bind_value(Scope *scope, String_View name, Word value, Type type, Reloc_Kind reloc, File_Location location)
+{
+    scope_add_binding(scope, (Binding) {
         .name = name,
         .value = value,
         .status = BINDING_EVALUATED,
         .type = type,
         .location = location,
-    };
+        .reloc = reloc,
+    });
 }
 
 void scope_defer_binding(Scope *scope, String_View name, Type type, File_Location location)
 {
-    assert(scope->bindings_size < BASM_BINDINGS_CAPACITY);
-
-    Binding *existing = scope_resolve_binding(scope, name);
-    if (existing) {
-        fprintf(stderr,
-                FL_Fmt": ERROR: name `"SV_Fmt"` is already bound\n",
-                FL_Arg(location),
-                SV_Arg(name));
-        fprintf(stderr,
-                FL_Fmt": NOTE: first binding is located here\n",
-                FL_Arg(existing->location));
-        exit(1);
-    }
-
-    scope->bindings[scope->bindings_size++] = (Binding) {
+    scope_add_binding(scope, (Binding) {
         .name = name,
         .status = BINDING_DEFERRED,
         .type = type,
         .location = location,
-    };
+        .reloc = reloc_of_type(type),
+    });
 }
 
 void scope_bind_expr(Scope *scope, String_View name, Expr expr, File_Location location)
 {
-    assert(scope->bindings_size < BASM_BINDINGS_CAPACITY);
-
-    Binding *existing = scope_resolve_binding(scope, name);
-    if (existing) {
-        fprintf(stderr,
-                FL_Fmt": ERROR: name `"SV_Fmt"` is already bound\n",
-                FL_Arg(location),
-                SV_Arg(name));
-        fprintf(stderr,
-                FL_Fmt": NOTE: first binding is located here\n",
-                FL_Arg(existing->location));
-        exit(1);
-    }
-
-    scope->bindings[scope->bindings_size++] = (Binding) {
+    scope_add_binding(scope, (Binding) {
         .name = name,
         .expr = expr,
         .location = location,
-    };
+    });
 }
 
 void basm_bind_value(Basm *basm, String_View name, Word value, Type type, File_Location location)
 {
     assert(basm->scope != NULL);
-    scope_bind_value(basm->scope, name, value, type, location);
+    scope_bind_value(basm->scope, name, value, type, reloc_of_type(type), location);
 }
 
 void basm_defer_binding(Basm *basm, String_View name, Type type, File_Location location)
@@ -155,81 +206,301 @@ void basm_bind_expr(Basm *basm, String_View name, Expr expr, File_Location locat
 
 void basm_push_deferred_operand(Basm *basm, Inst_Addr addr, Expr expr, File_Location location)
 {
-    assert(basm->deferred_operands_size < BASM_DEFERRED_OPERANDS_CAPACITY);
-    basm->deferred_operands[basm->deferred_operands_size++] = (Deferred_Operand) {
+    DYNARRAY_PUSH(&basm->arena, basm->deferred_operands, ((Deferred_Operand) {
         .addr = addr,
         .expr = expr,
         .location = location,
-        .scope = basm->scope,
-    };
+        .scope = basm_capture_scope(basm),
+    }));
 }
 
-Word basm_push_buffer_to_memory(Basm *basm, uint8_t *buffer, uint64_t buffer_size)
+// NOTE: appends `size` bytes to the memory and remembers them as a chunk of
+// that length. Returns the address of the chunk.
+static Word basm_alloc_memory(Basm *basm, uint64_t size)
 {
-    assert(basm->memory_size + buffer_size <= BM_MEMORY_CAPACITY);
+    // NOTE: all the targets reserve exactly that much memory for the program
+    if (basm->memory_size + size > BM_MEMORY_CAPACITY) {
+        fprintf(stderr, "ERROR: the memory of the program does not fit into %d bytes\n",
+                BM_MEMORY_CAPACITY);
+        exit(1);
+    }
+
+    if (basm->memory == NULL || basm->memory_size + size > basm->memory_allocated) {
+        size_t allocated = basm->memory_allocated == 0 ? DYNARRAY_INIT_CAP : basm->memory_allocated;
+        while (allocated < basm->memory_size + size) {
+            allocated *= 2;
+        }
+        basm->memory = arena_realloc(&basm->arena, basm->memory, basm->memory_allocated, allocated);
+        basm->memory_allocated = allocated;
+    }
 
     Word result = word_u64(basm->memory_size);
-    memcpy(basm->memory + basm->memory_size, buffer, buffer_size);
-    basm->memory_size += buffer_size;
+    basm->memory_size += size;
 
     if (basm->memory_size > basm->memory_capacity) {
         basm->memory_capacity = basm->memory_size;
     }
 
-    basm->string_lengths[basm->string_lengths_size++] = (String_Length) {
+    DYNARRAY_PUSH(&basm->arena, basm->string_lengths, ((String_Length) {
         .addr = result.as_u64,
-        .length = buffer_size,
-    };
+        .length = size,
+    }));
+
+    return result;
+}
 
+Word basm_push_buffer_to_memory(Basm *basm, uint8_t *buffer, uint64_t buffer_size)
+{
+    Word result = basm_alloc_memory(basm, buffer_size);
+    memcpy(basm->memory + result.as_u64, buffer, buffer_size);
     return result;
 }
 
 Word basm_push_byte_array_to_memory(Basm *basm, uint64_t size, uint8_t value)
 {
-    assert(basm->memory_size + size <= BM_MEMORY_CAPACITY);
+    Word result = basm_alloc_memory(basm, size);
+    memset(basm->memory + result.as_u64, value, size);
+    return result;
+}
 
-    Word result = word_u64(basm->memory_size);
-    memset(basm->memory + basm->memory_size, value, size);
-    basm->memory_size += size;
+// NOTE: the strings are never modified at translation time, so a string
+// that was already put into the memory is reused instead of being copied
+// again, and a string that the end of an earlier string is equal to is placed
+// right into it. For example "world" is placed into the last 5 bytes of
+// "Hello, world". Only the earlier strings can be shared, because their
+// addresses are already known. All the occurrences of the same literal refer
+// to the same memory, so a program that modifies one of them modifies all of
+// them.
+static void string_map_index(String_Map *map, size_t index)
+{
+    size_t i = map->items[index].hash & (map->slots_capacity - 1);
+    while (map->slots[i] != 0) {
+        i = (i + 1) & (map->slots_capacity - 1);
+    }
+    map->slots[i] = (uint32_t) index + 1;
+}
 
-    if (basm->memory_size > basm->memory_capacity) {
-        basm->memory_capacity = basm->memory_size;
+static void string_map_put(String_Map *map, Arena *arena, String_Entry entry)
+{
+    DYNARRAY_PUSH(arena, (*map), entry);
+
+    // NOTE: the load factor of the slots stays at most 1/2
+    if (map->size * 2 > map->slots_capacity) {
+        map->slots_capacity = map->slots_capacity == 0 ? DYNARRAY_INIT_CAP : map->slots_capacity * 2;
+        assert(map->slots_capacity <= UINT32_MAX);
+        map->slots = arena_alloc(arena, map->slots_capacity * sizeof(*map->slots));
+        for (size_t index = 0; index < map->size; ++index) {
+            string_map_index(map, index);
+        }
+    } else {
+        string_map_index(map, map->size - 1);
     }
+}
 
-    basm->string_lengths[basm->string_lengths_size++] = (String_Length) {
-        .addr = result.as_u64,
-        .length = size,
-    };
+Word basm_push_string_to_memory(Basm *basm, String_View sv)
+{
+    const uint64_t hash = hash_sv(sv);
+
+    const String_Map *strings = &basm->strings;
+    if (strings->slots_capacity > 0) {
+        for (size_t i = hash & (strings->slots_capacity - 1);
+                strings->slots[i] != 0;
+                i = (i + 1) & (strings->slots_capacity - 1)) {
+            const String_Entry entry = strings->items[strings->slots[i] - 1];
+            const String_Length chunk = basm->string_lengths.items[entry.chunk];
+            if (entry.hash == hash && chunk.length == sv.count &&
+                    memcmp(basm->memory + chunk.addr, sv.data, sv.count) == 0) {
+                return word_u64(chunk.addr);
+            }
+        }
+    }
 
+    Word result = basm_alloc_memory(basm, sv.count);
+    memcpy(basm->memory + result.as_u64, sv.data, sv.count);
+    string_map_put(&basm->strings, &basm->arena, (String_Entry) {
+        .hash = hash,
+        .chunk = basm->string_lengths.size - 1,
+    });
     return result;
 }
 
-Word basm_push_string_to_memory(Basm *basm, String_View sv)
+typedef struct {
+    const uint8_t *data;
+    uint64_t length;
+    size_t chunk;
+} Merged_String;
+
+// NOTE: compares the strings from their ends, so the strings that end with
+// the same characters are next to each other, each of them right before the
+// longer ones it is the suffix of
+static int merged_string_compare_reversed(const void *a, const void *b)
 {
-    assert(basm->memory_size + sv.count <= BM_MEMORY_CAPACITY);
+    const Merged_String *sa = a;
+    const Merged_String *sb = b;
+    const uint64_t n = sa->length < sb->length ? sa->length : sb->length;
+    for (uint64_t i = 1; i <= n; ++i) {
+        const uint8_t ca = sa->data[sa->length - i];
+        const uint8_t cb = sb->data[sb->length - i];
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
 
-    Word result = word_u64(basm->memory_size);
-    memcpy(basm->memory + basm->memory_size, sv.data, sv.count);
-    basm->memory_size += sv.count;
+    return (sa->length > sb->length) - (sa->length < sb->length);
+}
 
-    if (basm->memory_size > basm->memory_capacity) {
-        basm->memory_capacity = basm->memory_size;
+// NOTE: the last chunk that starts at or before the address. Several chunks
+// start at the same address only if all of them but the last one are empty.
+static size_t basm_chunk_at_or_before(const Basm *basm, Memory_Addr addr)
+{
+    size_t begin = 0;
+    size_t end = basm->string_lengths.size;
+    while (begin < end) {
+        const size_t middle = begin + (end - begin) / 2;
+        if (basm->string_lengths.items[middle].addr <= addr) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
     }
+    return begin == 0 ? SIZE_MAX : begin - 1;
+}
 
-    basm->string_lengths[basm->string_lengths_size++] = (String_Length) {
-        .addr = result.as_u64,
-        .length = sv.count,
-    };
+// NOTE: puts every string that is the suffix of a longer one at the end of
+// the longer one instead of a chunk of its own. That is done once all the
+// strings are known, so it does not matter in which order they appeared.
+// The memory of a program that depends on its layout is not touched.
+static void basm_merge_strings(Basm *basm)
+{
+    const size_t chunks_size = basm->string_lengths.size;
+    if (basm->memory_layout_dependent || basm->strings.size < 2) {
+        return;
+    }
 
-    return result;
+    // NOTE: the operands refer to the memory only within the chunks they
+    // were computed from or right after them, otherwise they cannot be moved
+    for (size_t i = 0; i < basm->deferred_operands.size; ++i) {
+        const Deferred_Operand operand = basm->deferred_operands.items[i];
+        if (basm->program_relocs[operand.addr] != RELOC_MEM_ADDR) {
+            continue;
+        }
+
+        const Memory_Addr value = basm->program[operand.addr].operand.as_u64;
+        const size_t chunk = basm_chunk_at_or_before(basm, operand.mem_base);
+        if (chunk == SIZE_MAX ||
+                value < basm->string_lengths.items[chunk].addr ||
+                value - basm->string_lengths.items[chunk].addr > basm->string_lengths.items[chunk].length) {
+            return;
+        }
+    }
+
+    Merged_String *sorted = arena_alloc(&basm->arena, (basm->strings.size + 1) * sizeof(*sorted));
+    size_t sorted_size = 0;
+    for (size_t i = 0; i < basm->strings.size; ++i) {
+        const size_t chunk = basm->strings.items[i].chunk;
+        const String_Length string = basm->string_lengths.items[chunk];
+        if (string.length > 0) {
+            sorted[sorted_size++] = (Merged_String) {
+                .data = basm->memory + string.addr,
+                .length = string.length,
+                .chunk = chunk,
+            };
+        }
+    }
+    qsort(sorted, sorted_size, sizeof(*sorted), merged_string_compare_reversed);
+
+    // NOTE: the chunk that the chunk is merged into, or SIZE_MAX
+    size_t *hosts = arena_alloc(&basm->arena, (chunks_size + 1) * sizeof(*hosts));
+    for (size_t i = 0; i < chunks_size; ++i) {
+        hosts[i] = SIZE_MAX;
+    }
+
+    bool merged = false;
+    for (size_t i = sorted_size; i-- > 1;) {
+        // NOTE: sorted[i] is either a host itself or already knows its host,
+        // which is the longest string that ends with it
+        const size_t host_chunk = hosts[sorted[i].chunk] == SIZE_MAX ? sorted[i].chunk : hosts[sorted[i].chunk];
+        const String_Length host = basm->string_lengths.items[host_chunk];
+        const Merged_String string = sorted[i - 1];
+        if (memcmp(basm->memory + host.addr + host.length - string.length,
+                   string.data, string.length) == 0) {
+            hosts[string.chunk] = host_chunk;
+            merged = true;
+        }
+    }
+
+    if (!merged) {
+        return;
+    }
+
+    Memory_Addr *chunk_addrs = arena_alloc(&basm->arena, (chunks_size + 1) * sizeof(*chunk_addrs));
+    Memory_Addr size = 0;
+    for (size_t i = 0; i < chunks_size; ++i) {
+        const String_Length chunk = basm->string_lengths.items[i];
+        if (hosts[i] == SIZE_MAX) {
+            chunk_addrs[i] = size;
+            memmove(basm->memory + size, basm->memory + chunk.addr, chunk.length);
+            size += chunk.length;
+        }
+    }
+
+    for (size_t i = 0; i < chunks_size; ++i) {
+        if (hosts[i] != SIZE_MAX) {
+            const String_Length host = basm->string_lengths.items[hosts[i]];
+            chunk_addrs[i] = chunk_addrs[hosts[i]] + host.length - basm->string_lengths.items[i].length;
+        }
+    }
+
+    for (size_t i = 0; i < basm->deferred_operands.size; ++i) {
+        const Deferred_Operand deferred = basm->deferred_operands.items[i];
+        if (basm->program_relocs[deferred.addr] == RELOC_MEM_ADDR) {
+            Word *operand = &basm->program[deferred.addr].operand;
+            const size_t chunk = basm_chunk_at_or_before(basm, deferred.mem_base);
+            operand->as_u64 = chunk_addrs[chunk] + (operand->as_u64 - basm->string_lengths.items[chunk].addr);
+        }
+    }
+
+    for (size_t i = 0; i < basm->merged_strings.size; ++i) {
+        String_Length *string = &basm->merged_strings.items[i];
+        const size_t chunk = basm_chunk_at_or_before(basm, string->addr);
+        string->addr = chunk_addrs[chunk] + (string->addr - basm->string_lengths.items[chunk].addr);
+    }
+
+    size_t kept_size = 0;
+    for (size_t i = 0; i < chunks_size; ++i) {
+        String_Length chunk = basm->string_lengths.items[i];
+        chunk.addr = chunk_addrs[i];
+        if (hosts[i] == SIZE_MAX) {
+            basm->string_lengths.items[kept_size++] = chunk;
+        } else {
+            DYNARRAY_PUSH(&basm->arena, basm->merged_strings, chunk);
+        }
+    }
+    basm->string_lengths.size = kept_size;
+
+    // NOTE: the entries refer to the chunks by their old indices
+    memset(basm->strings.slots, 0, basm->strings.slots_capacity * sizeof(*basm->strings.slots));
+    basm->strings.size = 0;
+
+    basm->memory_capacity -= basm->memory_size - size;
+    basm->memory_size = size;
 }
 
 bool basm_string_length_by_addr(Basm *basm, Inst_Addr addr, Word *length)
 {
-    for (size_t i = 0; i < basm->string_lengths_size; ++i) {
-        if (basm->string_lengths[i].addr == addr) {
+    for (size_t i = 0; i < basm->string_lengths.size; ++i) {
+        if (basm->string_lengths.items[i].addr == addr) {
             if (length) {
-                *length = word_u64(basm->string_lengths[i].length);
+                *length = word_u64(basm->string_lengths.items[i].length);
+            }
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < basm->merged_strings.size; ++i) {
+        if (basm->merged_strings.items[i].addr == addr) {
+            if (length) {
+                *length = word_u64(basm->merged_strings.items[i].length);
             }
             return true;
         }
@@ -278,8 +549,27 @@ void basm_save_to_file_as_target(Basm *basm, const char *output_file_path, Targe
     }
 }
 
+// NOTE: the program is allowed to grow beyond what the bm is able to load,
+// because the other targets do not have such limits
+static void basm_expect_bm_limits(const Basm *basm)
+{
+    if (basm->program_size > BM_PROGRAM_CAPACITY) {
+        fprintf(stderr, "ERROR: the program has %"PRIu64" instructions, but the bm is able to load only %d\n",
+                basm->program_size, BM_PROGRAM_CAPACITY);
+        exit(1);
+    }
+
+    if (basm->external_natives.size > BM_EXTERNAL_NATIVES_CAPACITY) {
+        fprintf(stderr, "ERROR: the program has %zu natives, but the bm is able to load only %d\n",
+                basm->external_natives.size, BM_EXTERNAL_NATIVES_CAPACITY);
+        exit(1);
+    }
+}
+
 void basm_save_to_bm(const Basm *basm, Bm *bm)
 {
+    basm_expect_bm_limits(basm);
+
     memset(bm, 0, sizeof(*bm));
 
     memcpy(bm->program, basm->program, basm->program_size * sizeof(basm->program[0]));
@@ -287,8 +577,11 @@ void basm_save_to_bm(const Basm *basm, Bm *bm)
     assert(basm->has_entry);
     bm->ip = basm->entry;
 
-    memcpy(bm->externals, basm->external_natives, basm->external_natives_size * sizeof(basm->external_natives[0]));
-    bm->externals_size = basm->external_natives_size;
+    memcpy(bm->externals, basm->external_natives.items, basm->external_natives.size * sizeof(basm->external_natives.items[0]));
+    bm->externals_size = basm->external_natives.size;
+
+    memcpy(bm->exports, basm->exports.items, basm->exports.size * sizeof(basm->exports.items[0]));
+    bm->exports_size = basm->exports.size;
 
     memcpy(bm->memory, basm->memory, basm->memory_size * sizeof(basm->memory[0]));
     bm->expected_memory_size = basm->memory_size;
@@ -296,6 +589,8 @@ void basm_save_to_bm(const Basm *basm, Bm *bm)
 
 void basm_save_to_file_as_bm(Basm *basm, const char *file_path)
 {
+    basm_expect_bm_limits(basm);
+
     FILE *f = fopen(file_path, "wb");
     if (f == NULL) {
         fprintf(stderr, "ERROR: Could not open file `%s`: %s\n",
@@ -310,7 +605,8 @@ void basm_save_to_file_as_bm(Basm *basm, const char *file_path)
         .program_size = basm->program_size,
         .memory_size = basm->memory_size,
         .memory_capacity = basm->memory_capacity,
-        .externals_size = basm->external_natives_size,
+        .externals_size = basm->external_natives.size,
+        .exports_size = basm->exports.size,
     };
 
     fwrite(&meta, sizeof(meta), 1, f);
@@ -334,7 +630,14 @@ void basm_save_to_file_as_bm(Basm *basm, const char *file_path)
         exit(1);
     }
 
-    fwrite(basm->external_natives, sizeof(basm->external_natives[0]), basm->external_natives_size, f);
+    fwrite(basm->external_natives.items, sizeof(basm->external_natives.items[0]), basm->external_natives.size, f);
+    if (ferror(f)) {
+        fprintf(stderr, "ERROR: Could not write to file `%s`: %s\n",
+                file_path, strerror(errno));
+        exit(1);
+    }
+
+    fwrite(basm->exports.items, sizeof(basm->exports.items[0]), basm->exports.size, f);
     if (ferror(f)) {
         fprintf(stderr, "ERROR: Could not write to file `%s`: %s\n",
                 file_path, strerror(errno));
@@ -395,6 +698,9 @@ void basm_translate_block_statement(Basm *basm, Block_Statement *block)
             case STATEMENT_KIND_ENTRY:
                 basm_translate_entry_statement(basm, statement.value.as_entry, statement.location);
                 break;
+            case STATEMENT_KIND_EXPORT:
+                basm_translate_export_statement(basm, statement.value.as_export, statement.location);
+                break;
             case STATEMENT_KIND_BLOCK:
                 basm_translate_block_statement(basm, statement.value.as_block);
                 break;
@@ -405,6 +711,7 @@ void basm_translate_block_statement(Basm *basm, Block_Statement *block)
 
             case STATEMENT_KIND_MACROCALL:
             case STATEMENT_KIND_FUNCDEF:
+            case STATEMENT_KIND_ONCE:
             case STATEMENT_KIND_FOR:
             case STATEMENT_KIND_SCOPE:
             case STATEMENT_KIND_EMIT_INST:
@@ -437,6 +744,10 @@ void basm_translate_block_statement(Basm *basm, Block_Statement *block)
 
                 binding->status = BINDING_EVALUATED;
                 binding->value.as_u64 = basm->program_size;
+
+                if (basm->relocatable && basm->scope == basm->global_scope) {
+                    DYNARRAY_PUSH(&basm->arena, basm->global_labels, binding);
+                }
             }
             break;
 
@@ -466,10 +777,12 @@ void basm_translate_block_statement(Basm *basm, Block_Statement *block)
             case STATEMENT_KIND_FUNCDEF:
             case STATEMENT_KIND_BLOCK:
             case STATEMENT_KIND_ENTRY:
+            case STATEMENT_KIND_EXPORT:
             case STATEMENT_KIND_ERROR:
             case STATEMENT_KIND_ASSERT:
             case STATEMENT_KIND_INCLUDE:
             case STATEMENT_KIND_CONST:
+            case STATEMENT_KIND_ONCE:
                 // NOTE: ignored at the second pass
                 break;
 
@@ -486,20 +799,20 @@ void basm_eval_deferred_asserts(Basm *basm)
 {
     Scope *saved_basm_scope = basm->scope;
 
-    for (size_t i = 0; i < basm->deferred_asserts_size; ++i) {
-        assert(basm->deferred_asserts[i].scope);
-        basm->scope = basm->deferred_asserts[i].scope;
+    for (size_t i = 0; i < basm->deferred_asserts.size; ++i) {
+        assert(basm->deferred_asserts.items[i].scope);
+        basm->scope = basm->deferred_asserts.items[i].scope;
         // TODO(#285): make basm_expr_eval accept the scope in which you want to evaluate the expression
         // So there is no need for that silly `saved_basm_scope` hack above
         Eval_Result result = basm_expr_eval(
                                  basm,
-                                 basm->deferred_asserts[i].expr,
-                                 basm->deferred_asserts[i].location);
+                                 basm->deferred_asserts.items[i].expr,
+                                 basm->deferred_asserts.items[i].location);
         assert(result.status == EVAL_STATUS_OK);
 
         if (!result.value.as_u64) {
             fprintf(stderr, FL_Fmt": ERROR: assertion failed\n",
-                    FL_Arg(basm->deferred_asserts[i].location));
+                    FL_Arg(basm->deferred_asserts.items[i].location));
             exit(1);
         }
     }
@@ -511,24 +824,43 @@ void basm_eval_deferred_operands(Basm *basm)
 {
     Scope *saved_basm_scope = basm->scope;
 
-    for (size_t i = 0; i < basm->deferred_operands_size; ++i) {
-        assert(basm->deferred_operands[i].scope);
-        basm->scope = basm->deferred_operands[i].scope;
+    for (size_t i = 0; i < basm->deferred_operands.size; ++i) {
+        assert(basm->deferred_operands.items[i].scope);
+        basm->scope = basm->deferred_operands.items[i].scope;
 
-        Inst_Addr addr = basm->deferred_operands[i].addr;
-        Expr expr = basm->deferred_operands[i].expr;
-        File_Location location = basm->deferred_operands[i].location;
+        Inst_Addr addr = basm->deferred_operands.items[i].addr;
+        Expr expr = basm->deferred_operands.items[i].expr;
+        File_Location location = basm->deferred_operands.items[i].location;
 
-        Eval_Result result = basm_expr_eval(basm, expr, location);
+        Inst_Def inst_def = get_inst_def(basm->program[addr].type);
+        assert(inst_def.has_operand);
+
+        Eval_Result result = {0};
+        if (basm->relocatable &&
+                expr.kind == EXPR_KIND_BINDING &&
+                basm_resolve_binding(basm, expr.value.as_binding) == NULL) {
+            // NOTE: the symbols of the other objects are always labels
+            result = eval_result_ok(word_u64(0), TYPE_INST_ADDR);
+            result.reloc = RELOC_SYMBOL;
+            basm->program_symbols[addr] = expr.value.as_binding;
+        } else {
+            result = basm_expr_eval(basm, expr, location);
+        }
         assert(result.status == EVAL_STATUS_OK);
         basm->program[addr].operand = result.value;
 
-        Inst_Def inst_def = get_inst_def(basm->program[addr].type);
-        assert(inst_def.has_operand);
+        if (basm->relocatable && result.reloc == RELOC_INVALID) {
+            fprintf(stderr, FL_Fmt": ERROR: the operand of `%s` instruction depends on the addresses in a way that cannot be relocated. Only an address plus or minus a constant, or the difference between two addresses of the same kind can be linked.\n",
+                    FL_Arg(location),
+                    inst_def.name);
+            exit(1);
+        }
+        basm->program_relocs[addr] = result.reloc;
+        basm->deferred_operands.items[i].mem_base = result.mem_base;
 
         if (!is_subtype_of(result.type, inst_def.operand_type)) {
             fprintf(stderr, FL_Fmt": ERROR: TYPE CHECK ERROR! `%s` instruction expects an operand of the type `%s`. But the value of type `%s` was found.\n",
-                    FL_Arg(basm->deferred_operands[i].location),
+                    FL_Arg(basm->deferred_operands.items[i].location),
                     inst_def.name,
                     type_name(inst_def.operand_type),
                     type_name(result.type));
@@ -588,6 +920,57 @@ void basm_eval_deferred_entry(Basm *basm)
     basm->scope = saved_basm_scope;
 }
 
+void basm_eval_deferred_exports(Basm *basm)
+{
+    Scope *saved_basm_scope = basm->scope;
+
+    for (size_t i = 0; i < basm->deferred_exports.size; ++i) {
+        Deferred_Export *deferred_export = &basm->deferred_exports.items[i];
+        assert(deferred_export->scope);
+        basm->scope = deferred_export->scope;
+
+        Binding *binding = basm_resolve_binding(basm, deferred_export->binding_name);
+        if (binding == NULL) {
+            fprintf(stderr, FL_Fmt": ERROR: unknown binding `"SV_Fmt"`\n",
+                    FL_Arg(deferred_export->location),
+                    SV_Arg(deferred_export->binding_name));
+            exit(1);
+        }
+
+        if (binding->type != TYPE_INST_ADDR) {
+            fprintf(stderr, FL_Fmt": ERROR: Type check error. Trying to export `"SV_Fmt"` that has the type of %s. Only %s can be exported.\n",
+                    FL_Arg(deferred_export->location),
+                    SV_Arg(binding->name),
+                    type_name(binding->type),
+                    type_name(TYPE_INST_ADDR));
+            exit(1);
+        }
+
+        for (size_t j = 0; j < i; ++j) {
+            if (sv_eq(basm->deferred_exports.items[j].binding_name, deferred_export->binding_name)) {
+                fprintf(stderr, FL_Fmt": ERROR: `"SV_Fmt"` has been already exported\n",
+                        FL_Arg(deferred_export->location),
+                        SV_Arg(deferred_export->binding_name));
+                fprintf(stderr, FL_Fmt": NOTE: the first export\n",
+                        FL_Arg(basm->deferred_exports.items[j].location));
+                exit(1);
+            }
+        }
+
+        Eval_Result result = basm_binding_eval(basm, binding);
+        assert(result.status == EVAL_STATUS_OK);
+
+        Bm_Export export = {0};
+        memcpy(export.name,
+               deferred_export->binding_name.data,
+               deferred_export->binding_name.count);
+        export.addr = result.value.as_u64;
+        DYNARRAY_PUSH(&basm->arena, basm->exports, export);
+    }
+
+    basm->scope = saved_basm_scope;
+}
+
 void basm_translate_emit_inst_statement(Basm *basm, Emit_Inst_Statement emit_inst, File_Location location)
 {
     Inst_Addr addr = basm_push_inst(basm, emit_inst.type, word_u64(0));
@@ -620,7 +1003,33 @@ void basm_translate_entry_statement(Basm *basm, Entry_Statement entry, File_Loca
     String_View label = entry.value.value.as_binding;
     basm->deferred_entry.binding_name = label;
     basm->deferred_entry.location = location;
-    basm->deferred_entry.scope = basm->scope;
+    basm->deferred_entry.scope = basm_capture_scope(basm);
+}
+
+void basm_translate_export_statement(Basm *basm, Export_Statement export, File_Location location)
+{
+    assert(basm->scope);
+    assert(export.value.kind == EXPR_KIND_BINDING);
+
+    String_View name = export.value.value.as_binding;
+
+    // NOTE: at least one character is reserved for the NULL-terminator
+    if (name.count >= NATIVE_NAME_CAPACITY - 1) {
+        fprintf(stderr, FL_Fmt": ERROR: exceed maximum size of the name for an export. The limit is %zu.\n", FL_Arg(location), (size_t) (NATIVE_NAME_CAPACITY - 1));
+        exit(1);
+    }
+
+    if (basm->deferred_exports.size >= BM_EXPORTS_CAPACITY) {
+        fprintf(stderr, FL_Fmt": ERROR: too many exports. The limit is %zu.\n",
+                FL_Arg(location), (size_t) BM_EXPORTS_CAPACITY);
+        exit(1);
+    }
+
+    DYNARRAY_PUSH(&basm->arena, basm->deferred_exports, ((Deferred_Export) {
+        .binding_name = name,
+        .location = location,
+        .scope = basm_capture_scope(basm),
+    }));
 }
 
 void basm_translate_const_statement(Basm *basm, Const_Statement konst, File_Location location)
@@ -646,11 +1055,11 @@ void basm_translate_native_statement(Basm *basm, Native_Statement native, File_L
 void basm_translate_assert_statement(Basm *basm, Assert_Statement azzert, File_Location location)
 {
     assert(basm->scope != NULL);
-    basm->deferred_asserts[basm->deferred_asserts_size++] = (Deferred_Assert) {
+    DYNARRAY_PUSH(&basm->arena, basm->deferred_asserts, ((Deferred_Assert) {
         .expr = azzert.condition,
         .location = location,
-        .scope = basm->scope,
-    };
+        .scope = basm_capture_scope(basm),
+    }));
 }
 
 void basm_translate_error_statement(Error_Statement error, File_Location location)
@@ -663,10 +1072,25 @@ void basm_translate_error_statement(Error_Statement error, File_Location locatio
 void basm_translate_include_statement(Basm *basm, Include_Statement include, File_Location location)
 {
     {
+        const String_View requested_path = intern_sv(include.path);
+
         String_View resolved_path = SV_NULL;
-        if (basm_resolve_include_file_path(basm, include.path, &resolved_path)) {
+        if (basm_resolve_include_file_path(basm, &basm->arena, include.path, &resolved_path)) {
             include.path = resolved_path;
         }
+
+        if (intern_map_get(&basm->include_resolutions, requested_path) == NULL) {
+            Include_Resolution *resolution = arena_alloc(&basm->arena, sizeof(*resolution));
+            resolution->requested_path = requested_path;
+            resolution->resolved_path = include.path;
+            intern_map_put(&basm->include_resolutions, &basm->arena, requested_path, resolution);
+        }
+    }
+
+    if (basm->include_level >= BASM_MAX_INCLUDE_LEVEL) {
+        fprintf(stderr, FL_Fmt": ERROR: exceeded the maximum include level %d\n",
+                FL_Arg(location), BASM_MAX_INCLUDE_LEVEL);
+        exit(1);
     }
 
     {
@@ -768,16 +1192,22 @@ void basm_translate_if_statement(Basm *basm, If_Statement eef, File_Location loc
 
 void basm_translate_root_source_file(Basm *basm, String_View input_file_path)
 {
+    if (basm->jobs > 1) {
+        basm_prefetch_source_files(basm, input_file_path);
+    }
+
     basm_push_new_scope(basm);
-    basm->global_scope = basm->scope;
+    basm->global_scope = basm_capture_scope(basm);
     basm_translate_source_file(basm, input_file_path);
     basm_pop_scope(basm);
 
     basm_eval_deferred_asserts(basm);
     basm_eval_deferred_operands(basm);
     basm_eval_deferred_entry(basm);
+    basm_eval_deferred_exports(basm);
+    basm_merge_strings(basm);
 
-    if (!basm->has_entry) {
+    if (!basm->has_entry && !basm->relocatable) {
         fprintf(stderr, SV_Fmt": ERROR: entry point for a BM program is not provided. Use translation directive %%entry to provide the entry point.\n", SV_Arg(input_file_path));
         fprintf(stderr, "  main:\n");
         fprintf(stderr, "     push 69\n");
@@ -792,10 +1222,39 @@ void basm_translate_root_source_file(Basm *basm, String_View input_file_path)
     }
 }
 
-void basm_translate_source_file(Basm *basm, String_View input_file_path)
+bool source_file_parse(Source_File *file, Arena *arena)
 {
     Linizer linizer = {0};
-    if (!linizer_from_file(&linizer, &basm->arena, input_file_path)) {
+    if (!linizer_from_file(&linizer, arena, file->path)) {
+        return false;
+    }
+
+    file->hash = hash_sv(linizer.source);
+    file->block = parse_block_from_lines(arena, &linizer);
+    expect_no_lines(&linizer);
+
+    for (Block_Statement *iter = file->block; iter != NULL; iter = iter->next) {
+        if (iter->statement.kind == STATEMENT_KIND_ONCE) {
+            file->once = true;
+        }
+    }
+
+    file->parsed = true;
+    return true;
+}
+
+Source_File *basm_parse_source_file(Basm *basm, String_View input_file_path)
+{
+    input_file_path = intern_sv(input_file_path);
+
+    Source_File *file = intern_map_get(&basm->source_files, input_file_path);
+    if (file == NULL) {
+        file = arena_alloc(&basm->arena, sizeof(*file));
+        file->path = input_file_path;
+        intern_map_put(&basm->source_files, &basm->arena, input_file_path, file);
+    }
+
+    if (!file->parsed && !source_file_parse(file, &basm->arena)) {
         if (basm->include_level > 0) {
             fprintf(stderr, FL_Fmt": ERROR: could not read file `"SV_Fmt"`: %s\n",
                     FL_Arg(basm->include_location),
@@ -807,9 +1266,46 @@ void basm_translate_source_file(Basm *basm, String_View input_file_path)
         exit(1);
     }
 
-    Block_Statement *input_file_block = parse_block_from_lines(&basm->arena, &linizer);
-    expect_no_lines(&linizer);
-    basm_translate_block_statement(basm, input_file_block);
+    return file;
+}
+
+static bool source_file_is_visible(const Source_File *file, const Scope *scope)
+{
+    for (; scope != NULL; scope = scope->previous) {
+        for (size_t i = 0; i < file->translated_scopes.size; ++i) {
+            if (file->translated_scopes.items[i] == scope->id) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void basm_translate_source_file(Basm *basm, String_View input_file_path)
+{
+    Source_File *file = basm_parse_source_file(basm, input_file_path);
+    if (file->once) {
+        assert(basm->scope != NULL);
+        if (source_file_is_visible(file, basm->scope)) {
+            return;
+        }
+        DYNARRAY_PUSH(&basm->arena, file->translated_scopes, basm->scope->id);
+    }
+
+    if (!basm->relocatable || basm->include_level == 0) {
+        basm_translate_block_statement(basm, file->block);
+        return;
+    }
+
+    const size_t group = basm->include_groups.size;
+    DYNARRAY_PUSH(&basm->arena, basm->include_groups, ((Include_Group) {
+        .file_path = file->path,
+        .hash = file->hash,
+        .begin = basm->program_size,
+    }));
+    basm_translate_block_statement(basm, file->block);
+    basm->include_groups.items[group].end = basm->program_size;
 }
 
 Eval_Result basm_binding_eval(Basm *basm, Binding *binding)
@@ -823,6 +1319,8 @@ Eval_Result basm_binding_eval(Basm *basm, Binding *binding)
         if (result.status == EVAL_STATUS_OK) {
             binding->type = result.type;
             binding->value = result.value;
+            binding->reloc = result.reloc;
+            binding->mem_base = result.mem_base;
         }
 
         return result;
@@ -835,7 +1333,10 @@ Eval_Result basm_binding_eval(Basm *basm, Binding *binding)
     }
     break;
     case BINDING_EVALUATED: {
-        return eval_result_ok(binding->value, binding->type);
+        Eval_Result result = eval_result_ok(binding->value, binding->type);
+        result.reloc = binding->reloc;
+        result.mem_base = binding->mem_base;
+        return result;
     }
     break;
     case BINDING_DEFERRED: {
@@ -850,6 +1351,58 @@ Eval_Result basm_binding_eval(Basm *basm, Binding *binding)
     }
 }
 
+static void basm_depend_on_layout(Basm *basm, Reloc_Kind reloc, File_Location location)
+{
+    if (reloc == RELOC_INST_ADDR && !basm->layout_dependent) {
+        basm->layout_dependent = true;
+        basm->layout_dependent_location = location;
+    }
+
+    if (reloc == RELOC_MEM_ADDR) {
+        basm->memory_layout_dependent = true;
+    }
+}
+
+static Reloc_Kind reloc_of_binary_op(Binary_Op_Kind kind, Reloc_Kind left, Reloc_Kind right)
+{
+    if (left == RELOC_NONE && right == RELOC_NONE) {
+        return RELOC_NONE;
+    }
+
+    // NOTE: the linker moves all the addresses of the same kind within an
+    // object by the same offset, so their differences and the comparisons
+    // between them stay the same
+    const bool same_base = left == right && (left == RELOC_INST_ADDR || left == RELOC_MEM_ADDR);
+
+    switch (kind) {
+    case BINARY_OP_PLUS:
+        if (right == RELOC_NONE) {
+            return left;
+        }
+        if (left == RELOC_NONE) {
+            return right;
+        }
+        return RELOC_INVALID;
+
+    case BINARY_OP_MINUS:
+        if (right == RELOC_NONE) {
+            return left;
+        }
+        return same_base ? RELOC_NONE : RELOC_INVALID;
+
+    case BINARY_OP_GT:
+    case BINARY_OP_LT:
+    case BINARY_OP_EQUALS:
+        return same_base ? RELOC_NONE : RELOC_INVALID;
+
+    case BINARY_OP_MULT:
+    case BINARY_OP_DIV:
+    case BINARY_OP_MOD:
+    default:
+        return RELOC_INVALID;
+    }
+}
+
 static Eval_Result basm_binary_op_eval(Basm *basm, Binary_Op *binary_op, File_Location location)
 {
     Eval_Result left_result = basm_expr_eval(basm, binary_op->left, location);
@@ -882,58 +1435,59 @@ static Eval_Result basm_binary_op_eval(Basm *basm, Binary_Op *binary_op, File_Lo
     const Type type = left_result.type;
     const Type_Repr repr = type_repr_of(type);
 
+    Eval_Result result = {0};
     switch (binary_op->kind) {
     case BINARY_OP_PLUS: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_plus_repr(left_result.value, right_result.value, repr),
                    type);
     }
     break;
 
     case BINARY_OP_MINUS: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_minus_repr(left_result.value, right_result.value, repr),
                    type);
     }
     break;
 
     case BINARY_OP_MULT: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_mult_repr(left_result.value, right_result.value, repr),
                    type);
     }
     break;
 
     case BINARY_OP_DIV: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_div_repr(left_result.value, right_result.value, repr),
                    type);
     }
     break;
 
     case BINARY_OP_GT: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_gt_repr(left_result.value, right_result.value, repr),
                    TYPE_BOOL);
     }
     break;
 
     case BINARY_OP_LT: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_lt_repr(left_result.value, right_result.value, repr),
                    TYPE_BOOL);
     }
     break;
 
     case BINARY_OP_EQUALS: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_eq_repr(left_result.value, right_result.value, repr),
                    TYPE_BOOL);
     }
     break;
 
     case BINARY_OP_MOD: {
-        return eval_result_ok(
+        result = eval_result_ok(
                    word_mod_repr(left_result.value, right_result.value, repr),
                    type);
     }
@@ -944,6 +1498,16 @@ static Eval_Result basm_binary_op_eval(Basm *basm, Binary_Op *binary_op, File_Lo
         exit(1);
     }
     }
+
+    result.reloc = reloc_of_binary_op(binary_op->kind, left_result.reloc, right_result.reloc);
+    result.mem_base = left_result.reloc == RELOC_MEM_ADDR ? left_result.mem_base : right_result.mem_base;
+    if (result.reloc != left_result.reloc) {
+        basm_depend_on_layout(basm, left_result.reloc, location);
+    }
+    if (result.reloc != right_result.reloc) {
+        basm_depend_on_layout(basm, right_result.reloc, location);
+    }
+    return result;
 }
 
 void funcall_expect_arity(Funcall *funcall, size_t expected_arity, File_Location location)
@@ -984,9 +1548,8 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
     break;
 
     case EXPR_KIND_LIT_STR: {
-        return eval_result_ok(
-                   basm_push_string_to_memory(basm, expr.value.as_lit_str),
-                   TYPE_MEM_ADDR);
+        return eval_result_mem_addr(
+                   basm_push_string_to_memory(basm, expr.value.as_lit_str));
     }
     break;
 
@@ -1026,6 +1589,7 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
                 if (result.status == EVAL_STATUS_DEFERRED) {
                     return result;
                 }
+                basm_depend_on_layout(basm, result.reloc, location);
                 size = result.value;
             }
             args = args->next;
@@ -1036,15 +1600,15 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
                 if (result.status == EVAL_STATUS_DEFERRED) {
                     return result;
                 }
+                basm_depend_on_layout(basm, result.reloc, location);
                 value = result.value;
             }
 
-            return eval_result_ok(
+            return eval_result_mem_addr(
                        basm_push_byte_array_to_memory(
                            basm,
                            size.as_u64,
-                           (uint8_t) value.as_u64),
-                       TYPE_MEM_ADDR);
+                           (uint8_t) value.as_u64));
         } else if (sv_eq(expr.value.as_funcall->name, sv_from_cstr("int32"))) {
             Funcall_Arg *args = expr.value.as_funcall->args;
 
@@ -1056,16 +1620,16 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
                 if (result.status == EVAL_STATUS_DEFERRED) {
                     return result;
                 }
+                basm_depend_on_layout(basm, result.reloc, location);
                 init_value = result.value;
             }
 
             uint32_t byte_array = (uint32_t) init_value.as_u64;
-            return eval_result_ok(
+            return eval_result_mem_addr(
                        basm_push_buffer_to_memory(
                            basm,
                            (uint8_t*) &byte_array,
-                           sizeof(byte_array)),
-                       TYPE_MEM_ADDR);
+                           sizeof(byte_array)));
         } else if (sv_eq(expr.value.as_funcall->name, sv_from_cstr("file"))) {
             funcall_expect_arity(expr.value.as_funcall, 1, location);
 
@@ -1087,9 +1651,16 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
                 exit(1);
             }
 
-            return eval_result_ok(
-                       basm_push_string_to_memory(basm, file_content),
-                       TYPE_MEM_ADDR);
+            file_path = intern_sv(file_path);
+            if (intern_map_get(&basm->embedded_files, file_path) == NULL) {
+                Embedded_File *embedded_file = arena_alloc(&basm->arena, sizeof(*embedded_file));
+                embedded_file->path = file_path;
+                embedded_file->hash = hash_sv(file_content);
+                intern_map_put(&basm->embedded_files, &basm->arena, file_path, embedded_file);
+            }
+
+            return eval_result_mem_addr(
+                       basm_push_string_to_memory(basm, file_content));
         } else {
             Type target_type = TYPE_ANY;
             if (type_by_name(expr.value.as_funcall->name, &target_type)) {
@@ -1101,6 +1672,9 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
                     return result;
                 }
 
+                if (type_repr_of(result.type) != type_repr_of(target_type)) {
+                    basm_depend_on_layout(basm, result.reloc, location);
+                }
                 result.value = convert_type_reprs(
                                    result.value,
                                    type_repr_of(result.type),
@@ -1145,18 +1719,18 @@ Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location)
 
 void basm_push_include_path(Basm *basm, String_View path)
 {
-    assert(basm->include_paths_size < BASM_INCLUDE_PATHS_CAPACITY);
-    basm->include_paths[basm->include_paths_size++] = path;
+    DYNARRAY_PUSH(&basm->arena, basm->include_paths, path);
 }
 
-bool basm_resolve_include_file_path(Basm *basm,
+bool basm_resolve_include_file_path(const Basm *basm,
+                                    Arena *arena,
                                     String_View file_path,
                                     String_View *resolved_path)
 {
-    for (size_t i = 0; i < basm->include_paths_size; ++i) {
-        String_View path = path_join(&basm->arena, basm->include_paths[i],
+    for (size_t i = 0; i < basm->include_paths.size; ++i) {
+        String_View path = path_join(arena, basm->include_paths.items[i],
                                      file_path);
-        if (path_file_exist(arena_sv_to_cstr(&basm->arena, path))) {
+        if (path_file_exist(arena_sv_to_cstr(arena, path))) {
             if (resolved_path) {
                 *resolved_path = path;
             }
@@ -1169,13 +1743,7 @@ bool basm_resolve_include_file_path(Basm *basm,
 
 Macrodef *scope_resolve_macrodef(Scope *scope, String_View name)
 {
-    for (size_t i = 0; i < scope->macrodefs_size; ++i) {
-        if (sv_eq(scope->macrodefs[i].name, name)) {
-            return &scope->macrodefs[i];
-        }
-    }
-
-    return NULL;
+    return intern_map_get(&scope->macrodefs, name);
 }
 
 void scope_add_macrodef(Scope *scope, Macrodef macrodef)
@@ -1190,8 +1758,12 @@ void scope_add_macrodef(Scope *scope, Macrodef macrodef)
         exit(1);
     }
 
-    assert(scope->macrodefs_size < BASM_MACRODEFS_CAPACITY);
-    scope->macrodefs[scope->macrodefs_size++] = macrodef;
+    Macrodef *result = intern_map_spare(&scope->macrodefs);
+    if (result == NULL) {
+        result = arena_alloc(scope->arena, sizeof(*result));
+    }
+    *result = macrodef;
+    intern_map_put(&scope->macrodefs, scope->arena, macrodef.name, result);
 }
 
 void basm_translate_macrocall_statement(Basm *basm, Macrocall_Statement macrocall, File_Location location)
@@ -1203,7 +1775,7 @@ void basm_translate_macrocall_statement(Basm *basm, Macrocall_Statement macrocal
         exit(1);
     }
 
-    Scope *args_scope = arena_alloc(&basm->arena, sizeof(*args_scope));
+    Scope *args_scope = basm_new_scope(basm);
 
     Funcall_Arg *call_args = macrocall.args;
     Fundef_Arg *def_args = macrodef->args;
@@ -1225,11 +1797,15 @@ void basm_translate_macrocall_statement(Basm *basm, Macrocall_Statement macrocal
         }
         assert(result.status == EVAL_STATUS_OK);
 
-        scope_bind_value(args_scope,
-                         def_args->name,
-                         result.value,
-                         result.type,
-                         macrodef->location);
+        scope_add_binding(args_scope, (Binding) {
+            .name = def_args->name,
+            .value = result.value,
+            .status = BINDING_EVALUATED,
+            .type = result.type,
+            .location = macrodef->location,
+            .reloc = result.reloc,
+            .mem_base = result.mem_base,
+        });
 
         call_args = call_args->next;
         def_args = def_args->next;
@@ -1260,6 +1836,7 @@ void basm_translate_macrocall_statement(Basm *basm, Macrocall_Statement macrocal
     basm->scope = macrodef->scope;
     basm_push_scope(basm, args_scope);
     basm_translate_block_statement(basm, macrodef->body);
+    basm_pop_scope(basm);
     basm->scope = saved_scope;
 }
 
@@ -1270,7 +1847,7 @@ void basm_translate_macrodef_statement(Basm *basm, Macrodef_Statement macrodef_s
     macrodef.args = macrodef_statement.args;
     macrodef.body = macrodef_statement.body;
     macrodef.location = location;
-    macrodef.scope = basm->scope;
+    macrodef.scope = basm_capture_scope(basm);
     scope_add_macrodef(basm->scope, macrodef);
 }
 
@@ -1290,20 +1867,47 @@ Macrodef *basm_resolve_macrodef(Basm *basm, String_View name)
 
 Native_ID basm_push_external_native(Basm *basm, String_View native_name)
 {
-    assert(basm->external_natives_size < BM_EXTERNAL_NATIVES_CAPACITY);
     // NOTE: at least one character is reserved for the NULL-terminator
     assert(native_name.count < NATIVE_NAME_CAPACITY - 1);
-    const Native_ID id = basm->external_natives_size++;
-    memset(basm->external_natives[id].name, 0, NATIVE_NAME_CAPACITY);
-    memcpy(basm->external_natives[id].name, native_name.data, native_name.count);
+    const Native_ID id = basm->external_natives.size;
+    External_Native native = {0};
+    memcpy(native.name, native_name.data, native_name.count);
+    DYNARRAY_PUSH(&basm->arena, basm->external_natives, native);
     return id;
 }
 
+static void *basm_grow_program_array(Basm *basm, void *items, size_t item_size, uint64_t allocated)
+{
+    return arena_realloc(&basm->arena, items,
+                         basm->program_allocated * item_size,
+                         allocated * item_size);
+}
+
 Inst_Addr basm_push_inst(Basm *basm, Inst_Type inst_type, Word inst_operand)
 {
-    assert(basm->program_size < BM_PROGRAM_CAPACITY);
+    if (basm->program_size >= basm->program_allocated) {
+        const uint64_t allocated = basm->program_allocated == 0
+                                   ? DYNARRAY_INIT_CAP
+                                   : basm->program_allocated * 2;
+        basm->program = basm_grow_program_array(
+                            basm, basm->program, sizeof(*basm->program), allocated);
+        basm->program_locations = basm_grow_program_array(
+                                      basm, basm->program_locations, sizeof(*basm->program_locations), allocated);
+        basm->program_operand_types = basm_grow_program_array(
+                                          basm, basm->program_operand_types, sizeof(*basm->program_operand_types), allocated);
+        basm->program_relocs = basm_grow_program_array(
+                                   basm, basm->program_relocs, sizeof(*basm->program_relocs), allocated);
+        basm->program_symbols = basm_grow_program_array(
+                                    basm, basm->program_symbols, sizeof(*basm->program_symbols), allocated);
+        basm->program_allocated = allocated;
+    }
+
     const Inst_Addr addr = basm->program_size++;
     basm->program[addr].type = inst_type;
     basm->program[addr].operand = inst_operand;
+    basm->program_locations[addr] = (File_Location) {0};
+    basm->program_operand_types[addr] = TYPE_ANY;
+    basm->program_relocs[addr] = RELOC_NONE;
+    basm->program_symbols[addr] = SV_NULL;
     return addr;
 }
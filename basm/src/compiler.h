@@ -3,19 +3,16 @@
 
 #include "./sv.h"
 #include "./arena.h"
+#include "./intern.h"
 #include "./bm.h"
 #include "./expr.h"
 #include "./statement.h"
 #include "./types.h"
 #include "./target.h"
+#include "./object.h"
 
-#define BASM_BINDINGS_CAPACITY 1024
-#define BASM_MACRODEFS_CAPACITY 1024
-#define BASM_DEFERRED_OPERANDS_CAPACITY 1024
-#define BASM_DEFERRED_ASSERTS_CAPACITY 1024
-#define BASM_STRING_LENGTHS_CAPACITY 1024
 #define BASM_MAX_INCLUDE_LEVEL 69
-#define BASM_INCLUDE_PATHS_CAPACITY 1024
+#define BASM_MAX_JOBS 64
 
 typedef enum {
     OS_TARGET_LINUX = 0,
@@ -40,6 +37,9 @@ typedef struct {
     Expr expr;
     Binding_Status status;
     File_Location location;
+    Reloc_Kind reloc;
+    // NOTE: Eval_Result.mem_base
+    Memory_Addr mem_base;
 } Binding;
 
 typedef struct {
@@ -47,6 +47,34 @@ typedef struct {
     uint64_t length;
 } String_Length;
 
+typedef struct {
+    uint64_t hash;
+    // NOTE: the index of the chunk of the string in Basm.string_lengths
+    size_t chunk;
+} String_Entry;
+
+// NOTE: An open-addressing hash map from the contents of the strings to
+// their chunks. Unlike Intern_Map it looks at the contents, which are
+// already in the memory of the program, so nothing is copied anywhere else.
+typedef struct {
+    String_Entry *items;
+    size_t size;
+    size_t capacity;
+
+    // NOTE: 0 is an empty slot, otherwise it is the index of the entry + 1
+    uint32_t *slots;
+    size_t slots_capacity;
+} String_Map;
+
+// NOTE: the instructions [begin, end) an included file was translated into
+typedef struct {
+    String_View file_path;
+    // NOTE: Source_File.hash
+    uint64_t hash;
+    Inst_Addr begin;
+    Inst_Addr end;
+} Include_Group;
+
 typedef enum {
     EVAL_STATUS_OK = 0,
     EVAL_STATUS_DEFERRED
@@ -57,6 +85,13 @@ typedef struct {
     Binding *deferred_binding;
     Word value;
     Type type;
+    // NOTE: what the value has to be adjusted by when the object is linked
+    Reloc_Kind reloc;
+    // NOTE: the beginning of the chunk of the memory a RELOC_MEM_ADDR value
+    // was computed from. The address right after one chunk is also the
+    // beginning of the next one, so the value alone does not tell which of
+    // them it belongs to.
+    Memory_Addr mem_base;
 } Eval_Result;
 
 Eval_Result eval_result_ok(Word value, Type type);
@@ -72,14 +107,26 @@ typedef struct {
     Scope *scope;
 } Macrodef;
 
+// NOTE: The names of the bindings and the macros must be interned (see
+// ./intern.h), so resolving them within a scope is a hash lookup by pointer.
+//
+// A scope starts empty and its maps grow with the bindings. Once a scope is
+// popped it is reused by the next pushed scope, unless something that
+// outlives it (a deferred operand, a macro definition, etc) has captured it
+// with basm_capture_scope(). So the scopes of the iterations of %for and of
+// the macro calls do not pile up in the arena.
 struct Scope {
     Scope *previous;
-
-    Binding bindings[BASM_BINDINGS_CAPACITY];
-    size_t bindings_size;
-
-    Macrodef macrodefs[BASM_MACRODEFS_CAPACITY];
-    size_t macrodefs_size;
+    Arena *arena;
+    bool captured;
+    // NOTE: unique among all the scopes ever pushed, including the reused
+    // ones (see Source_File.translated_scopes)
+    uint64_t id;
+
+    // NOTE: Binding* in the order they were bound
+    Intern_Map bindings;
+    // NOTE: Macrodef* in the order they were defined
+    Intern_Map macrodefs;
 };
 
 typedef struct {
@@ -87,6 +134,8 @@ typedef struct {
     Expr expr;
     File_Location location;
     Scope *scope;
+    // NOTE: Eval_Result.mem_base of the operand once it is evaluated
+    Memory_Addr mem_base;
 } Deferred_Operand;
 
 typedef struct {
@@ -101,20 +150,81 @@ typedef struct {
     Scope *scope;
 } Deferred_Entry;
 
+typedef struct {
+    String_View binding_name;
+    File_Location location;
+    Scope *scope;
+} Deferred_Export;
+
+// NOTE: A source file is linized and parsed only the first time it is
+// translated, or ahead of time by basm_prefetch_source_files(). The later
+// %include-s of the same resolved path translate the cached tree again. A
+// file with a top level %once directive is not translated again where the
+// names it has bound are already visible, that is when it was translated
+// into the current scope or into one of the scopes around it. Two sibling
+// %scope-s that include it get a copy each.
+typedef struct {
+    String_View path;
+    bool parsed;
+    // NOTE: the hash of the content of the file (see ./cache.h)
+    uint64_t hash;
+    Block_Statement *block;
+    bool once;
+    // NOTE: the Scope.id-s the file was translated into
+    struct {
+        uint64_t *items;
+        size_t size;
+        size_t capacity;
+    } translated_scopes;
+} Source_File;
+
+// NOTE: a file that was put into the memory by file()
+typedef struct {
+    String_View path;
+    uint64_t hash;
+} Embedded_File;
+
+typedef struct {
+    String_View requested_path;
+    String_View resolved_path;
+} Include_Resolution;
+
+// Linizes and parses the file into the arena. Returns false if the file
+// could not be read. Touches nothing but the file and the arena, so
+// different files can be parsed on different threads.
+bool source_file_parse(Source_File *file, Arena *arena);
+
 typedef struct {
     Scope *scope;
     Scope *global_scope;
-
-    Inst program[BM_PROGRAM_CAPACITY];
-    File_Location program_locations[BM_PROGRAM_CAPACITY];
-    Type program_operand_types[BM_PROGRAM_CAPACITY];
+    // NOTE: linked through Scope.previous
+    Scope *free_scopes;
+    uint64_t scopes_count;
+
+    // NOTE: the instructions and what is known about each of them. All the
+    // arrays are allocated in the arena and grow together in
+    // basm_push_inst(), so the program is not limited by
+    // BM_PROGRAM_CAPACITY until it is saved for the bm.
+    Inst *program;
+    File_Location *program_locations;
+    Type *program_operand_types;
+    Reloc_Kind *program_relocs;
+    // NOTE: the names of the symbols of the RELOC_SYMBOL operands
+    String_View *program_symbols;
     uint64_t program_size;
+    uint64_t program_allocated;
 
-    Deferred_Operand deferred_operands[BASM_DEFERRED_OPERANDS_CAPACITY];
-    size_t deferred_operands_size;
+    struct {
+        Deferred_Operand *items;
+        size_t size;
+        size_t capacity;
+    } deferred_operands;
 
-    Deferred_Assert deferred_asserts[BASM_DEFERRED_ASSERTS_CAPACITY];
-    size_t deferred_asserts_size;
+    struct {
+        Deferred_Assert *items;
+        size_t size;
+        size_t capacity;
+    } deferred_asserts;
 
     Deferred_Entry deferred_entry;
 
@@ -122,33 +232,117 @@ typedef struct {
     bool has_entry;
     File_Location entry_location;
 
-    String_Length string_lengths[BASM_STRING_LENGTHS_CAPACITY];
-    size_t string_lengths_size;
-
-    uint8_t memory[BM_MEMORY_CAPACITY];
+    struct {
+        Deferred_Export *items;
+        size_t size;
+        size_t capacity;
+    } deferred_exports;
+
+    struct {
+        Bm_Export *items;
+        size_t size;
+        size_t capacity;
+    } exports;
+
+    struct {
+        String_Length *items;
+        size_t size;
+        size_t capacity;
+    } string_lengths;
+    // NOTE: the chunks of the string literals and the file()-s by their
+    // contents. The same contents are put into the memory only once. Only
+    // valid during the translation.
+    String_Map strings;
+    // NOTE: the strings that ended up at the end of the chunk of a longer
+    // string instead of a chunk of their own (see basm_merge_strings()).
+    // They are not chunks, only the lengths that len() looks up.
+    struct {
+        String_Length *items;
+        size_t size;
+        size_t capacity;
+    } merged_strings;
+
+    // NOTE: `memory_capacity` is the size of the memory the program
+    // expects, `memory_allocated` is how much of the arena the memory
+    // occupies
+    uint8_t *memory;
     size_t memory_size;
     size_t memory_capacity;
+    size_t memory_allocated;
 
-    External_Native external_natives[BM_EXTERNAL_NATIVES_CAPACITY];
-    size_t external_natives_size;
+    struct {
+        External_Native *items;
+        size_t size;
+        size_t capacity;
+    } external_natives;
 
     Arena arena;
 
     size_t include_level;
     File_Location include_location;
 
-    String_View include_paths[BASM_INCLUDE_PATHS_CAPACITY];
-    size_t include_paths_size;
+    // NOTE: Source_File* by the interned path
+    Intern_Map source_files;
+    // NOTE: Embedded_File* by the interned path
+    Intern_Map embedded_files;
+    // NOTE: Include_Resolution* by the interned path an %include requested
+    Intern_Map include_resolutions;
+
+    // NOTE: the amount of threads that parse the source files ahead of the
+    // translation. 0 or 1 parses them lazily on the main thread.
+    size_t jobs;
+    Arena job_arenas[BASM_MAX_JOBS];
+
+    struct {
+        String_View *items;
+        size_t size;
+        size_t capacity;
+    } include_paths;
+
+    // NOTE: translate into a relocatable object (see ./object.h). The names
+    // that are not bound anywhere are allowed as operands and refer to the
+    // symbols of the other objects. The entry point is optional.
+    bool relocatable;
+    // NOTE: the labels of the global scope that become the symbols of the
+    // object
+    struct {
+        Binding **items;
+        size_t size;
+        size_t capacity;
+    } global_labels;
+    // NOTE: the included files of the object, in the order their
+    // translation began. The linker keeps only one copy of the same library
+    // included into several objects.
+    struct {
+        Include_Group *items;
+        size_t size;
+        size_t capacity;
+    } include_groups;
+
+    // NOTE: set when an address of an instruction is used for anything but
+    // an operand that is a label plus or minus a constant, like the
+    // difference between two labels or a value put into the memory. The
+    // instructions of such a program cannot be moved (see ./optimizer.h).
+    bool layout_dependent;
+    File_Location layout_dependent_location;
+    // NOTE: the same for the addresses of the memory. The memory of such a
+    // program cannot be moved.
+    bool memory_layout_dependent;
 } Basm;
 
 Macrodef *scope_resolve_macrodef(Scope *scope, String_View name);
 void scope_add_macrodef(Scope *scope, Macrodef macrodef);
 
 Binding *scope_resolve_binding(Scope *scope, String_View name);
-void scope_bind_value(Scope *scope, String_View name, Word value, Type type, File_Location location);
+Reloc_Kind reloc_of_type(Type type);
+void scope_bind_value(Scope *scope, String_View name, Word value, Type type, Reloc_Kind reloc, File_Location location);
 void scope_defer_binding(Scope *scope, String_View name, Type type, File_Location location);
 void scope_bind_expr(Scope *scope, String_View name, Expr expr, File_Location location);
 
+Scope *basm_new_scope(Basm *basm);
+// Keeps the current scope and all the scopes it can see alive after they are
+// popped. Anything that remembers a scope for later must capture it.
+Scope *basm_capture_scope(Basm *basm);
 void basm_push_scope(Basm *basm, Scope *scope);
 void basm_push_new_scope(Basm *basm);
 void basm_pop_scope(Basm *basm);
@@ -156,6 +350,7 @@ void basm_pop_scope(Basm *basm);
 void basm_eval_deferred_asserts(Basm *basm);
 void basm_eval_deferred_operands(Basm *basm);
 void basm_eval_deferred_entry(Basm *basm);
+void basm_eval_deferred_exports(Basm *basm);
 Binding *basm_resolve_binding(Basm *basm, String_View name);
 void basm_defer_binding(Basm *basm, String_View name, Type type, File_Location location);
 void basm_bind_expr(Basm *basm, String_View name, Expr expr, File_Location location);
@@ -166,6 +361,7 @@ void basm_save_to_file_as_target(Basm *basm, const char *output_file_path, Targe
 void basm_save_to_file_as_bm(Basm *basm, const char *output_file_path);
 void basm_save_to_file_as_nasm_sysv_x86_64(Basm *basm, OS_Target os_target, const char *output_file_path);
 void basm_save_to_file_as_gas_arm64(Basm *basm, OS_Target os_target, const char *output_file_path);
+void basm_save_to_file_as_object(Basm *basm, const char *output_file_path);
 Word basm_push_string_to_memory(Basm *basm, String_View sv);
 Word basm_push_byte_array_to_memory(Basm *basm, uint64_t size, uint8_t value);
 Word basm_push_buffer_to_memory(Basm *basm, uint8_t *buffer, uint64_t buffer_size);
@@ -173,7 +369,9 @@ bool basm_string_length_by_addr(Basm *basm, Inst_Addr addr, Word *length);
 Eval_Result basm_expr_eval(Basm *basm, Expr expr, File_Location location);
 Eval_Result basm_binding_eval(Basm *basm, Binding *binding);
 void basm_push_include_path(Basm *basm, String_View path);
-bool basm_resolve_include_file_path(Basm *basm,
+// NOTE: allocates the resolved path in the provided arena
+bool basm_resolve_include_file_path(const Basm *basm,
+                                    Arena *arena,
                                     String_View file_path,
                                     String_View *resolved_path);
 Macrodef *basm_resolve_macrodef(Basm *basm, String_View name);
@@ -187,8 +385,10 @@ void basm_translate_include_statement(Basm *basm, Include_Statement include, Fil
 void basm_translate_assert_statement(Basm *basm, Assert_Statement azzert, File_Location location);
 void basm_translate_error_statement(Error_Statement error, File_Location location);
 void basm_translate_entry_statement(Basm *basm, Entry_Statement entry, File_Location location);
+void basm_translate_export_statement(Basm *basm, Export_Statement export, File_Location location);
 void basm_translate_emit_inst_statement(Basm *basm, Emit_Inst_Statement emit_inst, File_Location location);
 void basm_translate_for_statement(Basm *basm, For_Statement phor, File_Location location);
+Source_File *basm_parse_source_file(Basm *basm, String_View input_file_path);
 void basm_translate_source_file(Basm *basm, String_View input_file_path);
 void basm_translate_root_source_file(Basm *basm, String_View input_file_path);
 void funcall_expect_arity(Funcall *funcall, size_t expected_arity, File_Location location);
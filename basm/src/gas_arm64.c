@@ -245,8 +245,8 @@ void basm_save_to_file_as_gas_arm64(Basm *basm, OS_Target os_target, const char
         }
         break;
         case INST_NATIVE: {
-            assert(inst.operand.as_u64 < basm->external_natives_size);
-            const char *const name = basm->external_natives[inst.operand.as_u64].name;
+            assert(inst.operand.as_u64 < basm->external_natives.size);
+            const char *const name = basm->external_natives.items[inst.operand.as_u64].name;
 
             fprintf(output, "    // native %s\n", name);
             if (strcmp(name, "write") == 0) {
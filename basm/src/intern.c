@@ -0,0 +1,161 @@
+#include <assert.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
+
+#include "./intern.h"
+#include "./hash.h"
+
+#define INTERN_INIT_CAPACITY 1024
+#define INTERN_MAP_INIT_CAPACITY 8
+
+// NOTE: the interned names live as long as the process does
+static struct {
+    String_View *slots;
+    size_t capacity;
+    size_t size;
+    Arena arena;
+} names = {0};
+
+#ifndef _WIN32
+// NOTE: the source files may be parsed on several threads (see ./prefetch.h)
+static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif // _WIN32
+
+static void intern_grow(void)
+{
+    const size_t new_capacity = names.capacity == 0 ? INTERN_INIT_CAPACITY : names.capacity * 2;
+    String_View *new_slots = calloc(new_capacity, sizeof(*new_slots));
+    assert(new_slots != NULL);
+
+    for (size_t i = 0; i < names.capacity; ++i) {
+        if (names.slots[i].data != NULL) {
+            size_t j = hash_sv(names.slots[i]) & (new_capacity - 1);
+            while (new_slots[j].data != NULL) {
+                j = (j + 1) & (new_capacity - 1);
+            }
+            new_slots[j] = names.slots[i];
+        }
+    }
+
+    free(names.slots);
+    names.slots = new_slots;
+    names.capacity = new_capacity;
+}
+
+String_View intern_sv(String_View sv)
+{
+    if (sv.count == 0) {
+        return SV_NULL;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_lock(&names_lock);
+#endif // _WIN32
+
+    // NOTE: keep the load factor below 1/2
+    if (names.size * 2 >= names.capacity) {
+        intern_grow();
+    }
+
+    size_t i = hash_sv(sv) & (names.capacity - 1);
+    while (names.slots[i].data != NULL && !sv_eq(names.slots[i], sv)) {
+        i = (i + 1) & (names.capacity - 1);
+    }
+
+    if (names.slots[i].data == NULL) {
+        names.slots[i] = arena_sv_dup(&names.arena, sv);
+        names.size += 1;
+    }
+
+    String_View result = names.slots[i];
+
+#ifndef _WIN32
+    pthread_mutex_unlock(&names_lock);
+#endif // _WIN32
+
+    return result;
+}
+
+static size_t intern_map_slot(const char *key, size_t slots_capacity)
+{
+    // NOTE: the keys are unique pointers, so mixing their bits is enough
+    uint64_t hash = (uint64_t) (uintptr_t) key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (size_t) hash & (slots_capacity - 1);
+}
+
+static void intern_map_index(Intern_Map *map, size_t index)
+{
+    size_t i = intern_map_slot(map->keys[index], map->slots_capacity);
+    while (map->slots[i] != 0) {
+        i = (i + 1) & (map->slots_capacity - 1);
+    }
+    map->slots[i] = (uint32_t) index + 1;
+}
+
+void *intern_map_get(const Intern_Map *map, String_View name)
+{
+    if (map->size == 0) {
+        return NULL;
+    }
+
+    size_t i = intern_map_slot(name.data, map->slots_capacity);
+    while (map->slots[i] != 0) {
+        const size_t index = map->slots[i] - 1;
+        if (map->keys[index] == name.data) {
+            return map->values[index];
+        }
+        i = (i + 1) & (map->slots_capacity - 1);
+    }
+
+    return NULL;
+}
+
+void intern_map_put(Intern_Map *map, Arena *arena, String_View name, void *value)
+{
+    assert(intern_map_get(map, name) == NULL);
+
+    if (map->size >= map->capacity) {
+        const size_t new_capacity = map->capacity == 0 ? INTERN_MAP_INIT_CAPACITY : map->capacity * 2;
+        assert(new_capacity <= UINT32_MAX);
+
+        map->keys = arena_realloc(arena, map->keys,
+                                  map->capacity * sizeof(*map->keys),
+                                  new_capacity * sizeof(*map->keys));
+        map->values = arena_realloc(arena, map->values,
+                                    map->capacity * sizeof(*map->values),
+                                    new_capacity * sizeof(*map->values));
+        map->capacity = new_capacity;
+
+        // NOTE: the load factor of the slots stays at most 1/2
+        map->slots_capacity = new_capacity * 2;
+        map->slots = arena_alloc(arena, map->slots_capacity * sizeof(*map->slots));
+        for (size_t index = 0; index < map->size; ++index) {
+            intern_map_index(map, index);
+        }
+    }
+
+    map->keys[map->size] = name.data;
+    map->values[map->size] = value;
+    intern_map_index(map, map->size);
+    map->size += 1;
+}
+
+void intern_map_clear(Intern_Map *map)
+{
+    if (map->size == 0) {
+        return;
+    }
+
+    memset(map->slots, 0, map->slots_capacity * sizeof(*map->slots));
+    map->size = 0;
+}
+
+void *intern_map_spare(const Intern_Map *map)
+{
+    return map->size < map->capacity ? map->values[map->size] : NULL;
+}
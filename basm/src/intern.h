@@ -0,0 +1,46 @@
+#ifndef INTERN_H_
+#define INTERN_H_
+
+#include <stdint.h>
+
+#include "./sv.h"
+#include "./arena.h"
+
+// NOTE: All the identifiers of basm are interned by the tokenizer and the
+// linizer: every distinct name is stored exactly once and all of its
+// occurrences point to that single copy. So two interned names are equal
+// if and only if their data pointers are equal and the hash of a name can be
+// computed from its pointer without looking at the characters.
+String_View intern_sv(String_View sv);
+
+static inline bool interned_eq(String_View a, String_View b)
+{
+    return a.data == b.data;
+}
+
+// NOTE: An open-addressing hash map from interned names to pointers. The
+// entries are kept densely in the insertion order, and `slots` only
+// indexes them, so iterating the map is deterministic and growing it does
+// not move the values the pointers refer to.
+typedef struct {
+    const char **keys;
+    void **values;
+    size_t size;
+    size_t capacity;
+
+    // NOTE: 0 is an empty slot, otherwise it is the index of the entry + 1
+    uint32_t *slots;
+    size_t slots_capacity;
+} Intern_Map;
+
+void *intern_map_get(const Intern_Map *map, String_View name);
+// NOTE: the name must not be in the map yet
+void intern_map_put(Intern_Map *map, Arena *arena, String_View name, void *value);
+// Removes all the entries but keeps the memory of the map. The values that
+// were in it can be picked up again one by one with intern_map_spare().
+void intern_map_clear(Intern_Map *map);
+// The value that occupied the place of the next entry before the map was
+// cleared, or NULL
+void *intern_map_spare(const Intern_Map *map);
+
+#endif // INTERN_H_
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include "./linizer.h"
 #include "./tokenizer.h"
+#include "./intern.h"
 
 const char *line_kind_name(Line_Kind kind)
 {
@@ -83,7 +84,8 @@ bool linizer_peek(Linizer *linizer, Line *output)
     if (sv_starts_with(line, sv_from_cstr("%"))) {
         sv_chop_left(&line, 1);
         result.kind = LINE_KIND_DIRECTIVE;
-        result.value.as_directive.name = sv_trim(sv_chop_left_while(&line, is_name));
+        // NOTE: the names of the directives double as the names of the macros
+        result.value.as_directive.name = intern_sv(sv_trim(sv_chop_left_while(&line, is_name)));
         result.value.as_directive.body = sv_trim(line);
     } else if (sv_ends_with(line, sv_from_cstr(":"))) {
         result.kind = LINE_KIND_LABEL;
@@ -43,8 +43,8 @@ static String_View *precompute_label_locations(Basm *basm)
     String_View *label_locations = arena_alloc(&basm->arena, basm->program_size * sizeof(String_View));
 
     if (basm->global_scope) {
-        for (size_t i = 0; i < basm->global_scope->bindings_size; i++) {
-            Binding *binding = &basm->global_scope->bindings[i];
+        for (size_t i = 0; i < basm->global_scope->bindings.size; i++) {
+            Binding *binding = basm->global_scope->bindings.values[i];
 
             if (binding->type == TYPE_INST_ADDR) {
                 label_locations[binding->value.as_u64] = binding->name;
@@ -69,18 +69,23 @@ void basm_save_to_file_as_nasm_sysv_x86_64(Basm *basm, OS_Target os_target, cons
     fprintf(output, "BITS 64\n");
     fprintf(output, "%%define BM_STACK_CAPACITY %d\n", BM_STACK_CAPACITY);
     fprintf(output, "%%define BM_WORD_SIZE %d\n", BM_WORD_SIZE);
+    fprintf(output, "%%define BM_INPUT_BUFFER_CAPACITY %d\n", BM_INPUT_BUFFER_CAPACITY);
 
     switch (os_target) {
     case OS_TARGET_LINUX: {
         fprintf(output, "%%define SYS_EXIT 60\n");
+        fprintf(output, "%%define SYS_READ 0\n");
         fprintf(output, "%%define SYS_WRITE 1\n");
+        fprintf(output, "%%define STDIN 0\n");
         fprintf(output, "%%define STDOUT 1\n");
         fprintf(output, "%%define ENTRY_POINT _start\n");
     }
     break;
     case OS_TARGET_FREEBSD: {
         fprintf(output, "%%define SYS_EXIT 1\n");
+        fprintf(output, "%%define SYS_READ 3\n");
         fprintf(output, "%%define SYS_WRITE 4\n");
+        fprintf(output, "%%define STDIN 0\n");
         fprintf(output, "%%define STDOUT 1\n");
         fprintf(output, "%%define ENTRY_POINT _start\n");
     }
@@ -96,7 +101,9 @@ void basm_save_to_file_as_nasm_sysv_x86_64(Basm *basm, OS_Target os_target, cons
         // the syscall numbers are actually the same as BSD, but
         // they need to be left-shifted 24 bits for some reason.
         fprintf(output, "%%define SYS_EXIT 0x2000001\n");
+        fprintf(output, "%%define SYS_READ 0x2000003\n");
         fprintf(output, "%%define SYS_WRITE 0x2000004\n");
+        fprintf(output, "%%define STDIN 0\n");
         fprintf(output, "%%define STDOUT 1\n");
         fprintf(output, "%%define ENTRY_POINT _main\n");
     }
@@ -125,6 +132,7 @@ void basm_save_to_file_as_nasm_sysv_x86_64(Basm *basm, OS_Target os_target, cons
     */
 
     size_t jmp_count = 0;
+    bool uses_input = false;
     for (size_t i = 0; i < basm->program_size; ++i) {
         Inst inst = basm->program[i];
 
@@ -277,8 +285,8 @@ stack_push_xmm(output, "xmm1");                         \
         }
         break;
         case INST_NATIVE: {
-            assert(inst.operand.as_u64 < basm->external_natives_size);
-            const char *const name = basm->external_natives[inst.operand.as_u64].name;
+            assert(inst.operand.as_u64 < basm->external_natives.size);
+            const char *const name = basm->external_natives.items[inst.operand.as_u64].name;
 
             fprintf(output, "    ;; native %s\n", name);
             if (strcmp(name, "write") == 0) {
@@ -310,6 +318,14 @@ stack_push_xmm(output, "xmm1");                         \
                 }
                 break;
                 }
+            } else if ((strcmp(name, "read") == 0 || strcmp(name, "read_line") == 0) &&
+                       os_target != OS_TARGET_WINDOWS) {
+                stack_pop(output, "rsi");
+                stack_pop(output, "rdi");
+                fprintf(output, "    add rdi, r14\n");
+                fprintf(output, "    call bm_%s\n", name);
+                stack_push(output, "rax");
+                uses_input = true;
             } else {
                 fprintf(stderr, FL_Fmt": ERROR: unsupported native function `%s`\n",
                         FL_Arg(basm->program_locations[i]),
@@ -597,6 +613,82 @@ fprintf(output, "    mov " size " [rbx + r14], " reg "\n"); \
     }
 
     fprintf(output, "    ret\n");
+
+    if (uses_input) {
+        // NOTE: Mirrors native_read() and native_read_line() of the Virtual
+        // Machine, so `read` and `read_line` can be mixed the same way.
+        // rdi - destination, rsi - count/capacity, rax - the amount of read bytes
+        fprintf(output, "\n");
+        fprintf(output, "bm_read:\n");
+        fprintf(output, "    mov rcx, [REL input_begin]\n");
+        fprintf(output, "    mov rdx, [REL input_end]\n");
+        fprintf(output, "    cmp rcx, rdx\n");
+        fprintf(output, "    jb .buffered\n");
+        fprintf(output, "    mov rdx, rsi\n");
+        fprintf(output, "    mov rsi, rdi\n");
+        fprintf(output, "    mov rdi, STDIN\n");
+        fprintf(output, "    mov rax, SYS_READ\n");
+        fprintf(output, "    syscall\n");
+        fprintf(output, "    test rax, rax\n");
+        fprintf(output, "    jge .end\n");
+        fprintf(output, "    xor eax, eax\n");
+        fprintf(output, ".end:\n");
+        fprintf(output, "    ret\n");
+        fprintf(output, ".buffered:\n");
+        fprintf(output, "    sub rdx, rcx\n");
+        fprintf(output, "    cmp rsi, rdx\n");
+        fprintf(output, "    cmovb rdx, rsi\n");
+        fprintf(output, "    lea rsi, [REL input_buffer]\n");
+        fprintf(output, "    add rsi, rcx\n");
+        fprintf(output, "    add rcx, rdx\n");
+        fprintf(output, "    mov [REL input_begin], rcx\n");
+        fprintf(output, "    mov rax, rdx\n");
+        fprintf(output, "    mov rcx, rdx\n");
+        fprintf(output, "    rep movsb\n");
+        fprintf(output, "    ret\n");
+        fprintf(output, "\n");
+        fprintf(output, "bm_read_line:\n");
+        fprintf(output, "    xor r8, r8\n");
+        fprintf(output, "    mov rcx, [REL input_begin]\n");
+        fprintf(output, "    mov rdx, [REL input_end]\n");
+        fprintf(output, "    lea r9, [REL input_buffer]\n");
+        fprintf(output, ".loop:\n");
+        fprintf(output, "    cmp r8, rsi\n");
+        fprintf(output, "    jae .done\n");
+        fprintf(output, "    cmp rcx, rdx\n");
+        fprintf(output, "    jb .copy\n");
+        fprintf(output, "    push rdi\n");
+        fprintf(output, "    push rsi\n");
+        fprintf(output, "    push r8\n");
+        fprintf(output, "    push r9\n");
+        fprintf(output, "    mov rdi, STDIN\n");
+        fprintf(output, "    mov rsi, r9\n");
+        fprintf(output, "    mov rdx, BM_INPUT_BUFFER_CAPACITY\n");
+        fprintf(output, "    mov rax, SYS_READ\n");
+        fprintf(output, "    syscall\n");
+        fprintf(output, "    pop r9\n");
+        fprintf(output, "    pop r8\n");
+        fprintf(output, "    pop rsi\n");
+        fprintf(output, "    pop rdi\n");
+        fprintf(output, "    xor ecx, ecx\n");
+        fprintf(output, "    xor edx, edx\n");
+        fprintf(output, "    test rax, rax\n");
+        fprintf(output, "    jle .done\n");
+        fprintf(output, "    mov rdx, rax\n");
+        fprintf(output, ".copy:\n");
+        fprintf(output, "    mov al, [r9 + rcx]\n");
+        fprintf(output, "    inc rcx\n");
+        fprintf(output, "    mov [rdi + r8], al\n");
+        fprintf(output, "    inc r8\n");
+        fprintf(output, "    cmp al, 10\n");
+        fprintf(output, "    jne .loop\n");
+        fprintf(output, ".done:\n");
+        fprintf(output, "    mov [REL input_begin], rcx\n");
+        fprintf(output, "    mov [REL input_end], rdx\n");
+        fprintf(output, "    mov rax, r8\n");
+        fprintf(output, "    ret\n");
+    }
+
     fprintf(output, "segment .data\n");
     switch (os_target) {
     case OS_TARGET_WINDOWS:
@@ -656,6 +748,11 @@ fprintf(output, "    mov " size " [rbx + r14], " reg "\n"); \
         exit(1);
     }
     fprintf(output, "stack: resq BM_STACK_CAPACITY\n");
+    if (uses_input) {
+        fprintf(output, "input_begin: resq 1\n");
+        fprintf(output, "input_end: resq 1\n");
+        fprintf(output, "input_buffer: resb BM_INPUT_BUFFER_CAPACITY\n");
+    }
 
     fclose(output);
 }
@@ -0,0 +1,304 @@
+#include <assert.h>
+#include <errno.h>
+
+#include "./compiler.h"
+#include "./object.h"
+#include "./dynarray.h"
+
+typedef struct {
+    char *items;
+    size_t size;
+    size_t capacity;
+} Object_Strings;
+
+static uint64_t object_strings_push(Arena *arena, Object_Strings *strings, String_View sv)
+{
+    const uint64_t offset = strings->size;
+    for (size_t i = 0; i < sv.count; ++i) {
+        DYNARRAY_PUSH(arena, (*strings), sv.data[i]);
+    }
+    DYNARRAY_PUSH(arena, (*strings), '\0');
+    return offset;
+}
+
+static void object_write(FILE *f, const char *file_path, const void *data, size_t size, size_t count)
+{
+    fwrite(data, size, count, f);
+    if (ferror(f)) {
+        fprintf(stderr, "ERROR: Could not write to file `%s`: %s\n",
+                file_path, strerror(errno));
+        exit(1);
+    }
+}
+
+void basm_save_to_file_as_object(Basm *basm, const char *file_path)
+{
+    assert(basm->relocatable);
+
+    Object_Strings strings = {0};
+    // NOTE: the offset 0 is the empty string
+    object_strings_push(&basm->arena, &strings, SV(""));
+
+    Basm_Object_Symbol *symbols =
+        arena_alloc(&basm->arena, (basm->global_labels.size + 1) * sizeof(*symbols));
+    for (size_t i = 0; i < basm->global_labels.size; ++i) {
+        const Binding *label = basm->global_labels.items[i];
+        symbols[i] = (Basm_Object_Symbol) {
+            .name = object_strings_push(&basm->arena, &strings, label->name),
+            .file_path = object_strings_push(&basm->arena, &strings, label->location.file_path),
+            .line_number = (uint64_t) label->location.line_number,
+            .addr = label->value.as_u64,
+        };
+    }
+
+    Basm_Object_Reloc *relocs =
+        arena_alloc(&basm->arena, (basm->program_size + 1) * sizeof(*relocs));
+    size_t relocs_size = 0;
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        const Reloc_Kind kind = basm->program_relocs[addr];
+        if (kind == RELOC_NONE) {
+            continue;
+        }
+        assert(kind != RELOC_INVALID);
+
+        relocs[relocs_size++] = (Basm_Object_Reloc) {
+            .addr = addr,
+            .kind = (uint8_t) kind,
+            .symbol = kind == RELOC_SYMBOL
+                ? object_strings_push(&basm->arena, &strings, basm->program_symbols[addr])
+                : 0,
+        };
+    }
+
+    Basm_Object_Group *groups =
+        arena_alloc(&basm->arena, (basm->include_groups.size + 1) * sizeof(*groups));
+    for (size_t i = 0; i < basm->include_groups.size; ++i) {
+        const Include_Group group = basm->include_groups.items[i];
+        groups[i] = (Basm_Object_Group) {
+            .file_path = object_strings_push(&basm->arena, &strings, group.file_path),
+            .hash = group.hash,
+            .begin = group.begin,
+            .end = group.end,
+        };
+    }
+
+    Basm_Object_Chunk *chunks =
+        arena_alloc(&basm->arena, (basm->string_lengths.size + 1) * sizeof(*chunks));
+    for (size_t i = 0; i < basm->string_lengths.size; ++i) {
+        chunks[i] = (Basm_Object_Chunk) {
+            .addr = basm->string_lengths.items[i].addr,
+            .length = basm->string_lengths.items[i].length,
+        };
+    }
+
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Could not open file `%s`: %s\n",
+                file_path, strerror(errno));
+        exit(1);
+    }
+
+    Basm_Object_Meta meta = {
+        .magic = BASM_OBJECT_MAGIC,
+        .version = BASM_OBJECT_VERSION,
+        .program_size = basm->program_size,
+        .memory_size = basm->memory_size,
+        .has_entry = basm->has_entry,
+        .entry = basm->entry,
+        .externals_size = basm->external_natives.size,
+        .exports_size = basm->exports.size,
+        .symbols_size = basm->global_labels.size,
+        .relocs_size = relocs_size,
+        .groups_size = basm->include_groups.size,
+        .chunks_size = basm->string_lengths.size,
+        .strings_size = strings.size,
+        .layout_dependent = basm->layout_dependent,
+        .memory_layout_dependent = basm->memory_layout_dependent,
+    };
+
+    object_write(f, file_path, &meta, sizeof(meta), 1);
+    object_write(f, file_path, basm->program, sizeof(basm->program[0]), basm->program_size);
+    object_write(f, file_path, basm->memory, sizeof(basm->memory[0]), basm->memory_size);
+    object_write(f, file_path, basm->external_natives.items, sizeof(basm->external_natives.items[0]), basm->external_natives.size);
+    object_write(f, file_path, basm->exports.items, sizeof(basm->exports.items[0]), basm->exports.size);
+    object_write(f, file_path, symbols, sizeof(symbols[0]), basm->global_labels.size);
+    object_write(f, file_path, relocs, sizeof(relocs[0]), relocs_size);
+    object_write(f, file_path, groups, sizeof(groups[0]), basm->include_groups.size);
+    object_write(f, file_path, chunks, sizeof(chunks[0]), basm->string_lengths.size);
+    object_write(f, file_path, strings.items, sizeof(strings.items[0]), strings.size);
+
+    fclose(f);
+}
+
+static void object_corrupted(const char *file_path, const char *reason)
+{
+    fprintf(stderr, "ERROR: %s: corrupted object file: %s\n", file_path, reason);
+    exit(1);
+}
+
+static void *object_section(Arena *arena, const char *file_path,
+                            String_View *content,
+                            size_t size, uint64_t count, uint64_t capacity)
+{
+    if (count > capacity) {
+        object_corrupted(file_path, "a section is too big");
+    }
+
+    const size_t section_size = size * (size_t) count;
+    if (section_size > content->count) {
+        object_corrupted(file_path, "unexpected end of file");
+    }
+
+    // NOTE: the sections are not aligned within the file
+    void *section = arena_alloc(arena, section_size + 1);
+    memcpy(section, content->data, section_size);
+    sv_chop_left(content, section_size);
+    return section;
+}
+
+void basm_object_load(Basm_Object *object, Arena *arena, const char *file_path)
+{
+    memset(object, 0, sizeof(*object));
+    object->file_path = file_path;
+
+    String_View content = {0};
+    if (arena_slurp_file(arena, sv_from_cstr(file_path), &content) != 0) {
+        fprintf(stderr, "ERROR: Could not read file `%s`: %s\n",
+                file_path, strerror(errno));
+        exit(1);
+    }
+
+    if (content.count < sizeof(object->meta)) {
+        object_corrupted(file_path, "unexpected end of file");
+    }
+    memcpy(&object->meta, content.data, sizeof(object->meta));
+    sv_chop_left(&content, sizeof(object->meta));
+
+    const Basm_Object_Meta meta = object->meta;
+    if (meta.magic != BASM_OBJECT_MAGIC) {
+        fprintf(stderr, "ERROR: %s: not a basm object file\n", file_path);
+        exit(1);
+    }
+
+    if (meta.version != BASM_OBJECT_VERSION) {
+        fprintf(stderr, "ERROR: %s: unsupported version of the object file %d. Expected version %d.\n",
+                file_path, meta.version, BASM_OBJECT_VERSION);
+        exit(1);
+    }
+
+    object->program = object_section(arena, file_path, &content,
+                                     sizeof(*object->program), meta.program_size,
+                                     BM_PROGRAM_CAPACITY);
+    object->memory = object_section(arena, file_path, &content,
+                                    sizeof(*object->memory), meta.memory_size,
+                                    BM_MEMORY_CAPACITY);
+    object->externals = object_section(arena, file_path, &content,
+                                       sizeof(*object->externals), meta.externals_size,
+                                       BM_EXTERNAL_NATIVES_CAPACITY);
+    object->exports = object_section(arena, file_path, &content,
+                                     sizeof(*object->exports), meta.exports_size,
+                                     BM_EXPORTS_CAPACITY);
+    object->symbols = object_section(arena, file_path, &content,
+                                     sizeof(*object->symbols), meta.symbols_size,
+                                     content.count);
+    object->relocs = object_section(arena, file_path, &content,
+                                    sizeof(*object->relocs), meta.relocs_size,
+                                    BM_PROGRAM_CAPACITY);
+    object->groups = object_section(arena, file_path, &content,
+                                    sizeof(*object->groups), meta.groups_size,
+                                    content.count);
+    object->chunks = object_section(arena, file_path, &content,
+                                    sizeof(*object->chunks), meta.chunks_size,
+                                    content.count);
+    object->strings = object_section(arena, file_path, &content,
+                                     sizeof(*object->strings), meta.strings_size,
+                                     content.count);
+
+    if (content.count > 0) {
+        object_corrupted(file_path, "unexpected data at the end of file");
+    }
+
+    if (meta.strings_size == 0 || object->strings[meta.strings_size - 1] != '\0') {
+        object_corrupted(file_path, "the strings are not terminated");
+    }
+
+    if (meta.has_entry && meta.entry >= meta.program_size) {
+        object_corrupted(file_path, "the entry point is outside of the program");
+    }
+
+    for (uint64_t i = 0; i < meta.externals_size; ++i) {
+        if (object->externals[i].name[NATIVE_NAME_CAPACITY - 1] != '\0') {
+            object_corrupted(file_path, "the name of a native is not terminated");
+        }
+    }
+
+    for (uint64_t i = 0; i < meta.exports_size; ++i) {
+        if (object->exports[i].name[NATIVE_NAME_CAPACITY - 1] != '\0') {
+            object_corrupted(file_path, "the name of an export is not terminated");
+        }
+        if (object->exports[i].addr >= meta.program_size) {
+            object_corrupted(file_path, "an export is outside of the program");
+        }
+    }
+
+    for (uint64_t i = 0; i < meta.symbols_size; ++i) {
+        const Basm_Object_Symbol symbol = object->symbols[i];
+        if (symbol.name >= meta.strings_size || symbol.file_path >= meta.strings_size) {
+            object_corrupted(file_path, "the name of a symbol is outside of the strings");
+        }
+        // NOTE: a label at the very end of the code is fine
+        if (symbol.addr > meta.program_size) {
+            object_corrupted(file_path, "a symbol is outside of the program");
+        }
+    }
+
+    for (uint64_t i = 0; i < meta.relocs_size; ++i) {
+        const Basm_Object_Reloc reloc = object->relocs[i];
+        if (reloc.addr >= meta.program_size) {
+            object_corrupted(file_path, "a relocation is outside of the program");
+        }
+
+        switch ((Reloc_Kind) reloc.kind) {
+        case RELOC_INST_ADDR:
+        case RELOC_MEM_ADDR:
+            break;
+
+        case RELOC_NATIVE_ID:
+            if (object->program[reloc.addr].operand.as_u64 >= meta.externals_size) {
+                object_corrupted(file_path, "a relocation refers to an unknown native");
+            }
+            break;
+
+        case RELOC_SYMBOL:
+            if (reloc.symbol >= meta.strings_size) {
+                object_corrupted(file_path, "the name of a symbol is outside of the strings");
+            }
+            break;
+
+        case RELOC_NONE:
+        case RELOC_INVALID:
+        default:
+            object_corrupted(file_path, "unknown kind of relocation");
+        }
+    }
+
+    for (uint64_t i = 0; i < meta.groups_size; ++i) {
+        const Basm_Object_Group group = object->groups[i];
+        if (group.file_path >= meta.strings_size) {
+            object_corrupted(file_path, "the path of an include group is outside of the strings");
+        }
+        if (group.begin > group.end || group.end > meta.program_size) {
+            object_corrupted(file_path, "an include group is outside of the program");
+        }
+    }
+
+    Memory_Addr chunks_end = 0;
+    for (uint64_t i = 0; i < meta.chunks_size; ++i) {
+        const Basm_Object_Chunk chunk = object->chunks[i];
+        if (chunk.addr < chunks_end || chunk.addr > meta.memory_size ||
+                chunk.length > meta.memory_size - chunk.addr) {
+            object_corrupted(file_path, "a chunk is outside of the memory or overlaps another one");
+        }
+        chunks_end = chunk.addr + chunk.length;
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef OBJECT_H_
+#define OBJECT_H_
+
+#include "./bm.h"
+#include "./arena.h"
+
+// NOTE: A relocatable object (.bmo) is what `basm -c` produces out of a
+// single source file and what `bmld` links into a .bm file. It contains:
+//
+// - the code of the file, as if it started at the instruction 0,
+// - the memory of the file, as if it started at the address 0,
+// - the natives it declared, in the order of their Native_ID-s,
+// - the exported labels and the entry point (if any),
+// - the symbols: the labels of the global scope that other objects may refer
+//   to,
+// - the relocations: the operands that must be adjusted once the code and the
+//   memory of the object are placed into the final program, and the operands
+//   that refer to the symbols of the other objects,
+// - the include groups: the instructions each included file was translated
+//   into. An object that includes the same library as an object before it
+//   does not need its own copy of the code and bmld drops it,
+// - the chunks: the strings and the arrays the memory is made of. bmld
+//   compares what the memory operands of the include groups point to by
+//   them,
+// - the strings: NULL-terminated names and paths the other sections refer to
+//   by their offsets.
+//
+// All of the sections follow the Basm_Object_Meta in that order.
+
+#define BASM_OBJECT_MAGIC 0xa46f6d62
+#define BASM_OBJECT_VERSION 3
+
+typedef enum {
+    RELOC_NONE = 0,
+    // NOTE: + the address of the first instruction of the object
+    RELOC_INST_ADDR,
+    // NOTE: + the address of the memory of the object
+    RELOC_MEM_ADDR,
+    // NOTE: the native of the object with that Native_ID
+    RELOC_NATIVE_ID,
+    // NOTE: the address of a symbol defined by another object
+    RELOC_SYMBOL,
+    // NOTE: the value depends on the addresses in a way that cannot be
+    // adjusted by the linker, like the sum of two labels. Never written to
+    // the objects.
+    RELOC_INVALID,
+} Reloc_Kind;
+
+PACK(struct Basm_Object_Meta {
+    uint32_t magic;
+    uint16_t version;
+    uint64_t program_size;
+    uint64_t memory_size;
+    uint8_t has_entry;
+    uint64_t entry;
+    uint64_t externals_size;
+    uint64_t exports_size;
+    uint64_t symbols_size;
+    uint64_t relocs_size;
+    uint64_t groups_size;
+    uint64_t chunks_size;
+    uint64_t strings_size;
+    // NOTE: Basm.layout_dependent and Basm.memory_layout_dependent. The code
+    // (the memory) of such an object is never moved within it.
+    uint8_t layout_dependent;
+    uint8_t memory_layout_dependent;
+});
+
+typedef struct Basm_Object_Meta Basm_Object_Meta;
+
+PACK(struct Basm_Object_Symbol {
+    // NOTE: offsets into the strings
+    uint64_t name;
+    uint64_t file_path;
+    uint64_t line_number;
+    Inst_Addr addr;
+});
+
+typedef struct Basm_Object_Symbol Basm_Object_Symbol;
+
+PACK(struct Basm_Object_Reloc {
+    Inst_Addr addr;
+    uint8_t kind;
+    // NOTE: the offset of the name of the symbol in the strings for
+    // RELOC_SYMBOL, otherwise 0
+    uint64_t symbol;
+});
+
+typedef struct Basm_Object_Reloc Basm_Object_Reloc;
+
+PACK(struct Basm_Object_Group {
+    // NOTE: the offset of the path in the strings
+    uint64_t file_path;
+    uint64_t hash;
+    Inst_Addr begin;
+    Inst_Addr end;
+});
+
+typedef struct Basm_Object_Group Basm_Object_Group;
+
+// NOTE: Basm.string_lengths. The chunks are sorted by their addresses and do
+// not overlap.
+PACK(struct Basm_Object_Chunk {
+    Memory_Addr addr;
+    uint64_t length;
+});
+
+typedef struct Basm_Object_Chunk Basm_Object_Chunk;
+
+typedef struct {
+    const char *file_path;
+    Basm_Object_Meta meta;
+    Inst *program;
+    uint8_t *memory;
+    External_Native *externals;
+    Bm_Export *exports;
+    Basm_Object_Symbol *symbols;
+    Basm_Object_Reloc *relocs;
+    Basm_Object_Group *groups;
+    Basm_Object_Chunk *chunks;
+    const char *strings;
+} Basm_Object;
+
+// Reads and validates the object. The sections are copied into the arena.
+// Reports the errors and exits.
+void basm_object_load(Basm_Object *object, Arena *arena, const char *file_path);
+
+#endif // OBJECT_H_
@@ -0,0 +1,670 @@
+#include <assert.h>
+
+#include "./optimizer.h"
+
+static bool optimizer_is_const(const Basm *basm, Inst_Addr addr)
+{
+    return basm->program[addr].type == INST_PUSH && basm->program_relocs[addr] == RELOC_NONE;
+}
+
+static bool optimizer_is_jump(const Basm *basm, Inst_Addr addr)
+{
+    const Inst_Type type = basm->program[addr].type;
+    return (type == INST_JMP || type == INST_JMP_IF || type == INST_CALL) &&
+           basm->program_relocs[addr] == RELOC_INST_ADDR;
+}
+
+// NOTE: the bm multiplies the signed integers as int64_t, so the product
+// must fit into one
+static bool optimizer_multi_overflows(int64_t a, int64_t b)
+{
+    if (a == 0 || b == 0) {
+        return false;
+    }
+
+    if (a > 0) {
+        return b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a;
+    }
+
+    return b > 0 ? a < INT64_MIN / b : a < INT64_MAX / b;
+}
+
+// NOTE: the instruction only computes its output out of its inputs and the
+// bm computes it without running into undefined behavior of C (a signed
+// overflow, a shift by the width of the word and the like) for these inputs,
+// so it can be executed at translation time
+static bool optimizer_can_fold(Inst_Type type, const Word *inputs)
+{
+    switch (type) {
+    case INST_DIVI:
+    case INST_MODI:
+        return !(inputs[0].as_i64 == INT64_MIN && inputs[1].as_i64 == -1);
+
+    case INST_MULTI:
+        return !optimizer_multi_overflows(inputs[0].as_i64, inputs[1].as_i64);
+
+    case INST_SHR:
+    case INST_SHL:
+        return inputs[1].as_u64 < 64;
+
+    case INST_PLUSI:
+    case INST_MINUSI:
+    case INST_MULTU:
+    case INST_DIVU:
+    case INST_MODU:
+    case INST_PLUSF:
+    case INST_MINUSF:
+    case INST_MULTF:
+    case INST_DIVF:
+    case INST_NOT:
+    case INST_EQI:
+    case INST_GEI:
+    case INST_GTI:
+    case INST_LEI:
+    case INST_LTI:
+    case INST_NEI:
+    case INST_EQU:
+    case INST_GEU:
+    case INST_GTU:
+    case INST_LEU:
+    case INST_LTU:
+    case INST_NEU:
+    case INST_EQF:
+    case INST_GEF:
+    case INST_GTF:
+    case INST_LEF:
+    case INST_LTF:
+    case INST_NEF:
+    case INST_ANDB:
+    case INST_ORB:
+    case INST_XOR:
+    case INST_NOTB:
+    case INST_I2F:
+    case INST_U2F:
+        return true;
+
+    // NOTE: out of range conversions of floats are undefined in C
+    case INST_F2I:
+    case INST_F2U:
+    case INST_NOP:
+    case INST_PUSH:
+    case INST_DROP:
+    case INST_DUP:
+    case INST_SWAP:
+    case INST_JMP:
+    case INST_JMP_IF:
+    case INST_RET:
+    case INST_CALL:
+    case INST_NATIVE:
+    case INST_HALT:
+    case INST_READ8U:
+    case INST_READ16U:
+    case INST_READ32U:
+    case INST_READ64U:
+    case INST_READ8I:
+    case INST_READ16I:
+    case INST_READ32I:
+    case INST_READ64I:
+    case INST_WRITE8:
+    case INST_WRITE16:
+    case INST_WRITE32:
+    case INST_WRITE64:
+    case NUMBER_OF_INSTS:
+    default:
+        return false;
+    }
+}
+
+// NOTE: `push 0` or `push 1` followed by the instruction leaves the stack as
+// it was before the `push`
+static bool optimizer_is_identity(Inst_Type type, uint64_t operand)
+{
+    switch (type) {
+    case INST_PLUSI:
+    case INST_MINUSI:
+    case INST_ORB:
+    case INST_XOR:
+    case INST_SHR:
+    case INST_SHL:
+        return operand == 0;
+
+    case INST_MULTI:
+    case INST_MULTU:
+    case INST_DIVI:
+    case INST_DIVU:
+        return operand == 1;
+
+    case INST_NOP:
+    case INST_PUSH:
+    case INST_DROP:
+    case INST_DUP:
+    case INST_SWAP:
+    case INST_MODI:
+    case INST_MODU:
+    case INST_PLUSF:
+    case INST_MINUSF:
+    case INST_MULTF:
+    case INST_DIVF:
+    case INST_JMP:
+    case INST_JMP_IF:
+    case INST_RET:
+    case INST_CALL:
+    case INST_NATIVE:
+    case INST_HALT:
+    case INST_NOT:
+    case INST_EQI:
+    case INST_GEI:
+    case INST_GTI:
+    case INST_LEI:
+    case INST_LTI:
+    case INST_NEI:
+    case INST_EQU:
+    case INST_GEU:
+    case INST_GTU:
+    case INST_LEU:
+    case INST_LTU:
+    case INST_NEU:
+    case INST_EQF:
+    case INST_GEF:
+    case INST_GTF:
+    case INST_LEF:
+    case INST_LTF:
+    case INST_NEF:
+    case INST_ANDB:
+    case INST_NOTB:
+    case INST_READ8U:
+    case INST_READ16U:
+    case INST_READ32U:
+    case INST_READ64U:
+    case INST_READ8I:
+    case INST_READ16I:
+    case INST_READ32I:
+    case INST_READ64I:
+    case INST_WRITE8:
+    case INST_WRITE16:
+    case INST_WRITE32:
+    case INST_WRITE64:
+    case INST_I2F:
+    case INST_U2F:
+    case INST_F2I:
+    case INST_F2U:
+    case NUMBER_OF_INSTS:
+    default:
+        return false;
+    }
+}
+
+// NOTE: the comparison that is the same as the comparison followed by
+// `not`. The comparisons of floats other than `eqf` and `nef` are false for
+// NaN either way, so they have none.
+static const Inst_Type negated_comparisons[NUMBER_OF_INSTS] = {
+    [INST_EQI] = INST_NEI,
+    [INST_NEI] = INST_EQI,
+    [INST_GEI] = INST_LTI,
+    [INST_LTI] = INST_GEI,
+    [INST_GTI] = INST_LEI,
+    [INST_LEI] = INST_GTI,
+    [INST_EQU] = INST_NEU,
+    [INST_NEU] = INST_EQU,
+    [INST_GEU] = INST_LTU,
+    [INST_LTU] = INST_GEU,
+    [INST_GTU] = INST_LEU,
+    [INST_LEU] = INST_GTU,
+    [INST_EQF] = INST_NEF,
+    [INST_NEF] = INST_EQF,
+};
+
+static void optimizer_mark_targets(Optimizer *optimizer, const Basm *basm)
+{
+    memset(optimizer->targets, 0, (basm->program_size + 1) * sizeof(*optimizer->targets));
+
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (basm->program_relocs[addr] == RELOC_INST_ADDR) {
+            optimizer->targets[basm->program[addr].operand.as_u64] = true;
+        }
+    }
+
+    if (basm->has_entry) {
+        optimizer->targets[basm->entry] = true;
+    }
+
+    for (size_t i = 0; i < basm->exports.size; ++i) {
+        optimizer->targets[basm->exports.items[i].addr] = true;
+    }
+
+    for (size_t i = 0; i < basm->global_labels.size; ++i) {
+        optimizer->targets[basm->global_labels.items[i]->value.as_u64] = true;
+    }
+}
+
+// NOTE: `size` instructions starting at `addr` can be rewritten as a whole
+static bool optimizer_window(const Optimizer *optimizer, const Basm *basm,
+                             Inst_Addr addr, size_t size)
+{
+    if (addr + size > basm->program_size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        if (optimizer->deleted[addr + i] || (i > 0 && optimizer->targets[addr + i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void optimizer_delete(Optimizer *optimizer, Inst_Addr addr, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        optimizer->deleted[addr + i] = true;
+    }
+}
+
+static void optimizer_move(Basm *basm, Inst_Addr dst, Inst_Addr src)
+{
+    basm->program[dst] = basm->program[src];
+    basm->program_locations[dst] = basm->program_locations[src];
+    basm->program_operand_types[dst] = basm->program_operand_types[src];
+    basm->program_relocs[dst] = basm->program_relocs[src];
+    basm->program_symbols[dst] = basm->program_symbols[src];
+}
+
+static bool optimizer_thread_jumps(Basm *basm)
+{
+    bool changed = false;
+
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (!optimizer_is_jump(basm, addr)) {
+            continue;
+        }
+
+        Inst_Addr target = basm->program[addr].operand.as_u64;
+        // NOTE: the amount of steps is limited by the size of the program,
+        // because the jumps may form a loop
+        for (uint64_t steps = 0; steps < basm->program_size; ++steps) {
+            if (target >= basm->program_size ||
+                    target == addr ||
+                    basm->program[target].type != INST_JMP ||
+                    !optimizer_is_jump(basm, target)) {
+                break;
+            }
+            target = basm->program[target].operand.as_u64;
+        }
+
+        if (target != basm->program[addr].operand.as_u64) {
+            basm->program[addr].operand.as_u64 = target;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static bool optimizer_fold(Optimizer *optimizer, Basm *basm, Inst_Addr addr)
+{
+    size_t consts = 0;
+    while (consts < 2 &&
+            optimizer_window(optimizer, basm, addr, consts + 1) &&
+            optimizer_is_const(basm, addr + consts)) {
+        consts += 1;
+    }
+
+    for (size_t inputs = consts; inputs > 0; --inputs) {
+        const Inst_Addr op = addr + consts - inputs;
+        if (!optimizer_window(optimizer, basm, op, inputs + 1)) {
+            continue;
+        }
+
+        const Inst inst = basm->program[op + inputs];
+        const Inst_Def def = get_inst_def(inst.type);
+        if (def.has_operand || def.input.size != inputs || def.output.size != 1) {
+            continue;
+        }
+
+        Bm *bm = &optimizer->bm;
+        bm->stack_size = 0;
+        for (size_t i = 0; i < inputs; ++i) {
+            bm->stack[bm->stack_size++] = basm->program[op + i].operand;
+        }
+
+        if (!optimizer_can_fold(inst.type, bm->stack)) {
+            continue;
+        }
+
+        bm->program[0] = inst;
+        bm->program_size = 1;
+        bm->ip = 0;
+        if (bm_execute_inst(bm) != ERR_OK) {
+            continue;
+        }
+        assert(bm->stack_size == 1);
+
+        basm->program[op].operand = bm->stack[0];
+        basm->program_locations[op] = basm->program_locations[op + inputs];
+        basm->program_operand_types[op] = def.output.types[0];
+        optimizer_delete(optimizer, op + 1, inputs);
+        return true;
+    }
+
+    return false;
+}
+
+// NOTE: applies the first rule that matches the instructions starting at
+// `addr`
+static bool optimizer_peephole(Optimizer *optimizer, Basm *basm, Inst_Addr addr)
+{
+    const Inst inst = basm->program[addr];
+
+    if (inst.type == INST_NOP || (inst.type == INST_SWAP && inst.operand.as_u64 == 0)) {
+        optimizer_delete(optimizer, addr, 1);
+        return true;
+    }
+
+    if (inst.type == INST_JMP &&
+            basm->program_relocs[addr] == RELOC_INST_ADDR &&
+            inst.operand.as_u64 == addr + 1) {
+        optimizer_delete(optimizer, addr, 1);
+        return true;
+    }
+
+    if (inst.type == INST_JMP_IF &&
+            basm->program_relocs[addr] == RELOC_INST_ADDR &&
+            inst.operand.as_u64 == addr + 1) {
+        basm->program[addr] = (Inst) {.type = INST_DROP};
+        basm->program_relocs[addr] = RELOC_NONE;
+        return true;
+    }
+
+    if (!optimizer_window(optimizer, basm, addr, 2)) {
+        return false;
+    }
+
+    const Inst next = basm->program[addr + 1];
+
+    if ((inst.type == INST_PUSH || inst.type == INST_DUP) && next.type == INST_DROP) {
+        optimizer_delete(optimizer, addr, 2);
+        return true;
+    }
+
+    if (inst.type == INST_SWAP && next.type == INST_SWAP &&
+            inst.operand.as_u64 == next.operand.as_u64) {
+        optimizer_delete(optimizer, addr, 2);
+        return true;
+    }
+
+    if (negated_comparisons[inst.type] != INST_NOP && next.type == INST_NOT) {
+        basm->program[addr].type = negated_comparisons[inst.type];
+        optimizer_delete(optimizer, addr + 1, 1);
+        return true;
+    }
+
+    if (optimizer_is_const(basm, addr) && optimizer_is_identity(next.type, inst.operand.as_u64)) {
+        optimizer_delete(optimizer, addr, 2);
+        return true;
+    }
+
+    if (optimizer_is_const(basm, addr) && next.type == INST_JMP_IF) {
+        if (inst.operand.as_u64 != 0) {
+            optimizer_move(basm, addr, addr + 1);
+            basm->program[addr].type = INST_JMP;
+            optimizer_delete(optimizer, addr + 1, 1);
+        } else {
+            optimizer_delete(optimizer, addr, 2);
+        }
+        return true;
+    }
+
+    return optimizer_fold(optimizer, basm, addr);
+}
+
+static void optimizer_reach(Optimizer *optimizer, const Basm *basm, Inst_Addr addr, size_t *worklist_size)
+{
+    if (addr < basm->program_size && !optimizer->reachable[addr]) {
+        optimizer->reachable[addr] = true;
+        optimizer->worklist[(*worklist_size)++] = addr;
+    }
+}
+
+// NOTE: marks the instructions that are not reachable from the entry point,
+// the exports and the labels of the object as deleted. The instructions
+// refer to each other by the jumps, the calls and the pushed labels.
+static bool optimizer_delete_unreachable(Optimizer *optimizer, const Basm *basm)
+{
+    memset(optimizer->reachable, 0, basm->program_size * sizeof(*optimizer->reachable));
+    size_t worklist_size = 0;
+
+    if (basm->has_entry) {
+        optimizer_reach(optimizer, basm, basm->entry, &worklist_size);
+    }
+
+    for (size_t i = 0; i < basm->exports.size; ++i) {
+        optimizer_reach(optimizer, basm, basm->exports.items[i].addr, &worklist_size);
+    }
+
+    for (size_t i = 0; i < basm->global_labels.size; ++i) {
+        optimizer_reach(optimizer, basm, basm->global_labels.items[i]->value.as_u64, &worklist_size);
+    }
+
+    while (worklist_size > 0) {
+        const Inst_Addr addr = optimizer->worklist[--worklist_size];
+        const Inst inst = basm->program[addr];
+
+        if (basm->program_relocs[addr] == RELOC_INST_ADDR) {
+            optimizer_reach(optimizer, basm, inst.operand.as_u64, &worklist_size);
+        }
+
+        if (inst.type != INST_JMP && inst.type != INST_RET && inst.type != INST_HALT) {
+            optimizer_reach(optimizer, basm, addr + 1, &worklist_size);
+        }
+    }
+
+    bool deleted = false;
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (!optimizer->reachable[addr]) {
+            optimizer->deleted[addr] = true;
+            deleted = true;
+        }
+    }
+
+    return deleted;
+}
+
+// NOTE: an address right after a chunk is either the end of it or the
+// beginning of the next one. It belongs to the previous chunk only if the
+// next one does not exist.
+static bool optimizer_chunk_owns(const Basm *basm, size_t index, Memory_Addr addr)
+{
+    const String_Length chunk = basm->string_lengths.items[index];
+    if (chunk.addr <= addr && (addr < chunk.addr + chunk.length || addr == chunk.addr)) {
+        return true;
+    }
+
+    if (addr != chunk.addr + chunk.length) {
+        return false;
+    }
+
+    for (size_t i = 0; i < basm->string_lengths.size; ++i) {
+        if (basm->string_lengths.items[i].addr == addr) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// NOTE: the memory consists of the chunks that the strings, the
+// byte_array()-s and the file()-s were put into (see Basm.string_lengths).
+// Only the chunks that the remaining instructions refer to are kept.
+static void optimizer_delete_unused_memory(Optimizer *optimizer, Basm *basm)
+{
+    if (basm->memory_layout_dependent) {
+        return;
+    }
+
+    const size_t chunks_size = basm->string_lengths.size;
+    memset(optimizer->chunks_used, 0, chunks_size * sizeof(*optimizer->chunks_used));
+
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (basm->program_relocs[addr] != RELOC_MEM_ADDR) {
+            continue;
+        }
+
+        const Memory_Addr value = basm->program[addr].operand.as_u64;
+        bool found = false;
+        for (size_t i = 0; i < chunks_size; ++i) {
+            if (optimizer_chunk_owns(basm, i, value)) {
+                optimizer->chunks_used[i] = true;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            return;
+        }
+    }
+
+    Memory_Addr size = 0;
+    size_t kept_size = 0;
+    for (size_t i = 0; i < chunks_size; ++i) {
+        const String_Length chunk = basm->string_lengths.items[i];
+        optimizer->chunk_addrs[i] = size;
+        if (optimizer->chunks_used[i]) {
+            memmove(basm->memory + size, basm->memory + chunk.addr, chunk.length);
+            size += chunk.length;
+        }
+    }
+
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (basm->program_relocs[addr] != RELOC_MEM_ADDR) {
+            continue;
+        }
+
+        Word *operand = &basm->program[addr].operand;
+        for (size_t i = 0; i < chunks_size; ++i) {
+            if (optimizer_chunk_owns(basm, i, operand->as_u64)) {
+                assert(optimizer->chunks_used[i]);
+                operand->as_u64 = optimizer->chunk_addrs[i] + (operand->as_u64 - basm->string_lengths.items[i].addr);
+                break;
+            }
+        }
+    }
+
+    // NOTE: a merged string lies inside of the chunk of the longer string
+    // (see basm_merge_strings()) and moves along with it
+    size_t merged_size = 0;
+    for (size_t i = 0; i < basm->merged_strings.size; ++i) {
+        String_Length string = basm->merged_strings.items[i];
+        for (size_t j = 0; j < chunks_size; ++j) {
+            const String_Length chunk = basm->string_lengths.items[j];
+            if (chunk.addr < string.addr && string.addr < chunk.addr + chunk.length) {
+                if (optimizer->chunks_used[j]) {
+                    string.addr = optimizer->chunk_addrs[j] + (string.addr - chunk.addr);
+                    basm->merged_strings.items[merged_size++] = string;
+                }
+                break;
+            }
+        }
+    }
+    basm->merged_strings.size = merged_size;
+
+    for (size_t i = 0; i < chunks_size; ++i) {
+        if (optimizer->chunks_used[i]) {
+            basm->string_lengths.items[kept_size] = basm->string_lengths.items[i];
+            basm->string_lengths.items[kept_size].addr = optimizer->chunk_addrs[i];
+            kept_size += 1;
+        }
+    }
+    basm->string_lengths.size = kept_size;
+
+    basm->memory_capacity -= basm->memory_size - size;
+    basm->memory_size = size;
+}
+
+static void optimizer_compact(Optimizer *optimizer, Basm *basm)
+{
+    Inst_Addr size = 0;
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        optimizer->addrs[addr] = size;
+        if (!optimizer->deleted[addr]) {
+            optimizer_move(basm, size, addr);
+            size += 1;
+        }
+    }
+    optimizer->addrs[basm->program_size] = size;
+    basm->program_size = size;
+
+    for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+        if (basm->program_relocs[addr] == RELOC_INST_ADDR) {
+            Word *operand = &basm->program[addr].operand;
+            operand->as_u64 = optimizer->addrs[operand->as_u64];
+        }
+    }
+
+    if (basm->has_entry) {
+        basm->entry = optimizer->addrs[basm->entry];
+    }
+
+    for (size_t i = 0; i < basm->exports.size; ++i) {
+        basm->exports.items[i].addr = optimizer->addrs[basm->exports.items[i].addr];
+    }
+
+    for (size_t i = 0; i < basm->global_labels.size; ++i) {
+        Word *value = &basm->global_labels.items[i]->value;
+        value->as_u64 = optimizer->addrs[value->as_u64];
+    }
+    for (size_t i = 0; i < basm->include_groups.size; ++i) {
+        Include_Group *group = &basm->include_groups.items[i];
+        group->begin = optimizer->addrs[group->begin];
+        group->end = optimizer->addrs[group->end];
+    }
+}
+
+void optimizer_optimize(Optimizer *optimizer, Basm *basm)
+{
+    for (Inst_Addr addr = 0; addr < basm->program_size && !basm->layout_dependent; ++addr) {
+        if (basm->program_relocs[addr] == RELOC_INST_ADDR &&
+                basm->program[addr].operand.as_u64 > basm->program_size) {
+            basm->layout_dependent = true;
+            basm->layout_dependent_location = basm->program_locations[addr];
+        }
+    }
+
+    if (basm->layout_dependent) {
+        fprintf(stderr, FL_Fmt": WARNING: the program is not optimized, because it depends on the addresses of its instructions here\n",
+                FL_Arg(basm->layout_dependent_location));
+        return;
+    }
+
+    const size_t program_size = basm->program_size;
+    const size_t chunks_size = basm->string_lengths.size;
+    optimizer->targets = arena_alloc(&basm->arena, (program_size + 1) * sizeof(*optimizer->targets));
+    optimizer->deleted = arena_alloc(&basm->arena, (program_size + 1) * sizeof(*optimizer->deleted));
+    optimizer->addrs = arena_alloc(&basm->arena, (program_size + 1) * sizeof(*optimizer->addrs));
+    optimizer->reachable = arena_alloc(&basm->arena, (program_size + 1) * sizeof(*optimizer->reachable));
+    optimizer->worklist = arena_alloc(&basm->arena, (program_size + 1) * sizeof(*optimizer->worklist));
+    optimizer->chunks_used = arena_alloc(&basm->arena, (chunks_size + 1) * sizeof(*optimizer->chunks_used));
+    optimizer->chunk_addrs = arena_alloc(&basm->arena, (chunks_size + 1) * sizeof(*optimizer->chunk_addrs));
+
+    bool changed = true;
+    while (changed) {
+        changed = optimizer_thread_jumps(basm);
+
+        optimizer_mark_targets(optimizer, basm);
+        memset(optimizer->deleted, 0, basm->program_size * sizeof(*optimizer->deleted));
+
+        bool rewritten = optimizer_delete_unreachable(optimizer, basm);
+        for (Inst_Addr addr = 0; addr < basm->program_size; ++addr) {
+            if (!optimizer->deleted[addr] && optimizer_peephole(optimizer, basm, addr)) {
+                rewritten = true;
+            }
+        }
+
+        if (rewritten) {
+            changed = true;
+            optimizer_compact(optimizer, basm);
+        }
+    }
+
+    optimizer_delete_unused_memory(optimizer, basm);
+}
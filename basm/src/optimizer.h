@@ -0,0 +1,64 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#include "./bm.h"
+#include "./compiler.h"
+
+// NOTE: The optimizer rewrites the translated program until none of its
+// rules apply anymore:
+//
+// - the instructions that do nothing are removed: `nop`, `swap 0`,
+//   `push x; drop`, `dup n; drop`, `swap n; swap n`, `push 0; plusi` and
+//   the like,
+// - a comparison followed by `not` becomes the opposite comparison,
+// - the instructions with constant inputs are folded: `push a; push b; plusi`
+//   becomes `push a+b`. The constants are computed by the bm itself, so the
+//   result is exactly what the program would have computed. The inputs that
+//   C leaves undefined for the instruction, like a `multi` that overflows,
+//   are left for the runtime,
+// - the jumps are threaded: a jump to a `jmp` goes straight to where that
+//   `jmp` goes, a jump to the next instruction is removed and a `jmp_if` of
+//   a constant becomes either a `jmp` or nothing,
+// - the instructions that cannot be reached from the entry point, the
+//   exports or the labels of the object are removed. So are the strings and
+//   the arrays in the memory that the remaining instructions do not refer
+//   to. That is how the unused routines of the included libraries, like
+//   ./lib/std.hasm, are dropped.
+//
+// A rule never spans an instruction that something jumps to, except for the
+// first instruction of the rule. When the instructions are removed the
+// operands that are addresses of the instructions, the entry point, the
+// exports, the labels and the include groups of the object (see ./object.h)
+// are moved along. `bmld -O` optimizes the linked program the same way, so
+// the routines that none of the objects use are dropped there too.
+//
+// The addresses that the program computes at runtime cannot be moved, so the
+// program is expected to jump only to its labels, possibly plus or minus a
+// constant, and to access only the memory of its strings and arrays. A
+// program that uses the addresses of its instructions in any other way at
+// translation time (see Basm.layout_dependent) is not optimized. The same
+// goes for the memory (see Basm.memory_layout_dependent).
+
+typedef struct {
+    // NOTE: all the arrays are indexed by the addresses of the instructions
+    // (or by the index in Basm.string_lengths for the chunks) and are
+    // allocated once the size of the program is known. The program only
+    // shrinks while it is optimized.
+    //
+    // NOTE: something jumps to the instruction or refers to it otherwise
+    bool *targets;
+    bool *deleted;
+    // NOTE: the new addresses of the instructions after the deleted ones are
+    // removed
+    Inst_Addr *addrs;
+    bool *reachable;
+    Inst_Addr *worklist;
+    bool *chunks_used;
+    Memory_Addr *chunk_addrs;
+    // NOTE: folds the constants
+    Bm bm;
+} Optimizer;
+
+void optimizer_optimize(Optimizer *optimizer, Basm *basm);
+
+#endif // OPTIMIZER_H_
@@ -0,0 +1,186 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include <assert.h>
+
+#include "./prefetch.h"
+#include "./dynarray.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct {
+    Source_File **items;
+    size_t size;
+    size_t capacity;
+} Prefetch_Queue;
+
+typedef struct {
+    Basm *basm;
+
+    // NOTE: protects everything below, `basm->source_files` and `basm->arena`
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    Prefetch_Queue queue;
+    size_t queue_head;
+    // NOTE: the files that are being parsed right now and may enqueue more
+    size_t busy;
+} Prefetch;
+
+typedef struct {
+    Prefetch *prefetch;
+    Arena *arena;
+} Prefetch_Job;
+
+// NOTE: must be called with the lock held
+static void prefetch_enqueue(Prefetch *prefetch, String_View path)
+{
+    Basm *basm = prefetch->basm;
+
+    path = intern_sv(path);
+    if (intern_map_get(&basm->source_files, path) != NULL) {
+        return;
+    }
+
+    Source_File *file = arena_alloc(&basm->arena, sizeof(*file));
+    file->path = path;
+    intern_map_put(&basm->source_files, &basm->arena, path, file);
+
+    DYNARRAY_PUSH(&basm->arena, prefetch->queue, file);
+    pthread_cond_signal(&prefetch->cond);
+}
+
+static void prefetch_includes(Prefetch_Job *job, Block_Statement *block)
+{
+    Prefetch *prefetch = job->prefetch;
+
+    for (Block_Statement *iter = block; iter != NULL; iter = iter->next) {
+        const Statement statement = iter->statement;
+        switch (statement.kind) {
+        case STATEMENT_KIND_INCLUDE: {
+            // NOTE: resolved the same way basm_translate_include_statement() does
+            String_View path = statement.value.as_include.path;
+            basm_resolve_include_file_path(prefetch->basm, job->arena, path, &path);
+
+            pthread_mutex_lock(&prefetch->lock);
+            prefetch_enqueue(prefetch, path);
+            pthread_mutex_unlock(&prefetch->lock);
+        }
+        break;
+
+        case STATEMENT_KIND_SCOPE:
+            prefetch_includes(job, statement.value.as_scope);
+            break;
+
+        case STATEMENT_KIND_BLOCK:
+            prefetch_includes(job, statement.value.as_block);
+            break;
+
+        case STATEMENT_KIND_EMIT_INST:
+        case STATEMENT_KIND_LABEL:
+        case STATEMENT_KIND_CONST:
+        case STATEMENT_KIND_NATIVE:
+        case STATEMENT_KIND_ASSERT:
+        case STATEMENT_KIND_ERROR:
+        case STATEMENT_KIND_ENTRY:
+        case STATEMENT_KIND_EXPORT:
+        case STATEMENT_KIND_IF:
+        case STATEMENT_KIND_FOR:
+        case STATEMENT_KIND_FUNCDEF:
+        case STATEMENT_KIND_MACROCALL:
+        case STATEMENT_KIND_MACRODEF:
+        case STATEMENT_KIND_ONCE:
+        default:
+            break;
+        }
+    }
+}
+
+static void *prefetch_job(void *arg)
+{
+    Prefetch_Job *job = arg;
+    Prefetch *prefetch = job->prefetch;
+
+    pthread_mutex_lock(&prefetch->lock);
+    for (;;) {
+        while (prefetch->queue_head >= prefetch->queue.size && prefetch->busy > 0) {
+            pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+        }
+
+        if (prefetch->queue_head >= prefetch->queue.size) {
+            break;
+        }
+
+        Source_File *file = prefetch->queue.items[prefetch->queue_head++];
+        prefetch->busy += 1;
+        pthread_mutex_unlock(&prefetch->lock);
+
+        if (source_file_parse(file, job->arena)) {
+            prefetch_includes(job, file->block);
+        }
+
+        pthread_mutex_lock(&prefetch->lock);
+        prefetch->busy -= 1;
+    }
+    pthread_cond_broadcast(&prefetch->cond);
+    pthread_mutex_unlock(&prefetch->lock);
+
+    return NULL;
+}
+
+void basm_prefetch_source_files(Basm *basm, String_View root_file_path)
+{
+    const size_t jobs_count = basm->jobs < BASM_MAX_JOBS ? basm->jobs : BASM_MAX_JOBS;
+
+    Prefetch prefetch = {
+        .basm = basm,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+    prefetch_enqueue(&prefetch, root_file_path);
+
+    pthread_t threads[BASM_MAX_JOBS];
+    Prefetch_Job jobs[BASM_MAX_JOBS];
+    for (size_t i = 0; i < jobs_count; ++i) {
+        jobs[i] = (Prefetch_Job) {
+            .prefetch = &prefetch,
+            .arena = &basm->job_arenas[i],
+        };
+        int err = pthread_create(&threads[i], NULL, prefetch_job, &jobs[i]);
+        assert(err == 0);
+        (void) err;
+    }
+
+    for (size_t i = 0; i < jobs_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&prefetch.cond);
+    pthread_mutex_destroy(&prefetch.lock);
+}
+
+size_t basm_default_jobs(void)
+{
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        return 1;
+    }
+    return (size_t) n < BASM_MAX_JOBS ? (size_t) n : BASM_MAX_JOBS;
+}
+#else
+void basm_prefetch_source_files(Basm *basm, String_View root_file_path)
+{
+    (void) basm;
+    (void) root_file_path;
+}
+
+size_t basm_default_jobs(void)
+{
+    return 1;
+}
+#endif // _WIN32
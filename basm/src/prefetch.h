@@ -0,0 +1,27 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+
+#include "./compiler.h"
+
+// Linizes and parses the root file and all the files it includes on
+// `basm->jobs` threads ahead of the translation, each thread into its own
+// arena from `basm->job_arenas`, and puts the trees into the cache of
+// basm_parse_source_file(). Only the %include-s that are always translated
+// are followed: the ones at the top level of the files and inside of %scope
+// blocks. The files that could not be read are left for the translation to
+// report. The translation itself stays serial and in the original order, so
+// the output does not depend on the amount of threads.
+//
+// The diagnostics are an exception: a syntax error is reported by the thread
+// that parses the file, and it exits the process while the other threads
+// are still running. If several files are broken which error is printed
+// depends on the timing. Pass `-j 1` to get the first one in the order of
+// the translation.
+//
+// Only POSIX systems are supported. Elsewhere the files are parsed lazily.
+void basm_prefetch_source_files(Basm *basm, String_View root_file_path);
+
+// The amount of the online processors, at most BASM_MAX_JOBS
+size_t basm_default_jobs(void);
+
+#endif // PREFETCH_H_
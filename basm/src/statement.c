@@ -69,12 +69,23 @@ void dump_statement(FILE *stream, Statement statement, int level)
     }
     break;
 
+    case STATEMENT_KIND_ONCE: {
+        fprintf(stream, "%*sOnce\n", level * 2, "");
+    }
+    break;
+
     case STATEMENT_KIND_ENTRY: {
         fprintf(stream, "%*sEntry:\n", level * 2, "");
         dump_expr(stream, statement.value.as_entry.value, level + 1);
     }
     break;
 
+    case STATEMENT_KIND_EXPORT: {
+        fprintf(stream, "%*sExport:\n", level * 2, "");
+        dump_expr(stream, statement.value.as_export.value, level + 1);
+    }
+    break;
+
     case STATEMENT_KIND_BLOCK: {
         dump_block(stream, statement.value.as_block, level);
     }
@@ -237,6 +248,14 @@ int dump_statement_as_dot_edges(FILE *stream, Statement statement, int *counter)
     }
     break;
 
+    case STATEMENT_KIND_ONCE: {
+        int id = (*counter)++;
+        fprintf(stream, "Expr_%d [shape=diamond label=\"%%once\"]\n",
+                id);
+        return id;
+    }
+    break;
+
     case STATEMENT_KIND_ENTRY: {
         int id = (*counter)++;
         fprintf(stream, "Expr_%d [shape=diamond label=\"%%entry\"]\n",
@@ -247,6 +266,16 @@ int dump_statement_as_dot_edges(FILE *stream, Statement statement, int *counter)
     }
     break;
 
+    case STATEMENT_KIND_EXPORT: {
+        int id = (*counter)++;
+        fprintf(stream, "Expr_%d [shape=diamond label=\"%%export\"]\n",
+                id);
+        int child_id = dump_expr_as_dot_edges(stream, statement.value.as_export.value, counter);
+        fprintf(stream, "Expr_%d -> Expr_%d [style=dotted]\n", id, child_id);
+        return id;
+    }
+    break;
+
     case STATEMENT_KIND_BLOCK: {
         return dump_block_as_dot_edges(stream, statement.value.as_block, counter);
     }
@@ -614,6 +643,37 @@ void parse_directive_from_line(Arena *arena, Linizer *linizer, Block_List *outpu
                 exit(1);
             }
 
+            statement.value.as_label.name = expr.value.as_binding;
+            block_list_push(arena, output, statement);
+        }
+    } else if (sv_eq(name, SV("export"))) {
+        body = sv_trim(body);
+        bool inline_export = false;
+
+        if (sv_ends_with(body, sv_from_cstr(":"))) {
+            sv_chop_right(&body, 1);
+            inline_export = true;
+        }
+
+        Expr expr = parse_expr_from_sv(arena, body, line.location);
+        if (expr.kind != EXPR_KIND_BINDING) {
+            fprintf(stderr, FL_Fmt": ERROR: expected binding name for %%export\n",
+                    FL_Arg(location));
+            exit(1);
+        }
+
+        {
+            Statement statement = {0};
+            statement.location = location;
+            statement.kind = STATEMENT_KIND_EXPORT;
+            statement.value.as_export.value = expr;
+            block_list_push(arena, output, statement);
+        }
+
+        if (inline_export) {
+            Statement statement = {0};
+            statement.location = location;
+            statement.kind = STATEMENT_KIND_LABEL;
             statement.value.as_label.name = expr.value.as_binding;
             block_list_push(arena, output, statement);
         }
@@ -625,6 +685,14 @@ void parse_directive_from_line(Arena *arena, Linizer *linizer, Block_List *outpu
         statement.value.as_error.message = parse_lit_str_from_tokens(&tokenizer, arena, location);
         expect_no_tokens(&tokenizer, location);
         block_list_push(arena, output, statement);
+    } else if (sv_eq(name, SV("once"))) {
+        Tokenizer tokenizer = tokenizer_from_sv(body);
+        expect_no_tokens(&tokenizer, location);
+
+        Statement statement = {0};
+        statement.location = location;
+        statement.kind = STATEMENT_KIND_ONCE;
+        block_list_push(arena, output, statement);
     } else if (sv_eq(name, SV("if"))) {
         Expr condition = parse_expr_from_sv(arena, body, location);
         Statement statement =
@@ -18,13 +18,15 @@ typedef enum {
     STATEMENT_KIND_ASSERT,
     STATEMENT_KIND_ERROR,
     STATEMENT_KIND_ENTRY,
+    STATEMENT_KIND_EXPORT,
     STATEMENT_KIND_BLOCK,
     STATEMENT_KIND_IF,
     STATEMENT_KIND_SCOPE,
     STATEMENT_KIND_FOR,
     STATEMENT_KIND_FUNCDEF,
     STATEMENT_KIND_MACROCALL,
-    STATEMENT_KIND_MACRODEF
+    STATEMENT_KIND_MACRODEF,
+    STATEMENT_KIND_ONCE
 } Statement_Kind;
 
 typedef struct {
@@ -61,6 +63,10 @@ typedef struct {
     Expr value;
 } Entry_Statement;
 
+typedef struct {
+    Expr value;
+} Export_Statement;
+
 typedef struct {
     Expr condition;
     Block_Statement *then;
@@ -101,6 +107,7 @@ typedef union {
     Assert_Statement as_assert;
     Error_Statement as_error;
     Entry_Statement as_entry;
+    Export_Statement as_export;
     Block_Statement *as_block;
     If_Statement as_if;
     Block_Statement *as_scope;
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include "./tokenizer.h"
+#include "./intern.h"
 
 bool is_name(char x)
 {
@@ -169,6 +170,7 @@ bool tokenizer_peek(Tokenizer *tokenizer, Token *output, File_Location location)
                 token.kind = TOKEN_KIND_PROC;
             } else {
                 token.kind = TOKEN_KIND_NAME;
+                token.text = intern_sv(token.text);
             }
         } else if (isdigit(*tokenizer->source.data)) {
             token.kind = TOKEN_KIND_NUMBER;
@@ -25,11 +25,9 @@ bool verifier_pop_frame(Verifier *verifier, Frame *output)
     return false;
 }
 
-// TODO(#357): unreachable code elimination
-
 void verifier_verify(Verifier *verifier, const Basm *basm)
 {
-    if (basm->entry >= BM_PROGRAM_CAPACITY) {
+    if (basm->entry >= basm->program_size) {
         fprintf(stderr, FL_Fmt": ERROR: entry point is an illegal instruction address\n",
                 FL_Arg(basm->entry_location));
         exit(1);
@@ -39,9 +37,13 @@ void verifier_verify(Verifier *verifier, const Basm *basm)
     bool halt = false;
 
     while (!halt) {
-        Inst_Def def = get_inst_def(basm->program[ip].type);
+        if (ip >= basm->program_size) {
+            fprintf(stderr, FL_Fmt": ERROR: the execution goes past the end of the program after this instruction\n",
+                    FL_Arg(basm->program_locations[ip - 1]));
+            exit(1);
+        }
 
-        assert(ip < BM_PROGRAM_CAPACITY);
+        Inst_Def def = get_inst_def(basm->program[ip].type);
 
         switch (basm->program[ip].type) {
         case INST_HALT: {
@@ -9,6 +9,7 @@
 #define COMMON_UNITS PATH("..", "common", "sv.c"), \
                      PATH("..", "common", "arena.c")
 #define BM_UNITS PATH("..", "bm", "src", "bm.c"), \
+                 PATH("..", "bm", "src", "channel.c"), \
                  PATH("..", "bm", "src", "types.c")
 #define UNITS COMMON_UNITS, BM_UNITS
 #define LIBS "-lm"
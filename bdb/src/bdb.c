@@ -108,58 +108,75 @@ void bdb_delete_breakpoint(Bdb_State *state, Inst_Addr addr)
     fprintf(stdout, "INFO : Deleted breakpoint at %"PRIu64"\n", addr);
 }
 
-Bdb_Err bdb_continue(Bdb_State *state)
+// NOTE: called before every instruction of bdb_continue(). Returns true if
+// the execution has to stop at the current instruction.
+static bool bdb_break_before(Bdb_State *state, Inst inst)
 {
-    assert(state);
+    if (state->is_in_step_over_mode) {
+        if (inst.type == INST_CALL) {
+            state->step_over_mode_call_depth += 1;
+        } else if (inst.type == INST_RET) {
+            state->step_over_mode_call_depth -= 1;
+        }
+    }
 
-    if (state->bm.halt) {
-        fprintf(stderr, "ERR : Program is not being run\n");
-        return BDB_OK;
+    if (state->breakpoints_size == 0) {
+        return false;
     }
 
-    do {
-        if (state->is_in_step_over_mode) {
-            if (state->bm.program[state->bm.ip].type == INST_CALL) {
-                state->step_over_mode_call_depth += 1;
-            } else if (state->bm.program[state->bm.ip].type == INST_RET) {
-                state->step_over_mode_call_depth -= 1;
-            }
-        }
+    Bdb_Breakpoint *bp = bdb_find_breakpoint_by_addr(state, state->bm.ip);
+    if (bp == NULL) {
+        return false;
+    }
 
-        Bdb_Breakpoint *bp = bdb_find_breakpoint_by_addr(state, state->bm.ip);
-        if (bp != NULL) {
-            if (!bp->is_broken) {
-                fprintf(stdout, "Hit breakpoint at %"PRIu64, state->bm.ip);
+    if (bp->is_broken) {
+        bp->is_broken = 0;
+        return false;
+    }
 
-                if (bp->label.data) {
-                    fprintf(stdout, " label '"SV_Fmt"'", SV_Arg(bp->label));
-                }
+    fprintf(stdout, "Hit breakpoint at %"PRIu64, state->bm.ip);
 
-                fprintf(stdout, "\n");
-                bp->is_broken = 1;
+    if (bp->label.data) {
+        fprintf(stdout, " label '"SV_Fmt"'", SV_Arg(bp->label));
+    }
 
-                state->step_over_mode_call_depth = 0;
-                state->is_in_step_over_mode = 0;
+    fprintf(stdout, "\n");
+    bp->is_broken = 1;
 
-                return BDB_OK;
-            } else {
-                bp->is_broken = 0;
-            }
-        }
+    state->step_over_mode_call_depth = 0;
+    state->is_in_step_over_mode = 0;
 
-        Err err = bm_execute_inst(&state->bm);
-        if (err) {
-            return bdb_fault(state, err);
-        }
+    return true;
+}
 
-        if (state->is_in_step_over_mode &&
-                state->step_over_mode_call_depth == 0) {
-            return BDB_OK;
-        }
+// NOTE: the breakpoint-aware interpreter loop. Stops before a breakpoint
+// and after the instruction that completes a step over.
+#define BM_LOOP_NAME bdb_run
+#define BM_LOOP_UNLIMITED
+#define BM_LOOP_PARAMS , Bdb_State *state
+#define BM_LOOP_BEFORE(bm, inst) \
+    if (bdb_break_before(state, (inst))) return ERR_OK
+#define BM_LOOP_AFTER(bm, inst) \
+    if (state->is_in_step_over_mode && state->step_over_mode_call_depth == 0) return ERR_OK
+#include "./inst_loop.h"
 
-    } while (!state->bm.halt);
+Bdb_Err bdb_continue(Bdb_State *state)
+{
+    assert(state);
 
-    printf("Program halted.\n");
+    if (state->bm.halt) {
+        fprintf(stderr, "ERR : Program is not being run\n");
+        return BDB_OK;
+    }
+
+    Err err = bdb_run(&state->bm, state);
+    if (err) {
+        return bdb_fault(state, err);
+    }
+
+    if (state->bm.halt) {
+        printf("Program halted.\n");
+    }
 
     return BDB_OK;
 }
@@ -292,13 +309,11 @@ Bdb_Err bdb_reset(Bdb_State *state)
     }
 
     for (size_t i = 0; i < state->bm.externals_size; ++i) {
-        if (strcmp(state->bm.externals[i].name, "write") == 0) {
-            bm_push_native(&state->bm, native_write);
-        } else if (strcmp(state->bm.externals[i].name, "external") == 0) {
-            bm_push_native(&state->bm, native_external);
-        } else {
+        Bm_Native native = bm_builtin_native_by_name(state->bm.externals[i].name);
+        if (native == NULL) {
             fprintf(stderr, "TODO(#276): bdb does not support native function loading\n");
         }
+        bm_push_native(&state->bm, native);
     }
 
     return BDB_OK;
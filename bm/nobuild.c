@@ -6,9 +6,18 @@
 #define CFLAGS       COMMON_FLAGS
 #define COMMON_UNITS PATH("..", "common", "sv.c"), \
                      PATH("..", "common", "arena.c"), \
-                     PATH("..", "common", "path.c")
+                     PATH("..", "common", "path.c"), \
+                     PATH("..", "common", "hash.c")
 #define BM_UNITS     PATH("src", "bm.c"), \
+                     PATH("src", "channel.c"), \
+                     PATH("src", "event_loop.c"), \
+                     PATH("src", "image_cache.c"), \
+                     PATH("src", "metrics.c"), \
                      PATH("src", "native_loader.c"), \
+                     PATH("src", "pool.c"), \
+                     PATH("src", "record.c"), \
+                     PATH("src", "snapshot.c"), \
+                     PATH("src", "trace.c"), \
                      PATH("src", "types.c")
 #define UNITS        COMMON_UNITS, \
                      BM_UNITS
@@ -18,11 +27,99 @@
 #define LIBS         "-ldl", "-lm"
 #endif // _WIN32
 
-int main(void)
+// NOTE: libbm is the minimal set of units a host application needs to
+// embed the Virtual Machine: loading, executing and the built-in natives.
+// It does not depend on the dynamic native loader.
+#ifndef _WIN32
+static void build_libbm(void)
+{
+    const char *cc = getenv("CC");
+    if (cc == NULL) {
+        cc = "cc";
+    }
+
+    MKDIRS("bin", "libbm");
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("..", "common", "sv.c"),   "-o", PATH("bin", "libbm", "sv.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("..", "common", "hash.c"), "-o", PATH("bin", "libbm", "hash.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "bm.c"),            "-o", PATH("bin", "libbm", "bm.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "channel.c"),       "-o", PATH("bin", "libbm", "channel.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "event_loop.c"),    "-o", PATH("bin", "libbm", "event_loop.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "image_cache.c"),   "-o", PATH("bin", "libbm", "image_cache.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "metrics.c"),       "-o", PATH("bin", "libbm", "metrics.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "pool.c"),          "-o", PATH("bin", "libbm", "pool.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "record.c"),        "-o", PATH("bin", "libbm", "record.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "snapshot.c"),      "-o", PATH("bin", "libbm", "snapshot.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "trace.c"),         "-o", PATH("bin", "libbm", "trace.o"));
+    CMD(cc, CFLAGS, INCLUDES, "-c", PATH("src", "types.c"),         "-o", PATH("bin", "libbm", "types.o"));
+    CMD("ar", "rcs", PATH("bin", "libbm.a"),
+        PATH("bin", "libbm", "sv.o"),
+        PATH("bin", "libbm", "hash.o"),
+        PATH("bin", "libbm", "bm.o"),
+        PATH("bin", "libbm", "channel.o"),
+        PATH("bin", "libbm", "event_loop.o"),
+        PATH("bin", "libbm", "image_cache.o"),
+        PATH("bin", "libbm", "metrics.o"),
+        PATH("bin", "libbm", "pool.o"),
+        PATH("bin", "libbm", "record.o"),
+        PATH("bin", "libbm", "snapshot.o"),
+        PATH("bin", "libbm", "trace.o"),
+        PATH("bin", "libbm", "types.o"));
+}
+
+// NOTE: every file in the test folder besides test.c is a driver of the
+// embedding API. Each one is linked with libbm.a the way a host application
+// would be and gets bin/test as the folder for the files it creates.
+static void bm_test(void)
+{
+    const char *cc = getenv("CC");
+    if (cc == NULL) {
+        cc = "cc";
+    }
+
+    MKDIRS("bin", "test");
+    FOREACH_FILE_IN_DIR(driver, "test", {
+        if (ENDS_WITH(driver, ".c") && strcmp(driver, "test.c") != 0) {
+            const char *driver_path = PATH("bin", "test", NOEXT(driver));
+            CMD(cc, CFLAGS, INCLUDES, INCLUDE_FLAG("src"),
+                "-o", driver_path,
+                PATH("test", driver),
+                PATH("test", "test.c"),
+                PATH("bin", "libbm.a"),
+                "-lm");
+            CMD(driver_path, PATH("bin", "test"));
+        }
+    });
+}
+#endif // _WIN32
+
+static void build_all_bins(void)
 {
     MKDIRS("bin");
     CC("bin", "bme", PATH("src", "bme.c"));
     CC("bin", "bmr", PATH("src", "bmr.c"));
+    CC("bin", "bmbench", PATH("src", "bmbench.c"));
+    CC("bin", "bmtrace", PATH("src", "bmtrace.c"));
+    CC("bin", "bmstat", PATH("src", "bmstat.c"));
+#ifndef _WIN32
+    build_libbm();
+#endif // _WIN32
+}
+
+int main(int argc, char **argv)
+{
+    build_all_bins();
+
+    if (argc >= 2) {
+        if (strcmp(argv[1], "test") == 0) {
+#ifndef _WIN32
+            bm_test();
+#else
+            PANIC("the tests of libbm are not supported on Windows yet");
+#endif // _WIN32
+        } else {
+            PANIC("unknown subcommand `%s`", argv[1]);
+        }
+    }
 
     return 0;
 }
@@ -1,6 +1,29 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
 #include "./bm.h"
 
-static Inst_Def inst_defs[NUMBER_OF_INSTS] = {
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif // __linux__
+#else
+#include <io.h>
+#include <limits.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // _WIN32
+
+static const Inst_Def inst_defs[NUMBER_OF_INSTS] = {
     [INST_NOP]     = {.type = INST_NOP,     .name = "nop",     .has_operand = false},
     [INST_PUSH]    = {
         .type = INST_PUSH,    .name = "push",    .has_operand = true,
@@ -349,636 +372,1164 @@ const char *err_as_cstr(Err err)
         return "ERR_ILLEGAL_MEMORY_ACCESS";
     case ERR_NULL_NATIVE:
         return "ERR_NULL_NATIVE";
+    case ERR_PENDING:
+        return "ERR_PENDING";
+    case ERR_WAIT_FAILED:
+        return "ERR_WAIT_FAILED";
     default:
         assert(false && "err_as_cstr: Unreachable");
         exit(1);
     }
 }
 
-Err bm_execute_program(Bm *bm, int limit)
+Err bm_suspend(Bm *bm, int fd, Bm_Wait wait, Bm_Completion complete)
 {
-    while (limit != 0 && !bm->halt) {
-        Err err = bm_execute_inst(bm);
-        if (err != ERR_OK) {
-            return err;
-        }
-        if (limit > 0) {
-            --limit;
-        }
+    assert(bm->async);
+    assert(!bm->pending.active);
+    bm->pending.active = true;
+    bm->pending.fd = fd;
+    bm->pending.wait = wait;
+    bm->pending.complete = complete;
+    bm->pending.loop_fd = -1;
+    return ERR_PENDING;
+}
+
+Err bm_resume(Bm *bm)
+{
+    assert(bm->pending.active);
+    bm->pending.active = false;
+
+    Err err = bm->pending.complete(bm);
+    if (err != ERR_OK) {
+        return err;
     }
 
+    bm->ip += 1;
     return ERR_OK;
 }
 
-#define READ_OP(bm, type, out) \
-    do { \
-        if ((bm)->stack_size < 1) { \
-            return ERR_STACK_UNDERFLOW; \
-        } \
-        const Memory_Addr addr = (bm)->stack[(bm)->stack_size - 1].as_u64; \
-        if (addr >= BM_MEMORY_CAPACITY) { \
-            return ERR_ILLEGAL_MEMORY_ACCESS; \
-        } \
-        /* note: since we are relying on some integer widening conversions here, */ \
-        /* we must create a temporary variable so the compiler can do the implicit cast. */ \
-        type tmp; \
-        memcpy(&tmp, &(bm)->memory[addr], sizeof(type)); \
-        (bm)->stack[(bm)->stack_size - 1].as_##out = tmp; \
-        (bm)->ip += 1; \
-    } while(false)
-
-#define BINARY_OP(bm, in, out, op)                                      \
-    do {                                                                \
-        if ((bm)->stack_size < 2) {                                     \
-            return ERR_STACK_UNDERFLOW;                                 \
-        }                                                               \
-                                                                        \
-        (bm)->stack[(bm)->stack_size - 2].as_##out = (bm)->stack[(bm)->stack_size - 2].as_##in op (bm)->stack[(bm)->stack_size - 1].as_##in; \
-        (bm)->stack_size -= 1;                                          \
-        (bm)->ip += 1;                                                  \
-    } while (false)
-
-#define CAST_OP(bm, src, dst, cast)             \
-    do {                                        \
-        if ((bm)->stack_size < 1) {             \
-            return ERR_STACK_UNDERFLOW;         \
-        }                                                               \
-                                                                        \
-        (bm)->stack[(bm)->stack_size - 1].as_##dst = cast (bm)->stack[(bm)->stack_size - 1].as_##src; \
-                                                                        \
-        (bm)->ip += 1;                                                  \
-    } while (false)
-
+Err bm_wait_pending(Bm *bm)
+{
+    assert(bm->pending.active);
+#ifndef _WIN32
+    struct pollfd pfd = {
+        .fd = bm->pending.fd,
+        .events = bm->pending.wait == BM_WAIT_READ ? POLLIN : POLLOUT,
+    };
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {}
+#endif // _WIN32
+    return bm_resume(bm);
+}
 
-Err bm_execute_inst(Bm *bm)
+static uint8_t *bm_memory_span(Bm *bm, Memory_Addr addr, bool write, uint64_t *available)
 {
-    if (bm->ip >= bm->program_size) {
-        return ERR_ILLEGAL_INST_ACCESS;
+    if (addr < BM_MEMORY_CAPACITY) {
+        *available = BM_MEMORY_CAPACITY - addr;
+        return &bm->memory[addr];
     }
 
-    Inst inst = bm->program[bm->ip];
+    const uint64_t offset = addr - BM_WINDOW_ADDR;
+    if (addr < BM_WINDOW_ADDR || offset >= bm->window_size) {
+        return NULL;
+    }
 
-    switch (inst.type) {
-    case INST_NOP:
-        bm->ip += 1;
-        break;
+    // NOTE: the reads do not care about the boundaries between the mappings
+    // since the padding between them is mapped as well
+    if (!write) {
+        *available = bm->window_size - offset;
+        return &bm->window[offset];
+    }
 
-    case INST_PUSH:
-        if (bm->stack_size >= BM_STACK_CAPACITY) {
-            return ERR_STACK_OVERFLOW;
+    for (size_t i = 0; i < bm->mappings_size; ++i) {
+        const Bm_Mapping *mapping = &bm->mappings[i];
+        if (mapping->addr <= addr && addr - mapping->addr < mapping->size) {
+            if (!mapping->writable) {
+                return NULL;
+            }
+            *available = mapping->addr + mapping->size - addr;
+            return &bm->window[offset];
         }
-        bm->stack[bm->stack_size++] = inst.operand;
-        bm->ip += 1;
-        break;
+    }
+
+    return NULL;
+}
+
+static void bm_memory_mark_dirty(Bm *bm, Memory_Addr addr, uint64_t size)
+{
+    if (size == 0) {
+        return;
+    }
 
-    case INST_DROP:
-        if (bm->stack_size < 1) {
-            return ERR_STACK_UNDERFLOW;
+    const uint64_t last = (addr + size - 1) / BM_MEMORY_PAGE_SIZE;
+    for (uint64_t page = addr / BM_MEMORY_PAGE_SIZE; page <= last; ++page) {
+        bm->dirty_pages[page / 64] |= 1ULL << (page % 64);
+    }
+}
+
+uint8_t *bm_memory_range(Bm *bm, Memory_Addr addr, uint64_t size, bool write)
+{
+    if (addr < BM_MEMORY_CAPACITY && size <= BM_MEMORY_CAPACITY - addr) {
+        if (write) {
+            bm_memory_mark_dirty(bm, addr, size);
         }
-        bm->stack_size -= 1;
-        bm->ip += 1;
-        break;
+        return &bm->memory[addr];
+    }
 
-    case INST_PLUSI:
-        BINARY_OP(bm, u64, u64, +);
-        break;
+    uint64_t available = 0;
+    uint8_t *data = bm_memory_span(bm, addr, write, &available);
+    if (data == NULL || size > available) {
+        return NULL;
+    }
 
-    case INST_MINUSI:
-        BINARY_OP(bm, u64, u64, -);
-        break;
+    return data;
+}
 
-    case INST_MULTI:
-        BINARY_OP(bm, i64, i64, *);
-        break;
+const char *bm_memory_cstr(Bm *bm, Memory_Addr addr)
+{
+    uint64_t available = 0;
+    const uint8_t *data = bm_memory_span(bm, addr, false, &available);
+    if (data == NULL || memchr(data, '\0', available) == NULL) {
+        return NULL;
+    }
 
-    case INST_MULTU:
-        BINARY_OP(bm, u64, u64, *);
-        break;
+    return (const char *) data;
+}
 
-    case INST_DIVI: {
-        if (bm->stack[bm->stack_size - 1].as_i64 == 0) {
-            return ERR_DIV_BY_ZERO;
-        }
-        BINARY_OP(bm, i64, i64, /);
+static Err bm_call_native_def_with(Bm *bm, const Bm_Native_Def *def, uint64_t base, const Word *args)
+{
+    Word results[BM_NATIVE_RESULTS_CAPACITY];
+    Err err = def->function(bm, args, results);
+    if (err != ERR_OK) {
+        return err;
     }
-    break;
 
-    case INST_DIVU: {
-        if (bm->stack[bm->stack_size - 1].as_u64 == 0) {
-            return ERR_DIV_BY_ZERO;
-        }
-        BINARY_OP(bm, u64, u64, /);
+    bm->stack_size = base;
+    for (size_t i = 0; i < def->signature.results_size; ++i) {
+        bm->stack[bm->stack_size++] = results[i];
     }
-    break;
 
-    case INST_MODI: {
-        if (bm->stack[bm->stack_size - 1].as_i64 == 0) {
-            return ERR_DIV_BY_ZERO;
-        }
-        BINARY_OP(bm, i64, i64, %);
+    return ERR_OK;
+}
+
+Err bm_call_native_def(Bm *bm, const Bm_Native_Def *def)
+{
+    const Bm_Native_Signature *signature = &def->signature;
+
+    if (bm->stack_size < signature->args_size) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    const uint64_t base = bm->stack_size - signature->args_size;
+    if (base + signature->results_size > BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
     }
-    break;
 
-    case INST_MODU: {
-        if (bm->stack[bm->stack_size - 1].as_u64 == 0) {
-            return ERR_DIV_BY_ZERO;
+    // NOTE: the arguments are passed directly from the stack unless some of
+    // them have to be converted to host pointers
+    const Word *args = &bm->stack[base];
+    Word converted_args[BM_NATIVE_ARGS_CAPACITY];
+    for (size_t i = 0; i < signature->args_size; ++i) {
+        if (signature->args[i].type == TYPE_MEM_ADDR) {
+            if (args != converted_args) {
+                memcpy(converted_args, args, signature->args_size * sizeof(args[0]));
+                args = converted_args;
+            }
+
+            const bool write = !signature->args[i].read_only;
+            const Memory_Addr addr = args[i].as_u64;
+            uint64_t available = 0;
+            uint8_t *data = bm_memory_span(bm, addr, write, &available);
+            if (data == NULL) {
+                return ERR_ILLEGAL_MEMORY_ACCESS;
+            }
+
+            uint64_t size = 0;
+            switch (signature->args[i].size) {
+            case BM_NATIVE_SIZE_NEXT_ARG:
+                size =  bm->stack[base + i + 1].as_u64;
+                break;
+
+            case BM_NATIVE_SIZE_CSTR:
+                if (memchr(data, '\0', available) == NULL) {
+                    return ERR_ILLEGAL_MEMORY_ACCESS;
+                }
+                break;
+
+            default:
+                size = signature->args[i].size;
+            }
+
+            if (size > available) {
+                return ERR_ILLEGAL_MEMORY_ACCESS;
+            }
+
+            // NOTE: the native may write anywhere within the range
+            if (write && addr < BM_MEMORY_CAPACITY) {
+                bm_memory_mark_dirty(bm, addr, size);
+            }
+
+            converted_args[i].as_ptr = data;
         }
-        BINARY_OP(bm, u64, u64, %);
     }
-    break;
 
-    case INST_PLUSF:
-        BINARY_OP(bm, f64, f64, +);
-        break;
+    return bm_call_native_def_with(bm, def, base, args);
+}
 
-    case INST_MINUSF:
-        BINARY_OP(bm, f64, f64, -);
-        break;
+Err bm_call_direct_native_def(Bm *bm, const Bm_Native_Def *def)
+{
+    const uint64_t args_size = def->signature.args_size;
+    if (bm->stack_size < args_size) {
+        return ERR_STACK_UNDERFLOW;
+    }
 
-    case INST_MULTF:
-        BINARY_OP(bm, f64, f64, *);
-        break;
+    const uint64_t base = bm->stack_size - args_size;
+    if (base + def->signature.results_size > BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
 
-    case INST_DIVF:
-        BINARY_OP(bm, f64, f64, /);
-        break;
+    // NOTE: the results are collected aside, since the native may still be
+    // reading the arguments while it writes them
+    Word results[BM_NATIVE_RESULTS_CAPACITY];
+    Err err = def->function(bm, &bm->stack[base], results);
+    if (err != ERR_OK) {
+        return err;
+    }
 
-    case INST_JMP:
-        bm->ip = inst.operand.as_u64;
-        break;
+    bm->stack_size = base;
+    for (size_t i = 0; i < def->signature.results_size; ++i) {
+        bm->stack[bm->stack_size++] = results[i];
+    }
 
-    case INST_RET:
-        if (bm->stack_size < 1) {
-            return ERR_STACK_UNDERFLOW;
-        }
+    return ERR_OK;
+}
+
+Err bm_execute_inst(Bm *bm)
+{
+    if (bm->ip >= bm->program_size) {
+        return ERR_ILLEGAL_INST_ACCESS;
+    }
 
-        bm->ip = bm->stack[bm->stack_size - 1].as_u64;
-        bm->stack_size -= 1;
-        break;
+    Inst inst = bm->program[bm->ip];
 
-    case INST_CALL:
-        if (bm->stack_size >= BM_STACK_CAPACITY) {
-            return ERR_STACK_OVERFLOW;
-        }
+    switch (inst.type) {
+#define BM_INST(type, ...) case type: __VA_ARGS__ break;
+#include "./inst_table.h"
+#undef BM_INST
 
-        bm->stack[bm->stack_size++].as_u64 = bm->ip + 1;
-        bm->ip = inst.operand.as_u64;
-        break;
+    case NUMBER_OF_INSTS:
+    default:
+        return ERR_ILLEGAL_INST;
+    }
 
-    case INST_NATIVE:
-        if (inst.operand.as_u64 > bm->natives_size) {
-            return ERR_ILLEGAL_OPERAND;
-        }
+    return ERR_OK;
+}
 
-        if (!bm->natives[inst.operand.as_u64]) {
-            return ERR_NULL_NATIVE;
+// NOTE: the loop for the programs that run to completion. No hooks and no
+// limit to count down.
+#define BM_LOOP_NAME bm_execute_fast
+#define BM_LOOP_UNLIMITED
+#include "./inst_loop.h"
+
+#define BM_LOOP_NAME bm_execute_checked
+#include "./inst_loop.h"
+
+#define BM_LOOP_NAME bm_execute_counting_loop
+#define BM_LOOP_PARAMS , uint64_t *counts
+#define BM_LOOP_BEFORE(bm, inst) counts[(inst).type] += 1
+#include "./inst_loop.h"
+
+Err bm_execute_program(Bm *bm, int limit)
+{
+    if (limit < 0) {
+        return bm_execute_fast(bm);
+    }
+
+    return bm_execute_checked(bm, limit);
+}
+
+Err bm_execute_counting(Bm *bm, int limit, uint64_t counts[NUMBER_OF_INSTS])
+{
+    return bm_execute_counting_loop(bm, limit, counts);
+}
+
+static bool bm_native_is_builtin(Bm_Native native);
+
+void bm_set_native(Bm *bm, Native_ID id, Bm_Native native)
+{
+    assert(id < BM_NATIVES_CAPACITY);
+    bm->native_defs[id] = NULL;
+    bm->native_defs_direct[id] = false;
+    bm->natives_tracked[id] = bm_native_is_builtin(native);
+    bm->natives[id] = native;
+}
+
+void bm_push_native(Bm *bm, Bm_Native native)
+{
+    assert(bm->natives_size < BM_NATIVES_CAPACITY);
+    bm_set_native(bm, bm->natives_size++, native);
+}
+
+void bm_push_tracked_native(Bm *bm, Bm_Native native)
+{
+    bm_push_native(bm, native);
+    bm->natives_tracked[bm->natives_size - 1] = true;
+}
+
+void bm_memory_mark_all_dirty(Bm *bm)
+{
+    memset(bm->dirty_pages, 0xff, sizeof(bm->dirty_pages));
+}
+
+void bm_set_native_def(Bm *bm, Native_ID id, const Bm_Native_Def *def)
+{
+    assert(id < BM_NATIVES_CAPACITY);
+    assert(def->signature.args_size <= BM_NATIVE_ARGS_CAPACITY);
+    assert(def->signature.results_size <= BM_NATIVE_RESULTS_CAPACITY);
+    bool direct = true;
+    for (size_t i = 0; i < def->signature.args_size; ++i) {
+        assert((def->signature.args[i].size != BM_NATIVE_SIZE_NEXT_ARG || i + 1 < def->signature.args_size) &&
+               "the length of a memory range must be the next argument");
+        if (def->signature.args[i].type == TYPE_MEM_ADDR) {
+            direct = false;
         }
+    }
+    bm->natives[id] = NULL;
+    bm->native_defs_direct[id] = direct;
+    bm->natives_tracked[id] = true;
+    bm->native_defs[id] = def;
+}
+
+void bm_push_native_def(Bm *bm, const Bm_Native_Def *def)
+{
+    assert(bm->natives_size < BM_NATIVES_CAPACITY);
+    bm_set_native_def(bm, bm->natives_size++, def);
+}
 
-        const Err err = bm->natives[inst.operand.as_u64](bm);
-        if (err != ERR_OK) {
-            return err;
+void bm_dump_stack(FILE *stream, const Bm *bm)
+{
+    fprintf(stream, "Stack:\n");
+    if (bm->stack_size > 0) {
+        for (Inst_Addr i = 0; i < bm->stack_size; ++i) {
+            fprintf(stream, "  u64: %" PRIu64 ", i64: %" PRId64 ", f64: %lf, ptr: %p\n",
+                    bm->stack[i].as_u64,
+                    bm->stack[i].as_i64,
+                    bm->stack[i].as_f64,
+                    bm->stack[i].as_ptr);
         }
-        bm->ip += 1;
-        break;
+    } else {
+        fprintf(stream, "  [empty]\n");
+    }
+}
 
-    case INST_HALT:
-        bm->halt = 1;
-        break;
+Bm *bm_create(void)
+{
+    Bm *bm = calloc(1, sizeof(*bm));
+    return bm;
+}
 
-    case INST_EQF:
-        BINARY_OP(bm, f64, u64, ==);
-        break;
+void bm_destroy(Bm *bm)
+{
+    bm_unmap_all(bm);
+    free(bm);
+}
 
-    case INST_GEF:
-        BINARY_OP(bm, f64, u64, >=);
-        break;
+bool bm_error(Bm_Error *error, const char *fmt, ...)
+{
+    if (error) {
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(error->message, sizeof(error->message), fmt, args);
+        va_end(args);
+    }
 
-    case INST_GTF:
-        BINARY_OP(bm, f64, u64, >);
-        break;
+    return false;
+}
 
-    case INST_LEF:
-        BINARY_OP(bm, f64, u64, <=);
-        break;
+bool bm_image_decode(Bm_Image *image, const void *buffer, size_t buffer_size, Bm_Error *error)
+{
+    const uint8_t *data = buffer;
+    Bm_File_Meta meta = {0};
 
-    case INST_LTF:
-        BINARY_OP(bm, f64, u64, <);
-        break;
+    if (buffer_size < sizeof(meta)) {
+        return bm_error(error, "could not read meta data: expected %zu bytes but got only %zu",
+                        sizeof(meta), buffer_size);
+    }
+    memcpy(&meta, data, sizeof(meta));
+    data += sizeof(meta);
+    buffer_size -= sizeof(meta);
 
-    case INST_NEF:
-        BINARY_OP(bm, f64, u64, !=);
-        break;
+    if (meta.magic != BM_FILE_MAGIC) {
+        return bm_error(error,
+                        "does not appear to be a valid BM file. "
+                        "Unexpected magic %04X. Expected %04X.",
+                        meta.magic, BM_FILE_MAGIC);
+    }
 
-    case INST_EQI:
-        BINARY_OP(bm, i64, u64, ==);
-        break;
+    if (meta.version != BM_FILE_VERSION) {
+        return bm_error(error,
+                        "unsupported version of BM file %d. Expected version %d.",
+                        meta.version, BM_FILE_VERSION);
+    }
 
-    case INST_GEI:
-        BINARY_OP(bm, i64, u64, >=);
-        break;
+    if (meta.program_size > BM_PROGRAM_CAPACITY) {
+        return bm_error(error,
+                        "program section is too big. The file contains %" PRIu64 " program instruction. But the capacity is %"  PRIu64,
+                        meta.program_size,
+                        (uint64_t) BM_PROGRAM_CAPACITY);
+    }
 
-    case INST_GTI:
-        BINARY_OP(bm, i64, u64, >);
-        break;
+    if (meta.memory_capacity > BM_MEMORY_CAPACITY) {
+        return bm_error(error,
+                        "memory section is too big. The file wants %" PRIu64 " bytes. But the capacity is %"  PRIu64 " bytes",
+                        meta.memory_capacity,
+                        (uint64_t) BM_MEMORY_CAPACITY);
+    }
+
+    if (meta.memory_size > meta.memory_capacity) {
+        return bm_error(error,
+                        "memory size %"PRIu64" is greater than declared memory capacity %"PRIu64,
+                        meta.memory_size,
+                        meta.memory_capacity);
+    }
 
-    case INST_LEI:
-        BINARY_OP(bm, i64, u64, <=);
-        break;
+    if (meta.externals_size > BM_EXTERNAL_NATIVES_CAPACITY) {
+        return bm_error(error,
+                        "external names section is too big. The file contains %" PRIu64 " external names. But the capacity is %"  PRIu64 " external names",
+                        meta.externals_size,
+                        (uint64_t) BM_EXTERNAL_NATIVES_CAPACITY);
+    }
 
-    case INST_LTI:
-        BINARY_OP(bm, i64, u64, <);
-        break;
+    if (meta.exports_size > BM_EXPORTS_CAPACITY) {
+        return bm_error(error,
+                        "exports section is too big. The file contains %" PRIu64 " exports. But the capacity is %"  PRIu64 " exports",
+                        meta.exports_size,
+                        (uint64_t) BM_EXPORTS_CAPACITY);
+    }
 
-    case INST_NEI:
-        BINARY_OP(bm, i64, u64, !=);
-        break;
+    const size_t program_bytes = meta.program_size * sizeof(Inst);
+    if (buffer_size < program_bytes) {
+        return bm_error(error, "read %zu program instructions, but expected %"PRIu64,
+                        buffer_size / sizeof(Inst),
+                        meta.program_size);
+    }
+    image->program = data;
+    data += program_bytes;
+    buffer_size -= program_bytes;
+
+    if (buffer_size < meta.memory_size) {
+        return bm_error(error, "read %zu bytes of memory section, but expected %"PRIu64" bytes.",
+                        buffer_size,
+                        meta.memory_size);
+    }
+    image->memory = data;
+    data += meta.memory_size;
+    buffer_size -= meta.memory_size;
+
+    const size_t externals_bytes = meta.externals_size * sizeof(External_Native);
+    if (buffer_size < externals_bytes) {
+        return bm_error(error, "read %zu external names, but expected %"PRIu64,
+                        buffer_size / sizeof(External_Native),
+                        meta.externals_size);
+    }
+    image->externals = data;
+    data += externals_bytes;
+    buffer_size -= externals_bytes;
+
+    const size_t exports_bytes = meta.exports_size * sizeof(Bm_Export);
+    if (buffer_size < exports_bytes) {
+        return bm_error(error, "read %zu exports, but expected %"PRIu64,
+                        buffer_size / sizeof(Bm_Export),
+                        meta.exports_size);
+    }
+    image->exports = data;
 
-    case INST_EQU:
-        BINARY_OP(bm, u64, u64, ==);
-        break;
+    image->meta = meta;
 
-    case INST_GEU:
-        BINARY_OP(bm, u64, u64, >=);
-        break;
+    return true;
+}
 
-    case INST_GTU:
-        BINARY_OP(bm, u64, u64, >);
-        break;
+// NOTE: the input stays attached to the same fd, but whatever the previous
+// run has buffered from it is dropped. An operation that was left pending is
+// forgotten and the context is synchronous again until the host says
+// otherwise (see bm_event_loop_spawn()).
+static void bm_reset_runtime_state(Bm *bm, Inst_Addr entry)
+{
+    bm->stack_size = 0;
+    bm->ip = entry;
+    bm->halt = false;
+    bm->input.begin = 0;
+    bm->input.end = 0;
+    bm->async = false;
+    bm->pending = (Bm_Pending) {
+        .fd = -1,
+        .loop_fd = -1,
+    };
+}
 
-    case INST_LEU:
-        BINARY_OP(bm, u64, u64, <=);
-        break;
+void bm_image_install(Bm *bm, const Bm_Image *image)
+{
+    const Bm_File_Meta *meta = &image->meta;
 
-    case INST_LTU:
-        BINARY_OP(bm, u64, u64, <);
-        break;
+    bm_unmap_all(bm);
 
-    case INST_NEU:
-        BINARY_OP(bm, u64, u64, !=);
-        break;
+    memcpy(bm->program, image->program, meta->program_size * sizeof(bm->program[0]));
+    bm->program_size = meta->program_size;
 
-    case INST_JMP_IF:
-        if (bm->stack_size < 1) {
-            return ERR_STACK_UNDERFLOW;
-        }
+    memcpy(bm->memory, image->memory, meta->memory_size);
+    // NOTE: the program is allowed to access the memory beyond the memory
+    // section of the file and expects it to be zero initialized
+    memset(bm->memory + meta->memory_size, 0, BM_MEMORY_CAPACITY - meta->memory_size);
+    bm->expected_memory_size = meta->memory_size;
+    memset(bm->dirty_pages, 0, sizeof(bm->dirty_pages));
 
-        if (bm->stack[bm->stack_size - 1].as_u64) {
-            bm->ip = inst.operand.as_u64;
-        } else {
-            bm->ip += 1;
-        }
+    memcpy(bm->externals, image->externals, meta->externals_size * sizeof(bm->externals[0]));
+    bm->externals_size = meta->externals_size;
 
-        bm->stack_size -= 1;
-        break;
+    memcpy(bm->exports, image->exports, meta->exports_size * sizeof(bm->exports[0]));
+    bm->exports_size = meta->exports_size;
 
-    case INST_DUP:
-        if (bm->stack_size >= BM_STACK_CAPACITY) {
-            return ERR_STACK_OVERFLOW;
-        }
+    // NOTE: only the runtime state is reset here instead of the whole
+    // structure. The rest of the arrays are bounded by their sizes.
+    bm->natives_size = 0;
+    bm_reset_runtime_state(bm, meta->entry);
+}
 
-        if (bm->stack_size - inst.operand.as_u64 <= 0) {
-            return ERR_STACK_UNDERFLOW;
-        }
+size_t bm_image_reset(Bm *bm, const Bm_Image *image)
+{
+    const size_t memory_size = image->meta.memory_size;
+    size_t restored = 0;
 
-        bm->stack[bm->stack_size] = bm->stack[bm->stack_size - 1 - inst.operand.as_u64];
-        bm->stack_size += 1;
-        bm->ip += 1;
-        break;
+    bm_unmap_all(bm);
 
-    case INST_SWAP:
-        if (inst.operand.as_u64 >= bm->stack_size) {
-            return ERR_STACK_UNDERFLOW;
+    for (size_t page = 0; page < BM_MEMORY_PAGES_COUNT; ++page) {
+        if (bm->dirty_pages[page / 64] == 0) {
+            page += 63;
+            continue;
         }
 
-        const uint64_t a = bm->stack_size - 1;
-        const uint64_t b = bm->stack_size - 1 - inst.operand.as_u64;
-
-        Word t = bm->stack[a];
-        bm->stack[a] = bm->stack[b];
-        bm->stack[b] = t;
-        bm->ip += 1;
-        break;
+        if (!(bm->dirty_pages[page / 64] & (1ULL << (page % 64)))) {
+            continue;
+        }
 
-    case INST_NOT:
-        if (bm->stack_size < 1) {
-            return ERR_STACK_UNDERFLOW;
+        const size_t begin = page * BM_MEMORY_PAGE_SIZE;
+        const size_t end = begin + BM_MEMORY_PAGE_SIZE < BM_MEMORY_CAPACITY
+                           ? begin + BM_MEMORY_PAGE_SIZE
+                           : BM_MEMORY_CAPACITY;
+        const size_t copied = end < memory_size ? end : memory_size;
+        if (begin < copied) {
+            memcpy(bm->memory + begin, image->memory + begin, copied - begin);
+            memset(bm->memory + copied, 0, end - copied);
+        } else {
+            memset(bm->memory + begin, 0, end - begin);
         }
+        restored += 1;
+    }
+    memset(bm->dirty_pages, 0, sizeof(bm->dirty_pages));
 
-        bm->stack[bm->stack_size - 1].as_u64 = !bm->stack[bm->stack_size - 1].as_u64;
-        bm->ip += 1;
-        break;
+    bm_reset_runtime_state(bm, image->meta.entry);
 
-    case INST_ANDB:
-        BINARY_OP(bm, u64, u64, &);
-        break;
+    return restored;
+}
 
-    case INST_ORB:
-        BINARY_OP(bm, u64, u64, |);
-        break;
+bool bm_load_program_from_memory(Bm *bm, const void *buffer, size_t buffer_size, Bm_Error *error)
+{
+    Bm_Image image = {0};
+    if (!bm_image_decode(&image, buffer, buffer_size, error)) {
+        return false;
+    }
+    bm_image_install(bm, &image);
+    return true;
+}
 
-    case INST_XOR:
-        BINARY_OP(bm, u64, u64, ^);
-        break;
+bool bm_slurp_file(const char *file_path, uint8_t **data, size_t *size, Bm_Error *error)
+{
+    FILE *f = fopen(file_path, "rb");
+    if (f == NULL) {
+        return bm_error(error, "Could not open file `%s`: %s",
+                        file_path, strerror(errno));
+    }
 
-    case INST_SHR:
-        BINARY_OP(bm, u64, u64, >>);
-        break;
+    if (fseek(f, 0, SEEK_END) < 0) {
+        fclose(f);
+        return bm_error(error, "Could not read file `%s`: %s",
+                        file_path, strerror(errno));
+    }
 
-    case INST_SHL:
-        BINARY_OP(bm, u64, u64, <<);
-        break;
+    long m = ftell(f);
+    if (m < 0 || fseek(f, 0, SEEK_SET) < 0) {
+        fclose(f);
+        return bm_error(error, "Could not read file `%s`: %s",
+                        file_path, strerror(errno));
+    }
 
-    case INST_NOTB:
-        if (bm->stack_size < 1) {
-            return ERR_STACK_UNDERFLOW;
-        }
+    uint8_t *buffer = malloc((size_t) m);
+    if (buffer == NULL && m > 0) {
+        fclose(f);
+        return bm_error(error, "Could not allocate %ld bytes for file `%s`",
+                        m, file_path);
+    }
 
-        bm->stack[bm->stack_size - 1].as_u64 = ~bm->stack[bm->stack_size - 1].as_u64;
-        bm->ip += 1;
-        break;
+    size_t n = fread(buffer, 1, (size_t) m, f);
+    if (ferror(f)) {
+        free(buffer);
+        fclose(f);
+        return bm_error(error, "Could not read file `%s`: %s",
+                        file_path, strerror(errno));
+    }
+    fclose(f);
 
-    case INST_READ8U:
-        READ_OP(bm, uint8_t, u64);
-        break;
+    *data = buffer;
+    *size = n;
 
-    case INST_READ16U:
-        READ_OP(bm, uint16_t, u64);
-        break;
+    return true;
+}
+
+bool bm_try_load_program_from_file(Bm *bm, const char *file_path, Bm_Error *error)
+{
+    uint8_t *buffer = NULL;
+    size_t buffer_size = 0;
+    if (!bm_slurp_file(file_path, &buffer, &buffer_size, error)) {
+        return false;
+    }
 
-    case INST_READ32U:
-        READ_OP(bm, uint32_t, u64);
-        break;
+    Bm_Error load_error = {0};
+    bool ok = bm_load_program_from_memory(bm, buffer, buffer_size, &load_error);
+    free(buffer);
 
-    case INST_READ64U:
-        READ_OP(bm, uint64_t, u64);
-        break;
+    if (!ok) {
+        return bm_error(error, "%s: %s", file_path, load_error.message);
+    }
 
-    case INST_READ8I:
-        READ_OP(bm, int8_t, i64);
-        break;
+    return true;
+}
 
-    case INST_READ16I:
-        READ_OP(bm, int16_t, i64);
-        break;
+void bm_load_program_from_file(Bm *bm, const char *file_path)
+{
+    Bm_Error error = {0};
+    if (!bm_try_load_program_from_file(bm, file_path, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+}
 
-    case INST_READ32I:
-        READ_OP(bm, int32_t, i64);
-        break;
+static const struct {
+    const char *name;
+    Bm_Native native;
+} bm_builtin_natives[] = {
+    {"write",           native_write},
+    {"read",            native_read},
+    {"read_line",       native_read_line},
+    {"map_file",        native_map_file},
+    {"sleep",           native_sleep},
+    {"snapshot",        native_snapshot},
+    {"channel_open",    native_channel_open},
+    {"channel_acquire", native_channel_acquire},
+    {"channel_publish", native_channel_publish},
+    {"channel_peek",    native_channel_peek},
+    {"channel_release", native_channel_release},
+    {"channel_wait",    native_channel_wait},
+    {"channel_close",   native_channel_close},
+    {"external",        native_external},
+};
 
-    case INST_READ64I:
-        READ_OP(bm, int64_t, i64);
-        break;
+#define BM_BUILTIN_NATIVES_COUNT (sizeof(bm_builtin_natives) / sizeof(bm_builtin_natives[0]))
 
-    case INST_WRITE8: {
-        if (bm->stack_size < 2) {
-            return ERR_STACK_UNDERFLOW;
-        }
-        const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
-        if (addr >= BM_MEMORY_CAPACITY) {
-            return ERR_ILLEGAL_MEMORY_ACCESS;
+Bm_Native bm_builtin_native_by_name(const char *name)
+{
+    for (size_t i = 0; i < BM_BUILTIN_NATIVES_COUNT; ++i) {
+        if (strcmp(name, bm_builtin_natives[i].name) == 0) {
+            return bm_builtin_natives[i].native;
         }
-        bm->memory[addr] = (uint8_t) bm->stack[bm->stack_size - 1].as_u64;
-        bm->stack_size -= 2;
-        bm->ip += 1;
     }
-    break;
 
-    case INST_WRITE16: {
-        if (bm->stack_size < 2) {
-            return ERR_STACK_UNDERFLOW;
-        }
-        const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
-        if (addr >= BM_MEMORY_CAPACITY - 1) {
-            return ERR_ILLEGAL_MEMORY_ACCESS;
+    return NULL;
+}
+
+// NOTE: all the built-in natives access the memory through bm_memory_range()
+static bool bm_native_is_builtin(Bm_Native native)
+{
+    for (size_t i = 0; i < BM_BUILTIN_NATIVES_COUNT; ++i) {
+        if (bm_builtin_natives[i].native == native) {
+            return true;
         }
-        uint16_t value = (uint16_t) bm->stack[bm->stack_size - 1].as_u64;
-        memcpy(&bm->memory[addr], &value, sizeof(value));
-        bm->stack_size -= 2;
-        bm->ip += 1;
     }
-    break;
 
-    case INST_WRITE32: {
-        if (bm->stack_size < 2) {
-            return ERR_STACK_UNDERFLOW;
-        }
-        const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
-        if (addr >= BM_MEMORY_CAPACITY - 3) {
-            return ERR_ILLEGAL_MEMORY_ACCESS;
-        }
-        uint32_t value = (uint32_t) bm->stack[bm->stack_size - 1].as_u64;
-        memcpy(&bm->memory[addr], &value, sizeof(value));
-        bm->stack_size -= 2;
-        bm->ip += 1;
+    return false;
+}
+
+Err native_external(Bm *bm)
+{
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
     }
-    break;
 
-    case INST_WRITE64: {
-        if (bm->stack_size < 2) {
-            return ERR_STACK_UNDERFLOW;
-        }
-        const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
-        if (addr >= BM_MEMORY_CAPACITY - 7) {
-            return ERR_ILLEGAL_MEMORY_ACCESS;
-        }
-        uint64_t value = bm->stack[bm->stack_size - 1].as_u64;
-        memcpy(&bm->memory[addr], &value, sizeof(value));
-        bm->stack_size -= 2;
-        bm->ip += 1;
+    Memory_Addr addr = bm->stack[bm->stack_size - 1].as_u64;
+
+    uint8_t *data = bm_memory_range(bm, addr, 0, true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+
+    // NOTE: nobody knows what the host is going to do with the pointer
+    if (addr < BM_MEMORY_CAPACITY) {
+        bm_memory_mark_dirty(bm, addr, BM_MEMORY_CAPACITY - addr);
     }
-    break;
 
-    case INST_I2F:
-        CAST_OP(bm, i64, f64, (double));
-        break;
+    bm->stack[bm->stack_size - 1].as_ptr = data;
 
-    case INST_U2F:
-        CAST_OP(bm, u64, f64, (double));
-        break;
+    return ERR_OK;
+}
 
-    case INST_F2I:
-        CAST_OP(bm, f64, i64, (int64_t));
-        break;
+Err native_write(Bm *bm)
+{
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
 
-    case INST_F2U:
-        CAST_OP(bm, f64, u64, (uint64_t) (int64_t));
-        break;
+    Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint64_t count = bm->stack[bm->stack_size - 1].as_u64;
 
-    case NUMBER_OF_INSTS:
-    default:
-        return ERR_ILLEGAL_INST;
+    const uint8_t *data = bm_memory_range(bm, addr, count, false);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
     }
 
+    fwrite(data, sizeof(data[0]), count, stdout);
+
+    bm->stack_size -= 2;
+
     return ERR_OK;
 }
 
-void bm_push_native(Bm *bm, Bm_Native native)
+void bm_attach_input(Bm *bm, int fd)
 {
-    assert(bm->natives_size < BM_NATIVES_CAPACITY);
-    bm->natives[bm->natives_size++] = native;
+    bm->input.fd = fd;
+    bm->input.begin = 0;
+    bm->input.end = 0;
 }
 
-void bm_dump_stack(FILE *stream, const Bm *bm)
+// Reads directly from the fd of the input bypassing the buffer. Any failure
+// is treated as the end of the input.
+static size_t bm_input_read_raw(Bm_Input *input, void *data, size_t size)
 {
-    fprintf(stream, "Stack:\n");
-    if (bm->stack_size > 0) {
-        for (Inst_Addr i = 0; i < bm->stack_size; ++i) {
-            fprintf(stream, "  u64: %" PRIu64 ", i64: %" PRId64 ", f64: %lf, ptr: %p\n",
-                    bm->stack[i].as_u64,
-                    bm->stack[i].as_i64,
-                    bm->stack[i].as_f64,
-                    bm->stack[i].as_ptr);
+    if (input->fd < 0) {
+        return 0;
+    }
+
+#ifndef _WIN32
+    ssize_t n = 0;
+    do {
+        n = read(input->fd, data, size);
+    } while (n < 0 && errno == EINTR);
+#else
+    int n = _read(input->fd, data, (unsigned int) (size > INT_MAX ? INT_MAX : size));
+#endif // _WIN32
+
+    return n > 0 ? (size_t) n : 0;
+}
+
+// NOTE: regular files and errors count as ready, so the natives never
+// suspend on something that is not going to wake them up
+static bool bm_input_ready(const Bm_Input *input)
+{
+#ifndef _WIN32
+    if (input->fd < 0) {
+        return true;
+    }
+
+    struct pollfd pfd = {.fd = input->fd, .events = POLLIN};
+    return poll(&pfd, 1, 0) != 0;
+#else
+    (void) input;
+    return true;
+#endif // _WIN32
+}
+
+static bool bm_input_fill(Bm_Input *input)
+{
+    input->begin = 0;
+    input->end = bm_input_read_raw(input, input->buffer, BM_INPUT_BUFFER_CAPACITY);
+    return input->end > 0;
+}
+
+Err native_read(Bm *bm)
+{
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint64_t count = bm->stack[bm->stack_size - 1].as_u64;
+
+    uint8_t *data = bm_memory_range(bm, addr, count, true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+
+    Bm_Input *input = &bm->input;
+    size_t size = 0;
+
+    if (bm->async && count > 0 && input->begin >= input->end && !bm_input_ready(input)) {
+        return bm_suspend(bm, input->fd, BM_WAIT_READ, native_read);
+    }
+
+    if (input->begin < input->end) {
+        size = input->end - input->begin;
+        if (size > count) {
+            size = count;
         }
-    } else {
-        fprintf(stream, "  [empty]\n");
+        memcpy(data, &input->buffer[input->begin], size);
+        input->begin += size;
+    } else if (count >= BM_INPUT_BUFFER_CAPACITY) {
+        // NOTE: big reads go straight into the memory of the machine without the extra copy
+        size = bm_input_read_raw(input, data, count);
+    } else if (count > 0 && bm_input_fill(input)) {
+        size = input->end < count ? input->end : count;
+        memcpy(data, input->buffer, size);
+        input->begin = size;
     }
+
+    bm->stack_size -= 1;
+    bm->stack[bm->stack_size - 1].as_u64 = size;
+
+    return ERR_OK;
 }
 
-void bm_load_program_from_file(Bm *bm, const char *file_path)
+Err native_read_line(Bm *bm)
 {
-    memset(bm, 0, sizeof(*bm));
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
 
-    FILE *f = fopen(file_path, "rb");
-    if (f == NULL) {
-        fprintf(stderr, "ERROR: Could not open file `%s`: %s\n",
-                file_path, strerror(errno));
-        exit(1);
+    Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint64_t capacity = bm->stack[bm->stack_size - 1].as_u64;
+
+    uint8_t *data = bm_memory_range(bm, addr, capacity, true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
     }
 
-    Bm_File_Meta meta = {0};
+    Bm_Input *input = &bm->input;
+    size_t size = 0;
 
-    size_t n = fread(&meta, sizeof(meta), 1, f);
-    if (n < 1) {
-        fprintf(stderr, "ERROR: Could not read meta data from file `%s`: %s\n",
-                file_path, strerror(errno));
-        exit(1);
+    // NOTE: only the beginning of the line is awaited asynchronously. If the
+    // rest of it is late, the native blocks
+    if (bm->async && capacity > 0 && input->begin >= input->end && !bm_input_ready(input)) {
+        return bm_suspend(bm, input->fd, BM_WAIT_READ, native_read_line);
     }
 
-    if (meta.magic != BM_FILE_MAGIC) {
-        fprintf(stderr,
-                "ERROR: %s does not appear to be a valid BM file. "
-                "Unexpected magic %04X. Expected %04X.\n",
-                file_path,
-                meta.magic, BM_FILE_MAGIC);
-        exit(1);
+    while (size < capacity) {
+        if (input->begin >= input->end && !bm_input_fill(input)) {
+            break;
+        }
+
+        size_t n = input->end - input->begin;
+        if (n > capacity - size) {
+            n = capacity - size;
+        }
+
+        const uint8_t *begin = &input->buffer[input->begin];
+        const uint8_t *newline = memchr(begin, '\n', n);
+        if (newline != NULL) {
+            n = (size_t) (newline - begin) + 1;
+        }
+
+        memcpy(data + size, begin, n);
+        input->begin += n;
+        size += n;
+
+        if (newline != NULL) {
+            break;
+        }
     }
 
-    if (meta.version != BM_FILE_VERSION) {
-        fprintf(stderr,
-                "ERROR: %s: unsupported version of BM file %d. Expected version %d.\n",
-                file_path,
-                meta.version, BM_FILE_VERSION);
-        exit(1);
+    bm->stack_size -= 1;
+    bm->stack[bm->stack_size - 1].as_u64 = size;
+
+    return ERR_OK;
+}
+
+#ifndef _WIN32
+static bool bm_reserve_window(Bm *bm, Bm_Error *error)
+{
+    if (bm->window != NULL) {
+        return true;
     }
 
-    if (meta.program_size > BM_PROGRAM_CAPACITY) {
-        fprintf(stderr,
-                "ERROR: %s: program section is too big. The file contains %" PRIu64 " program instruction. But the capacity is %"  PRIu64 "\n",
-                file_path,
-                meta.program_size,
-                (uint64_t) BM_PROGRAM_CAPACITY);
-        exit(1);
+    // NOTE: only the address space is reserved here. The memory is committed
+    // by the file mappings placed on top of it.
+    void *window = mmap(NULL, BM_WINDOW_CAPACITY, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (window == MAP_FAILED) {
+        return bm_error(error, "could not reserve the window for the mapped files: %s",
+                        strerror(errno));
     }
 
-    bm->ip = meta.entry;
+    bm->window = window;
+    bm->window_size = 0;
+    return true;
+}
+#endif // _WIN32
 
-    if (meta.memory_capacity > BM_MEMORY_CAPACITY) {
-        fprintf(stderr,
-                "ERROR: %s: memory section is too big. The file wants %" PRIu64 " bytes. But the capacity is %"  PRIu64 " bytes\n",
-                file_path,
-                meta.memory_capacity,
-                (uint64_t) BM_MEMORY_CAPACITY);
-        exit(1);
+bool bm_map_fd(Bm *bm, int fd, uint64_t offset, uint64_t size, Bm_Mapping_Kind kind,
+               Memory_Addr *addr, uint8_t **data, Bm_Error *error)
+{
+#ifndef _WIN32
+    if (bm->mappings_size >= BM_MAPPINGS_CAPACITY) {
+        return bm_error(error, "too many mappings. The capacity is %d", BM_MAPPINGS_CAPACITY);
     }
 
-    if (meta.memory_size > meta.memory_capacity) {
-        fprintf(stderr,
-                "ERROR: %s: memory size %"PRIu64" is greater than declared memory capacity %"PRIu64"\n",
-                file_path,
-                meta.memory_size,
-                meta.memory_capacity);
-        exit(1);
+    if (!bm_reserve_window(bm, error)) {
+        return false;
     }
 
-    if (meta.externals_size > BM_EXTERNAL_NATIVES_CAPACITY) {
-        fprintf(stderr,
-                "ERROR: %s: external names section is too big. The file contains %" PRIu64 " external names. But the capacity is %"  PRIu64 " external names\n",
-                file_path,
-                meta.externals_size,
-                (uint64_t) BM_EXTERNAL_NATIVES_CAPACITY);
-        exit(1);
+    const uint64_t page_size = (uint64_t) sysconf(_SC_PAGESIZE);
+    const uint64_t mapped_size = (size + page_size - 1) / page_size * page_size;
+
+    if (mapped_size > BM_WINDOW_CAPACITY - bm->window_size) {
+        return bm_error(error, "the mapping does not fit into the rest of the window");
     }
 
-    bm->program_size = fread(bm->program, sizeof(bm->program[0]), meta.program_size, f);
+    uint8_t *begin = bm->window + bm->window_size;
+
+    if (size > 0) {
+        int prot = PROT_READ | PROT_WRITE;
+        int flags = MAP_PRIVATE | MAP_FIXED;
+        switch (kind) {
+        case BM_MAPPING_READ_ONLY:
+            prot = PROT_READ;
+            break;
+        case BM_MAPPING_COPY_ON_WRITE:
+            break;
+        case BM_MAPPING_SHARED:
+            flags = MAP_SHARED | MAP_FIXED;
+            break;
+        }
 
-    if (bm->program_size != meta.program_size) {
-        fprintf(stderr, "ERROR: %s: read %"PRIu64" program instructions, but expected %"PRIu64"\n",
-                file_path,
-                bm->program_size,
-                meta.program_size);
-        exit(1);
+        if (mmap(begin, size, prot, flags, fd, (off_t) offset) == MAP_FAILED) {
+            return bm_error(error, "could not map: %s", strerror(errno));
+        }
     }
 
-    n = fread(bm->memory, sizeof(bm->memory[0]), meta.memory_size, f);
-    bm->expected_memory_size = meta.memory_size;
+    Bm_Mapping *mapping = &bm->mappings[bm->mappings_size++];
+    mapping->addr = BM_WINDOW_ADDR + bm->window_size;
+    mapping->size = size;
+    mapping->writable = kind != BM_MAPPING_READ_ONLY;
+    bm->window_size += mapped_size;
 
-    if (n != meta.memory_size) {
-        fprintf(stderr, "ERROR: %s: read %zd bytes of memory section, but expected %"PRIu64" bytes.\n",
-                file_path,
-                n,
-                meta.memory_size);
-        exit(1);
+    if (addr) {
+        *addr = mapping->addr;
+    }
+    if (data) {
+        *data = begin;
     }
 
-    bm->externals_size = fread(bm->externals, sizeof(bm->externals[0]), meta.externals_size, f);
-    if (bm->externals_size != meta.externals_size) {
-        fprintf(stderr, "ERROR: %s: read %zu external names, but expected %"PRIu64"\n",
-                file_path,
-                bm->externals_size,
-                meta.externals_size);
-        exit(1);
+    return true;
+#else
+    (void) bm;
+    (void) fd;
+    (void) offset;
+    (void) size;
+    (void) kind;
+    (void) addr;
+    (void) data;
+    return bm_error(error, "mapping is not supported on this platform");
+#endif // _WIN32
+}
+
+bool bm_map_file(Bm *bm, const char *file_path, bool copy_on_write,
+                 Memory_Addr *addr, uint64_t *size, Bm_Error *error)
+{
+#ifndef _WIN32
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        return bm_error(error, "%s: %s", file_path, strerror(errno));
     }
 
-    fclose(f);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return bm_error(error, "%s: %s", file_path, strerror(errno));
+    }
+
+    const uint64_t file_size = (uint64_t) st.st_size;
+
+    Bm_Error map_error = {0};
+    bool ok = bm_map_fd(bm, fd, 0, file_size,
+                        copy_on_write ? BM_MAPPING_COPY_ON_WRITE : BM_MAPPING_READ_ONLY,
+                        addr, NULL, &map_error);
+    close(fd);
+
+    if (!ok) {
+        return bm_error(error, "%s: %s", file_path, map_error.message);
+    }
+
+    if (size) {
+        *size = file_size;
+    }
+
+    return true;
+#else
+    (void) bm;
+    (void) copy_on_write;
+    (void) addr;
+    (void) size;
+    return bm_error(error, "%s: mapping files is not supported on this platform", file_path);
+#endif // _WIN32
 }
 
-Err native_external(Bm *bm)
+void bm_unmap_all(Bm *bm)
 {
-    if (bm->stack_size < 1) {
+    bm_close_all_channels(bm);
+
+#ifndef _WIN32
+    if (bm->window != NULL) {
+        munmap(bm->window, BM_WINDOW_CAPACITY);
+    }
+#endif // _WIN32
+    bm->window = NULL;
+    bm->window_size = 0;
+    bm->mappings_size = 0;
+}
+
+Err native_map_file(Bm *bm)
+{
+    if (bm->stack_size < 2) {
         return ERR_STACK_UNDERFLOW;
     }
 
-    Memory_Addr addr = bm->stack[bm->stack_size - 1].as_u64;
+    Memory_Addr path_addr = bm->stack[bm->stack_size - 2].as_u64;
+    bool copy_on_write = bm->stack[bm->stack_size - 1].as_u64 != 0;
 
-    if (addr >= BM_MEMORY_CAPACITY) {
+    const char *path = bm_memory_cstr(bm, path_addr);
+    if (path == NULL) {
         return ERR_ILLEGAL_MEMORY_ACCESS;
     }
 
-    bm->stack[bm->stack_size - 1].as_ptr = &bm->memory[addr];
+    Memory_Addr addr = 0;
+    uint64_t size = 0;
+    if (!bm_map_file(bm, path, copy_on_write, &addr, &size, NULL)) {
+        addr = 0;
+        size = 0;
+    }
+
+    bm->stack[bm->stack_size - 2].as_u64 = addr;
+    bm->stack[bm->stack_size - 1].as_u64 = size;
 
     return ERR_OK;
 }
 
-Err native_write(Bm *bm)
+#ifdef __linux__
+static Err native_sleep_complete(Bm *bm)
 {
-    if (bm->stack_size < 2) {
+    close(bm->pending.fd);
+    bm->stack_size -= 1;
+    return ERR_OK;
+}
+#endif // __linux__
+
+Err native_sleep(Bm *bm)
+{
+    if (bm->stack_size < 1) {
         return ERR_STACK_UNDERFLOW;
     }
 
-    Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
-    uint64_t count = bm->stack[bm->stack_size - 1].as_u64;
+    const uint64_t ms = bm->stack[bm->stack_size - 1].as_u64;
+
+#ifdef __linux__
+    if (bm->async && ms > 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd >= 0) {
+            struct itimerspec spec = {0};
+            spec.it_value.tv_sec = (time_t) (ms / 1000);
+            spec.it_value.tv_nsec = (long) (ms % 1000) * 1000 * 1000;
+            if (timerfd_settime(fd, 0, &spec, NULL) == 0) {
+                return bm_suspend(bm, fd, BM_WAIT_READ, native_sleep_complete);
+            }
+            close(fd);
+        }
+    }
+#endif // __linux__
+
+#ifndef _WIN32
+    struct timespec duration = {
+        .tv_sec = (time_t) (ms / 1000),
+        .tv_nsec = (long) (ms % 1000) * 1000 * 1000,
+    };
+    while (nanosleep(&duration, &duration) < 0 && errno == EINTR) {}
+#else
+    Sleep((DWORD) ms);
+#endif // _WIN32
+
+    bm->stack_size -= 1;
+    return ERR_OK;
+}
 
-    if (addr >= BM_MEMORY_CAPACITY) {
-        return ERR_ILLEGAL_MEMORY_ACCESS;
+Err native_snapshot(Bm *bm)
+{
+    (void) bm;
+    return ERR_OK;
+}
+
+bool bm_export_by_name(const Bm *bm, const char *name, size_t *export_id)
+{
+    for (size_t i = 0; i < bm->exports_size; ++i) {
+        if (strcmp(bm->exports[i].name, name) == 0) {
+            if (export_id) {
+                *export_id = i;
+            }
+            return true;
+        }
     }
 
-    if (addr + count < addr || addr + count >= BM_MEMORY_CAPACITY) {
-        return ERR_ILLEGAL_MEMORY_ACCESS;
+    return false;
+}
+
+Err bm_call(Bm *bm, size_t export_id,
+            const Word *args, size_t args_count,
+            Word *results, size_t results_count)
+{
+    if (export_id >= bm->exports_size) {
+        return ERR_ILLEGAL_OPERAND;
     }
 
-    fwrite(&bm->memory[addr], sizeof(bm->memory[0]), count, stdout);
+    if (bm->stack_size + args_count + 1 > BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
 
-    bm->stack_size -= 2;
+    const uint64_t saved_stack_size = bm->stack_size;
+    const Inst_Addr saved_ip = bm->ip;
+    const bool saved_halt = bm->halt;
 
-    return ERR_OK;
+    for (size_t i = 0; i < args_count; ++i) {
+        bm->stack[bm->stack_size++] = args[i];
+    }
+    bm->stack[bm->stack_size++].as_u64 = BM_CALL_SENTINEL;
+    bm->ip = bm->exports[export_id].addr;
+    // NOTE: the exports of a program that already ran to its end are still
+    // callable
+    bm->halt = false;
+
+    Err err = ERR_OK;
+    while (err == ERR_OK && bm->ip != BM_CALL_SENTINEL && !bm->halt) {
+        err = bm_execute_inst(bm);
+    }
+
+    if (err == ERR_OK && !bm->halt) {
+        if (bm->stack_size < saved_stack_size + results_count) {
+            err = ERR_STACK_UNDERFLOW;
+        } else {
+            for (size_t i = 0; i < results_count; ++i) {
+                results[i] = bm->stack[bm->stack_size - results_count + i];
+            }
+        }
+    }
+
+    // NOTE: whatever the routine did, the machine is left the way the call
+    // found it, so a failed or halted call does not break the next ones
+    bm->stack_size = saved_stack_size;
+    bm->ip = saved_ip;
+    bm->halt = bm->halt || saved_halt;
+
+    return err;
 }
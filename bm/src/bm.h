@@ -33,7 +33,18 @@
 #define BM_PROGRAM_CAPACITY 1024
 #define BM_NATIVES_CAPACITY 1024
 #define BM_MEMORY_CAPACITY (640 * 1000)
+// NOTE: The granularity of tracking the writes to the memory
+#define BM_MEMORY_PAGE_SIZE 4096
+#define BM_MEMORY_PAGES_COUNT ((BM_MEMORY_CAPACITY + BM_MEMORY_PAGE_SIZE - 1) / BM_MEMORY_PAGE_SIZE)
 #define BM_EXTERNAL_NATIVES_CAPACITY 1024
+#define BM_EXPORTS_CAPACITY 1024
+#define BM_INPUT_BUFFER_CAPACITY (64 * 1024)
+// NOTE: The files mapped with map_file are located in the window of the
+// address space starting at BM_WINDOW_ADDR, far away from the regular memory.
+#define BM_WINDOW_ADDR (1ULL << 40)
+#define BM_WINDOW_CAPACITY (1ULL << 36)
+#define BM_MAPPINGS_CAPACITY 64
+#define BM_CHANNELS_CAPACITY 16
 
 typedef enum {
     ERR_OK = 0,
@@ -44,7 +55,13 @@ typedef enum {
     ERR_ILLEGAL_OPERAND,
     ERR_ILLEGAL_MEMORY_ACCESS,
     ERR_DIV_BY_ZERO,
-    ERR_NULL_NATIVE
+    ERR_NULL_NATIVE,
+    // NOTE: Not an actual error. An asynchronous native has suspended the
+    // machine until its operation completes. See bm_suspend().
+    ERR_PENDING,
+    // NOTE: The host could not wait for the fd of the pending operation, for
+    // instance because it ran out of fds. The context can not continue.
+    ERR_WAIT_FAILED,
 } Err;
 
 const char *err_as_cstr(Err err);
@@ -163,12 +180,124 @@ typedef struct Bm Bm;
 
 typedef Err (*Bm_Native)(Bm*);
 
+#define BM_NATIVE_ARGS_CAPACITY 16
+#define BM_NATIVE_RESULTS_CAPACITY 4
+
+// NOTE: Special values of Bm_Native_Arg.size for the TYPE_MEM_ADDR arguments
+// The length of the memory range is the next argument
+#define BM_NATIVE_SIZE_NEXT_ARG SIZE_MAX
+// The memory range is a NULL-terminated string
+#define BM_NATIVE_SIZE_CSTR (SIZE_MAX - 1)
+
+typedef struct {
+    Type type;
+    // NOTE: Only for TYPE_MEM_ADDR. The amount of bytes the native is going
+    // to access starting from the address, or one of the BM_NATIVE_SIZE_*
+    // values above.
+    size_t size;
+    // NOTE: Only for TYPE_MEM_ADDR. The native only reads the range, so it
+    // may be a read-only mapping (see bm_map_file()) and it is not marked as
+    // written (see Bm.dirty_pages).
+    bool read_only;
+} Bm_Native_Arg;
+
+typedef struct {
+    Bm_Native_Arg args[BM_NATIVE_ARGS_CAPACITY];
+    size_t args_size;
+    Type results[BM_NATIVE_RESULTS_CAPACITY];
+    size_t results_size;
+} Bm_Native_Signature;
+
+// NOTE: The arguments are in the order they were pushed onto the stack.
+// The TYPE_MEM_ADDR ones are already validated and converted to host
+// pointers. The results are pushed onto the stack in the same order after
+// the arguments are popped.
+typedef Err (*Bm_Typed_Native)(Bm *bm, const Word *args, Word *results);
+
+typedef struct {
+    Bm_Native_Signature signature;
+    Bm_Typed_Native function;
+} Bm_Native_Def;
+
 #define NATIVE_NAME_CAPACITY 256
 
 typedef struct {
     char name[NATIVE_NAME_CAPACITY];
 } External_Native;
 
+// NOTE: Exports are the named entry points of the program that the host
+// application can call via bm_call(). The names share the capacity with
+// the external natives since both come from basm bindings.
+typedef struct {
+    char name[NATIVE_NAME_CAPACITY];
+    Inst_Addr addr;
+} Bm_Export;
+
+// NOTE: The source of the `read` and `read_line` natives. A zero initialized
+// input reads the standard input. A negative `fd` means there is no input and
+// the natives always report the end of it.
+typedef struct {
+    int fd;
+    size_t begin;
+    size_t end;
+    uint8_t buffer[BM_INPUT_BUFFER_CAPACITY];
+} Bm_Input;
+
+typedef struct {
+    Memory_Addr addr;
+    uint64_t size;
+    bool writable;
+} Bm_Mapping;
+
+typedef enum {
+    BM_MAPPING_READ_ONLY = 0,
+    BM_MAPPING_COPY_ON_WRITE,
+    // NOTE: the changes are visible to the other processes that map the same object
+    BM_MAPPING_SHARED,
+} Bm_Mapping_Kind;
+
+// NOTE: The layout of the shared memory of a channel is private to channel.c
+typedef struct Bm_Channel_Header Bm_Channel_Header;
+
+// NOTE: Defined in native_loader.h, which is not part of the library itself
+typedef struct Native_Loader Native_Loader;
+
+// NOTE: A channel is a single-producer single-consumer ring buffer of fixed
+// size slots in a named POSIX shared memory object. Only the slots are mapped
+// into the window, so the producer fills them and the consumer reads them in
+// place. The header with the counters is mapped separately and the program
+// cannot reach it.
+typedef struct {
+    Bm_Channel_Header *header;
+    uint64_t header_size;
+    uint8_t *slots;
+    Memory_Addr slots_addr;
+    uint64_t slot_stride;
+    uint64_t slots_count;
+    uint64_t slot_size;
+    // NOTE: the index of the side in Bm_Channel_Header.pids
+    size_t side;
+    char name[NATIVE_NAME_CAPACITY];
+} Bm_Channel;
+
+typedef enum {
+    BM_WAIT_READ = 0,
+    BM_WAIT_WRITE,
+} Bm_Wait;
+
+// Finishes the stack effect of a suspended native once its fd is ready.
+// May suspend the machine again by returning bm_suspend().
+typedef Err (*Bm_Completion)(Bm *bm);
+
+typedef struct {
+    bool active;
+    int fd;
+    Bm_Wait wait;
+    Bm_Completion complete;
+    // NOTE: belongs to the event loop that is waiting for the fd
+    int loop_fd;
+} Bm_Pending;
+
 struct Bm {
     Word stack[BM_STACK_CAPACITY];
     uint64_t stack_size;
@@ -177,29 +306,148 @@ struct Bm {
     uint64_t program_size;
     Inst_Addr ip;
 
+    // NOTE: A native is either a legacy Bm_Native that works with the stack
+    // directly or a Bm_Native_Def with a signature. The unused one is NULL.
     Bm_Native natives[BM_NATIVES_CAPACITY];
+    const Bm_Native_Def *native_defs[BM_NATIVES_CAPACITY];
+    // NOTE: the native reports all of its writes to the memory (see
+    // `dirty_pages`). After any other native all the pages are considered
+    // written.
+    bool natives_tracked[BM_NATIVES_CAPACITY];
+    // NOTE: none of the arguments of the Bm_Native_Def is TYPE_MEM_ADDR, so
+    // the native is called with the arguments right on the stack (see
+    // bm_call_direct_native_def())
+    bool native_defs_direct[BM_NATIVES_CAPACITY];
     size_t natives_size;
 
     External_Native externals[BM_EXTERNAL_NATIVES_CAPACITY];
     size_t externals_size;
 
+    Bm_Export exports[BM_EXPORTS_CAPACITY];
+    size_t exports_size;
+
     uint8_t memory[BM_MEMORY_CAPACITY];
     // NOTE: `expected_memory_size` is the size of the memory from the bm file.
     // The program is allowed to access memory beyond the `expected_memory_size`.
     // This variable is needed for debasm to reliably recover the source code.
     size_t expected_memory_size;
+    // NOTE: a bit per page of the memory that was written since the program
+    // was installed. The writes that go through the instructions,
+    // bm_memory_range() and the signatures of typed natives are tracked. A
+    // legacy native that was not pushed with bm_push_tracked_native() may
+    // write anywhere, so it marks all the pages.
+    uint64_t dirty_pages[(BM_MEMORY_PAGES_COUNT + 63) / 64];
 
     bool halt;
+
+    Bm_Input input;
+
+    // NOTE: set by the host that is able to resume the suspended natives.
+    // Otherwise the natives just block.
+    bool async;
+    Bm_Pending pending;
+
+    // NOTE: `window` is the host address of BM_WINDOW_ADDR. The whole window
+    // is reserved on the first mapping and the files are mapped into it one
+    // after another, so `window_size` is the size of its used part.
+    uint8_t *window;
+    uint64_t window_size;
+    Bm_Mapping mappings[BM_MAPPINGS_CAPACITY];
+    size_t mappings_size;
+
+    Bm_Channel channels[BM_CHANNELS_CAPACITY];
+    size_t channels_size;
+
+    // NOTE: the loader that resolves the lazily bound externals. Set by
+    // native_loader_bind_externals(), see native_loader.h.
+    Native_Loader *native_loader;
+
+    // NOTE: Opaque pointer that belongs to the host application.
+    // The Virtual Machine never touches it.
+    void *user_data;
 };
 
+#define BM_ERROR_CAPACITY 512
+
+// NOTE: Bm_Error is a human readable description of what went wrong during
+// loading. The library never prints it or exits on its own. That is up to
+// the host application.
+typedef struct {
+    char message[BM_ERROR_CAPACITY];
+} Bm_Error;
+
+// Formats the message into `error` if it is not NULL. Always returns false,
+// so the loaders can report the failure in a single statement.
+bool bm_error(Bm_Error *error, const char *fmt, ...);
+
+// NOTE: The whole state of the Virtual Machine lives in a single Bm context.
+// The library has no global mutable state, so several contexts can be used
+// in parallel as long as each one of them stays on its own thread.
+Bm *bm_create(void);
+void bm_destroy(Bm *bm);
+
 Err bm_execute_inst(Bm *bm);
 Err bm_execute_program(Bm *bm, int limit);
+// Same as bm_execute_program() but also counts how many times each
+// instruction was executed. The counts are added to the existing values.
+Err bm_execute_counting(Bm *bm, int limit, uint64_t counts[NUMBER_OF_INSTS]);
 void bm_push_native(Bm *bm, Bm_Native native);
+// The same as bm_push_native() for a native that accesses the memory only
+// through bm_memory_range(), so its writes do not make the whole memory dirty.
+// The built-in natives are always considered tracked.
+void bm_push_tracked_native(Bm *bm, Bm_Native native);
+void bm_memory_mark_all_dirty(Bm *bm);
+void bm_push_native_def(Bm *bm, const Bm_Native_Def *def);
+// Replace the native that is already in the slot `id` and update everything
+// the push functions above know about it.
+void bm_set_native(Bm *bm, Native_ID id, Bm_Native native);
+void bm_set_native_def(Bm *bm, Native_ID id, const Bm_Native_Def *def);
+// Checks the stack against the signature, calls the native and pushes its results
+Err bm_call_native_def(Bm *bm, const Bm_Native_Def *def);
+// The same for a signature without TYPE_MEM_ADDR arguments, which does not
+// look at the arguments at all
+Err bm_call_direct_native_def(Bm *bm, const Bm_Native_Def *def);
 void bm_dump_stack(FILE *stream, const Bm *bm);
+bool bm_load_program_from_memory(Bm *bm, const void *buffer, size_t buffer_size, Bm_Error *error);
+bool bm_try_load_program_from_file(Bm *bm, const char *file_path, Bm_Error *error);
+// NOTE: Convenience wrapper for the command line tools. Prints the error and exits on failure.
 void bm_load_program_from_file(Bm *bm, const char *file_path);
 
+// NOTE: Asynchronous natives. When `bm->async` is set, a native that would
+// block calls bm_suspend() and returns its result. The instruction pointer stays
+// at the native and the stack is left as is, so bm_execute_program() returns
+// ERR_PENDING and the host may run other contexts in the meantime. When the fd
+// is ready the host calls bm_resume(), which calls `complete` to finish the
+// native and moves on to the next instruction. See event_loop.h.
+Err bm_suspend(Bm *bm, int fd, Bm_Wait wait, Bm_Completion complete);
+Err bm_resume(Bm *bm);
+// Blocks the thread until the pending operation is ready and resumes the machine.
+Err bm_wait_pending(Bm *bm);
+
+// Returns false if the program does not export anything with such name
+bool bm_export_by_name(const Bm *bm, const char *name, size_t *export_id);
+
+// NOTE: The return address that bm_call() pushes onto the stack. When the
+// exported routine executes `ret` with it the call is finished.
+#define BM_CALL_SENTINEL UINT64_MAX
+
+// Calls an exported routine the same way the `call` instruction does: pushes
+// `args` (the last one ends up on top), pushes BM_CALL_SENTINEL as the return
+// address and executes until the routine returns. Then the top
+// `results_count` words are copied into `results` and the stack is restored
+// to its original size. The memory, the natives and the instruction pointer
+// are left intact, so it is cheap to call the same routine over and over.
+//
+// The stack and the instruction pointer are restored even if the routine
+// fails. The routine runs even if the machine has already halted. If the
+// routine halts the machine, bm_call() returns ERR_OK with `bm->halt` set and
+// `results` untouched.
+Err bm_call(Bm *bm, size_t export_id,
+            const Word *args, size_t args_count,
+            Word *results, size_t results_count);
+
 #define BM_FILE_MAGIC 0xa4016d62
-#define BM_FILE_VERSION 7
+#define BM_FILE_VERSION 8
 
 PACK(struct Bm_File_Meta {
     uint32_t magic;
@@ -209,11 +457,107 @@ PACK(struct Bm_File_Meta {
     uint64_t memory_size;
     uint64_t memory_capacity;
     uint64_t externals_size;
+    uint64_t exports_size;
 });
 
 typedef struct Bm_File_Meta Bm_File_Meta;
 
+// NOTE: Bm_Image is a validated view into the content of a .bm file.
+// The sections are not necessarily aligned within the buffer, so they are
+// kept as raw bytes and only copied into the Bm by bm_image_install().
+// The image does not own the buffer it was decoded from.
+typedef struct {
+    Bm_File_Meta meta;
+    const uint8_t *program;
+    const uint8_t *memory;
+    const uint8_t *externals;
+    const uint8_t *exports;
+} Bm_Image;
+
+bool bm_image_decode(Bm_Image *image, const void *buffer, size_t buffer_size, Bm_Error *error);
+void bm_image_install(Bm *bm, const Bm_Image *image);
+// Brings the context back to the state right after bm_image_install() of the
+// same image, but copies only the pages of the memory that were written since
+// then. The natives stay bound. The image must be the one that was installed.
+// Returns the amount of restored pages.
+size_t bm_image_reset(Bm *bm, const Bm_Image *image);
+
+// Reads the whole file into a malloc-ed buffer. The caller is responsible for freeing it.
+bool bm_slurp_file(const char *file_path, uint8_t **data, size_t *size, Bm_Error *error);
+
+// Returns the host pointer to `size` bytes of the memory at `addr` or NULL if
+// the range is not accessible. The range may be located either in the regular
+// memory or within a single mapped file.
+uint8_t *bm_memory_range(Bm *bm, Memory_Addr addr, uint64_t size, bool write);
+// Returns the NULL-terminated string at `addr` or NULL if it is not terminated
+// within the accessible memory.
+const char *bm_memory_cstr(Bm *bm, Memory_Addr addr);
+
+// Maps the file into the window without copying it. The pages are loaded on
+// demand. A copy-on-write mapping can be modified by the program without
+// affecting the file, otherwise it is read-only. Only supported on POSIX systems.
+bool bm_map_file(Bm *bm, const char *file_path, bool copy_on_write,
+                 Memory_Addr *addr, uint64_t *size, Bm_Error *error);
+// Maps `size` bytes of the fd starting at `offset` into the window. `offset`
+// must be a multiple of the page size. The fd can be closed afterwards.
+// Returns both the address in the window and the host pointer to it.
+bool bm_map_fd(Bm *bm, int fd, uint64_t offset, uint64_t size, Bm_Mapping_Kind kind,
+               Memory_Addr *addr, uint8_t **data, Bm_Error *error);
+// Closes all the channels, unmaps all the files and releases the window.
+// Loading a program does that too.
+void bm_unmap_all(Bm *bm);
+
+// Opens the channel with such name creating it if it does not exist yet. Both
+// sides must agree on `slot_size` and `slots_count`. Implemented in channel.c.
+bool bm_channel_open(Bm *bm, const char *name, uint64_t slot_size, uint64_t slots_count,
+                     size_t *channel_id, Bm_Error *error);
+// Tells the other side that this one is done. The second side to close the
+// channel removes its shared memory object.
+void bm_channel_close(Bm *bm, size_t channel_id);
+void bm_close_all_channels(Bm *bm);
+
+// Makes the `read` and `read_line` natives read from `fd` dropping
+// everything that was buffered from the previous one. The fd is not owned
+// by the Virtual Machine.
+void bm_attach_input(Bm *bm, int fd);
+
 Err native_write(Bm *bm);
 Err native_external(Bm *bm);
+// [addr count] -> [size]. Reads at most `count` bytes. Returns 0 only at the end of the input.
+Err native_read(Bm *bm);
+// [addr capacity] -> [size]. Reads up to and including the next '\n'. The
+// line is split if it does not fit. Returns 0 only at the end of the input.
+Err native_read_line(Bm *bm);
+// [path copy_on_write] -> [addr size]. `path` is a NULL-terminated string.
+// Pushes 0 0 if the file could not be mapped.
+Err native_map_file(Bm *bm);
+// [milliseconds] -> []. Suspends the machine instead of blocking when it is asynchronous.
+Err native_sleep(Bm *bm);
+// [] -> []. Does nothing by itself. Hosts that are able to save snapshots
+// (see snapshot.h) bind their own native with this name.
+Err native_snapshot(Bm *bm);
+
+#define BM_CHANNEL_INVALID UINT64_MAX
+
+// [name slot_size slots_count] -> [channel]. `name` is a NULL-terminated
+// string. Pushes BM_CHANNEL_INVALID if the channel could not be opened.
+Err native_channel_open(Bm *bm);
+// [channel] -> [addr]. The next free slot for the producer to fill or 0 if the channel is full.
+Err native_channel_acquire(Bm *bm);
+// [channel size] -> []. Hands the acquired slot with `size` bytes in it to the consumer.
+Err native_channel_publish(Bm *bm);
+// [channel] -> [addr size]. The oldest published slot or 0 0 if the channel is empty.
+Err native_channel_peek(Bm *bm);
+// [channel] -> []. Gives the peeked slot back to the producer.
+Err native_channel_release(Bm *bm);
+// [channel for_space] -> [alive]. Blocks until there is something to peek
+// (or a slot to acquire if `for_space` is true). Pushes false if the other
+// side closed the channel and there is nothing left to wait for.
+Err native_channel_wait(Bm *bm);
+// [channel] -> []
+Err native_channel_close(Bm *bm);
+
+// Returns NULL if there is no built-in native with such name
+Bm_Native bm_builtin_native_by_name(const char *name);
 
 #endif // BM_H_
@@ -0,0 +1,976 @@
+#include <limits.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif // _WIN32
+
+#include "./bm.h"
+#include "./event_loop.h"
+#include "./image_cache.h"
+#include "./path.h"
+#include "./pool.h"
+#include "./trace.h"
+
+// NOTE: bmbench measures the overhead of embedding the Virtual Machine into
+// a host application. Every scenario is a self-contained function that
+// constructs its bytecode in memory, so the benchmark does not depend on
+// basm or on the file system.
+
+#define BENCH_IMAGE_CAPACITY (64 * 1024)
+
+typedef struct {
+    uint8_t data[BENCH_IMAGE_CAPACITY];
+    size_t size;
+} Bench_Image;
+
+static void bench_image_push(Bench_Image *image, const void *data, size_t size)
+{
+    assert(image->size + size <= BENCH_IMAGE_CAPACITY);
+    memcpy(image->data + image->size, data, size);
+    image->size += size;
+}
+
+static void bench_image_make(Bench_Image *image,
+                             const Inst *program, size_t program_size,
+                             Inst_Addr entry,
+                             const Bm_Export *exports, size_t exports_size)
+{
+    Bm_File_Meta meta = {
+        .magic = BM_FILE_MAGIC,
+        .version = BM_FILE_VERSION,
+        .program_size = program_size,
+        .entry = entry,
+        .memory_size = 0,
+        .memory_capacity = 0,
+        .externals_size = 0,
+        .exports_size = exports_size,
+    };
+
+    image->size = 0;
+    bench_image_push(image, &meta, sizeof(meta));
+    bench_image_push(image, program, sizeof(program[0]) * program_size);
+    bench_image_push(image, exports, sizeof(exports[0]) * exports_size);
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void bench_report(const char *scenario, size_t iterations, double elapsed, const char *unit)
+{
+    printf("%s: %zu %s in %.3lfs, %.0lf %s/s\n",
+           scenario, iterations, unit, elapsed,
+           (double) iterations / elapsed, unit);
+}
+
+// NOTE: sums the numbers from 0 to 9 and halts
+static const Inst bench_small_program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},  // sum
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},  // i
+    // loop:
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 10}},
+    {.type = INST_GEU},
+    {.type = INST_JMP_IF, .operand = {.as_u64 = 13}},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_DUP,    .operand = {.as_u64 = 1}},
+    {.type = INST_PLUSI},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PLUSI},
+    {.type = INST_JMP,    .operand = {.as_u64 = 2}},
+    // end:
+    {.type = INST_DROP},
+    {.type = INST_HALT},
+};
+#define BENCH_SMALL_PROGRAM_SIZE (sizeof(bench_small_program) / sizeof(bench_small_program[0]))
+
+static void bench_load(size_t iterations)
+{
+    static Bench_Image image = {0};
+    bench_image_make(&image, bench_small_program, BENCH_SMALL_PROGRAM_SIZE, 0, NULL, 0);
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    double begin = bench_now();
+    for (size_t i = 0; i < iterations; ++i) {
+        Bm_Error error = {0};
+        if (!bm_load_program_from_memory(bm, image.data, image.size, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        Err err = bm_execute_program(bm, -1);
+        if (err != ERR_OK) {
+            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+            exit(1);
+        }
+
+        assert(bm->stack_size == 1);
+        assert(bm->stack[0].as_u64 == 45);
+    }
+    double elapsed = bench_now() - begin;
+
+    bench_report("load", iterations, elapsed, "programs");
+
+    bm_destroy(bm);
+}
+
+// NOTE: `add` takes two integers and returns their sum following the
+// calling convention of basm: the arguments are below the return address
+static const Inst bench_call_program[] = {
+    // add:
+    {.type = INST_SWAP,   .operand = {.as_u64 = 2}},
+    {.type = INST_PLUSI},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_RET},
+    // main:
+    {.type = INST_HALT},
+};
+#define BENCH_CALL_PROGRAM_SIZE (sizeof(bench_call_program) / sizeof(bench_call_program[0]))
+
+static const Bm_Export bench_call_exports[] = {
+    {.name = "add", .addr = 0},
+};
+#define BENCH_CALL_EXPORTS_SIZE (sizeof(bench_call_exports) / sizeof(bench_call_exports[0]))
+
+static void bench_call(size_t iterations)
+{
+    static Bench_Image image = {0};
+    bench_image_make(&image,
+                     bench_call_program, BENCH_CALL_PROGRAM_SIZE, 4,
+                     bench_call_exports, BENCH_CALL_EXPORTS_SIZE);
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    Bm_Error error = {0};
+    if (!bm_load_program_from_memory(bm, image.data, image.size, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    size_t add = 0;
+    if (!bm_export_by_name(bm, "add", &add)) {
+        fprintf(stderr, "ERROR: no `add` export\n");
+        exit(1);
+    }
+
+    uint64_t sum = 0;
+    double begin = bench_now();
+    for (size_t i = 0; i < iterations; ++i) {
+        Word args[2] = {word_u64(sum), word_u64(i)};
+        Word result = {0};
+        Err err = bm_call(bm, add, args, 2, &result, 1);
+        if (err != ERR_OK) {
+            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+            exit(1);
+        }
+        sum = result.as_u64;
+    }
+    double elapsed = bench_now() - begin;
+
+    assert(sum == (uint64_t) iterations * ((uint64_t) iterations - 1) / 2);
+    bench_report("call", iterations, elapsed, "calls");
+    printf("call: %.1lfns per call\n", elapsed * 1e9 / (double) iterations);
+
+    bm_destroy(bm);
+}
+
+// NOTE: the image has a memory section of a typical size to give the
+// decoding something to chew on
+#define BENCH_CACHE_MEMORY_SIZE (4 * 1024)
+#define BENCH_CACHE_FILE_PATH "bmbench-cache.bm"
+
+static void bench_cache(size_t iterations)
+{
+    static Bench_Image image = {0};
+    bench_image_make(&image, bench_small_program, BENCH_SMALL_PROGRAM_SIZE, 0, NULL, 0);
+    Bm_File_Meta meta = {0};
+    memcpy(&meta, image.data, sizeof(meta));
+    meta.memory_size = BENCH_CACHE_MEMORY_SIZE;
+    meta.memory_capacity = BENCH_CACHE_MEMORY_SIZE;
+    memcpy(image.data, &meta, sizeof(meta));
+    for (size_t i = 0; i < BENCH_CACHE_MEMORY_SIZE; ++i) {
+        uint8_t byte = (uint8_t) i;
+        bench_image_push(&image, &byte, sizeof(byte));
+    }
+
+    FILE *f = fopen(BENCH_CACHE_FILE_PATH, "wb");
+    if (f == NULL || fwrite(image.data, 1, image.size, f) != image.size) {
+        fprintf(stderr, "ERROR: could not write `%s`: %s\n",
+                BENCH_CACHE_FILE_PATH, strerror(errno));
+        exit(1);
+    }
+    fclose(f);
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    static Bm_Image_Cache cache = {0};
+    cache.max_entries = 16;
+
+    for (int cached = 0; cached <= 1; ++cached) {
+        double begin = bench_now();
+        for (size_t i = 0; i < iterations; ++i) {
+            Bm_Error error = {0};
+            bool ok = cached
+                      ? bm_image_cache_load_from_file(&cache, bm, BENCH_CACHE_FILE_PATH, &error)
+                      : bm_try_load_program_from_file(bm, BENCH_CACHE_FILE_PATH, &error);
+            if (!ok) {
+                fprintf(stderr, "ERROR: %s\n", error.message);
+                exit(1);
+            }
+        }
+        double elapsed = bench_now() - begin;
+        bench_report(cached ? "cache: cached" : "cache: uncached", iterations, elapsed, "loads");
+    }
+
+    bm_image_cache_dump_stats(stdout, &cache);
+    bm_image_cache_clear(&cache);
+    bm_destroy(bm);
+    remove(BENCH_CACHE_FILE_PATH);
+}
+
+static Err bench_legacy_add(Bm *bm)
+{
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    bm->stack[bm->stack_size - 2].as_u64 += bm->stack[bm->stack_size - 1].as_u64;
+    bm->stack_size -= 1;
+
+    return ERR_OK;
+}
+
+static Err bench_typed_add(Bm *bm, const Word *args, Word *results)
+{
+    (void) bm;
+    results[0].as_u64 = args[0].as_u64 + args[1].as_u64;
+    return ERR_OK;
+}
+
+static const Bm_Native_Def bench_typed_add_def = {
+    .signature = {
+        .args = {{.type = TYPE_UNSIGNED_INT}, {.type = TYPE_UNSIGNED_INT}},
+        .args_size = 2,
+        .results = {TYPE_UNSIGNED_INT},
+        .results_size = 1,
+    },
+    .function = bench_typed_add,
+};
+
+// NOTE: calls the native 0 the amount of times specified by the operand of the instruction 2
+static const Inst bench_native_program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    // loop:
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_GEU},
+    {.type = INST_JMP_IF, .operand = {.as_u64 = 11}},
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_DROP},
+    {.type = INST_JMP,    .operand = {.as_u64 = 1}},
+    // end:
+    {.type = INST_HALT},
+};
+#define BENCH_NATIVE_PROGRAM_SIZE (sizeof(bench_native_program) / sizeof(bench_native_program[0]))
+
+static void bench_native(size_t iterations)
+{
+    static Inst program[BENCH_NATIVE_PROGRAM_SIZE];
+    memcpy(program, bench_native_program, sizeof(program));
+    program[2].operand.as_u64 = iterations;
+
+    static Bench_Image image = {0};
+    bench_image_make(&image, program, BENCH_NATIVE_PROGRAM_SIZE, 0, NULL, 0);
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    for (int typed = 0; typed <= 1; ++typed) {
+        Bm_Error error = {0};
+        if (!bm_load_program_from_memory(bm, image.data, image.size, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        if (typed) {
+            bm_push_native_def(bm, &bench_typed_add_def);
+        } else {
+            bm_push_tracked_native(bm, bench_legacy_add);
+        }
+
+        double begin = bench_now();
+        Err err = bm_execute_program(bm, -1);
+        double elapsed = bench_now() - begin;
+        if (err != ERR_OK) {
+            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+            exit(1);
+        }
+        assert(bm->stack_size == 1);
+        assert(bm->stack[0].as_u64 == iterations);
+
+        bench_report(typed ? "native: typed" : "native: legacy", iterations, elapsed, "iterations");
+    }
+
+    bm_destroy(bm);
+}
+
+// NOTE: a job that writes a byte into each of the first `pages` pages of
+// the memory and halts
+static const Inst bench_pool_program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},  // page
+    // loop:
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},  // pages
+    {.type = INST_GEU},
+    {.type = INST_JMP_IF, .operand = {.as_u64 = 13}},
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = BM_MEMORY_PAGE_SIZE}},
+    {.type = INST_MULTU},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 69}},
+    {.type = INST_WRITE8},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PLUSI},
+    {.type = INST_JMP,    .operand = {.as_u64 = 1}},
+    // end:
+    {.type = INST_DROP},
+    {.type = INST_HALT},
+};
+#define BENCH_POOL_PROGRAM_SIZE (sizeof(bench_pool_program) / sizeof(bench_pool_program[0]))
+
+static void bench_pool_run(Bm *bm)
+{
+    Err err = bm_execute_program(bm, -1);
+    if (err != ERR_OK) {
+        fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+        exit(1);
+    }
+    assert(bm->halt);
+}
+
+static void bench_pool(size_t iterations)
+{
+    const size_t pages_list[] = {1, 16, BM_MEMORY_PAGES_COUNT};
+
+    for (size_t k = 0; k < sizeof(pages_list) / sizeof(pages_list[0]); ++k) {
+        static Inst program[BENCH_POOL_PROGRAM_SIZE];
+        memcpy(program, bench_pool_program, sizeof(program));
+        program[2].operand.as_u64 = pages_list[k];
+
+        static Bench_Image image = {0};
+        bench_image_make(&image, program, BENCH_POOL_PROGRAM_SIZE, 0, NULL, 0);
+
+        char name[64];
+
+        {
+            Bm *bm = bm_create();
+            if (bm == NULL) {
+                fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+                exit(1);
+            }
+
+            double begin = bench_now();
+            for (size_t i = 0; i < iterations; ++i) {
+                memset(bm, 0, sizeof(*bm));
+                Bm_Error error = {0};
+                if (!bm_load_program_from_memory(bm, image.data, image.size, &error)) {
+                    fprintf(stderr, "ERROR: %s\n", error.message);
+                    exit(1);
+                }
+                bench_pool_run(bm);
+            }
+            double elapsed = bench_now() - begin;
+            bm_destroy(bm);
+
+            snprintf(name, sizeof(name), "pool: %zu pages: full reset", pages_list[k]);
+            bench_report(name, iterations, elapsed, "jobs");
+        }
+
+        {
+            Bm_Pool pool = {0};
+            Bm_Error error = {0};
+            if (!bm_pool_init(&pool, image.data, image.size, &error)) {
+                fprintf(stderr, "ERROR: %s\n", error.message);
+                exit(1);
+            }
+
+            double begin = bench_now();
+            for (size_t i = 0; i < iterations; ++i) {
+                Bm *bm = bm_pool_acquire(&pool);
+                if (bm == NULL) {
+                    fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+                    exit(1);
+                }
+                bench_pool_run(bm);
+                bm_pool_release(&pool, bm);
+            }
+            double elapsed = bench_now() - begin;
+
+            assert(pool.created == 1);
+            assert(pool.restored_pages == iterations * pages_list[k]);
+            bm_pool_free(&pool);
+
+            snprintf(name, sizeof(name), "pool: %zu pages: dirty reset", pages_list[k]);
+            bench_report(name, iterations, elapsed, "jobs");
+        }
+    }
+}
+
+#define BENCH_LOOPS_TRACE_FILE_PATH "bmbench-loops.bmt"
+
+typedef enum {
+    BENCH_LOOP_STEP = 0,
+    BENCH_LOOP_FAST,
+    BENCH_LOOP_CHECKED,
+    BENCH_LOOP_COUNTING,
+    BENCH_LOOP_TRACING,
+    COUNT_BENCH_LOOPS,
+} Bench_Loop;
+
+static const char *bench_loop_names[COUNT_BENCH_LOOPS] = {
+    [BENCH_LOOP_STEP]     = "loops: bm_execute_inst() one by one",
+    [BENCH_LOOP_FAST]     = "loops: fast",
+    [BENCH_LOOP_CHECKED]  = "loops: checked",
+    [BENCH_LOOP_COUNTING] = "loops: counting",
+    [BENCH_LOOP_TRACING]  = "loops: tracing",
+};
+
+static Err bench_loop_run(Bench_Loop loop, Bm *bm, Bm_Trace *trace, uint64_t *counts)
+{
+    switch (loop) {
+    case BENCH_LOOP_STEP:
+        while (!bm->halt) {
+            Err err = bm_execute_inst(bm);
+            if (err != ERR_OK) {
+                return err;
+            }
+        }
+        return ERR_OK;
+
+    case BENCH_LOOP_FAST:
+        return bm_execute_program(bm, -1);
+
+    case BENCH_LOOP_CHECKED:
+        return bm_execute_program(bm, INT_MAX);
+
+    case BENCH_LOOP_COUNTING:
+        return bm_execute_counting(bm, -1, counts);
+
+    case BENCH_LOOP_TRACING:
+        return bm_trace_execute_program(trace, bm, -1);
+
+    case COUNT_BENCH_LOOPS:
+    default:
+        assert(false && "unreachable");
+        exit(1);
+    }
+}
+
+static void bench_loops(size_t iterations)
+{
+    // NOTE: the small program sums the numbers up to `iterations` instead
+    static Inst program[BENCH_SMALL_PROGRAM_SIZE];
+    memcpy(program, bench_small_program, sizeof(program));
+    program[3].operand.as_u64 = iterations;
+
+    static Bench_Image image = {0};
+    bench_image_make(&image, program, BENCH_SMALL_PROGRAM_SIZE, 0, NULL, 0);
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    // NOTE: 2 instructions before the loop, 11 per iteration, 4 for the
+    // last check and 2 after it
+    const uint64_t insts = 11 * (uint64_t) iterations + 8;
+    static uint64_t counts[NUMBER_OF_INSTS] = {0};
+
+    for (Bench_Loop loop = 0; loop < COUNT_BENCH_LOOPS; ++loop) {
+        Bm_Error error = {0};
+        if (!bm_load_program_from_memory(bm, image.data, image.size, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        Bm_Trace trace = {0};
+        if (loop == BENCH_LOOP_TRACING) {
+            if (!bm_trace_open(&trace, BENCH_LOOPS_TRACE_FILE_PATH, BM_TRACE_DEFAULT_CAPACITY,
+                               bm, NULL, 0, &error)) {
+                fprintf(stderr, "ERROR: %s\n", error.message);
+                continue;
+            }
+        }
+
+        double begin = bench_now();
+        Err err = bench_loop_run(loop, bm, &trace, counts);
+        double elapsed = bench_now() - begin;
+
+        if (loop == BENCH_LOOP_TRACING) {
+            bm_trace_close(&trace);
+            remove(BENCH_LOOPS_TRACE_FILE_PATH);
+        }
+
+        if (err != ERR_OK) {
+            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+            exit(1);
+        }
+        assert(bm->stack_size == 1);
+        assert(bm->stack[0].as_u64 == iterations * (iterations - 1) / 2);
+
+        bench_report(bench_loop_names[loop], insts, elapsed, "insts");
+    }
+
+    uint64_t counted = 0;
+    for (Inst_Type type = 0; type < NUMBER_OF_INSTS; ++type) {
+        counted += counts[type];
+    }
+    assert(counted == insts);
+
+    bm_destroy(bm);
+}
+
+#ifndef _WIN32
+#define BENCH_RECORD_SIZE 64
+#define BENCH_CHANNEL_SLOTS 1024
+#define BENCH_CHANNEL_NAME "bmbench"
+
+// NOTE: drives a native from the host the same way INST_NATIVE would
+static void bench_native_call(Bm *bm, Bm_Native native, const Word *args, size_t args_count)
+{
+    assert(bm->stack_size + args_count <= BM_STACK_CAPACITY);
+    memcpy(&bm->stack[bm->stack_size], args, args_count * sizeof(args[0]));
+    bm->stack_size += args_count;
+
+    Err err = native(bm);
+    if (err != ERR_OK) {
+        fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+        exit(1);
+    }
+}
+
+static Word bench_pop(Bm *bm)
+{
+    assert(bm->stack_size > 0);
+    return bm->stack[--bm->stack_size];
+}
+
+static pid_t bench_fork(void)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "ERROR: could not fork: %s\n", strerror(errno));
+        exit(1);
+    }
+    return pid;
+}
+
+static void bench_wait(pid_t pid)
+{
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "ERROR: the producer process failed\n");
+        exit(1);
+    }
+}
+
+// NOTE: the producer process writes the records into its stdout that is
+// redirected into the pipe. The consumer reads them with the `read` native.
+static void bench_channel_pipe(Bm *bm, size_t iterations)
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        fprintf(stderr, "ERROR: could not create a pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    double begin = bench_now();
+
+    pid_t pid = bench_fork();
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+
+        for (size_t i = 0; i < iterations; ++i) {
+            memset(bm->memory, (int) (i & 0xFF), BENCH_RECORD_SIZE);
+            bench_native_call(bm, native_write, (Word[]) {
+                word_u64(0), word_u64(BENCH_RECORD_SIZE)
+            }, 2);
+        }
+
+        fflush(stdout);
+        exit(0);
+    }
+
+    close(fds[1]);
+    bm_attach_input(bm, fds[0]);
+
+    uint64_t received = 0;
+    for (;;) {
+        bench_native_call(bm, native_read, (Word[]) {
+            word_u64(0), word_u64(BENCH_RECORD_SIZE)
+        }, 2);
+        uint64_t size = bench_pop(bm).as_u64;
+        if (size == 0) {
+            break;
+        }
+        received += size;
+    }
+
+    double elapsed = bench_now() - begin;
+    close(fds[0]);
+    bench_wait(pid);
+
+    assert(received == iterations * BENCH_RECORD_SIZE);
+    bench_report("channel: pipe", iterations, elapsed, "records");
+}
+
+// NOTE: the producer process fills the slots in place and the consumer reads
+// them in place. Nothing is copied and the syscalls are only made when one of
+// the sides has to sleep.
+static void bench_channel_shm(Bm *bm, size_t iterations)
+{
+    double begin = bench_now();
+
+    pid_t pid = bench_fork();
+    const bool producer = pid == 0;
+
+    Bm_Error error = {0};
+    size_t channel = 0;
+    if (!bm_channel_open(bm, BENCH_CHANNEL_NAME, BENCH_RECORD_SIZE, BENCH_CHANNEL_SLOTS, &channel, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    if (producer) {
+        for (size_t i = 0; i < iterations; ) {
+            bench_native_call(bm, native_channel_acquire, (Word[]) {
+                word_u64(channel)
+            }, 1);
+            Memory_Addr addr = bench_pop(bm).as_u64;
+            if (addr == 0) {
+                bench_native_call(bm, native_channel_wait, (Word[]) {
+                    word_u64(channel), word_u64(1)
+                }, 2);
+                if (!bench_pop(bm).as_u64) {
+                    exit(1);
+                }
+                continue;
+            }
+
+            memset(bm_memory_range(bm, addr, BENCH_RECORD_SIZE, true), (int) (i & 0xFF), BENCH_RECORD_SIZE);
+            bench_native_call(bm, native_channel_publish, (Word[]) {
+                word_u64(channel), word_u64(BENCH_RECORD_SIZE)
+            }, 2);
+            i += 1;
+        }
+
+        bm_channel_close(bm, channel);
+        exit(0);
+    }
+
+    uint64_t received = 0;
+    for (;;) {
+        bench_native_call(bm, native_channel_peek, (Word[]) {
+            word_u64(channel)
+        }, 1);
+        uint64_t size = bench_pop(bm).as_u64;
+        Memory_Addr addr = bench_pop(bm).as_u64;
+        if (addr == 0) {
+            bench_native_call(bm, native_channel_wait, (Word[]) {
+                word_u64(channel), word_u64(0)
+            }, 2);
+            if (!bench_pop(bm).as_u64) {
+                break;
+            }
+            continue;
+        }
+
+        received += size;
+        bench_native_call(bm, native_channel_release, (Word[]) {
+            word_u64(channel)
+        }, 1);
+    }
+
+    double elapsed = bench_now() - begin;
+    bm_channel_close(bm, channel);
+    bench_wait(pid);
+
+    assert(received == iterations * BENCH_RECORD_SIZE);
+    bench_report("channel: shm", iterations, elapsed, "records");
+}
+
+static void bench_channel(size_t iterations)
+{
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    bench_channel_pipe(bm, iterations);
+    bench_channel_shm(bm, iterations);
+
+    bm_destroy(bm);
+}
+#endif // _WIN32
+
+#ifdef __linux__
+#define BENCH_ASYNC_SLEEPS 10
+#define BENCH_ASYNC_SLEEP_MS 10
+// NOTE: the blocking contexts are too slow to run all of them
+#define BENCH_ASYNC_BLOCKING_CONTEXTS 10
+
+// NOTE: simulates a request handler that waits for slow I/O several times
+static const Inst bench_async_program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},  // i
+    // loop:
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = BENCH_ASYNC_SLEEPS}},
+    {.type = INST_GEU},
+    {.type = INST_JMP_IF, .operand = {.as_u64 = 10}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = BENCH_ASYNC_SLEEP_MS}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},  // sleep
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PLUSI},
+    {.type = INST_JMP,    .operand = {.as_u64 = 1}},
+    // end:
+    {.type = INST_DROP},
+    {.type = INST_HALT},
+};
+#define BENCH_ASYNC_PROGRAM_SIZE (sizeof(bench_async_program) / sizeof(bench_async_program[0]))
+
+static Bm *bench_async_context(const Bench_Image *image)
+{
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    Bm_Error error = {0};
+    if (!bm_load_program_from_memory(bm, image->data, image->size, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    bm_push_native(bm, native_sleep);
+    return bm;
+}
+
+static void bench_async(size_t iterations)
+{
+    static Bench_Image image = {0};
+    bench_image_make(&image, bench_async_program, BENCH_ASYNC_PROGRAM_SIZE, 0, NULL, 0);
+
+    {
+        Bm *bm = bench_async_context(&image);
+        double begin = bench_now();
+        for (size_t i = 0; i < BENCH_ASYNC_BLOCKING_CONTEXTS; ++i) {
+            bm->ip = 0;
+            bm->halt = false;
+            Err err = bm_execute_program(bm, -1);
+            if (err != ERR_OK) {
+                fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+                exit(1);
+            }
+        }
+        double elapsed = bench_now() - begin;
+        bm_destroy(bm);
+
+        bench_report("async: blocking", BENCH_ASYNC_BLOCKING_CONTEXTS, elapsed, "contexts");
+    }
+
+    {
+        Bm_Event_Loop *loop = malloc(sizeof(*loop));
+        Bm **contexts = malloc(sizeof(*contexts) * iterations);
+        assert(loop != NULL);
+        assert(contexts != NULL);
+
+        Bm_Error error = {0};
+        if (!bm_event_loop_init(loop, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        for (size_t i = 0; i < iterations; ++i) {
+            contexts[i] = bench_async_context(&image);
+        }
+
+        double begin = bench_now();
+        for (size_t i = 0; i < iterations; ++i) {
+            if (!bm_event_loop_spawn(loop, contexts[i], &error)) {
+                fprintf(stderr, "ERROR: %s\n", error.message);
+                exit(1);
+            }
+        }
+
+        Err err = bm_event_loop_run(loop, NULL);
+        double elapsed = bench_now() - begin;
+        if (err != ERR_OK) {
+            fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
+            exit(1);
+        }
+
+        for (size_t i = 0; i < iterations; ++i) {
+            assert(contexts[i]->halt);
+            bm_destroy(contexts[i]);
+        }
+        bm_event_loop_free(loop);
+        free(contexts);
+        free(loop);
+
+        bench_report("async: event loop", iterations, elapsed, "contexts");
+    }
+}
+#endif // __linux__
+
+typedef struct {
+    const char *name;
+    const char *description;
+    void (*run)(size_t iterations);
+    size_t default_iterations;
+} Bench_Scenario;
+
+static const Bench_Scenario scenarios[] = {
+    {
+        .name = "load",
+        .description = "Load a small program from memory into the same context and run it to completion",
+        .run = bench_load,
+        .default_iterations = 100 * 1000,
+    },
+    {
+        .name = "call",
+        .description = "Call an exported routine of an already loaded program",
+        .run = bench_call,
+        .default_iterations = 10 * 1000 * 1000,
+    },
+    {
+        .name = "cache",
+        .description = "Load the same file with and without the image cache",
+        .run = bench_cache,
+        .default_iterations = 100 * 1000,
+    },
+    {
+        .name = "native",
+        .description = "Call a legacy and a typed native in a loop",
+        .run = bench_native,
+        .default_iterations = 10 * 1000 * 1000,
+    },
+    {
+        .name = "pool",
+        .description = "Run jobs that write to 1, 16 and all of the pages of the memory on a fully reset context and on a pooled one",
+        .run = bench_pool,
+        .default_iterations = 10 * 1000,
+    },
+    {
+        .name = "loops",
+        .description = "Run a loop of the given amount of iterations with each of the specialized interpreter loops",
+        .run = bench_loops,
+        .default_iterations = 10 * 1000 * 1000,
+    },
+#ifndef _WIN32
+    {
+        .name = "channel",
+        .description = "Pass 64 byte records from a producer process to a consumer one through a pipe and through a channel",
+        .run = bench_channel,
+        .default_iterations = 10 * 1000 * 1000,
+    },
+#endif // _WIN32
+#ifdef __linux__
+    {
+        .name = "async",
+        .description = "Run contexts that sleep 10 times for 10ms each one after another and on the event loop",
+        .run = bench_async,
+        .default_iterations = 1000,
+    },
+#endif // __linux__
+};
+#define SCENARIOS_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s [OPTIONS] <scenario>\n", program);
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -n <iterations>  Amount of iterations of the scenario\n");
+    fprintf(stream, "    -h               Print this help to stdout\n");
+    fprintf(stream, "SCENARIOS:\n");
+    for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+        fprintf(stream, "    %-16s %s\n", scenarios[i].name, scenarios[i].description);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *program = shift(&argc, &argv);
+    const char *scenario_name = NULL;
+    size_t iterations = 0;
+
+    while (argc > 0) {
+        const char *flag = shift(&argc, &argv);
+
+        if (strcmp(flag, "-n") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            iterations = strtoull(shift(&argc, &argv), NULL, 10);
+        } else if (strcmp(flag, "-h") == 0) {
+            usage(stdout, program);
+            exit(0);
+        } else {
+            if (scenario_name != NULL) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: scenario is already provided as `%s`\n", scenario_name);
+                exit(1);
+            }
+
+            scenario_name = flag;
+        }
+    }
+
+    if (scenario_name == NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: no scenario is provided\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < SCENARIOS_COUNT; ++i) {
+        if (strcmp(scenarios[i].name, scenario_name) == 0) {
+            scenarios[i].run(iterations > 0 ? iterations : scenarios[i].default_iterations);
+            return 0;
+        }
+    }
+
+    usage(stderr, program);
+    fprintf(stderr, "ERROR: unknown scenario `%s`\n", scenario_name);
+    exit(1);
+}
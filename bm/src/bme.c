@@ -1,28 +1,212 @@
 #include "./bm.h"
 #include "./native_loader.h"
+#include "./image_cache.h"
+#include "./metrics.h"
 #include "./path.h"
+#include "./record.h"
+#include "./snapshot.h"
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define O_RDONLY _O_RDONLY
+#endif // _WIN32
+
+// NOTE: the program is loaded through the cache, so the records and the
+// snapshots take the content hash and the decoded image from there instead
+// of reading the file again
+static Bm_Image_Cache image_cache = {0};
+
+static const char *snapshot_file_path = NULL;
+static Bm_Snapshot_Bindings snapshot_bindings = {0};
+
+static void bme_save_snapshot(Bm *bm)
+{
+    Bm_Error error = {0};
+    if (!bm_snapshot_save(bm, &snapshot_bindings, &image_cache, snapshot_file_path, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+}
+
+static Err bme_native_snapshot(Bm *bm)
+{
+    if (snapshot_file_path != NULL) {
+        // NOTE: the resumed program continues right after this native
+        bm->ip += 1;
+        bme_save_snapshot(bm);
+        bm->ip -= 1;
+    }
+    return ERR_OK;
+}
+
+static Bm_Recorder recorder = {0};
+static Bm_Native recorded_natives[BM_NATIVES_CAPACITY] = {0};
+static const Bm_Native_Def *recorded_native_defs[BM_NATIVES_CAPACITY] = {0};
+static bool recorded_natives_tracked[BM_NATIVES_CAPACITY] = {0};
+static Bm_Replayer replayer = {0};
+
+static Err bme_native_record(Bm *bm)
+{
+    const Native_ID id = bm->program[bm->ip].operand.as_u64;
+    Err err = ERR_OK;
+    Bm_Error error = {0};
+    if (!bm_recorder_call(&recorder, bm, recorded_natives[id], recorded_native_defs[id],
+                          recorded_natives_tracked[id], &err, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    return err;
+}
+
+static Err bme_native_replay(Bm *bm)
+{
+    Err err = ERR_OK;
+    Bm_Error error = {0};
+    if (!bm_replayer_call(&replayer, bm, &err, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    return err;
+}
+
+static bool metrics_enabled = false;
+static Bm_Metrics metrics = {0};
+static Bm_Native metered_natives[BM_NATIVES_CAPACITY] = {0};
+static const Bm_Native_Def *metered_native_defs[BM_NATIVES_CAPACITY] = {0};
+
+static Err bme_native_metrics(Bm *bm)
+{
+    const Native_ID id = bm->program[bm->ip].operand.as_u64;
+    const uint64_t started_ns = bm_metrics_now_ns();
+
+    Err err = ERR_OK;
+    if (metered_natives[id]) {
+        err = metered_natives[id](bm);
+    } else if (metered_native_defs[id]) {
+        err = bm_call_native_def(bm, metered_native_defs[id]);
+    } else {
+        err = ERR_NULL_NATIVE;
+    }
+
+    // NOTE: the lazy natives patch their slot on the first call. Take the
+    // resolved native and put the wrapper back.
+    if (bm->natives[id] != bme_native_metrics || bm->native_defs[id] != NULL) {
+        metered_natives[id] = bm->natives[id];
+        metered_native_defs[id] = bm->native_defs[id];
+        bm->natives[id] = bme_native_metrics;
+        bm->native_defs[id] = NULL;
+    }
+
+    bm_metrics_native_called(&metrics, bm, id, started_ns);
+    return err;
+}
+
+static uint64_t bme_image_hash(const char *file_path)
+{
+    Bm_Error error = {0};
+    const Bm_Image_Cache_Entry *entry = bm_image_cache_get(&image_cache, file_path, &error);
+    if (entry == NULL) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    return entry->hash;
+}
+
+static void bme_copy_path(char *dst, const char *src)
+{
+    if (strlen(src) >= BM_SNAPSHOT_PATH_CAPACITY) {
+        fprintf(stderr, "ERROR: path `%s` is too long to be saved in a snapshot\n", src);
+        exit(1);
+    }
+    strcpy(dst, src);
+}
+
+// NOTE: only filled in with -stats. The counting loop is used only then,
+// so the regular runs do not pay for it.
+static bool stats = false;
+static uint64_t stats_counts[NUMBER_OF_INSTS] = {0};
+
+static Err bme_execute(Bm *bm, int limit)
+{
+    if (metrics_enabled) {
+        return bm_metrics_execute_program(&metrics, bm, limit);
+    }
+
+    if (stats) {
+        return bm_execute_counting(bm, limit, stats_counts);
+    }
+
+    return bm_execute_program(bm, limit);
+}
+
+static void bme_print_stats(void)
+{
+    uint64_t total = 0;
+    for (Inst_Type type = 0; type < NUMBER_OF_INSTS; ++type) {
+        total += stats_counts[type];
+    }
+
+    fprintf(stderr, "INFO: %"PRIu64" instructions executed\n", total);
+    for (Inst_Type type = 0; type < NUMBER_OF_INSTS; ++type) {
+        if (stats_counts[type] > 0) {
+            fprintf(stderr, "INFO:   %-10s %"PRIu64"\n", get_inst_def(type).name, stats_counts[type]);
+        }
+    }
+}
 
 static void usage(FILE *stream, const char *program)
 {
     fprintf(stream, "Usage: %s [OPTIONS] <input.bm>\n", program);
+    fprintf(stream, "       %s [OPTIONS] -resume <snapshot.bms>\n", program);
     fprintf(stream, "OPTIONS:\n");
     fprintf(stream, "    -l <limit>      Limit the amount of steps of the emulation.\n");
     fprintf(stream, "                    -1 means not limitation\n");
     fprintf(stream, "    -n <.so|.DLL>   File path to a dynamic library to load native\n");
     fprintf(stream, "                    functions from. You can provide several of them.\n");
+    fprintf(stream, "    -m <manifest>   Binding manifest that remembers which dynamic library\n");
+    fprintf(stream, "                    provides which native function. It is created if it\n");
+    fprintf(stream, "                    does not exist and updated after the execution.\n");
+    fprintf(stream, "    -i <file>       Read the input of the `read` and `read_line` natives\n");
+    fprintf(stream, "                    from the file instead of stdin.\n");
+    fprintf(stream, "    -eager          Resolve all the native functions before the execution\n");
+    fprintf(stream, "                    instead of on their first call.\n");
+    fprintf(stream, "    -snapshot <file.bms>\n");
+    fprintf(stream, "                    Save the state of the program into the file when\n");
+    fprintf(stream, "                    it calls the `snapshot` native.\n");
+    fprintf(stream, "    -snapshot-after <steps>\n");
+    fprintf(stream, "                    Also save it after the amount of steps of the emulation.\n");
+    fprintf(stream, "    -resume <file.bms>\n");
+    fprintf(stream, "                    Continue the program from the snapshot instead of\n");
+    fprintf(stream, "                    loading a .bm file.\n");
+    fprintf(stream, "    -record <file.bmn>\n");
+    fprintf(stream, "                    Record the effects of all the native calls into the\n");
+    fprintf(stream, "                    file. Implies -eager.\n");
+    fprintf(stream, "    -replay <file.bmn>\n");
+    fprintf(stream, "                    Replay the recorded effects instead of calling the\n");
+    fprintf(stream, "                    natives.\n");
+    fprintf(stream, "    -stats          Print how many times each instruction was executed.\n");
+    fprintf(stream, "    -metrics        Publish live metrics of the execution in the shared\n");
+    fprintf(stream, "                    memory. Use bmstat <pid> to read them.\n");
     fprintf(stream, "    -h              Print this help to stdout\n");
 }
 
 int main(int argc, char **argv)
 {
-    // NOTE: The structure might be quite big due its arena. Better allocate it in the static memory.
-    static Arena arena = {0};
-    static Bm bm = {0};
+    // NOTE: The structure might be quite big due its symbols table. Better allocate it in the static memory.
     static Native_Loader native_loader = {0};
 
     const char *program = shift(&argc, &argv);
     const char *input_file_path = NULL;
     int limit = -1;
+    const char *manifest_file_path = NULL;
+    bool eager = false;
+    const char *read_file_path = NULL;
+    const char *resume_file_path = NULL;
+    int snapshot_after = 0;
+    const char *record_file_path = NULL;
+    const char *replay_file_path = NULL;
 
     while (argc > 0) {
         const char *flag = shift(&argc, &argv);
@@ -38,6 +222,68 @@ int main(int argc, char **argv)
         } else if (strcmp(flag, "-h") == 0) {
             usage(stdout, program);
             exit(0);
+        } else if (strcmp(flag, "-m") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            manifest_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-i") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            read_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-snapshot") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            snapshot_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-snapshot-after") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            snapshot_after = atoi(shift(&argc, &argv));
+        } else if (strcmp(flag, "-resume") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            resume_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-record") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            record_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-replay") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            replay_file_path = shift(&argc, &argv);
+        } else if (strcmp(flag, "-eager") == 0) {
+            eager = true;
+        } else if (strcmp(flag, "-stats") == 0) {
+            stats = true;
+        } else if (strcmp(flag, "-metrics") == 0) {
+            metrics_enabled = true;
         } else if (strcmp(flag, "-n") == 0) {
             if (argc == 0) {
                 usage(stderr, program);
@@ -58,37 +304,206 @@ int main(int argc, char **argv)
         }
     }
 
-    if (input_file_path == NULL) {
+    if (input_file_path == NULL && resume_file_path == NULL) {
         usage(stderr, program);
         fprintf(stderr, "ERROR: input was not provided\n");
         exit(1);
     }
 
-    bm_load_program_from_file(&bm, input_file_path);
+    if (stats && metrics_enabled) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: -stats and -metrics can not be used together\n");
+        exit(1);
+    }
 
-    for (size_t i = 0; i < bm.externals_size; ++i) {
-        if (strcmp(bm.externals[i].name, "write") == 0) {
-            bm_push_native(&bm, native_write);
-        } else if (strcmp(bm.externals[i].name, "external") == 0) {
-            bm_push_native(&bm, native_external);
-        } else {
-            Bm_Native native = native_loader_find_function(&native_loader, &arena, bm.externals[i].name);
-            if (native == NULL) {
-                fprintf(stderr, "ERROR: could not find external native function `%s`. Make sure you attached all the necessary dynamic libraries via the `-n` flag.\n", bm.externals[i].name);
+    if (input_file_path != NULL && resume_file_path != NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: input file `%s` can not be provided together with a snapshot to resume\n", input_file_path);
+        exit(1);
+    }
+
+    if (snapshot_after > 0 && snapshot_file_path == NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: `-snapshot-after` requires `-snapshot`\n");
+        exit(1);
+    }
+
+    if (record_file_path != NULL && replay_file_path != NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: `-record` and `-replay` can not be used together\n");
+        exit(1);
+    }
+
+    if ((record_file_path != NULL || replay_file_path != NULL) && resume_file_path != NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: native calls can only be recorded and replayed from the beginning of the program\n");
+        exit(1);
+    }
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the Virtual Machine\n");
+        exit(1);
+    }
+
+    Bm_Error error = {0};
+    if (resume_file_path != NULL) {
+        // NOTE: static, since the loader keeps the paths of the objects
+        static Bm_Snapshot_Bindings resumed = {0};
+        if (!bm_snapshot_restore(bm, resume_file_path, &resumed, &error)) {
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        for (size_t i = 0; i < resumed.objects_size; ++i) {
+            native_loader_add_object(&native_loader, resumed.object_paths[i]);
+        }
+        input_file_path = resumed.image_path;
+    } else if (!bm_image_cache_load_from_file(&image_cache, bm, input_file_path, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    if (snapshot_file_path != NULL) {
+        bme_copy_path(snapshot_bindings.image_path, input_file_path);
+        if (native_loader.objects_size > BM_SNAPSHOT_OBJECTS_CAPACITY) {
+            fprintf(stderr, "ERROR: too many dynamic libraries to be saved in a snapshot\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < native_loader.objects_size; ++i) {
+            bme_copy_path(snapshot_bindings.object_paths[i], native_loader.object_paths[i]);
+        }
+        snapshot_bindings.objects_size = native_loader.objects_size;
+    }
+
+    if (read_file_path != NULL) {
+        int fd = open(read_file_path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "ERROR: could not open file `%s`: %s\n",
+                    read_file_path, strerror(errno));
+            exit(1);
+        }
+        bm_attach_input(bm, fd);
+    }
+
+    Bm_Error record_error = {0};
+    if (replay_file_path != NULL) {
+        if (!bm_replayer_open(&replayer, replay_file_path, bme_image_hash(input_file_path), &record_error)) {
+            fprintf(stderr, "ERROR: %s\n", record_error.message);
+            exit(1);
+        }
+
+        // NOTE: the natives are not even loaded
+        for (size_t i = 0; i < bm->externals_size; ++i) {
+            // NOTE: the replayer marks the pages it writes to
+            bm_push_tracked_native(bm, bme_native_replay);
+        }
+    } else {
+        if (manifest_file_path != NULL) {
+            // NOTE: a missing manifest is fine, it is going to be created after the execution
+            native_loader_load_manifest(&native_loader, manifest_file_path);
+        }
+
+        const char *missing_name = NULL;
+        if (!native_loader_bind_externals(&native_loader, bm, !eager && record_file_path == NULL, &missing_name)) {
+            fprintf(stderr, "ERROR: could not find external native function `%s`. Make sure you attached all the necessary dynamic libraries via the `-n` flag.\n", missing_name);
+            exit(1);
+        }
+
+        for (size_t i = 0; i < bm->externals_size; ++i) {
+            if (strcmp(bm->externals[i].name, "snapshot") == 0) {
+                bm->natives[i] = bme_native_snapshot;
+                bm->native_defs[i] = NULL;
+            }
+        }
+
+        // NOTE: every slot is wrapped by the recorder. That is why the natives
+        // are resolved eagerly: the lazy ones would patch the wrappers away.
+        if (record_file_path != NULL) {
+            if (!bm_recorder_open(&recorder, record_file_path, bme_image_hash(input_file_path), &record_error)) {
+                fprintf(stderr, "ERROR: %s\n", record_error.message);
                 exit(1);
             }
 
-            bm_push_native(&bm, native);
+            for (size_t i = 0; i < bm->natives_size; ++i) {
+                recorded_natives[i] = bm->natives[i];
+                recorded_native_defs[i] = bm->native_defs[i];
+                recorded_natives_tracked[i] = bm->natives_tracked[i];
+                // NOTE: the recorder finds out what the native writes to
+                // either way
+                bm->natives[i] = bme_native_record;
+                bm->native_defs[i] = NULL;
+                bm->natives_tracked[i] = true;
+            }
         }
     }
 
-    Err err = bm_execute_program(&bm, limit);
+    if (metrics_enabled) {
+        Bm_Error metrics_error = {0};
+        if (!bm_metrics_open(&metrics, bm,
+                             input_file_path != NULL ? input_file_path : resume_file_path,
+                             &metrics_error)) {
+            fprintf(stderr, "ERROR: %s\n", metrics_error.message);
+            exit(1);
+        }
+
+        for (size_t i = 0; i < bm->natives_size; ++i) {
+            metered_natives[i] = bm->natives[i];
+            metered_native_defs[i] = bm->native_defs[i];
+            bm->natives[i] = bme_native_metrics;
+            bm->native_defs[i] = NULL;
+        }
+    }
+
+    Err err = ERR_OK;
+    if (snapshot_after > 0 && (limit < 0 || snapshot_after < limit)) {
+        err = bme_execute(bm, snapshot_after);
+        if (err == ERR_OK && !bm->halt) {
+            bme_save_snapshot(bm);
+        }
+        if (limit > 0) {
+            limit -= snapshot_after;
+        }
+    }
+
+    if (err == ERR_OK) {
+        err = bme_execute(bm, limit);
+    }
+
+    if (stats) {
+        bme_print_stats();
+    }
+
+    bm_metrics_close(&metrics, bm);
+
+    if (record_file_path != NULL && !bm_recorder_close(&recorder, &record_error)) {
+        fprintf(stderr, "ERROR: %s\n", record_error.message);
+        exit(1);
+    }
+
+    if (replay_file_path != NULL) {
+        if (err == ERR_OK && bm->halt && !bm_replayer_finished(&replayer)) {
+            fprintf(stderr, "ERROR: %s: the program made fewer native calls than recorded (%"PRIu64")\n",
+                    replay_file_path, replayer.calls);
+            exit(1);
+        }
+        bm_replayer_close(&replayer);
+    }
+
+    if (manifest_file_path != NULL &&
+            native_loader.manifest_outdated &&
+            !native_loader_save_manifest(&native_loader, manifest_file_path)) {
+        fprintf(stderr, "WARNING: could not save the binding manifest to `%s`: %s\n",
+                manifest_file_path, strerror(errno));
+    }
 
     if (err != ERR_OK) {
         fprintf(stderr, "ERROR: %s\n", err_as_cstr(err));
         return 1;
     }
 
+    bm_destroy(bm);
+    bm_image_cache_clear(&image_cache);
     native_loader_unload_all(&native_loader);
 
     return 0;
@@ -3,6 +3,12 @@
 #include "./path.h"
 
 #include <stdarg.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define O_RDONLY _O_RDONLY
+#endif // _WIN32
 
 typedef struct {
     size_t size;
@@ -89,15 +95,12 @@ static Err bmr_write(Bm *bm)
     Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
     uint64_t count = bm->stack[bm->stack_size - 1].as_u64;
 
-    if (addr >= BM_MEMORY_CAPACITY) {
+    const uint8_t *data = bm_memory_range(bm, addr, count, false);
+    if (data == NULL) {
         return ERR_ILLEGAL_MEMORY_ACCESS;
     }
 
-    if (addr + count < addr || addr + count >= BM_MEMORY_CAPACITY) {
-        return ERR_ILLEGAL_MEMORY_ACCESS;
-    }
-
-    buffer_write(&actual_buffer, (void*) &bm->memory[addr], count);
+    buffer_write(&actual_buffer, (const char*) data, count);
 
     bm->stack_size -= 2;
 
@@ -106,7 +109,7 @@ static Err bmr_write(Bm *bm)
 
 static void usage(FILE *stream)
 {
-    fprintf(stream, "Usage: ./bmr -p <program.bm> [-ao <actual-output.txt>] [-eo <expected-output.txt>]\n");
+    fprintf(stream, "Usage: ./bmr -p <program.bm> [-i <input.txt>] [-ao <actual-output.txt>] [-eo <expected-output.txt>]\n");
 }
 
 static void compare_outputs(const char *file_path, String_View expected, String_View actual)
@@ -142,6 +145,7 @@ int main(int argc, char *argv[])
     const char *program_file_path = NULL;
     const char *actual_output_file_path = NULL;
     const char *expected_output_file_path = NULL;
+    const char *input_file_path = NULL;
 
     while (argc > 0) {
         const char *flag = shift(&argc, &argv);
@@ -152,6 +156,8 @@ int main(int argc, char *argv[])
             actual_output_file_path = parse_cstr_value(flag, &argc, &argv);
         } else if(strcmp(flag, "-eo") == 0) {
             expected_output_file_path = parse_cstr_value(flag, &argc, &argv);
+        } else if(strcmp(flag, "-i") == 0) {
+            input_file_path = parse_cstr_value(flag, &argc, &argv);
         } else {
             panic("unknown flag `%s`", flag);
         }
@@ -172,18 +178,33 @@ int main(int argc, char *argv[])
 
     bm_load_program_from_file(&bm, program_file_path);
 
+    // NOTE: without an explicit input the tests must not depend on whatever is in stdin
+    int input_fd = -1;
+    if (input_file_path) {
+        input_fd = open(input_file_path, O_RDONLY);
+        if (input_fd < 0) {
+            panic_errno("could not open input file `%s`", input_file_path);
+        }
+    }
+    bm_attach_input(&bm, input_fd);
+
     for (size_t i = 0; i < bm.externals_size; ++i) {
+        Bm_Native native = NULL;
         if (strcmp(bm.externals[i].name, "write") == 0) {
-            bm_push_native(&bm, bmr_write);
-        } else if (strcmp(bm.externals[i].name, "external") == 0) {
-            bm_push_native(&bm, native_external);
+            native = bmr_write;
         } else {
+            native = bm_builtin_native_by_name(bm.externals[i].name);
+        }
+
+        if (native == NULL) {
             fprintf(stderr, "ERROR: bmr does not provide native function `%s`\n", bm.externals[i].name);
             exit(1);
         }
+
+        bm_push_tracked_native(&bm, native);
     }
 
-    bm_push_native(&bm, bmr_write); // 0
+    bm_push_tracked_native(&bm, bmr_write); // 0
 
     Err err = bm_execute_program(&bm, -1);
     if (err != ERR_OK) {
@@ -0,0 +1,165 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include <time.h>
+
+#include "./bm.h"
+#include "./metrics.h"
+#include "./path.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif // _WIN32
+
+// NOTE: bmstat prints the live metrics that `bme -metrics` publishes. It only
+// reads the shared memory, so the observed process is never paused.
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s [OPTIONS] <pid>\n", program);
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -w <ms>    Keep printing the metrics every <ms> milliseconds\n");
+    fprintf(stream, "               until the process halts\n");
+    fprintf(stream, "    -h         Print this help to stdout\n");
+}
+
+static double ns_to_secs(uint64_t ns)
+{
+    return (double) ns * 1e-9;
+}
+
+static void print_metrics(const Bm_Metrics_Page *page, const Bm_Metrics_Page *previous)
+{
+    const uint64_t uptime_ns = page->updated_ns - page->started_ns;
+    const uint64_t bytecode_ns = uptime_ns > page->natives_ns ? uptime_ns - page->natives_ns : 0;
+
+    printf("program:  %s (pid %"PRIi64")%s\n", page->program, page->pid,
+           page->halted ? " halted" : "");
+    printf("uptime:   %.3lfs (bytecode %.3lfs, natives %.3lfs)\n",
+           ns_to_secs(uptime_ns), ns_to_secs(bytecode_ns), ns_to_secs(page->natives_ns));
+
+    printf("insts:    %"PRIu64, page->insts);
+    if (previous != NULL && page->updated_ns > previous->updated_ns) {
+        printf(" (%.0lf/s)", (double) (page->insts - previous->insts) /
+               ns_to_secs(page->updated_ns - previous->updated_ns));
+    }
+    printf("\n");
+
+    printf("ip:       %"PRIu64, page->ip);
+    if (page->label[0] != '\0') {
+        printf(" (in %s)", page->label);
+    }
+    if (page->inst_type < NUMBER_OF_INSTS) {
+        printf(": %s", get_inst_def((Inst_Type) page->inst_type).name);
+    }
+    printf("\n");
+
+    printf("stack:    %"PRIu64" (peak %"PRIu64")\n", page->stack_size, page->stack_peak);
+    printf("memory:   %"PRIu64" bytes written at most\n", page->memory_high);
+
+    printf("natives:\n");
+    for (size_t i = 0; i < page->natives_size && i < BM_NATIVES_CAPACITY; ++i) {
+        if (page->native_calls[i] > 0) {
+            printf("    %-24s %"PRIu64"\n", page->native_names[i], page->native_calls[i]);
+        }
+    }
+}
+
+static void sleep_ms(uint64_t ms)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t) (ms / 1000),
+        .tv_nsec = (long) (ms % 1000) * 1000 * 1000,
+    };
+#ifndef _WIN32
+    nanosleep(&ts, NULL);
+#else
+    (void) ts;
+#endif // _WIN32
+}
+
+int main(int argc, char **argv)
+{
+    const char *program = shift(&argc, &argv);
+    const char *pid_cstr = NULL;
+    uint64_t watch_ms = 0;
+
+    while (argc > 0) {
+        const char *flag = shift(&argc, &argv);
+
+        if (strcmp(flag, "-w") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            watch_ms = strtoull(shift(&argc, &argv), NULL, 10);
+            if (watch_ms == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: the interval is expected to be a positive amount of milliseconds\n");
+                exit(1);
+            }
+        } else if (strcmp(flag, "-h") == 0) {
+            usage(stdout, program);
+            exit(0);
+        } else {
+            if (pid_cstr != NULL) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: pid is already provided as `%s`\n", pid_cstr);
+                exit(1);
+            }
+
+            pid_cstr = flag;
+        }
+    }
+
+    if (pid_cstr == NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: no pid is provided\n");
+        exit(1);
+    }
+
+    char *endptr = NULL;
+    const int64_t pid = strtoll(pid_cstr, &endptr, 10);
+    if (endptr == pid_cstr || *endptr != '\0') {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: `%s` is not a valid pid\n", pid_cstr);
+        exit(1);
+    }
+
+    // NOTE: the page is quite big, better keep it in the static memory
+    static Bm_Metrics_Page pages[2] = {0};
+    Bm_Metrics_Page *page = &pages[0];
+    Bm_Metrics_Page *previous = NULL;
+
+    for (;;) {
+        Bm_Error error = {0};
+        if (!bm_metrics_read(pid, page, &error)) {
+            if (previous != NULL) {
+                // NOTE: the process removed its page on exit
+                return 0;
+            }
+            fprintf(stderr, "ERROR: %s\n", error.message);
+            exit(1);
+        }
+
+        print_metrics(page, previous);
+
+        if (watch_ms == 0 || page->halted) {
+            break;
+        }
+
+        printf("\n");
+        fflush(stdout);
+        sleep_ms(watch_ms);
+
+        previous = page;
+        page = page == &pages[0] ? &pages[1] : &pages[0];
+    }
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+#include "./bm.h"
+#include "./path.h"
+#include "./trace.h"
+
+// NOTE: bmtrace decodes the traces recorded by `bang run -t`. The trace
+// carries the program and the symbols, so nothing else is needed to print it.
+
+typedef struct {
+    const Bm_Trace_Header *header;
+    const Inst *program;
+    // NOTE: sorted by the address
+    Bm_Trace_Symbol *symbols;
+    size_t symbols_size;
+    const uint8_t *ring;
+} Trace_File;
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const Inst_Addr addr_a = ((const Bm_Trace_Symbol *) a)->addr;
+    const Inst_Addr addr_b = ((const Bm_Trace_Symbol *) b)->addr;
+    return (addr_a > addr_b) - (addr_a < addr_b);
+}
+
+static void trace_file_load(Trace_File *file, const char *file_path)
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+    Bm_Error error = {0};
+    if (!bm_slurp_file(file_path, &data, &size, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    if (size < sizeof(Bm_Trace_Header)) {
+        fprintf(stderr, "ERROR: %s: trace is too small\n", file_path);
+        exit(1);
+    }
+
+    file->header = (const Bm_Trace_Header *) data;
+    const Bm_Trace_Header *header = file->header;
+
+    if (header->magic != BM_TRACE_MAGIC) {
+        fprintf(stderr, "ERROR: %s: does not appear to be a valid BM trace. Unexpected magic %04X. Expected %04X.\n",
+                file_path, header->magic, BM_TRACE_MAGIC);
+        exit(1);
+    }
+
+    if (header->version != BM_TRACE_VERSION) {
+        fprintf(stderr, "ERROR: %s: unsupported version of BM trace %d. Expected version %d.\n",
+                file_path, header->version, BM_TRACE_VERSION);
+        exit(1);
+    }
+
+    const size_t symbols_offset = sizeof(*header) + sizeof(Inst) * header->program_size;
+    if (header->program_size > BM_PROGRAM_CAPACITY ||
+            header->capacity == 0 ||
+            (header->capacity & (header->capacity - 1)) != 0 ||
+            header->ring_offset < symbols_offset + sizeof(Bm_Trace_Symbol) * header->symbols_size ||
+            header->ring_offset + header->capacity > size ||
+            header->tail > header->head ||
+            header->head - header->tail > header->capacity) {
+        fprintf(stderr, "ERROR: %s: trace is corrupted\n", file_path);
+        exit(1);
+    }
+
+    file->program = (const Inst *) (data + sizeof(*header));
+    file->symbols_size = header->symbols_size;
+    file->symbols = malloc(sizeof(file->symbols[0]) * file->symbols_size);
+    assert(file->symbols != NULL || file->symbols_size == 0);
+    memcpy(file->symbols, data + symbols_offset, sizeof(file->symbols[0]) * file->symbols_size);
+    qsort(file->symbols, file->symbols_size, sizeof(file->symbols[0]), compare_symbols);
+    file->ring = data + header->ring_offset;
+}
+
+// Returns the symbol the address belongs to or NULL
+static const Bm_Trace_Symbol *trace_file_symbolize(const Trace_File *file, Inst_Addr addr)
+{
+    const Bm_Trace_Symbol *result = NULL;
+    size_t begin = 0;
+    size_t end = file->symbols_size;
+    while (begin < end) {
+        const size_t middle = begin + (end - begin) / 2;
+        if (file->symbols[middle].addr <= addr) {
+            result = &file->symbols[middle];
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return result;
+}
+
+static uint64_t trace_file_unit(const Trace_File *file, uint64_t offset)
+{
+    uint64_t unit = 0;
+    memcpy(&unit, &file->ring[offset & (file->header->capacity - 1)], sizeof(unit));
+    return unit;
+}
+
+static void usage(FILE *stream, const char *program)
+{
+    fprintf(stream, "Usage: %s [OPTIONS] <trace.bmt>\n", program);
+    fprintf(stream, "OPTIONS:\n");
+    fprintf(stream, "    -inst <name>    Only print the records of this instruction\n");
+    fprintf(stream, "    -symbol <name>  Only print the records within this symbol\n");
+    fprintf(stream, "    -writes         Only print the records that wrote to the memory\n");
+    fprintf(stream, "    -stats          Print how many times each instruction was executed\n");
+    fprintf(stream, "                    instead of the records\n");
+    fprintf(stream, "    -h              Print this help to stdout\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *program = shift(&argc, &argv);
+    const char *trace_file_path = NULL;
+    const char *symbol_name = NULL;
+    bool filter_inst = false;
+    Inst_Def inst_def = {0};
+    bool writes_only = false;
+    bool stats = false;
+
+    while (argc > 0) {
+        const char *flag = shift(&argc, &argv);
+
+        if (strcmp(flag, "-inst") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            const char *name = shift(&argc, &argv);
+            if (!inst_by_name(sv_from_cstr(name), &inst_def)) {
+                fprintf(stderr, "ERROR: unknown instruction `%s`\n", name);
+                exit(1);
+            }
+            filter_inst = true;
+        } else if (strcmp(flag, "-symbol") == 0) {
+            if (argc == 0) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: No argument is provided for flag `%s`\n", flag);
+                exit(1);
+            }
+
+            symbol_name = shift(&argc, &argv);
+        } else if (strcmp(flag, "-writes") == 0) {
+            writes_only = true;
+        } else if (strcmp(flag, "-stats") == 0) {
+            stats = true;
+        } else if (strcmp(flag, "-h") == 0) {
+            usage(stdout, program);
+            exit(0);
+        } else {
+            if (trace_file_path != NULL) {
+                usage(stderr, program);
+                fprintf(stderr, "ERROR: trace file is already provided as `%s`\n", trace_file_path);
+                exit(1);
+            }
+
+            trace_file_path = flag;
+        }
+    }
+
+    if (trace_file_path == NULL) {
+        usage(stderr, program);
+        fprintf(stderr, "ERROR: no trace file is provided\n");
+        exit(1);
+    }
+
+    Trace_File file = {0};
+    trace_file_load(&file, trace_file_path);
+    const Bm_Trace_Header *header = file.header;
+
+    uint64_t counts[NUMBER_OF_INSTS] = {0};
+    uint64_t shown = 0;
+    uint64_t kept = 0;
+
+    for (uint64_t offset = header->tail; offset < header->head; ) {
+        const uint64_t unit = trace_file_unit(&file, offset);
+        Bm_Trace_Record record = {0};
+        memcpy(&record, &unit, sizeof(record));
+
+        if ((record.kind != BM_TRACE_RECORD_INST && record.kind != BM_TRACE_RECORD_WRITE) ||
+                record.type >= NUMBER_OF_INSTS ||
+                record.ip >= header->program_size) {
+            fprintf(stderr, "ERROR: %s: trace is corrupted at offset %"PRIu64"\n",
+                    trace_file_path, offset);
+            exit(1);
+        }
+
+        uint64_t write_addr = 0;
+        uint64_t write_value = 0;
+        if (record.kind == BM_TRACE_RECORD_WRITE) {
+            write_addr = trace_file_unit(&file, offset + sizeof(uint64_t));
+            write_value = trace_file_unit(&file, offset + 2 * sizeof(uint64_t));
+        }
+        offset += BM_TRACE_RECORD_SIZE(record.kind);
+        kept += 1;
+
+        if (filter_inst && record.type != inst_def.type) {
+            continue;
+        }
+
+        if (writes_only && record.kind != BM_TRACE_RECORD_WRITE) {
+            continue;
+        }
+
+        const Bm_Trace_Symbol *symbol = trace_file_symbolize(&file, record.ip);
+        if (symbol_name != NULL && (symbol == NULL || strcmp(symbol->name, symbol_name) != 0)) {
+            continue;
+        }
+
+        shown += 1;
+        if (stats) {
+            counts[record.type] += 1;
+            continue;
+        }
+
+        if (symbol != NULL) {
+            printf("%s+%"PRIu64"\t", symbol->name, (uint64_t) record.ip - symbol->addr);
+        } else {
+            printf("?\t");
+        }
+
+        const Inst inst = file.program[record.ip];
+        const Inst_Def def = get_inst_def(inst.type);
+        printf("%04"PRIX32": %s", record.ip, def.name);
+        if (def.has_operand) {
+            printf(" %"PRIu64, inst.operand.as_u64);
+        }
+
+        if (record.kind == BM_TRACE_RECORD_WRITE) {
+            printf("\t[%"PRIX64"] <- %"PRIu64, write_addr, write_value);
+        }
+        printf("\n");
+    }
+
+    if (stats) {
+        for (Inst_Type type = 0; type < NUMBER_OF_INSTS; ++type) {
+            if (counts[type] > 0) {
+                printf("%-10s %"PRIu64"\n", get_inst_def(type).name, counts[type]);
+            }
+        }
+    }
+
+    fprintf(stderr, "INFO: %"PRIu64" records shown, %"PRIu64" in the trace, %"PRIu64" dropped\n",
+            shown, kept, header->records - kept);
+
+    return 0;
+}
@@ -0,0 +1,563 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include "./bm.h"
+
+#ifndef _WIN32
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif // __linux__
+
+#define BM_CHANNEL_MAGIC 0x6c6e6863
+// NOTE: the header takes the whole first page of the object, so the slots
+// start on a page boundary and can be mapped into the window without it
+#define BM_CHANNEL_HEADER_SIZE 4096
+#define BM_CHANNEL_CACHE_LINE 64
+// NOTE: how many times the side that did not create the channel checks if the
+// other one finished initializing it
+#define BM_CHANNEL_ATTACH_ATTEMPTS 100000
+// NOTE: how many times a waiting side checks the channel before going to
+// sleep. The other side is usually just a few records behind, and a futex
+// round trip costs much more than that.
+#define BM_CHANNEL_SPIN_ATTEMPTS 64
+// NOTE: the producer and the consumer
+#define BM_CHANNEL_SIDES 2
+
+// NOTE: The producer only writes `head` and the consumer only writes `tail`,
+// so they live on separate cache lines. `*_seq` are the futex words. They are
+// only touched when the corresponding `*_waiters` counter says that somebody
+// is about to sleep, so the fast path is a single store on each side.
+// `pids` are the processes attached to the sides, 0 for a side that is free
+// or was closed. They tell an object left behind by a crashed run from a
+// channel that somebody is still using.
+struct Bm_Channel_Header {
+    _Atomic uint32_t magic;
+    _Atomic uint32_t closed;
+    uint64_t slot_size;
+    uint64_t slots_count;
+    _Atomic int32_t pids[BM_CHANNEL_SIDES];
+
+    alignas(BM_CHANNEL_CACHE_LINE) _Atomic uint64_t head;
+    _Atomic uint32_t data_seq;
+    _Atomic uint32_t data_waiters;
+
+    alignas(BM_CHANNEL_CACHE_LINE) _Atomic uint64_t tail;
+    _Atomic uint32_t space_seq;
+    _Atomic uint32_t space_waiters;
+};
+
+static_assert(sizeof(Bm_Channel_Header) <= BM_CHANNEL_HEADER_SIZE,
+              "The header of the channel does not fit into its reserved space");
+
+static void bm_channel_futex_wait(_Atomic uint32_t *word, uint32_t value)
+{
+#ifdef __linux__
+    // NOTE: not FUTEX_WAIT_PRIVATE, the word is shared between processes
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, value, NULL, NULL, 0);
+#else
+    (void) word;
+    (void) value;
+    sched_yield();
+#endif // __linux__
+}
+
+static void bm_channel_futex_wake(_Atomic uint32_t *word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+    (void) word;
+#endif // __linux__
+}
+
+static bool bm_channel_pid_alive(int32_t pid)
+{
+    return pid > 0 && (kill((pid_t) pid, 0) == 0 || errno == EPERM);
+}
+
+// NOTE: takes a side that is free or whose process is gone. If none of the
+// sides belongs to a live process after that, but some process has left
+// without closing the channel, the counters are left from a crashed run and
+// are started over. Returns false if both sides are taken.
+static bool bm_channel_attach(Bm_Channel_Header *header, size_t *side)
+{
+    const int32_t self = (int32_t) getpid();
+    bool crashed = false;
+    bool attached = false;
+    for (size_t i = 0; i < BM_CHANNEL_SIDES; ++i) {
+        int32_t pid = atomic_load(&header->pids[i]);
+        if (pid == 0 || !bm_channel_pid_alive(pid)) {
+            if (!attached && atomic_compare_exchange_strong(&header->pids[i], &pid, self)) {
+                *side = i;
+                attached = true;
+            }
+            crashed = crashed || pid != 0;
+        }
+    }
+
+    if (!attached) {
+        return false;
+    }
+
+    for (size_t i = 0; i < BM_CHANNEL_SIDES; ++i) {
+        if (i != *side && bm_channel_pid_alive(atomic_load(&header->pids[i]))) {
+            return true;
+        }
+    }
+
+    if (crashed) {
+        for (size_t i = 0; i < BM_CHANNEL_SIDES; ++i) {
+            if (i != *side) {
+                atomic_store(&header->pids[i], 0);
+            }
+        }
+        atomic_store(&header->head, 0);
+        atomic_store(&header->tail, 0);
+        atomic_store(&header->data_waiters, 0);
+        atomic_store(&header->space_waiters, 0);
+        atomic_store(&header->closed, 0);
+    }
+
+    return true;
+}
+#endif // _WIN32
+
+bool bm_channel_open(Bm *bm, const char *name, uint64_t slot_size, uint64_t slots_count,
+                     size_t *channel_id, Bm_Error *error)
+{
+#ifndef _WIN32
+    if (bm->channels_size >= BM_CHANNELS_CAPACITY) {
+        return bm_error(error, "%s: too many channels. The capacity is %d",
+                        name, BM_CHANNELS_CAPACITY);
+    }
+
+    if (slots_count == 0 || slot_size == 0) {
+        return bm_error(error, "%s: a channel must have at least one non-empty slot", name);
+    }
+
+    Bm_Channel *channel = &bm->channels[bm->channels_size];
+    memset(channel, 0, sizeof(*channel));
+
+    int n = snprintf(channel->name, sizeof(channel->name), "/bm-%s", name);
+    if (n < 0 || (size_t) n >= sizeof(channel->name)) {
+        return bm_error(error, "%s: the name of the channel is too long", name);
+    }
+
+    // NOTE: every slot starts with the size of the record in it
+    channel->slot_size = slot_size;
+    channel->slot_stride = sizeof(uint64_t) + (slot_size + 7) / 8 * 8;
+    channel->slots_count = slots_count;
+
+    const uint64_t page_size = (uint64_t) sysconf(_SC_PAGESIZE);
+    const uint64_t header_size = page_size > BM_CHANNEL_HEADER_SIZE ? page_size : BM_CHANNEL_HEADER_SIZE;
+
+    if (channel->slot_stride > BM_WINDOW_CAPACITY / slots_count) {
+        return bm_error(error, "%s: the channel is too big", name);
+    }
+    const uint64_t slots_size = channel->slot_stride * slots_count;
+    const uint64_t size = header_size + slots_size;
+
+    bool created = true;
+    int fd = shm_open(channel->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(channel->name, O_RDWR, 0600);
+    }
+
+    if (fd < 0) {
+        return bm_error(error, "%s: could not open the shared memory: %s", name, strerror(errno));
+    }
+
+    if (created) {
+        if (ftruncate(fd, (off_t) size) < 0) {
+            bm_error(error, "%s: could not resize the shared memory: %s", name, strerror(errno));
+            close(fd);
+            shm_unlink(channel->name);
+            return false;
+        }
+    } else {
+        // NOTE: the creator might not have resized the object yet
+        struct stat st = {0};
+        for (size_t i = 0; i < BM_CHANNEL_ATTACH_ATTEMPTS && st.st_size == 0; ++i) {
+            if (fstat(fd, &st) < 0) {
+                close(fd);
+                return bm_error(error, "%s: %s", name, strerror(errno));
+            }
+            if (st.st_size == 0) {
+                sched_yield();
+            }
+        }
+
+        if ((uint64_t) st.st_size != size) {
+            close(fd);
+            return bm_error(error, "%s: the channel exists with a different size of slots", name);
+        }
+    }
+
+    // NOTE: the header is only mapped into the host. The program could
+    // otherwise move the counters of the other side under its feet.
+    void *header_data = mmap(NULL, header_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header_data == MAP_FAILED) {
+        bm_error(error, "%s: could not map the header: %s", name, strerror(errno));
+        close(fd);
+        if (created) {
+            shm_unlink(channel->name);
+        }
+        return false;
+    }
+
+    Bm_Channel_Header *header = header_data;
+    if (created) {
+        header->slot_size = slot_size;
+        header->slots_count = slots_count;
+        atomic_store(&header->pids[0], (int32_t) getpid());
+        channel->side = 0;
+        atomic_store_explicit(&header->magic, BM_CHANNEL_MAGIC, memory_order_release);
+    } else {
+        for (size_t i = 0;
+                i < BM_CHANNEL_ATTACH_ATTEMPTS &&
+                atomic_load_explicit(&header->magic, memory_order_acquire) != BM_CHANNEL_MAGIC;
+                ++i) {
+            sched_yield();
+        }
+
+        // NOTE: checked before the slots are mapped, so a mismatch does not
+        // leave anything behind in the window
+        if (atomic_load_explicit(&header->magic, memory_order_acquire) != BM_CHANNEL_MAGIC ||
+                header->slot_size != slot_size ||
+                header->slots_count != slots_count) {
+            munmap(header_data, header_size);
+            close(fd);
+            return bm_error(error, "%s: the channel exists with a different layout", name);
+        }
+
+        if (!bm_channel_attach(header, &channel->side)) {
+            munmap(header_data, header_size);
+            close(fd);
+            return bm_error(error, "%s: both sides of the channel are already attached", name);
+        }
+    }
+
+    Bm_Error map_error = {0};
+    bool ok = bm_map_fd(bm, fd, header_size, slots_size, BM_MAPPING_SHARED,
+                        &channel->slots_addr, &channel->slots, &map_error);
+    close(fd);
+    if (!ok) {
+        munmap(header_data, header_size);
+        if (created) {
+            shm_unlink(channel->name);
+        }
+        return bm_error(error, "%s: %s", name, map_error.message);
+    }
+
+    channel->header = header;
+    channel->header_size = header_size;
+
+    if (channel_id) {
+        *channel_id = bm->channels_size;
+    }
+    bm->channels_size += 1;
+
+    return true;
+#else
+    (void) bm;
+    (void) slot_size;
+    (void) slots_count;
+    (void) channel_id;
+    return bm_error(error, "%s: channels are not supported on this platform", name);
+#endif // _WIN32
+}
+
+void bm_channel_close(Bm *bm, size_t channel_id)
+{
+#ifndef _WIN32
+    assert(channel_id < bm->channels_size);
+    Bm_Channel *channel = &bm->channels[channel_id];
+    Bm_Channel_Header *header = channel->header;
+    if (header == NULL) {
+        return;
+    }
+
+    atomic_store(&header->pids[channel->side], 0);
+    if (atomic_fetch_add(&header->closed, 1) > 0) {
+        shm_unlink(channel->name);
+    }
+
+    atomic_fetch_add(&header->data_seq, 1);
+    atomic_fetch_add(&header->space_seq, 1);
+    bm_channel_futex_wake(&header->data_seq);
+    bm_channel_futex_wake(&header->space_seq);
+
+    // NOTE: the slots stay in the window until it is released
+    munmap(header, channel->header_size);
+    channel->header = NULL;
+#else
+    (void) bm;
+    (void) channel_id;
+#endif // _WIN32
+}
+
+void bm_close_all_channels(Bm *bm)
+{
+    for (size_t i = 0; i < bm->channels_size; ++i) {
+        bm_channel_close(bm, i);
+    }
+    bm->channels_size = 0;
+}
+
+#ifndef _WIN32
+static Bm_Channel *bm_channel_by_id(Bm *bm, uint64_t channel_id)
+{
+    if (channel_id >= bm->channels_size || bm->channels[channel_id].header == NULL) {
+        return NULL;
+    }
+
+    return &bm->channels[channel_id];
+}
+
+static bool bm_channel_has_data(Bm_Channel_Header *header)
+{
+    return atomic_load_explicit(&header->tail, memory_order_relaxed) <
+           atomic_load_explicit(&header->head, memory_order_acquire);
+}
+
+static bool bm_channel_has_space(const Bm_Channel *channel)
+{
+    Bm_Channel_Header *header = channel->header;
+    return atomic_load_explicit(&header->head, memory_order_relaxed) -
+           atomic_load_explicit(&header->tail, memory_order_acquire) < channel->slots_count;
+}
+
+static bool bm_channel_wait(Bm_Channel *channel, bool for_space)
+{
+    Bm_Channel_Header *header = channel->header;
+    _Atomic uint32_t *seq = for_space ? &header->space_seq : &header->data_seq;
+    _Atomic uint32_t *waiters = for_space ? &header->space_waiters : &header->data_waiters;
+
+    for (size_t attempt = 0; ; ++attempt) {
+        const uint32_t value = atomic_load(seq);
+        const bool ready = for_space ? bm_channel_has_space(channel) : bm_channel_has_data(header);
+        if (ready) {
+            return true;
+        }
+
+        if (attempt < BM_CHANNEL_SPIN_ATTEMPTS) {
+            // NOTE: let the other side run if it shares the core with us
+            sched_yield();
+            continue;
+        }
+
+        if (atomic_load(&header->closed) > 0) {
+            return false;
+        }
+
+        // NOTE: the other side checks `waiters` after it has moved its
+        // counter. So either it sees us here and bumps `seq` before waking us
+        // up (the futex does not sleep if `seq` has already changed), or we
+        // see its new counter on the second check.
+        atomic_fetch_add(waiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        const bool ready_now = for_space ? bm_channel_has_space(channel) : bm_channel_has_data(header);
+        if (!ready_now && atomic_load(&header->closed) == 0) {
+            bm_channel_futex_wait(seq, value);
+        }
+        atomic_fetch_sub(waiters, 1);
+    }
+}
+#endif // _WIN32
+
+Err native_channel_open(Bm *bm)
+{
+    if (bm->stack_size < 3) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    Memory_Addr name_addr = bm->stack[bm->stack_size - 3].as_u64;
+    uint64_t slot_size = bm->stack[bm->stack_size - 2].as_u64;
+    uint64_t slots_count = bm->stack[bm->stack_size - 1].as_u64;
+
+    const char *name = bm_memory_cstr(bm, name_addr);
+    if (name == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+
+    size_t channel_id = 0;
+    if (!bm_channel_open(bm, name, slot_size, slots_count, &channel_id, NULL)) {
+        channel_id = BM_CHANNEL_INVALID;
+    }
+
+    bm->stack_size -= 2;
+    bm->stack[bm->stack_size - 1].as_u64 = channel_id;
+
+    return ERR_OK;
+}
+
+Err native_channel_acquire(Bm *bm)
+{
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+#ifndef _WIN32
+    Bm_Channel *channel = bm_channel_by_id(bm, bm->stack[bm->stack_size - 1].as_u64);
+    if (channel == NULL) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    Memory_Addr addr = 0;
+    if (bm_channel_has_space(channel)) {
+        const uint64_t head = atomic_load_explicit(&channel->header->head, memory_order_relaxed);
+        addr = channel->slots_addr + (head % channel->slots_count) * channel->slot_stride + sizeof(uint64_t);
+    }
+
+    bm->stack[bm->stack_size - 1].as_u64 = addr;
+    return ERR_OK;
+#else
+    return ERR_ILLEGAL_OPERAND;
+#endif // _WIN32
+}
+
+Err native_channel_publish(Bm *bm)
+{
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+#ifndef _WIN32
+    Bm_Channel *channel = bm_channel_by_id(bm, bm->stack[bm->stack_size - 2].as_u64);
+    uint64_t size = bm->stack[bm->stack_size - 1].as_u64;
+    if (channel == NULL || size > channel->slot_size || !bm_channel_has_space(channel)) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    Bm_Channel_Header *header = channel->header;
+    const uint64_t head = atomic_load_explicit(&header->head, memory_order_relaxed);
+    memcpy(channel->slots + (head % channel->slots_count) * channel->slot_stride, &size, sizeof(size));
+
+    atomic_store_explicit(&header->head, head + 1, memory_order_seq_cst);
+    if (atomic_load(&header->data_waiters) > 0) {
+        atomic_fetch_add(&header->data_seq, 1);
+        bm_channel_futex_wake(&header->data_seq);
+    }
+
+    bm->stack_size -= 2;
+    return ERR_OK;
+#else
+    return ERR_ILLEGAL_OPERAND;
+#endif // _WIN32
+}
+
+Err native_channel_peek(Bm *bm)
+{
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    if (bm->stack_size >= BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
+
+#ifndef _WIN32
+    Bm_Channel *channel = bm_channel_by_id(bm, bm->stack[bm->stack_size - 1].as_u64);
+    if (channel == NULL) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    Memory_Addr addr = 0;
+    uint64_t size = 0;
+    if (bm_channel_has_data(channel->header)) {
+        const uint64_t tail = atomic_load_explicit(&channel->header->tail, memory_order_relaxed);
+        const uint64_t offset = (tail % channel->slots_count) * channel->slot_stride;
+        memcpy(&size, channel->slots + offset, sizeof(size));
+        // NOTE: the size lives in the window, so the program on either side
+        // may have overwritten it
+        if (size > channel->slot_size) {
+            size = channel->slot_size;
+        }
+        addr = channel->slots_addr + offset + sizeof(uint64_t);
+    }
+
+    bm->stack[bm->stack_size - 1].as_u64 = addr;
+    bm->stack[bm->stack_size++].as_u64 = size;
+    return ERR_OK;
+#else
+    return ERR_ILLEGAL_OPERAND;
+#endif // _WIN32
+}
+
+Err native_channel_release(Bm *bm)
+{
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+#ifndef _WIN32
+    Bm_Channel *channel = bm_channel_by_id(bm, bm->stack[bm->stack_size - 1].as_u64);
+    if (channel == NULL || !bm_channel_has_data(channel->header)) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    Bm_Channel_Header *header = channel->header;
+    const uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    atomic_store_explicit(&header->tail, tail + 1, memory_order_seq_cst);
+    if (atomic_load(&header->space_waiters) > 0) {
+        atomic_fetch_add(&header->space_seq, 1);
+        bm_channel_futex_wake(&header->space_seq);
+    }
+
+    bm->stack_size -= 1;
+    return ERR_OK;
+#else
+    return ERR_ILLEGAL_OPERAND;
+#endif // _WIN32
+}
+
+Err native_channel_wait(Bm *bm)
+{
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+#ifndef _WIN32
+    Bm_Channel *channel = bm_channel_by_id(bm, bm->stack[bm->stack_size - 2].as_u64);
+    bool for_space = bm->stack[bm->stack_size - 1].as_u64 != 0;
+    if (channel == NULL) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    bm->stack_size -= 1;
+    bm->stack[bm->stack_size - 1].as_u64 = bm_channel_wait(channel, for_space);
+    return ERR_OK;
+#else
+    return ERR_ILLEGAL_OPERAND;
+#endif // _WIN32
+}
+
+Err native_channel_close(Bm *bm)
+{
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    uint64_t channel_id = bm->stack[bm->stack_size - 1].as_u64;
+    if (channel_id >= bm->channels_size) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    bm_channel_close(bm, channel_id);
+
+    bm->stack_size -= 1;
+    return ERR_OK;
+}
@@ -0,0 +1,197 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include "./event_loop.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define BM_EVENT_LOOP_EVENTS 64
+
+bool bm_event_loop_init(Bm_Event_Loop *loop, Bm_Error *error)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        return bm_error(error, "could not create epoll instance: %s", strerror(errno));
+    }
+    return true;
+}
+
+void bm_event_loop_free(Bm_Event_Loop *loop)
+{
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+static void bm_event_loop_push_ready(Bm_Event_Loop *loop, Bm *bm)
+{
+    // NOTE: a context is either ready or suspended, and spawn() does not let
+    // the amount of contexts exceed the capacity
+    assert(loop->ready_size < BM_EVENT_LOOP_CAPACITY);
+    loop->ready[(loop->ready_begin + loop->ready_size) % BM_EVENT_LOOP_CAPACITY] = bm;
+    loop->ready_size += 1;
+}
+
+static Bm *bm_event_loop_pop_ready(Bm_Event_Loop *loop)
+{
+    assert(loop->ready_size > 0);
+    Bm *bm = loop->ready[loop->ready_begin];
+    loop->ready_begin = (loop->ready_begin + 1) % BM_EVENT_LOOP_CAPACITY;
+    loop->ready_size -= 1;
+    return bm;
+}
+
+bool bm_event_loop_spawn(Bm_Event_Loop *loop, Bm *bm, Bm_Error *error)
+{
+    if (loop->contexts_size >= BM_EVENT_LOOP_CAPACITY) {
+        return bm_error(error, "exceeded the capacity of the event loop (%d contexts)",
+                        BM_EVENT_LOOP_CAPACITY);
+    }
+
+    bm->async = true;
+    loop->contexts_size += 1;
+    bm_event_loop_push_ready(loop, bm);
+    return true;
+}
+
+// NOTE: the fd of the pending operation is duplicated, because several
+// contexts may wait for the same fd (for instance stdin) and epoll allows
+// only one registration per fd
+static Err bm_event_loop_park(Bm_Event_Loop *loop, Bm *bm)
+{
+    for (;;) {
+        int fd = dup(bm->pending.fd);
+        if (fd < 0 && errno != EBADF) {
+            // NOTE: out of fds, most likely. Resuming the context would not
+            // make any progress, so it would just spin until some fd is freed.
+            return ERR_WAIT_FAILED;
+        }
+
+        if (fd >= 0) {
+            struct epoll_event event = {
+                .events = (bm->pending.wait == BM_WAIT_READ ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT,
+                .data = {.ptr = bm},
+            };
+            if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0) {
+                bm->pending.loop_fd = fd;
+                return ERR_OK;
+            }
+
+            const int epoll_errno = errno;
+            close(fd);
+            if (epoll_errno != EPERM) {
+                return ERR_WAIT_FAILED;
+            }
+        }
+
+        // NOTE: the fd can not be waited for (a regular file or an fd that is
+        // already closed, for instance). Such operations do not really block,
+        // so they are completed right away.
+        Err err = bm_resume(bm);
+        if (err == ERR_OK) {
+            bm_event_loop_push_ready(loop, bm);
+            return ERR_OK;
+        } else if (err != ERR_PENDING) {
+            return err;
+        }
+    }
+}
+
+Err bm_event_loop_run(Bm_Event_Loop *loop, Bm **failed)
+{
+    struct epoll_event events[BM_EVENT_LOOP_EVENTS];
+
+    while (loop->contexts_size > 0) {
+        // NOTE: every context that was ready at the beginning of the round
+        // gets a slice before the loop checks the fds again
+        for (size_t n = loop->ready_size; n > 0; --n) {
+            Bm *bm = bm_event_loop_pop_ready(loop);
+            Err err = bm_execute_program(bm, BM_EVENT_LOOP_SLICE);
+            if (err == ERR_PENDING) {
+                err = bm_event_loop_park(loop, bm);
+            } else if (err == ERR_OK) {
+                if (bm->halt) {
+                    loop->contexts_size -= 1;
+                } else {
+                    bm_event_loop_push_ready(loop, bm);
+                }
+            }
+
+            if (err != ERR_OK) {
+                if (failed) {
+                    *failed = bm;
+                }
+                return err;
+            }
+        }
+
+        if (loop->contexts_size == 0) {
+            break;
+        }
+
+        const int timeout = loop->ready_size > 0 ? 0 : -1;
+        int n = epoll_wait(loop->epoll_fd, events, BM_EVENT_LOOP_EVENTS, timeout);
+        if (n < 0) {
+            assert(errno == EINTR);
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            Bm *bm = events[i].data.ptr;
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, bm->pending.loop_fd, NULL);
+            close(bm->pending.loop_fd);
+
+            Err err = bm_resume(bm);
+            if (err == ERR_PENDING) {
+                err = bm_event_loop_park(loop, bm);
+            } else if (err == ERR_OK) {
+                bm_event_loop_push_ready(loop, bm);
+            }
+
+            if (err != ERR_OK) {
+                if (failed) {
+                    *failed = bm;
+                }
+                return err;
+            }
+        }
+    }
+
+    return ERR_OK;
+}
+
+#else
+
+bool bm_event_loop_init(Bm_Event_Loop *loop, Bm_Error *error)
+{
+    (void) loop;
+    return bm_error(error, "event loop is not supported on this platform");
+}
+
+void bm_event_loop_free(Bm_Event_Loop *loop)
+{
+    (void) loop;
+}
+
+bool bm_event_loop_spawn(Bm_Event_Loop *loop, Bm *bm, Bm_Error *error)
+{
+    (void) loop;
+    (void) bm;
+    return bm_error(error, "event loop is not supported on this platform");
+}
+
+Err bm_event_loop_run(Bm_Event_Loop *loop, Bm **failed)
+{
+    (void) loop;
+    (void) failed;
+    return ERR_OK;
+}
+
+#endif // __linux__
@@ -0,0 +1,37 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include "./bm.h"
+
+#define BM_EVENT_LOOP_CAPACITY 4096
+// NOTE: the amount of instructions a context executes before it yields to
+// the other ready contexts
+#define BM_EVENT_LOOP_SLICE 10000
+
+// NOTE: Bm_Event_Loop runs many asynchronous contexts on a single thread.
+// A context that is suspended by a native (see bm_suspend()) is parked on
+// epoll until its fd is ready, while the other contexts keep running.
+// The contexts that are ready are executed round robin in slices of
+// BM_EVENT_LOOP_SLICE instructions. Only Linux is supported.
+typedef struct {
+    int epoll_fd;
+
+    Bm *ready[BM_EVENT_LOOP_CAPACITY];
+    size_t ready_begin;
+    size_t ready_size;
+
+    // NOTE: the contexts that have not halted yet, ready or suspended
+    size_t contexts_size;
+} Bm_Event_Loop;
+
+bool bm_event_loop_init(Bm_Event_Loop *loop, Bm_Error *error);
+void bm_event_loop_free(Bm_Event_Loop *loop);
+// Makes the context asynchronous and schedules it. The context must stay
+// alive until it halts or bm_event_loop_run() fails.
+bool bm_event_loop_spawn(Bm_Event_Loop *loop, Bm *bm, Bm_Error *error);
+// Runs until all of the spawned contexts halt. Stops on the first error and
+// reports the context that caused it through `failed`. A context whose fd can
+// not be waited for fails with ERR_WAIT_FAILED.
+Err bm_event_loop_run(Bm_Event_Loop *loop, Bm **failed);
+
+#endif // EVENT_LOOP_H_
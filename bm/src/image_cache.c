@@ -0,0 +1,275 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include <sys/stat.h>
+
+#include "./image_cache.h"
+#include "./hash.h"
+
+static void bm_image_cache_lru_unlink(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_first = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_last = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void bm_image_cache_lru_push_front(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_first;
+    if (cache->lru_first) {
+        cache->lru_first->lru_prev = entry;
+    } else {
+        cache->lru_last = entry;
+    }
+    cache->lru_first = entry;
+}
+
+static Bm_Image_Cache_Entry *bm_image_cache_find_path(Bm_Image_Cache *cache, uint64_t path_hash, const char *file_path)
+{
+    for (Bm_Image_Cache_Entry *entry = cache->path_buckets[path_hash % BM_IMAGE_CACHE_BUCKETS];
+            entry != NULL;
+            entry = entry->path_next) {
+        if (entry->path_hash == path_hash && strcmp(entry->file_path, file_path) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static Bm_Image_Cache_Entry *bm_image_cache_find_content(Bm_Image_Cache *cache, uint64_t hash,
+        const uint8_t *data, size_t size)
+{
+    for (Bm_Image_Cache_Entry *entry = cache->buckets[hash % BM_IMAGE_CACHE_BUCKETS];
+            entry != NULL;
+            entry = entry->bucket_next) {
+        if (entry->hash == hash && entry->size == size && memcmp(entry->data, data, size) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void bm_image_cache_unlink_path(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry)
+{
+    if (entry->file_path == NULL) {
+        return;
+    }
+
+    Bm_Image_Cache_Entry **iter = &cache->path_buckets[entry->path_hash % BM_IMAGE_CACHE_BUCKETS];
+    while (*iter != entry) {
+        assert(*iter != NULL);
+        iter = &(*iter)->path_next;
+    }
+    *iter = entry->path_next;
+
+    free(entry->file_path);
+    entry->file_path = NULL;
+    entry->path_next = NULL;
+}
+
+static void bm_image_cache_link_path(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry,
+                                     char *file_path, uint64_t path_hash)
+{
+    assert(entry->file_path == NULL);
+    entry->file_path = file_path;
+    entry->path_hash = path_hash;
+    entry->path_next = cache->path_buckets[path_hash % BM_IMAGE_CACHE_BUCKETS];
+    cache->path_buckets[path_hash % BM_IMAGE_CACHE_BUCKETS] = entry;
+}
+
+static void bm_image_cache_remove(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry)
+{
+    Bm_Image_Cache_Entry **iter = &cache->buckets[entry->hash % BM_IMAGE_CACHE_BUCKETS];
+    while (*iter != entry) {
+        assert(*iter != NULL);
+        iter = &(*iter)->bucket_next;
+    }
+    *iter = entry->bucket_next;
+
+    bm_image_cache_unlink_path(cache, entry);
+    bm_image_cache_lru_unlink(cache, entry);
+
+    cache->entries_size -= 1;
+    cache->bytes_size -= entry->size;
+
+    free(entry->data);
+    free(entry);
+}
+
+static Bm_File_Identity bm_file_identity(const struct stat *file_stat)
+{
+    Bm_File_Identity identity = {
+        .dev = (uint64_t) file_stat->st_dev,
+        .ino = (uint64_t) file_stat->st_ino,
+        .size = (uint64_t) file_stat->st_size,
+        .mtime_sec = (int64_t) file_stat->st_mtime,
+        .ctime_sec = (int64_t) file_stat->st_ctime,
+    };
+#ifdef __linux__
+    identity.mtime_nsec = (int64_t) file_stat->st_mtim.tv_nsec;
+    identity.ctime_nsec = (int64_t) file_stat->st_ctim.tv_nsec;
+#endif // __linux__
+    return identity;
+}
+
+static bool bm_file_identity_eq(Bm_File_Identity a, Bm_File_Identity b)
+{
+    return a.dev == b.dev && a.ino == b.ino && a.size == b.size &&
+           a.mtime_sec == b.mtime_sec && a.mtime_nsec == b.mtime_nsec &&
+           a.ctime_sec == b.ctime_sec && a.ctime_nsec == b.ctime_nsec;
+}
+
+// NOTE: whether the cache would exceed any of the limits after adding an
+// entry of `size` bytes
+static bool bm_image_cache_over_limits(const Bm_Image_Cache *cache, size_t size)
+{
+    return (cache->max_entries > 0 && cache->entries_size + 1 > cache->max_entries) ||
+           (cache->max_bytes > 0 && cache->bytes_size + size > cache->max_bytes);
+}
+
+static const Bm_Image_Cache_Entry *bm_image_cache_hit(Bm_Image_Cache *cache, Bm_Image_Cache_Entry *entry)
+{
+    cache->hits += 1;
+    bm_image_cache_lru_unlink(cache, entry);
+    bm_image_cache_lru_push_front(cache, entry);
+    return entry;
+}
+
+const Bm_Image_Cache_Entry *bm_image_cache_get(Bm_Image_Cache *cache,
+                                               const char *file_path,
+                                               Bm_Error *error)
+{
+    struct stat file_stat = {0};
+    if (stat(file_path, &file_stat) < 0) {
+        bm_error(error, "Could not open file `%s`: %s",
+                 file_path, strerror(errno));
+        return NULL;
+    }
+
+    const uint64_t path_hash = hash_bytes(file_path, strlen(file_path));
+    const Bm_File_Identity identity = bm_file_identity(&file_stat);
+
+    Bm_Image_Cache_Entry *entry = bm_image_cache_find_path(cache, path_hash, file_path);
+    if (entry && bm_file_identity_eq(entry->file_identity, identity)) {
+        return bm_image_cache_hit(cache, entry);
+    }
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    if (!bm_slurp_file(file_path, &data, &size, error)) {
+        return NULL;
+    }
+
+    // NOTE: the path does not lead to the same file anymore (it was touched,
+    // copied over or rebuilt), or the path is new. Its entry stays in the
+    // cache in case the content comes back.
+    if (entry) {
+        bm_image_cache_unlink_path(cache, entry);
+    }
+
+    char *entry_file_path = malloc(strlen(file_path) + 1);
+    if (entry_file_path == NULL) {
+        free(data);
+        bm_error(error, "Could not allocate memory for the image cache");
+        return NULL;
+    }
+    strcpy(entry_file_path, file_path);
+
+    const uint64_t hash = hash_bytes(data, size);
+    entry = bm_image_cache_find_content(cache, hash, data, size);
+    if (entry) {
+        free(data);
+        bm_image_cache_unlink_path(cache, entry);
+        bm_image_cache_link_path(cache, entry, entry_file_path, path_hash);
+        entry->file_identity = identity;
+        return bm_image_cache_hit(cache, entry);
+    }
+
+    cache->misses += 1;
+
+    Bm_Image image = {0};
+    Bm_Error decode_error = {0};
+    if (!bm_image_decode(&image, data, size, &decode_error)) {
+        free(entry_file_path);
+        free(data);
+        bm_error(error, "%s: %s", file_path, decode_error.message);
+        return NULL;
+    }
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL) {
+        free(entry_file_path);
+        free(data);
+        bm_error(error, "Could not allocate memory for the image cache");
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->data = data;
+    entry->size = size;
+    entry->image = image;
+    entry->file_identity = identity;
+    bm_image_cache_link_path(cache, entry, entry_file_path, path_hash);
+
+    // NOTE: the new entry is never evicted right away, so the caller gets it
+    // even if it does not fit into the limits on its own
+    while (bm_image_cache_over_limits(cache, size) && cache->lru_last != NULL) {
+        bm_image_cache_remove(cache, cache->lru_last);
+        cache->evictions += 1;
+    }
+
+    entry->bucket_next = cache->buckets[hash % BM_IMAGE_CACHE_BUCKETS];
+    cache->buckets[hash % BM_IMAGE_CACHE_BUCKETS] = entry;
+    bm_image_cache_lru_push_front(cache, entry);
+    cache->entries_size += 1;
+    cache->bytes_size += size;
+
+    return entry;
+}
+
+bool bm_image_cache_load_from_file(Bm_Image_Cache *cache, Bm *bm,
+                                   const char *file_path,
+                                   Bm_Error *error)
+{
+    const Bm_Image_Cache_Entry *entry = bm_image_cache_get(cache, file_path, error);
+    if (entry == NULL) {
+        return false;
+    }
+
+    bm_image_install(bm, &entry->image);
+    return true;
+}
+
+void bm_image_cache_clear(Bm_Image_Cache *cache)
+{
+    while (cache->lru_first) {
+        bm_image_cache_remove(cache, cache->lru_first);
+    }
+}
+
+void bm_image_cache_dump_stats(FILE *stream, const Bm_Image_Cache *cache)
+{
+    fprintf(stream, "Image cache:\n");
+    fprintf(stream, "  entries:   %zu\n", cache->entries_size);
+    fprintf(stream, "  bytes:     %zu\n", cache->bytes_size);
+    fprintf(stream, "  hits:      %"PRIu64"\n", cache->hits);
+    fprintf(stream, "  misses:    %"PRIu64"\n", cache->misses);
+    fprintf(stream, "  evictions: %"PRIu64"\n", cache->evictions);
+}
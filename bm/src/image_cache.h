@@ -0,0 +1,88 @@
+#ifndef IMAGE_CACHE_H_
+#define IMAGE_CACHE_H_
+
+#include "./bm.h"
+
+#define BM_IMAGE_CACHE_BUCKETS 64
+
+// NOTE: Bm_Image_Cache keeps the validated images of the recently loaded
+// .bm files, so loading the same file again skips decoding it and only
+// installs the image into the Bm. An entry is keyed by the hash of the
+// content of the file, so the copies of the same program share one image.
+// The entry also remembers the path it was last loaded from together with
+// the device, the inode, the size and the modification and the change times
+// of the file (with nanoseconds where the system has them). While those stay
+// the same, the file is not even read. Otherwise the file is read and hashed,
+// and the image is reused only if the content is exactly the same as a
+// cached one, so a file that is rebuilt in place gets a fresh image. Hashing
+// the content on every load would cost more than decoding it. The least
+// recently used images are evicted when any of the limits is exceeded. A
+// limit of 0 means no limit.
+//
+// The decoded image is byte for byte the .bm file, so the images are not
+// persisted anywhere: a cache on the disk would be a copy of the file.
+//
+// The cache is not synchronized. Either keep one cache per thread or
+// protect it with a lock.
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+} Bm_File_Identity;
+
+typedef struct Bm_Image_Cache_Entry Bm_Image_Cache_Entry;
+
+struct Bm_Image_Cache_Entry {
+    // NOTE: hash_bytes() of the data
+    uint64_t hash;
+    uint8_t *data;
+    size_t size;
+    Bm_Image image;
+
+    // NOTE: NULL once another entry was loaded from the same path
+    char *file_path;
+    uint64_t path_hash;
+    Bm_File_Identity file_identity;
+
+    Bm_Image_Cache_Entry *bucket_next;
+    Bm_Image_Cache_Entry *path_next;
+    Bm_Image_Cache_Entry *lru_prev;
+    Bm_Image_Cache_Entry *lru_next;
+};
+
+typedef struct {
+    size_t max_entries;
+    size_t max_bytes;
+
+    Bm_Image_Cache_Entry *buckets[BM_IMAGE_CACHE_BUCKETS];
+    Bm_Image_Cache_Entry *path_buckets[BM_IMAGE_CACHE_BUCKETS];
+    // NOTE: lru_first is the most recently used entry
+    Bm_Image_Cache_Entry *lru_first;
+    Bm_Image_Cache_Entry *lru_last;
+    size_t entries_size;
+    size_t bytes_size;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} Bm_Image_Cache;
+
+// Finds the image of the file in the cache or reads, decodes and caches it.
+// The entry is owned by the cache and stays valid until the next call of
+// bm_image_cache_get() or bm_image_cache_load_from_file(), which may evict
+// it, or until bm_image_cache_clear(). The image of a file that exceeds the
+// limits on its own is evicted only by the next call.
+const Bm_Image_Cache_Entry *bm_image_cache_get(Bm_Image_Cache *cache,
+                                               const char *file_path,
+                                               Bm_Error *error);
+bool bm_image_cache_load_from_file(Bm_Image_Cache *cache, Bm *bm,
+                                   const char *file_path,
+                                   Bm_Error *error);
+void bm_image_cache_clear(Bm_Image_Cache *cache);
+void bm_image_cache_dump_stats(FILE *stream, const Bm_Image_Cache *cache);
+
+#endif // IMAGE_CACHE_H_
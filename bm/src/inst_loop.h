@@ -0,0 +1,100 @@
+// NOTE: A template of an interpreter loop. Every inclusion generates a
+// static function that executes the program until it halts, fails or runs
+// out of the limit of steps, dispatching the instructions from
+// ./inst_table.h inline. The loop is specialized with the following macros,
+// all of which are undefined at the end of this file:
+//
+//   BM_LOOP_NAME              name of the generated function (required)
+//   BM_LOOP_PARAMS            extra parameters after the limit, starting
+//                             with a comma, e.g. `, uint64_t *counts`
+//   BM_LOOP_UNLIMITED         drop the `int limit` parameter entirely
+//   BM_LOOP_LIMIT_POINTER     take the limit as `int *limit` and count it
+//                             down in place, so the caller knows how many
+//                             steps were executed even if the loop stopped
+//                             early
+//   BM_LOOP_BEFORE(bm, inst)  statements executed before every instruction.
+//                             May declare variables for BM_LOOP_AFTER and
+//                             `return` to stop the loop.
+//   BM_LOOP_AFTER(bm, inst)   statements executed after every instruction
+//                             that succeeded
+//
+// The signature of the generated function is
+//
+//   static Err BM_LOOP_NAME(Bm *bm, int limit BM_LOOP_PARAMS)
+//
+// with the limit adjusted according to the options above.
+//
+// A loop only pays for the hooks it defines, so the tools that need to
+// observe the execution do not slow down everyone else.
+
+#ifndef BM_LOOP_NAME
+#error "BM_LOOP_NAME must be defined before including inst_loop.h"
+#endif // BM_LOOP_NAME
+
+#ifndef BM_LOOP_PARAMS
+#define BM_LOOP_PARAMS
+#endif // BM_LOOP_PARAMS
+
+#ifndef BM_LOOP_BEFORE
+#define BM_LOOP_BEFORE(bm, inst)
+#endif // BM_LOOP_BEFORE
+
+#ifndef BM_LOOP_AFTER
+#define BM_LOOP_AFTER(bm, inst)
+#endif // BM_LOOP_AFTER
+
+#ifdef BM_LOOP_LIMIT_POINTER
+#define BM_LOOP_LIMIT (*limit)
+#else
+#define BM_LOOP_LIMIT limit
+#endif // BM_LOOP_LIMIT_POINTER
+
+#if defined(BM_LOOP_UNLIMITED)
+static Err BM_LOOP_NAME(Bm *bm BM_LOOP_PARAMS)
+#elif defined(BM_LOOP_LIMIT_POINTER)
+static Err BM_LOOP_NAME(Bm *bm, int *limit BM_LOOP_PARAMS)
+#else
+static Err BM_LOOP_NAME(Bm *bm, int limit BM_LOOP_PARAMS)
+#endif // BM_LOOP_UNLIMITED
+{
+#ifdef BM_LOOP_UNLIMITED
+    while (!bm->halt) {
+#else
+    while (BM_LOOP_LIMIT != 0 && !bm->halt) {
+#endif // BM_LOOP_UNLIMITED
+        if (bm->ip >= bm->program_size) {
+            return ERR_ILLEGAL_INST_ACCESS;
+        }
+
+        const Inst inst = bm->program[bm->ip];
+        BM_LOOP_BEFORE(bm, inst);
+
+        switch (inst.type) {
+#define BM_INST(type, ...) case type: __VA_ARGS__ break;
+#include "./inst_table.h"
+#undef BM_INST
+
+        case NUMBER_OF_INSTS:
+        default:
+            return ERR_ILLEGAL_INST;
+        }
+
+        BM_LOOP_AFTER(bm, inst);
+
+#ifndef BM_LOOP_UNLIMITED
+        if (BM_LOOP_LIMIT > 0) {
+            --BM_LOOP_LIMIT;
+        }
+#endif // BM_LOOP_UNLIMITED
+    }
+
+    return ERR_OK;
+}
+
+#undef BM_LOOP_NAME
+#undef BM_LOOP_PARAMS
+#undef BM_LOOP_UNLIMITED
+#undef BM_LOOP_LIMIT_POINTER
+#undef BM_LOOP_LIMIT
+#undef BM_LOOP_BEFORE
+#undef BM_LOOP_AFTER
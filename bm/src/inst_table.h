@@ -0,0 +1,449 @@
+// NOTE: The semantics of every instruction of the Virtual Machine. This file
+// is an X-macro table that is meant to be included into a switch over
+// `inst.type` after defining
+//
+//   #define BM_INST(type, ...) case type: __VA_ARGS__ break;
+//
+// Every entry gets `Bm *bm` and the fetched `Inst inst`, moves `bm->ip`
+// and returns an Err when the instruction fails. The table is included by
+// bm_execute_inst() and by the interpreter loops generated from
+// ./inst_loop.h, so the instructions are defined only once no matter how
+// many specialized loops there are. There is deliberately no include guard.
+
+#ifndef BM_INST
+#error "BM_INST(type, ...) must be defined before including inst_table.h"
+#endif // BM_INST
+
+#define READ_OP(bm, type, out) \
+    do { \
+        if ((bm)->stack_size < 1) { \
+            return ERR_STACK_UNDERFLOW; \
+        } \
+        const Memory_Addr addr = (bm)->stack[(bm)->stack_size - 1].as_u64; \
+        const uint8_t *data = bm_memory_range((bm), addr, sizeof(type), false); \
+        if (data == NULL) { \
+            return ERR_ILLEGAL_MEMORY_ACCESS; \
+        } \
+        /* note: since we are relying on some integer widening conversions here, */ \
+        /* we must create a temporary variable so the compiler can do the implicit cast. */ \
+        type tmp; \
+        memcpy(&tmp, data, sizeof(type)); \
+        (bm)->stack[(bm)->stack_size - 1].as_##out = tmp; \
+        (bm)->ip += 1; \
+    } while(false)
+
+#define BINARY_OP(bm, in, out, op)                                      \
+    do {                                                                \
+        if ((bm)->stack_size < 2) {                                     \
+            return ERR_STACK_UNDERFLOW;                                 \
+        }                                                               \
+                                                                        \
+        (bm)->stack[(bm)->stack_size - 2].as_##out = (bm)->stack[(bm)->stack_size - 2].as_##in op (bm)->stack[(bm)->stack_size - 1].as_##in; \
+        (bm)->stack_size -= 1;                                          \
+        (bm)->ip += 1;                                                  \
+    } while (false)
+
+#define CAST_OP(bm, src, dst, cast)             \
+    do {                                        \
+        if ((bm)->stack_size < 1) {             \
+            return ERR_STACK_UNDERFLOW;         \
+        }                                                               \
+                                                                        \
+        (bm)->stack[(bm)->stack_size - 1].as_##dst = cast (bm)->stack[(bm)->stack_size - 1].as_##src; \
+                                                                        \
+        (bm)->ip += 1;                                                  \
+    } while (false)
+
+BM_INST(INST_NOP, {
+    bm->ip += 1;
+})
+
+BM_INST(INST_PUSH, {
+    if (bm->stack_size >= BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
+    bm->stack[bm->stack_size++] = inst.operand;
+    bm->ip += 1;
+})
+
+BM_INST(INST_DROP, {
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+    bm->stack_size -= 1;
+    bm->ip += 1;
+})
+
+BM_INST(INST_PLUSI, {
+    BINARY_OP(bm, u64, u64, +);
+})
+
+BM_INST(INST_MINUSI, {
+    BINARY_OP(bm, u64, u64, -);
+})
+
+BM_INST(INST_MULTI, {
+    BINARY_OP(bm, i64, i64, *);
+})
+
+BM_INST(INST_MULTU, {
+    BINARY_OP(bm, u64, u64, *);
+})
+
+BM_INST(INST_DIVI, {
+    if (bm->stack[bm->stack_size - 1].as_i64 == 0) {
+        return ERR_DIV_BY_ZERO;
+    }
+    BINARY_OP(bm, i64, i64, /);
+})
+
+BM_INST(INST_DIVU, {
+    if (bm->stack[bm->stack_size - 1].as_u64 == 0) {
+        return ERR_DIV_BY_ZERO;
+    }
+    BINARY_OP(bm, u64, u64, /);
+})
+
+BM_INST(INST_MODI, {
+    if (bm->stack[bm->stack_size - 1].as_i64 == 0) {
+        return ERR_DIV_BY_ZERO;
+    }
+    BINARY_OP(bm, i64, i64, %);
+})
+
+BM_INST(INST_MODU, {
+    if (bm->stack[bm->stack_size - 1].as_u64 == 0) {
+        return ERR_DIV_BY_ZERO;
+    }
+    BINARY_OP(bm, u64, u64, %);
+})
+
+BM_INST(INST_PLUSF, {
+    BINARY_OP(bm, f64, f64, +);
+})
+
+BM_INST(INST_MINUSF, {
+    BINARY_OP(bm, f64, f64, -);
+})
+
+BM_INST(INST_MULTF, {
+    BINARY_OP(bm, f64, f64, *);
+})
+
+BM_INST(INST_DIVF, {
+    BINARY_OP(bm, f64, f64, /);
+})
+
+BM_INST(INST_JMP, {
+    bm->ip = inst.operand.as_u64;
+})
+
+BM_INST(INST_RET, {
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    bm->ip = bm->stack[bm->stack_size - 1].as_u64;
+    bm->stack_size -= 1;
+})
+
+BM_INST(INST_CALL, {
+    if (bm->stack_size >= BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
+
+    bm->stack[bm->stack_size++].as_u64 = bm->ip + 1;
+    bm->ip = inst.operand.as_u64;
+})
+
+BM_INST(INST_NATIVE, {
+    if (inst.operand.as_u64 >= bm->natives_size) {
+        return ERR_ILLEGAL_OPERAND;
+    }
+
+    Err err = ERR_OK;
+    if (bm->natives[inst.operand.as_u64]) {
+        err = bm->natives[inst.operand.as_u64](bm);
+        if (!bm->natives_tracked[inst.operand.as_u64]) {
+            bm_memory_mark_all_dirty(bm);
+        }
+    } else if (bm->native_defs[inst.operand.as_u64]) {
+        err = bm->native_defs_direct[inst.operand.as_u64]
+              ? bm_call_direct_native_def(bm, bm->native_defs[inst.operand.as_u64])
+              : bm_call_native_def(bm, bm->native_defs[inst.operand.as_u64]);
+    } else {
+        return ERR_NULL_NATIVE;
+    }
+
+    if (err != ERR_OK) {
+        return err;
+    }
+    bm->ip += 1;
+})
+
+BM_INST(INST_HALT, {
+    bm->halt = 1;
+})
+
+BM_INST(INST_EQF, {
+    BINARY_OP(bm, f64, u64, ==);
+})
+
+BM_INST(INST_GEF, {
+    BINARY_OP(bm, f64, u64, >=);
+})
+
+BM_INST(INST_GTF, {
+    BINARY_OP(bm, f64, u64, >);
+})
+
+BM_INST(INST_LEF, {
+    BINARY_OP(bm, f64, u64, <=);
+})
+
+BM_INST(INST_LTF, {
+    BINARY_OP(bm, f64, u64, <);
+})
+
+BM_INST(INST_NEF, {
+    BINARY_OP(bm, f64, u64, !=);
+})
+
+BM_INST(INST_EQI, {
+    BINARY_OP(bm, i64, u64, ==);
+})
+
+BM_INST(INST_GEI, {
+    BINARY_OP(bm, i64, u64, >=);
+})
+
+BM_INST(INST_GTI, {
+    BINARY_OP(bm, i64, u64, >);
+})
+
+BM_INST(INST_LEI, {
+    BINARY_OP(bm, i64, u64, <=);
+})
+
+BM_INST(INST_LTI, {
+    BINARY_OP(bm, i64, u64, <);
+})
+
+BM_INST(INST_NEI, {
+    BINARY_OP(bm, i64, u64, !=);
+})
+
+BM_INST(INST_EQU, {
+    BINARY_OP(bm, u64, u64, ==);
+})
+
+BM_INST(INST_GEU, {
+    BINARY_OP(bm, u64, u64, >=);
+})
+
+BM_INST(INST_GTU, {
+    BINARY_OP(bm, u64, u64, >);
+})
+
+BM_INST(INST_LEU, {
+    BINARY_OP(bm, u64, u64, <=);
+})
+
+BM_INST(INST_LTU, {
+    BINARY_OP(bm, u64, u64, <);
+})
+
+BM_INST(INST_NEU, {
+    BINARY_OP(bm, u64, u64, !=);
+})
+
+BM_INST(INST_JMP_IF, {
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    if (bm->stack[bm->stack_size - 1].as_u64) {
+        bm->ip = inst.operand.as_u64;
+    } else {
+        bm->ip += 1;
+    }
+
+    bm->stack_size -= 1;
+})
+
+BM_INST(INST_DUP, {
+    if (bm->stack_size >= BM_STACK_CAPACITY) {
+        return ERR_STACK_OVERFLOW;
+    }
+
+    if (bm->stack_size - inst.operand.as_u64 <= 0) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    bm->stack[bm->stack_size] = bm->stack[bm->stack_size - 1 - inst.operand.as_u64];
+    bm->stack_size += 1;
+    bm->ip += 1;
+})
+
+BM_INST(INST_SWAP, {
+    if (inst.operand.as_u64 >= bm->stack_size) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    const uint64_t a = bm->stack_size - 1;
+    const uint64_t b = bm->stack_size - 1 - inst.operand.as_u64;
+
+    Word t = bm->stack[a];
+    bm->stack[a] = bm->stack[b];
+    bm->stack[b] = t;
+    bm->ip += 1;
+})
+
+BM_INST(INST_NOT, {
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    bm->stack[bm->stack_size - 1].as_u64 = !bm->stack[bm->stack_size - 1].as_u64;
+    bm->ip += 1;
+})
+
+BM_INST(INST_ANDB, {
+    BINARY_OP(bm, u64, u64, &);
+})
+
+BM_INST(INST_ORB, {
+    BINARY_OP(bm, u64, u64, |);
+})
+
+BM_INST(INST_XOR, {
+    BINARY_OP(bm, u64, u64, ^);
+})
+
+BM_INST(INST_SHR, {
+    BINARY_OP(bm, u64, u64, >>);
+})
+
+BM_INST(INST_SHL, {
+    BINARY_OP(bm, u64, u64, <<);
+})
+
+BM_INST(INST_NOTB, {
+    if (bm->stack_size < 1) {
+        return ERR_STACK_UNDERFLOW;
+    }
+
+    bm->stack[bm->stack_size - 1].as_u64 = ~bm->stack[bm->stack_size - 1].as_u64;
+    bm->ip += 1;
+})
+
+BM_INST(INST_READ8U, {
+    READ_OP(bm, uint8_t, u64);
+})
+
+BM_INST(INST_READ16U, {
+    READ_OP(bm, uint16_t, u64);
+})
+
+BM_INST(INST_READ32U, {
+    READ_OP(bm, uint32_t, u64);
+})
+
+BM_INST(INST_READ64U, {
+    READ_OP(bm, uint64_t, u64);
+})
+
+BM_INST(INST_READ8I, {
+    READ_OP(bm, int8_t, i64);
+})
+
+BM_INST(INST_READ16I, {
+    READ_OP(bm, int16_t, i64);
+})
+
+BM_INST(INST_READ32I, {
+    READ_OP(bm, int32_t, i64);
+})
+
+BM_INST(INST_READ64I, {
+    READ_OP(bm, int64_t, i64);
+})
+
+BM_INST(INST_WRITE8, {
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+    const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint8_t *data = bm_memory_range(bm, addr, sizeof(uint8_t), true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+    *data = (uint8_t) bm->stack[bm->stack_size - 1].as_u64;
+    bm->stack_size -= 2;
+    bm->ip += 1;
+})
+
+BM_INST(INST_WRITE16, {
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+    const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint8_t *data = bm_memory_range(bm, addr, sizeof(uint16_t), true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+    uint16_t value = (uint16_t) bm->stack[bm->stack_size - 1].as_u64;
+    memcpy(data, &value, sizeof(value));
+    bm->stack_size -= 2;
+    bm->ip += 1;
+})
+
+BM_INST(INST_WRITE32, {
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+    const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint8_t *data = bm_memory_range(bm, addr, sizeof(uint32_t), true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+    uint32_t value = (uint32_t) bm->stack[bm->stack_size - 1].as_u64;
+    memcpy(data, &value, sizeof(value));
+    bm->stack_size -= 2;
+    bm->ip += 1;
+})
+
+BM_INST(INST_WRITE64, {
+    if (bm->stack_size < 2) {
+        return ERR_STACK_UNDERFLOW;
+    }
+    const Memory_Addr addr = bm->stack[bm->stack_size - 2].as_u64;
+    uint8_t *data = bm_memory_range(bm, addr, sizeof(uint64_t), true);
+    if (data == NULL) {
+        return ERR_ILLEGAL_MEMORY_ACCESS;
+    }
+    uint64_t value = bm->stack[bm->stack_size - 1].as_u64;
+    memcpy(data, &value, sizeof(value));
+    bm->stack_size -= 2;
+    bm->ip += 1;
+})
+
+BM_INST(INST_I2F, {
+    CAST_OP(bm, i64, f64, (double));
+})
+
+BM_INST(INST_U2F, {
+    CAST_OP(bm, u64, f64, (double));
+})
+
+BM_INST(INST_F2I, {
+    CAST_OP(bm, f64, i64, (int64_t));
+})
+
+BM_INST(INST_F2U, {
+    CAST_OP(bm, f64, u64, (uint64_t) (int64_t));
+})
+
+#undef READ_OP
+#undef BINARY_OP
+#undef CAST_OP
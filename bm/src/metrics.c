@@ -0,0 +1,287 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include <time.h>
+
+#include "./metrics.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+// NOTE: the same as the checked loop, except that the limit of the batch is
+// counted down in place, so the amount of retired instructions is known even
+// if the program halted in the middle of the batch. No hooks.
+#define BM_LOOP_NAME bm_metrics_loop
+#define BM_LOOP_LIMIT_POINTER
+#include "./inst_loop.h"
+
+uint64_t bm_metrics_now_ns(void)
+{
+    struct timespec ts = {0};
+#ifndef _WIN32
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif // _WIN32
+    return (uint64_t) ts.tv_sec * 1000 * 1000 * 1000 + (uint64_t) ts.tv_nsec;
+}
+
+static void bm_metrics_name(char *name, int64_t pid)
+{
+    snprintf(name, BM_METRICS_NAME_CAPACITY, "/bm-metrics-%"PRIi64, pid);
+}
+
+static void bm_metrics_copy_name(char *dst, const char *src)
+{
+    snprintf(dst, BM_METRICS_NAME_CAPACITY, "%s", src);
+}
+
+#ifndef _WIN32
+bool bm_metrics_open(Bm_Metrics *metrics, const Bm *bm, const char *program, Bm_Error *error)
+{
+    memset(metrics, 0, sizeof(*metrics));
+    const int64_t pid = getpid();
+    bm_metrics_name(metrics->name, pid);
+
+    // NOTE: a page left behind by a crashed process with the same pid
+    shm_unlink(metrics->name);
+
+    int fd = shm_open(metrics->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return bm_error(error, "%s: could not open the shared memory: %s",
+                        metrics->name, strerror(errno));
+    }
+
+    if (ftruncate(fd, (off_t) sizeof(Bm_Metrics_Page)) < 0) {
+        bm_error(error, "%s: could not resize the shared memory: %s",
+                 metrics->name, strerror(errno));
+        close(fd);
+        shm_unlink(metrics->name);
+        return false;
+    }
+
+    void *data = mmap(NULL, sizeof(Bm_Metrics_Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(metrics->name);
+        return bm_error(error, "%s: could not map the shared memory: %s",
+                        metrics->name, strerror(errno));
+    }
+
+    Bm_Metrics_Page *page = data;
+    page->magic = BM_METRICS_MAGIC;
+    page->version = BM_METRICS_VERSION;
+    page->pid = pid;
+    bm_metrics_copy_name(page->program, program);
+    page->started_ns = bm_metrics_now_ns();
+    page->natives_size = bm->externals_size;
+    for (size_t i = 0; i < bm->externals_size; ++i) {
+        bm_metrics_copy_name(page->native_names[i], bm->externals[i].name);
+    }
+
+    metrics->page = page;
+    bm_metrics_publish(metrics, bm);
+
+    return true;
+}
+
+void bm_metrics_close(Bm_Metrics *metrics, const Bm *bm)
+{
+    if (metrics->page == NULL) {
+        return;
+    }
+
+    bm_metrics_publish(metrics, bm);
+    munmap(metrics->page, sizeof(Bm_Metrics_Page));
+    shm_unlink(metrics->name);
+    metrics->page = NULL;
+}
+
+bool bm_metrics_read(int64_t pid, Bm_Metrics_Page *page, Bm_Error *error)
+{
+    char name[BM_METRICS_NAME_CAPACITY];
+    bm_metrics_name(name, pid);
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return bm_error(error, "%s: could not open the shared memory: %s",
+                        name, strerror(errno));
+    }
+
+    struct stat st = {0};
+    if (fstat(fd, &st) < 0 || (uint64_t) st.st_size != sizeof(Bm_Metrics_Page)) {
+        close(fd);
+        return bm_error(error, "%s: unexpected size of the metrics page", name);
+    }
+
+    const Bm_Metrics_Page *shared = mmap(NULL, sizeof(Bm_Metrics_Page), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        return bm_error(error, "%s: could not map the shared memory: %s",
+                        name, strerror(errno));
+    }
+
+    const uint64_t deadline_ns = bm_metrics_now_ns() + BM_METRICS_READ_TIMEOUT_NS;
+    for (;;) {
+        const uint64_t before = atomic_load_explicit(
+                                    (_Atomic uint64_t *) &shared->sequence, memory_order_acquire);
+        if (before % 2 == 0) {
+            memcpy(page, shared, sizeof(*page));
+            atomic_thread_fence(memory_order_acquire);
+            const uint64_t after = atomic_load_explicit(
+                                       (_Atomic uint64_t *) &shared->sequence, memory_order_relaxed);
+            if (before == after) {
+                break;
+            }
+        }
+
+        if (kill((pid_t) pid, 0) < 0 && errno == ESRCH) {
+            munmap((void *) shared, sizeof(Bm_Metrics_Page));
+            return bm_error(error, "%s: the process %"PRIi64" died while writing the metrics page",
+                            name, pid);
+        }
+
+        if (bm_metrics_now_ns() >= deadline_ns) {
+            munmap((void *) shared, sizeof(Bm_Metrics_Page));
+            return bm_error(error, "%s: the metrics page stayed inconsistent for too long", name);
+        }
+
+        sched_yield();
+    }
+
+    munmap((void *) shared, sizeof(Bm_Metrics_Page));
+
+    if (page->magic != BM_METRICS_MAGIC || page->version != BM_METRICS_VERSION) {
+        return bm_error(error, "%s: unsupported metrics page", name);
+    }
+
+    return true;
+}
+#else
+bool bm_metrics_open(Bm_Metrics *metrics, const Bm *bm, const char *program, Bm_Error *error)
+{
+    (void) metrics;
+    (void) bm;
+    (void) program;
+    return bm_error(error, "live metrics are only supported on POSIX systems");
+}
+
+void bm_metrics_close(Bm_Metrics *metrics, const Bm *bm)
+{
+    (void) metrics;
+    (void) bm;
+}
+
+bool bm_metrics_read(int64_t pid, Bm_Metrics_Page *page, Bm_Error *error)
+{
+    (void) pid;
+    (void) page;
+    return bm_error(error, "live metrics are only supported on POSIX systems");
+}
+#endif // _WIN32
+
+static uint64_t bm_metrics_memory_high(const Bm *bm)
+{
+    for (size_t i = sizeof(bm->dirty_pages) / sizeof(bm->dirty_pages[0]); i > 0; --i) {
+        const uint64_t word = bm->dirty_pages[i - 1];
+        if (word != 0) {
+            uint64_t bit = 63;
+            while ((word & (1ULL << bit)) == 0) {
+                bit -= 1;
+            }
+            return ((i - 1) * 64 + bit + 1) * BM_MEMORY_PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+static const char *bm_metrics_label(const Bm *bm)
+{
+    const Bm_Export *closest = NULL;
+    for (size_t i = 0; i < bm->exports_size; ++i) {
+        const Bm_Export *export = &bm->exports[i];
+        if (export->addr <= bm->ip && (closest == NULL || export->addr > closest->addr)) {
+            closest = export;
+        }
+    }
+    return closest != NULL ? closest->name : "";
+}
+
+void bm_metrics_publish(Bm_Metrics *metrics, const Bm *bm)
+{
+    Bm_Metrics_Page *page = metrics->page;
+    if (page == NULL) {
+        return;
+    }
+
+    if (bm->stack_size > metrics->stack_peak) {
+        metrics->stack_peak = bm->stack_size;
+    }
+    metrics->published_ns = bm_metrics_now_ns();
+
+    const uint64_t sequence = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+    atomic_store_explicit(&page->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    page->updated_ns = metrics->published_ns;
+    page->natives_ns = metrics->natives_ns;
+    page->insts = metrics->insts;
+    page->ip = bm->ip;
+    page->inst_type = bm->ip < bm->program_size ? bm->program[bm->ip].type : NUMBER_OF_INSTS;
+    bm_metrics_copy_name(page->label, bm_metrics_label(bm));
+    page->stack_size = bm->stack_size;
+    page->stack_peak = metrics->stack_peak;
+    page->memory_high = bm_metrics_memory_high(bm);
+    page->halted = bm->halt;
+    memcpy(page->native_calls, metrics->native_calls,
+           page->natives_size * sizeof(page->native_calls[0]));
+
+    atomic_store_explicit(&page->sequence, sequence + 2, memory_order_release);
+}
+
+void bm_metrics_native_called(Bm_Metrics *metrics, const Bm *bm, Native_ID id, uint64_t started_ns)
+{
+    assert(id < BM_NATIVES_CAPACITY);
+    const uint64_t now_ns = bm_metrics_now_ns();
+    metrics->native_calls[id] += 1;
+    metrics->natives_ns += now_ns - started_ns;
+    if (bm->stack_size > metrics->stack_peak) {
+        metrics->stack_peak = bm->stack_size;
+    }
+
+    if (now_ns - metrics->published_ns >= BM_METRICS_PUBLISH_INTERVAL_NS) {
+        bm_metrics_publish(metrics, bm);
+    }
+}
+
+Err bm_metrics_execute_program(Bm_Metrics *metrics, Bm *bm, int limit)
+{
+    while (limit != 0 && !bm->halt) {
+        const int batch = limit > 0 && limit < BM_METRICS_BATCH ? limit : BM_METRICS_BATCH;
+
+        int remaining = batch;
+        Err err = bm_metrics_loop(bm, &remaining);
+        const int insts = batch - remaining;
+        metrics->insts += (uint64_t) insts;
+        bm_metrics_publish(metrics, bm);
+
+        if (err != ERR_OK) {
+            return err;
+        }
+
+        if (limit > 0) {
+            limit -= insts;
+        }
+    }
+
+    return ERR_OK;
+}
@@ -0,0 +1,92 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdatomic.h>
+
+#include "./bm.h"
+
+#define BM_METRICS_MAGIC 0x6d74656d
+#define BM_METRICS_VERSION 1
+#define BM_METRICS_NAME_CAPACITY 64
+// NOTE: the page is published after every batch of instructions, so the
+// interpreter loop itself does not touch the shared memory
+#define BM_METRICS_BATCH (64 * 1024)
+// NOTE: how often the page is published from the natives, so the metrics
+// stay fresh while the program is busy calling natives
+#define BM_METRICS_PUBLISH_INTERVAL_NS (100ULL * 1000 * 1000)
+// NOTE: how long a reader waits for the owner to finish writing the page
+#define BM_METRICS_READ_TIMEOUT_NS (1000ULL * 1000 * 1000)
+
+// NOTE: The metrics of a running Virtual Machine live in the POSIX shared
+// memory object `/bm-metrics-<pid>` (usually /dev/shm/bm-metrics-<pid>).
+// The owner updates it under a sequence lock: `sequence` is odd while the
+// page is being written, so readers copy the page and retry if `sequence`
+// changed in the meantime. The readers never block the owner. An owner that
+// died in the middle of writing leaves `sequence` odd forever, so the readers
+// give up once the process is gone or after BM_METRICS_READ_TIMEOUT_NS.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int64_t pid;
+    char program[BM_METRICS_NAME_CAPACITY];
+
+    _Atomic uint64_t sequence;
+
+    // NOTE: CLOCK_MONOTONIC in nanoseconds
+    uint64_t started_ns;
+    uint64_t updated_ns;
+    // NOTE: the rest of the time since `started_ns` was spent in the bytecode
+    uint64_t natives_ns;
+
+    uint64_t insts;
+    Inst_Addr ip;
+    uint64_t inst_type;
+    // NOTE: the closest export at or before `ip`, if any
+    char label[BM_METRICS_NAME_CAPACITY];
+    uint64_t stack_size;
+    // NOTE: sampled at the natives and at the ends of the batches
+    uint64_t stack_peak;
+    // NOTE: the end of the highest page of the memory that was written to
+    uint64_t memory_high;
+    uint64_t halted;
+
+    uint64_t natives_size;
+    uint64_t native_calls[BM_NATIVES_CAPACITY];
+    char native_names[BM_NATIVES_CAPACITY][BM_METRICS_NAME_CAPACITY];
+} Bm_Metrics_Page;
+
+typedef struct {
+    Bm_Metrics_Page *page;
+    char name[BM_METRICS_NAME_CAPACITY];
+
+    // NOTE: the values are accumulated here and copied to the page only
+    // when it is published
+    uint64_t insts;
+    uint64_t natives_ns;
+    uint64_t stack_peak;
+    uint64_t native_calls[BM_NATIVES_CAPACITY];
+    uint64_t published_ns;
+} Bm_Metrics;
+
+uint64_t bm_metrics_now_ns(void);
+
+// Creates the metrics page of the current process for the program loaded
+// into `bm`. Only POSIX systems are supported.
+bool bm_metrics_open(Bm_Metrics *metrics, const Bm *bm, const char *program, Bm_Error *error);
+// Publishes the final state and removes the page
+void bm_metrics_close(Bm_Metrics *metrics, const Bm *bm);
+void bm_metrics_publish(Bm_Metrics *metrics, const Bm *bm);
+// Accounts a call of the native `id` that started at `started_ns` (see
+// bm_metrics_now_ns()) and just returned. Publishes the page if it has not
+// been published for a while.
+void bm_metrics_native_called(Bm_Metrics *metrics, const Bm *bm, Native_ID id, uint64_t started_ns);
+// Executes the program the same way as bm_execute_program() and publishes the
+// page after every BM_METRICS_BATCH instructions
+Err bm_metrics_execute_program(Bm_Metrics *metrics, Bm *bm, int limit);
+
+// Copies a consistent snapshot of the metrics page of the process `pid`. Fails
+// if the page stays inconsistent (see Bm_Metrics_Page).
+bool bm_metrics_read(int64_t pid, Bm_Metrics_Page *page, Bm_Error *error);
+
+#endif // METRICS_H_
@@ -5,6 +5,7 @@
 #endif // _WIN32
 
 #include "./native_loader.h"
+#include "./hash.h"
 
 void native_loader_add_object(Native_Loader *loader, const char *object_path)
 {
@@ -26,6 +27,7 @@ void native_loader_add_object(Native_Loader *loader, const char *object_path)
         exit(1);
     }
 #endif
+    loader->object_paths[loader->objects_size] = object_path;
     loader->objects[loader->objects_size++] = result;
     printf("INFO: successfully loaded object `%s`\n", object_path);
 }
@@ -45,20 +47,206 @@ void native_loader_unload_all(Native_Loader *loader)
         }
 #endif
     }
+
+    arena_free(&loader->arena);
 }
 
-Bm_Native native_loader_find_function(Native_Loader *loader, Arena *arena, const char *function_name)
+static void *native_loader_object_symbol(Native_Loader *loader, size_t object, const char *symbol_name)
 {
-    for (size_t i = 0; i < loader->objects_size; ++i) {
-        Bm_Native result = NULL;
 #ifndef _WIN32
-        *(void**)(&result) = dlsym(loader->objects[i], CSTR_CONCAT(arena, "bm_", function_name));
+    return dlsym(loader->objects[object], symbol_name);
 #else
-        *(void**)(&result) = (void*)GetProcAddress(loader->objects[i], CSTR_CONCAT(arena, "bm_", function_name));
+    return (void*)GetProcAddress(loader->objects[object], symbol_name);
 #endif
-        if (result != NULL) {
-            return result;
+}
+
+static bool native_loader_resolve_in_object(Native_Loader *loader, size_t object, Native_Symbol *symbol)
+{
+    const Bm_Native_Def *def = native_loader_object_symbol(
+                                   loader, object,
+                                   CSTR_CONCAT(&loader->arena, "bm_native_def_", symbol->name));
+    if (def != NULL) {
+        symbol->def = def;
+        symbol->object = object;
+        return true;
+    }
+
+    Bm_Native native = NULL;
+    *(void**)(&native) = native_loader_object_symbol(
+                             loader, object,
+                             CSTR_CONCAT(&loader->arena, "bm_", symbol->name));
+    if (native != NULL) {
+        symbol->native = native;
+        symbol->object = object;
+        return true;
+    }
+
+    return false;
+}
+
+static Native_Symbol *native_loader_symbol_slot(Native_Loader *loader, const char *name)
+{
+    const uint64_t hash = hash_bytes(name, strlen(name));
+    size_t index = hash & (NATIVE_LOADER_SYMBOLS_CAPACITY - 1);
+
+    while (loader->symbols[index].name != NULL) {
+        Native_Symbol *symbol = &loader->symbols[index];
+        if (symbol->hash == hash && strcmp(symbol->name, name) == 0) {
+            return symbol;
+        }
+        index = (index + 1) & (NATIVE_LOADER_SYMBOLS_CAPACITY - 1);
+    }
+
+    if (loader->symbols_size >= NATIVE_LOADER_SYMBOLS_CAPACITY - 1) {
+        fprintf(stderr, "ERROR: Exceeded the capacity of native symbols\n");
+        exit(1);
+    }
+
+    Native_Symbol *symbol = &loader->symbols[index];
+    symbol->name = CSTR_CONCAT(&loader->arena, name);
+    symbol->hash = hash;
+    symbol->object = NATIVE_LOADER_NO_OBJECT;
+    loader->symbols_size += 1;
+    return symbol;
+}
+
+const Native_Symbol *native_loader_resolve(Native_Loader *loader, const char *name)
+{
+    Native_Symbol *symbol = native_loader_symbol_slot(loader, name);
+    if (symbol->resolved) {
+        return symbol;
+    }
+    symbol->resolved = true;
+
+    const size_t hint = symbol->object;
+    symbol->object = NATIVE_LOADER_NO_OBJECT;
+
+    if (hint < loader->objects_size && native_loader_resolve_in_object(loader, hint, symbol)) {
+        return symbol;
+    }
+
+    loader->manifest_outdated = true;
+
+    for (size_t i = 0; i < loader->objects_size; ++i) {
+        if (i != hint && native_loader_resolve_in_object(loader, i, symbol)) {
+            return symbol;
         }
     }
-    return NULL;
+
+    return symbol;
+}
+
+static Err native_loader_lazy_native(Bm *bm)
+{
+    Native_Loader *loader = bm->native_loader;
+    assert(loader != NULL);
+    assert(bm->ip < bm->program_size);
+    assert(bm->program[bm->ip].type == INST_NATIVE);
+
+    const Native_ID id = bm->program[bm->ip].operand.as_u64;
+    assert(id < bm->externals_size);
+
+    const Native_Symbol *symbol = native_loader_resolve(loader, bm->externals[id].name);
+    if (symbol->object == NATIVE_LOADER_NO_OBJECT) {
+        fprintf(stderr, "ERROR: could not find external native function `%s`. Make sure you attached all the necessary dynamic libraries via the `-n` flag.\n", symbol->name);
+        return ERR_NULL_NATIVE;
+    }
+
+    // NOTE: patch the slot, so the next calls do not go through the
+    // trampoline. The slot is tracked from now on, so this call does not
+    // make the whole memory dirty unless the native is not tracked itself.
+    if (symbol->def) {
+        bm_set_native_def(bm, id, symbol->def);
+        return bm_call_native_def(bm, symbol->def);
+    }
+
+    bm_set_native(bm, id, symbol->native);
+    return symbol->native(bm);
+}
+
+bool native_loader_bind_externals(Native_Loader *loader, Bm *bm, bool lazy, const char **missing_name)
+{
+    bm->native_loader = loader;
+
+    for (size_t i = 0; i < bm->externals_size; ++i) {
+        Bm_Native native = bm_builtin_native_by_name(bm->externals[i].name);
+        if (native != NULL) {
+            bm_push_native(bm, native);
+            continue;
+        }
+
+        if (lazy) {
+            bm_push_native(bm, native_loader_lazy_native);
+            continue;
+        }
+
+        const Native_Symbol *symbol = native_loader_resolve(loader, bm->externals[i].name);
+        if (symbol->object == NATIVE_LOADER_NO_OBJECT) {
+            if (missing_name) {
+                *missing_name = symbol->name;
+            }
+            return false;
+        }
+
+        if (symbol->def) {
+            bm_push_native_def(bm, symbol->def);
+        } else {
+            bm_push_native(bm, symbol->native);
+        }
+    }
+
+    return true;
+}
+
+bool native_loader_load_manifest(Native_Loader *loader, const char *file_path)
+{
+    String_View content = {0};
+    if (arena_slurp_file(&loader->arena, sv_from_cstr(file_path), &content) < 0) {
+        loader->manifest_outdated = true;
+        return false;
+    }
+
+    while (content.count > 0) {
+        String_View line = sv_trim(sv_chop_by_delim(&content, '\n'));
+        if (line.count == 0) {
+            continue;
+        }
+
+        String_View name = sv_chop_by_delim(&line, ' ');
+        String_View object_path = sv_trim(line);
+
+        // NOTE: the objects that are not attached anymore are ignored
+        for (size_t i = 0; i < loader->objects_size; ++i) {
+            if (sv_eq(object_path, sv_from_cstr(loader->object_paths[i]))) {
+                Native_Symbol *symbol = native_loader_symbol_slot(
+                                            loader,
+                                            arena_sv_to_cstr(&loader->arena, name));
+                if (!symbol->resolved) {
+                    symbol->object = i;
+                }
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool native_loader_save_manifest(const Native_Loader *loader, const char *file_path)
+{
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < NATIVE_LOADER_SYMBOLS_CAPACITY; ++i) {
+        const Native_Symbol *symbol = &loader->symbols[i];
+        if (symbol->name != NULL && symbol->object != NATIVE_LOADER_NO_OBJECT) {
+            fprintf(f, "%s %s\n", symbol->name, loader->object_paths[symbol->object]);
+        }
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
 }
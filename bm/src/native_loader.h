@@ -5,15 +5,64 @@
 #include "./arena.h"
 
 #define NATIVE_LOADER_CAPACITY 128
+// NOTE: must be a power of two and bigger than BM_EXTERNAL_NATIVES_CAPACITY
+#define NATIVE_LOADER_SYMBOLS_CAPACITY 2048
+#define NATIVE_LOADER_NO_OBJECT SIZE_MAX
 
+static_assert((NATIVE_LOADER_SYMBOLS_CAPACITY & (NATIVE_LOADER_SYMBOLS_CAPACITY - 1)) == 0,
+              "The capacity of the symbols table is expected to be a power of two");
+static_assert(NATIVE_LOADER_SYMBOLS_CAPACITY > BM_EXTERNAL_NATIVES_CAPACITY,
+              "The symbols table must fit all the externals of a program");
+
+// NOTE: An entry of the symbols cache. `object` is the index of the object
+// that provides the symbol or NATIVE_LOADER_NO_OBJECT if none of them does.
+// The entries loaded from a manifest are not resolved yet, their `object`
+// is only a hint where to look first.
 typedef struct {
+    const char *name;
+    uint64_t hash;
+    bool resolved;
+    size_t object;
+    Bm_Native native;
+    const Bm_Native_Def *def;
+} Native_Symbol;
+
+struct Native_Loader {
     void *objects[NATIVE_LOADER_CAPACITY];
+    const char *object_paths[NATIVE_LOADER_CAPACITY];
     size_t objects_size;
-} Native_Loader;
+
+    // NOTE: open addressing hash table keyed by the name of the native
+    Native_Symbol symbols[NATIVE_LOADER_SYMBOLS_CAPACITY];
+    size_t symbols_size;
+
+    // NOTE: some natives were resolved differently from what the manifest says
+    bool manifest_outdated;
+
+    Arena arena;
+};
 
 void native_loader_add_object(Native_Loader *loader, const char *object_path);
 void native_loader_unload_all(Native_Loader *loader);
 
-Bm_Native native_loader_find_function(Native_Loader *loader, Arena *arena, const char *function_name);
+// Looks up the native in the symbols cache first and only then in the objects.
+// Typed natives are exported by the objects as `const Bm_Native_Def bm_native_def_<name>`
+// and take priority over the legacy `Err bm_<name>(Bm*)` ones.
+const Native_Symbol *native_loader_resolve(Native_Loader *loader, const char *name);
+
+// Binds all the externals of the program that are not built-in natives.
+// With `lazy` the slots are bound to a trampoline that resolves the native
+// on its first call and patches the slot, so the programs only pay for the
+// natives they actually use. The loader is stored in `bm->native_loader`
+// for that and must outlive the execution.
+// Returns false and reports the name of the native if eager binding fails.
+bool native_loader_bind_externals(Native_Loader *loader, Bm *bm, bool lazy, const char **missing_name);
+
+// NOTE: The manifest is a text file with a line `<native name> <object path>`
+// per resolved native. It remembers which object provided a native, so the
+// next launch looks up only in that object.
+// Loading a manifest that does not exist marks it as outdated.
+bool native_loader_load_manifest(Native_Loader *loader, const char *file_path);
+bool native_loader_save_manifest(const Native_Loader *loader, const char *file_path);
 
 #endif // NATIVE_LOADER_H_
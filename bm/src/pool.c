@@ -0,0 +1,57 @@
+#include "./pool.h"
+
+bool bm_pool_init(Bm_Pool *pool, const void *buffer, size_t buffer_size, Bm_Error *error)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    pool->data = malloc(buffer_size);
+    if (pool->data == NULL && buffer_size > 0) {
+        return bm_error(error, "Could not allocate %zu bytes for the image", buffer_size);
+    }
+    memcpy(pool->data, buffer, buffer_size);
+
+    if (!bm_image_decode(&pool->image, pool->data, buffer_size, error)) {
+        free(pool->data);
+        pool->data = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void bm_pool_free(Bm_Pool *pool)
+{
+    for (size_t i = 0; i < pool->free_size; ++i) {
+        bm_destroy(pool->free[i]);
+    }
+    free(pool->data);
+    memset(pool, 0, sizeof(*pool));
+}
+
+Bm *bm_pool_acquire(Bm_Pool *pool)
+{
+    if (pool->free_size > 0) {
+        pool->reused += 1;
+        return pool->free[--pool->free_size];
+    }
+
+    Bm *bm = bm_create();
+    if (bm == NULL) {
+        return NULL;
+    }
+
+    bm_image_install(bm, &pool->image);
+    pool->created += 1;
+    return bm;
+}
+
+void bm_pool_release(Bm_Pool *pool, Bm *bm)
+{
+    if (pool->free_size >= BM_POOL_CAPACITY) {
+        bm_destroy(bm);
+        return;
+    }
+
+    pool->restored_pages += bm_image_reset(bm, &pool->image);
+    pool->free[pool->free_size++] = bm;
+}
@@ -0,0 +1,42 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include "./bm.h"
+
+#define BM_POOL_CAPACITY 64
+
+// NOTE: Bm_Pool keeps the contexts of finished jobs of the same program, so
+// the next jobs do not have to allocate and install them from scratch. A
+// released context is reset with bm_image_reset(), which restores only the
+// pages of the memory that the previous job wrote to, so the cost of the
+// reset is proportional to the work the job has done and not to
+// BM_MEMORY_CAPACITY. A job that calls a legacy native that is not tracked
+// (see bm_push_tracked_native()) gets the whole memory restored. The buffered
+// input and the asynchronous state of the previous job are dropped as well.
+//
+// A context that comes out of the pool for the first time has no natives
+// bound (`natives_size` is 0). The reused ones keep theirs.
+//
+// The pool is not synchronized. Either keep one pool per thread or protect
+// it with a lock.
+typedef struct {
+    // NOTE: the pool owns a copy of the .bm file the image points into
+    uint8_t *data;
+    Bm_Image image;
+
+    Bm *free[BM_POOL_CAPACITY];
+    size_t free_size;
+
+    uint64_t created;
+    uint64_t reused;
+    uint64_t restored_pages;
+} Bm_Pool;
+
+bool bm_pool_init(Bm_Pool *pool, const void *buffer, size_t buffer_size, Bm_Error *error);
+void bm_pool_free(Bm_Pool *pool);
+// Returns NULL if a new context could not be allocated
+Bm *bm_pool_acquire(Bm_Pool *pool);
+// The context must have been acquired from the same pool
+void bm_pool_release(Bm_Pool *pool, Bm *bm);
+
+#endif // POOL_H_
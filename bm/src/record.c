@@ -0,0 +1,249 @@
+#include "./record.h"
+
+static bool bm_record_write(Bm_Recorder *recorder, const void *data, size_t size, Bm_Error *error)
+{
+    if (size > 0 && fwrite(data, size, 1, recorder->file) != 1) {
+        return bm_error(error, "Could not write file `%s`: %s",
+                        recorder->file_path, strerror(errno));
+    }
+    return true;
+}
+
+bool bm_recorder_open(Bm_Recorder *recorder, const char *file_path, uint64_t image_hash, Bm_Error *error)
+{
+    recorder->file = fopen(file_path, "wb");
+    if (recorder->file == NULL) {
+        return bm_error(error, "Could not open file `%s`: %s",
+                        file_path, strerror(errno));
+    }
+    recorder->file_path = file_path;
+    recorder->calls = 0;
+
+    Bm_Record_Meta meta = {
+        .magic = BM_RECORD_MAGIC,
+        .version = BM_RECORD_VERSION,
+        .image_hash = image_hash,
+    };
+    return bm_record_write(recorder, &meta, sizeof(meta), error);
+}
+
+bool bm_recorder_call(Bm_Recorder *recorder, Bm *bm,
+                      Bm_Native native, const Bm_Native_Def *def, bool tracked,
+                      Err *err, Bm_Error *error)
+{
+    const uint64_t ip = bm->ip;
+    const uint64_t stack_size = bm->stack_size;
+    memcpy(recorder->stack, bm->stack, sizeof(bm->stack[0]) * stack_size);
+
+    // NOTE: the dirty pages of the memory are borrowed to find out what the
+    // native writes to. The pages that were dirty before are merged back.
+    memcpy(recorder->dirty_pages, bm->dirty_pages, sizeof(bm->dirty_pages));
+    memset(bm->dirty_pages, 0, sizeof(bm->dirty_pages));
+
+    const bool compared = def == NULL && !tracked;
+    if (compared) {
+        memcpy(recorder->memory, bm->memory, BM_MEMORY_CAPACITY);
+    }
+
+    *err = def ? bm_call_native_def(bm, def) : native(bm);
+
+    if (compared) {
+        for (size_t page = 0; page < BM_MEMORY_PAGES_COUNT; ++page) {
+            const size_t begin = page * BM_MEMORY_PAGE_SIZE;
+            const size_t n = BM_MEMORY_CAPACITY - begin < BM_MEMORY_PAGE_SIZE
+                             ? BM_MEMORY_CAPACITY - begin
+                             : BM_MEMORY_PAGE_SIZE;
+            if (memcmp(recorder->memory + begin, bm->memory + begin, n) != 0) {
+                bm->dirty_pages[page / 64] |= 1ULL << (page % 64);
+            }
+        }
+    }
+
+    uint64_t base = stack_size < bm->stack_size ? stack_size : bm->stack_size;
+    for (uint64_t i = 0; i < base; ++i) {
+        if (memcmp(&recorder->stack[i], &bm->stack[i], sizeof(bm->stack[i])) != 0) {
+            base = i;
+            break;
+        }
+    }
+
+    uint64_t pages_size = 0;
+    for (size_t page = 0; page < BM_MEMORY_PAGES_COUNT; ++page) {
+        if (bm->dirty_pages[page / 64] & (1ULL << (page % 64))) {
+            pages_size += 1;
+        }
+    }
+
+    Bm_Record_Call call = {
+        .ip = ip,
+        .native_id = bm->program[ip].operand.as_u64,
+        .err = (uint32_t) *err,
+        .base = base,
+        .inputs_size = stack_size - base,
+        .outputs_size = bm->stack_size - base,
+        .pages_size = pages_size,
+    };
+    if (!bm_record_write(recorder, &call, sizeof(call), error) ||
+            !bm_record_write(recorder, &recorder->stack[base], sizeof(Word) * call.inputs_size, error) ||
+            !bm_record_write(recorder, &bm->stack[base], sizeof(Word) * call.outputs_size, error)) {
+        return false;
+    }
+
+    static const uint8_t zeros[BM_MEMORY_PAGE_SIZE] = {0};
+    for (uint64_t page = 0; page < BM_MEMORY_PAGES_COUNT; ++page) {
+        if (bm->dirty_pages[page / 64] & (1ULL << (page % 64))) {
+            const size_t begin = page * BM_MEMORY_PAGE_SIZE;
+            const size_t n = BM_MEMORY_CAPACITY - begin < BM_MEMORY_PAGE_SIZE
+                             ? BM_MEMORY_CAPACITY - begin
+                             : BM_MEMORY_PAGE_SIZE;
+            if (!bm_record_write(recorder, &page, sizeof(page), error) ||
+                    !bm_record_write(recorder, bm->memory + begin, n, error) ||
+                    !bm_record_write(recorder, zeros, BM_MEMORY_PAGE_SIZE - n, error)) {
+                return false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(bm->dirty_pages) / sizeof(bm->dirty_pages[0]); ++i) {
+        bm->dirty_pages[i] |= recorder->dirty_pages[i];
+    }
+
+    recorder->calls += 1;
+    return true;
+}
+
+bool bm_recorder_close(Bm_Recorder *recorder, Bm_Error *error)
+{
+    if (fclose(recorder->file) != 0) {
+        recorder->file = NULL;
+        return bm_error(error, "Could not write file `%s`: %s",
+                        recorder->file_path, strerror(errno));
+    }
+    recorder->file = NULL;
+    return true;
+}
+
+bool bm_replayer_open(Bm_Replayer *replayer, const char *file_path, uint64_t image_hash, Bm_Error *error)
+{
+    memset(replayer, 0, sizeof(*replayer));
+    replayer->file_path = file_path;
+    if (!bm_slurp_file(file_path, &replayer->data, &replayer->size, error)) {
+        return false;
+    }
+
+    Bm_Record_Meta meta = {0};
+    if (replayer->size < sizeof(meta)) {
+        bm_replayer_close(replayer);
+        return bm_error(error, "%s: record is too small", file_path);
+    }
+    memcpy(&meta, replayer->data, sizeof(meta));
+    replayer->cursor = sizeof(meta);
+
+    if (meta.magic != BM_RECORD_MAGIC) {
+        bm_replayer_close(replayer);
+        return bm_error(error, "%s: does not appear to be a valid record of native calls. Unexpected magic %04X. Expected %04X.",
+                        file_path, meta.magic, BM_RECORD_MAGIC);
+    }
+
+    if (meta.version != BM_RECORD_VERSION) {
+        bm_replayer_close(replayer);
+        return bm_error(error, "%s: unsupported version of record %d. Expected version %d.",
+                        file_path, meta.version, BM_RECORD_VERSION);
+    }
+
+    if (meta.image_hash != image_hash) {
+        bm_replayer_close(replayer);
+        return bm_error(error, "%s: the record was made for a different program", file_path);
+    }
+
+    return true;
+}
+
+static const uint8_t *bm_replayer_take(Bm_Replayer *replayer, size_t size)
+{
+    if (size > replayer->size - replayer->cursor) {
+        return NULL;
+    }
+    const uint8_t *data = replayer->data + replayer->cursor;
+    replayer->cursor += size;
+    return data;
+}
+
+bool bm_replayer_call(Bm_Replayer *replayer, Bm *bm, Err *err, Bm_Error *error)
+{
+    Bm_Record_Call call = {0};
+    const uint8_t *data = bm_replayer_take(replayer, sizeof(call));
+    if (data == NULL) {
+        return bm_error(error, "%s: the program made more native calls than recorded (%"PRIu64")",
+                        replayer->file_path, replayer->calls);
+    }
+    memcpy(&call, data, sizeof(call));
+
+    if (call.ip != bm->ip || call.native_id != bm->program[bm->ip].operand.as_u64) {
+        return bm_error(error, "%s: native call #%"PRIu64" diverged: recorded native %"PRIu64" at %"PRIu64", but the program calls native %"PRIu64" at %"PRIu64,
+                        replayer->file_path, replayer->calls,
+                        call.native_id, call.ip,
+                        bm->program[bm->ip].operand.as_u64, bm->ip);
+    }
+
+    if (call.base > bm->stack_size ||
+            call.inputs_size != bm->stack_size - call.base ||
+            call.outputs_size > BM_STACK_CAPACITY - call.base ||
+            call.pages_size > BM_MEMORY_PAGES_COUNT ||
+            call.err > ERR_PENDING) {
+        return bm_error(error, "%s: native call #%"PRIu64" diverged: unexpected state of the stack",
+                        replayer->file_path, replayer->calls);
+    }
+
+    const uint8_t *inputs = bm_replayer_take(replayer, sizeof(Word) * call.inputs_size);
+    const uint8_t *outputs = bm_replayer_take(replayer, sizeof(Word) * call.outputs_size);
+    if (inputs == NULL || outputs == NULL) {
+        return bm_error(error, "%s: record is truncated", replayer->file_path);
+    }
+
+    if (memcmp(inputs, &bm->stack[call.base], sizeof(Word) * call.inputs_size) != 0) {
+        return bm_error(error, "%s: native call #%"PRIu64" diverged: unexpected arguments",
+                        replayer->file_path, replayer->calls);
+    }
+
+    for (uint64_t i = 0; i < call.pages_size; ++i) {
+        uint64_t page = 0;
+        const uint8_t *page_data = bm_replayer_take(replayer, sizeof(page));
+        if (page_data == NULL) {
+            return bm_error(error, "%s: record is truncated", replayer->file_path);
+        }
+        memcpy(&page, page_data, sizeof(page));
+
+        const uint8_t *content = bm_replayer_take(replayer, BM_MEMORY_PAGE_SIZE);
+        if (content == NULL || page >= BM_MEMORY_PAGES_COUNT) {
+            return bm_error(error, "%s: record is corrupted", replayer->file_path);
+        }
+
+        const size_t begin = page * BM_MEMORY_PAGE_SIZE;
+        const size_t n = BM_MEMORY_CAPACITY - begin < BM_MEMORY_PAGE_SIZE
+                         ? BM_MEMORY_CAPACITY - begin
+                         : BM_MEMORY_PAGE_SIZE;
+        memcpy(bm->memory + begin, content, n);
+        bm->dirty_pages[page / 64] |= 1ULL << (page % 64);
+    }
+
+    memcpy(&bm->stack[call.base], outputs, sizeof(Word) * call.outputs_size);
+    bm->stack_size = call.base + call.outputs_size;
+
+    *err = (Err) call.err;
+    replayer->calls += 1;
+    return true;
+}
+
+bool bm_replayer_finished(const Bm_Replayer *replayer)
+{
+    return replayer->cursor == replayer->size;
+}
+
+void bm_replayer_close(Bm_Replayer *replayer)
+{
+    free(replayer->data);
+    replayer->data = NULL;
+    replayer->size = 0;
+    replayer->cursor = 0;
+}
@@ -0,0 +1,88 @@
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include "./bm.h"
+
+#define BM_RECORD_MAGIC 0x636e6d62
+#define BM_RECORD_VERSION 1
+
+// NOTE: A record of the native calls (.bmn) lets a program that depends on
+// the outside world (SDL, input, ...) be executed again without it. Every
+// call of a native is logged with its effects: how the stack changed and the
+// content of the pages of the memory the native wrote to. Replaying feeds
+// the effects back instead of calling the natives, so the interpreter goes
+// through exactly the same states as during the recording. The layout is
+//
+//   Bm_Record_Meta
+//   for every call:
+//     Bm_Record_Call
+//     Word inputs[inputs_size]    // the stack from `base` before the call
+//     Word outputs[outputs_size]  // the stack from `base` after the call
+//     for every page:
+//       uint64_t page
+//       uint8_t content[BM_MEMORY_PAGE_SIZE]
+//
+// The pages a native writes to are found through the dirty pages of the
+// memory. A legacy native that does not report its writes (see
+// Bm.natives_tracked) gets the memory copied before the call and compared
+// after it instead. The effects that are outside of the Virtual Machine
+// (printing, the mapped files) are not reproduced.
+PACK(struct Bm_Record_Meta {
+    uint32_t magic;
+    uint16_t version;
+    // NOTE: the hash of the .bm file, so the record is not replayed against
+    // a different program
+    uint64_t image_hash;
+});
+
+typedef struct Bm_Record_Meta Bm_Record_Meta;
+
+PACK(struct Bm_Record_Call {
+    uint64_t ip;
+    uint64_t native_id;
+    uint32_t err;
+    uint64_t base;
+    uint64_t inputs_size;
+    uint64_t outputs_size;
+    uint64_t pages_size;
+});
+
+typedef struct Bm_Record_Call Bm_Record_Call;
+
+typedef struct {
+    FILE *file;
+    const char *file_path;
+    uint64_t calls;
+    // NOTE: the state of the Bm right before the current call
+    Word stack[BM_STACK_CAPACITY];
+    uint64_t dirty_pages[(BM_MEMORY_PAGES_COUNT + 63) / 64];
+    // NOTE: only for the natives that are not tracked
+    uint8_t memory[BM_MEMORY_CAPACITY];
+} Bm_Recorder;
+
+bool bm_recorder_open(Bm_Recorder *recorder, const char *file_path, uint64_t image_hash, Bm_Error *error);
+// Calls either the native or the def (the other one is NULL) and records its
+// effects. `tracked` tells whether the legacy native reports all of its writes
+// to the memory. The result of the native is reported through `err`.
+bool bm_recorder_call(Bm_Recorder *recorder, Bm *bm,
+                      Bm_Native native, const Bm_Native_Def *def, bool tracked,
+                      Err *err, Bm_Error *error);
+bool bm_recorder_close(Bm_Recorder *recorder, Bm_Error *error);
+
+typedef struct {
+    const char *file_path;
+    uint8_t *data;
+    size_t size;
+    size_t cursor;
+    uint64_t calls;
+} Bm_Replayer;
+
+bool bm_replayer_open(Bm_Replayer *replayer, const char *file_path, uint64_t image_hash, Bm_Error *error);
+// Applies the effects of the next recorded call instead of calling the native
+// at `bm->ip`. Fails if the machine is not in the state it was recorded in.
+bool bm_replayer_call(Bm_Replayer *replayer, Bm *bm, Err *err, Bm_Error *error);
+// Returns true if all of the recorded calls were replayed
+bool bm_replayer_finished(const Bm_Replayer *replayer);
+void bm_replayer_close(Bm_Replayer *replayer);
+
+#endif // RECORD_H_
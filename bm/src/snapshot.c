@@ -0,0 +1,337 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include "./snapshot.h"
+#include "./hash.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+static size_t bm_snapshot_align(size_t offset)
+{
+    return (offset + BM_SNAPSHOT_PAGE_SIZE - 1) / BM_SNAPSHOT_PAGE_SIZE * BM_SNAPSHOT_PAGE_SIZE;
+}
+
+static size_t bm_snapshot_page_end(size_t page)
+{
+    const size_t end = (page + 1) * BM_SNAPSHOT_PAGE_SIZE;
+    return end < BM_MEMORY_CAPACITY ? end : BM_MEMORY_CAPACITY;
+}
+
+// NOTE: compares the page of the memory against the memory right after the
+// image was installed: its memory section followed by zeros
+static bool bm_snapshot_page_dirty(const Bm *bm, const Bm_Image *image, size_t page)
+{
+    const size_t memory_size = image->meta.memory_size;
+    const size_t end = bm_snapshot_page_end(page);
+
+    size_t i = page * BM_SNAPSHOT_PAGE_SIZE;
+    if (i < memory_size) {
+        const size_t n = (end < memory_size ? end : memory_size) - i;
+        if (memcmp(bm->memory + i, image->memory + i, n) != 0) {
+            return true;
+        }
+        i += n;
+    }
+
+    for (; i < end; ++i) {
+        if (bm->memory[i] != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// NOTE: the snapshot may be resumed from another working directory, so it
+// remembers where the image and the native libraries actually are
+static bool bm_snapshot_full_path(const char *file_path, char *dst, Bm_Error *error)
+{
+#ifndef _WIN32
+    char *full_path = realpath(file_path, NULL);
+#else
+    char *full_path = _fullpath(NULL, file_path, 0);
+#endif // _WIN32
+    if (full_path == NULL) {
+        return bm_error(error, "Could not resolve path `%s`: %s", file_path, strerror(errno));
+    }
+
+    const size_t n = strlen(full_path);
+    if (n >= BM_SNAPSHOT_PATH_CAPACITY) {
+        free(full_path);
+        return bm_error(error, "Could not save snapshot: the path `%s` is too long", file_path);
+    }
+
+    memset(dst, 0, BM_SNAPSHOT_PATH_CAPACITY);
+    memcpy(dst, full_path, n);
+    free(full_path);
+    return true;
+}
+
+// NOTE: a bare name of a library is looked up by the dynamic loader in the
+// library paths rather than in the working directory, so it is saved as it is
+static bool bm_snapshot_is_bare_name(const char *file_path)
+{
+#ifndef _WIN32
+    return strchr(file_path, '/') == NULL;
+#else
+    return strchr(file_path, '/') == NULL && strchr(file_path, '\\') == NULL;
+#endif // _WIN32
+}
+
+bool bm_snapshot_save(const Bm *bm, const Bm_Snapshot_Bindings *bindings,
+                      Bm_Image_Cache *image_cache,
+                      const char *snapshot_path, Bm_Error *error)
+{
+    if (bm->mappings_size > 0) {
+        return bm_error(error, "Could not save snapshot `%s`: mapped files and channels can not be saved",
+                        snapshot_path);
+    }
+
+    // NOTE: the program has already consumed the input that sits in the
+    // buffer, so it would never see it again after resuming
+    if (bm->input.begin < bm->input.end) {
+        return bm_error(error, "Could not save snapshot `%s`: there is buffered input that can not be saved",
+                        snapshot_path);
+    }
+
+    if (bindings->objects_size > BM_SNAPSHOT_OBJECTS_CAPACITY) {
+        return bm_error(error, "Could not save snapshot `%s`: too many native libraries",
+                        snapshot_path);
+    }
+
+    char image_path[BM_SNAPSHOT_PATH_CAPACITY];
+    if (!bm_snapshot_full_path(bindings->image_path, image_path, error)) {
+        return false;
+    }
+
+    char object_paths[BM_SNAPSHOT_OBJECTS_CAPACITY][BM_SNAPSHOT_PATH_CAPACITY];
+    for (size_t i = 0; i < bindings->objects_size; ++i) {
+        if (bm_snapshot_is_bare_name(bindings->object_paths[i])) {
+            memcpy(object_paths[i], bindings->object_paths[i], BM_SNAPSHOT_PATH_CAPACITY);
+        } else if (!bm_snapshot_full_path(bindings->object_paths[i], object_paths[i], error)) {
+            return false;
+        }
+    }
+
+    Bm_Image_Cache local_cache = {0};
+    const Bm_Image_Cache_Entry *entry =
+        bm_image_cache_get(image_cache != NULL ? image_cache : &local_cache, image_path, error);
+    if (entry == NULL) {
+        return false;
+    }
+
+    uint64_t page_indices[BM_MEMORY_PAGES_COUNT];
+    size_t pages_size = 0;
+    for (size_t page = 0; page < BM_MEMORY_PAGES_COUNT; ++page) {
+        if (bm_snapshot_page_dirty(bm, &entry->image, page)) {
+            page_indices[pages_size++] = page;
+        }
+    }
+
+    Bm_Snapshot_Meta meta = {
+        .magic = BM_SNAPSHOT_MAGIC,
+        .version = BM_SNAPSHOT_VERSION,
+        .image_hash = entry->hash,
+        .image_size = entry->size,
+        .ip = bm->ip,
+        .stack_size = bm->stack_size,
+        .objects_size = bindings->objects_size,
+        .pages_size = pages_size,
+    };
+    memcpy(meta.image_path, image_path, BM_SNAPSHOT_PATH_CAPACITY);
+    bm_image_cache_clear(&local_cache);
+
+    FILE *f = fopen(snapshot_path, "wb");
+    if (f == NULL) {
+        return bm_error(error, "Could not open file `%s`: %s",
+                        snapshot_path, strerror(errno));
+    }
+
+    fwrite(&meta, sizeof(meta), 1, f);
+    fwrite(bm->stack, sizeof(bm->stack[0]), bm->stack_size, f);
+    fwrite(object_paths, BM_SNAPSHOT_PATH_CAPACITY, bindings->objects_size, f);
+    fwrite(page_indices, sizeof(page_indices[0]), pages_size, f);
+
+    // NOTE: the pages are aligned within the file, so they can be mapped
+    // right into the memory of the host
+    static const uint8_t zeros[BM_SNAPSHOT_PAGE_SIZE] = {0};
+    const size_t header_size = sizeof(meta)
+                               + sizeof(bm->stack[0]) * bm->stack_size
+                               + BM_SNAPSHOT_PATH_CAPACITY * bindings->objects_size
+                               + sizeof(page_indices[0]) * pages_size;
+    fwrite(zeros, 1, bm_snapshot_align(header_size) - header_size, f);
+
+    for (size_t i = 0; i < pages_size; ++i) {
+        const size_t begin = page_indices[i] * BM_SNAPSHOT_PAGE_SIZE;
+        const size_t n = bm_snapshot_page_end(page_indices[i]) - begin;
+        fwrite(bm->memory + begin, 1, n, f);
+        fwrite(zeros, 1, BM_SNAPSHOT_PAGE_SIZE - n, f);
+    }
+
+    if (ferror(f)) {
+        fclose(f);
+        return bm_error(error, "Could not write file `%s`: %s",
+                        snapshot_path, strerror(errno));
+    }
+
+    fclose(f);
+    return true;
+}
+
+// NOTE: the snapshot is mapped instead of read, so only the pages that are
+// actually restored are loaded from the disk
+static bool bm_snapshot_map(const char *snapshot_path, uint8_t **data, size_t *size, Bm_Error *error)
+{
+#ifndef _WIN32
+    int fd = open(snapshot_path, O_RDONLY);
+    if (fd < 0) {
+        return bm_error(error, "Could not open file `%s`: %s",
+                        snapshot_path, strerror(errno));
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) {
+        close(fd);
+        return bm_error(error, "Could not read file `%s`: %s",
+                        snapshot_path, strerror(errno));
+    }
+
+    *size = (size_t) statbuf.st_size;
+    if (*size == 0) {
+        close(fd);
+        return bm_error(error, "%s: snapshot is empty", snapshot_path);
+    }
+
+    void *result = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (result == MAP_FAILED) {
+        return bm_error(error, "Could not map file `%s`: %s",
+                        snapshot_path, strerror(errno));
+    }
+
+    *data = result;
+    return true;
+#else
+    return bm_slurp_file(snapshot_path, data, size, error);
+#endif // _WIN32
+}
+
+static void bm_snapshot_unmap(uint8_t *data, size_t size)
+{
+#ifndef _WIN32
+    munmap(data, size);
+#else
+    (void) size;
+    free(data);
+#endif // _WIN32
+}
+
+static bool bm_snapshot_restore_mapped(Bm *bm, const char *snapshot_path,
+                                       const uint8_t *data, size_t size,
+                                       Bm_Snapshot_Bindings *bindings, Bm_Error *error)
+{
+    Bm_Snapshot_Meta meta = {0};
+    if (size < sizeof(meta)) {
+        return bm_error(error, "%s: snapshot is too small", snapshot_path);
+    }
+    memcpy(&meta, data, sizeof(meta));
+
+    if (meta.magic != BM_SNAPSHOT_MAGIC) {
+        return bm_error(error, "%s: does not appear to be a valid BM snapshot. Unexpected magic %04X. Expected %04X.",
+                        snapshot_path, meta.magic, BM_SNAPSHOT_MAGIC);
+    }
+
+    if (meta.version != BM_SNAPSHOT_VERSION) {
+        return bm_error(error, "%s: unsupported version of BM snapshot %d. Expected version %d.",
+                        snapshot_path, meta.version, BM_SNAPSHOT_VERSION);
+    }
+
+    if (meta.stack_size > BM_STACK_CAPACITY ||
+            meta.objects_size > BM_SNAPSHOT_OBJECTS_CAPACITY ||
+            meta.pages_size > BM_MEMORY_PAGES_COUNT ||
+            meta.image_path[BM_SNAPSHOT_PATH_CAPACITY - 1] != '\0') {
+        return bm_error(error, "%s: snapshot is corrupted", snapshot_path);
+    }
+
+    const size_t stack_offset = sizeof(meta);
+    const size_t objects_offset = stack_offset + sizeof(Word) * meta.stack_size;
+    const size_t indices_offset = objects_offset + BM_SNAPSHOT_PATH_CAPACITY * meta.objects_size;
+    const size_t pages_offset = bm_snapshot_align(indices_offset + sizeof(uint64_t) * meta.pages_size);
+    if (pages_offset + BM_SNAPSHOT_PAGE_SIZE * meta.pages_size > size) {
+        return bm_error(error, "%s: snapshot is truncated", snapshot_path);
+    }
+
+    uint8_t *image_data = NULL;
+    size_t image_size = 0;
+    if (!bm_slurp_file(meta.image_path, &image_data, &image_size, error)) {
+        return false;
+    }
+
+    if (image_size != meta.image_size || hash_bytes(image_data, image_size) != meta.image_hash) {
+        free(image_data);
+        return bm_error(error, "%s: `%s` has changed since the snapshot was taken",
+                        snapshot_path, meta.image_path);
+    }
+
+    Bm_Error load_error = {0};
+    bool ok = bm_load_program_from_memory(bm, image_data, image_size, &load_error);
+    free(image_data);
+    if (!ok) {
+        return bm_error(error, "%s: %s", meta.image_path, load_error.message);
+    }
+
+    if (meta.ip >= bm->program_size) {
+        return bm_error(error, "%s: snapshot is corrupted", snapshot_path);
+    }
+
+    for (size_t i = 0; i < meta.pages_size; ++i) {
+        uint64_t page = 0;
+        memcpy(&page, data + indices_offset + sizeof(page) * i, sizeof(page));
+        if (page >= BM_MEMORY_PAGES_COUNT) {
+            return bm_error(error, "%s: snapshot is corrupted", snapshot_path);
+        }
+
+        const size_t begin = page * BM_SNAPSHOT_PAGE_SIZE;
+        memcpy(bm->memory + begin,
+               data + pages_offset + BM_SNAPSHOT_PAGE_SIZE * i,
+               bm_snapshot_page_end(page) - begin);
+        bm->dirty_pages[page / 64] |= 1ULL << (page % 64);
+    }
+
+    memcpy(bm->stack, data + stack_offset, sizeof(Word) * meta.stack_size);
+    bm->stack_size = meta.stack_size;
+    bm->ip = meta.ip;
+
+    memcpy(bindings->image_path, meta.image_path, BM_SNAPSHOT_PATH_CAPACITY);
+    for (size_t i = 0; i < meta.objects_size; ++i) {
+        memcpy(bindings->object_paths[i],
+               data + objects_offset + BM_SNAPSHOT_PATH_CAPACITY * i,
+               BM_SNAPSHOT_PATH_CAPACITY);
+        bindings->object_paths[i][BM_SNAPSHOT_PATH_CAPACITY - 1] = '\0';
+    }
+    bindings->objects_size = meta.objects_size;
+
+    return true;
+}
+
+bool bm_snapshot_restore(Bm *bm, const char *snapshot_path,
+                         Bm_Snapshot_Bindings *bindings, Bm_Error *error)
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+    if (!bm_snapshot_map(snapshot_path, &data, &size, error)) {
+        return false;
+    }
+
+    bool ok = bm_snapshot_restore_mapped(bm, snapshot_path, data, size, bindings, error);
+    bm_snapshot_unmap(data, size);
+    return ok;
+}
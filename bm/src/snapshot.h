@@ -0,0 +1,66 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "./bm.h"
+#include "./image_cache.h"
+
+#define BM_SNAPSHOT_MAGIC 0x736d6273
+#define BM_SNAPSHOT_VERSION 1
+#define BM_SNAPSHOT_PAGE_SIZE BM_MEMORY_PAGE_SIZE
+#define BM_SNAPSHOT_PATH_CAPACITY 256
+#define BM_SNAPSHOT_OBJECTS_CAPACITY 16
+
+// NOTE: A snapshot (.bms) is the state of a running program on top of the
+// .bm file it was loaded from. It is laid out as follows:
+//
+//   Bm_Snapshot_Meta
+//   Word stack[stack_size]
+//   char object_paths[objects_size][BM_SNAPSHOT_PATH_CAPACITY]
+//   uint64_t page_indices[pages_size]
+//   padding up to BM_SNAPSHOT_PAGE_SIZE
+//   uint8_t pages[pages_size][BM_SNAPSHOT_PAGE_SIZE]
+//
+// Only the pages of the memory that differ from the memory of the .bm file
+// are stored. The file is checked with its hash when the snapshot is restored.
+PACK(struct Bm_Snapshot_Meta {
+    uint32_t magic;
+    uint16_t version;
+    uint64_t image_hash;
+    uint64_t image_size;
+    uint64_t ip;
+    uint64_t stack_size;
+    uint64_t objects_size;
+    uint64_t pages_size;
+    char image_path[BM_SNAPSHOT_PATH_CAPACITY];
+});
+
+typedef struct Bm_Snapshot_Meta Bm_Snapshot_Meta;
+
+// NOTE: What the host needs to know to continue the program besides the state
+// of the Bm: where the program came from and which dynamic libraries provided
+// its natives. The natives themselves are bound again by name after restoring.
+typedef struct {
+    char image_path[BM_SNAPSHOT_PATH_CAPACITY];
+    char object_paths[BM_SNAPSHOT_OBJECTS_CAPACITY][BM_SNAPSHOT_PATH_CAPACITY];
+    size_t objects_size;
+} Bm_Snapshot_Bindings;
+
+// Saves the state of `bm` that was loaded from `bindings->image_path`. The
+// program continues from `bm->ip` when the snapshot is restored, so a native
+// that saves a snapshot has to point it past its own instruction. The
+// mappings, the channels and the buffered input are not saved, so the
+// snapshot is refused while there are mappings or buffered input. The
+// snapshot stores the absolute paths of the image and of the native
+// libraries that were given by their paths. The image is compared with the
+// memory through `image_cache` if it is not NULL, so a program that saves
+// snapshots repeatedly does not read and decode its file every time.
+bool bm_snapshot_save(const Bm *bm, const Bm_Snapshot_Bindings *bindings,
+                      Bm_Image_Cache *image_cache,
+                      const char *snapshot_path, Bm_Error *error);
+// Loads the .bm file the snapshot was taken from, restores the stack, the
+// memory and the instruction pointer and reports the bindings. The natives
+// are not bound, that is up to the host as with a freshly loaded program.
+bool bm_snapshot_restore(Bm *bm, const char *snapshot_path,
+                         Bm_Snapshot_Bindings *bindings, Bm_Error *error);
+
+#endif // SNAPSHOT_H_
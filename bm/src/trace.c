@@ -0,0 +1,169 @@
+#ifndef _WIN32
+#    ifdef __linux__
+#        define _DEFAULT_SOURCE
+#    endif
+#endif // _WIN32
+
+#include "./trace.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+bool bm_trace_open(Bm_Trace *trace, const char *file_path, uint64_t capacity,
+                   const Bm *bm, const Bm_Trace_Symbol *symbols, size_t symbols_size,
+                   Bm_Error *error)
+{
+    uint64_t ring_capacity = BM_TRACE_ALIGNMENT;
+    while (ring_capacity < capacity) {
+        ring_capacity *= 2;
+    }
+
+    const size_t program_offset = sizeof(Bm_Trace_Header);
+    const size_t symbols_offset = program_offset + sizeof(bm->program[0]) * bm->program_size;
+    const size_t ring_offset = (symbols_offset + sizeof(symbols[0]) * symbols_size + BM_TRACE_ALIGNMENT - 1)
+                               / BM_TRACE_ALIGNMENT * BM_TRACE_ALIGNMENT;
+    const size_t size = ring_offset + ring_capacity;
+
+    int fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return bm_error(error, "Could not open file `%s`: %s",
+                        file_path, strerror(errno));
+    }
+
+    if (ftruncate(fd, (off_t) size) < 0) {
+        close(fd);
+        return bm_error(error, "Could not resize file `%s`: %s",
+                        file_path, strerror(errno));
+    }
+
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return bm_error(error, "Could not map file `%s`: %s",
+                        file_path, strerror(errno));
+    }
+
+    trace->header = data;
+    trace->ring = (uint8_t *) data + ring_offset;
+    trace->mask = ring_capacity - 1;
+    trace->mapped_size = size;
+
+    memcpy((uint8_t *) data + program_offset, bm->program, sizeof(bm->program[0]) * bm->program_size);
+    memcpy((uint8_t *) data + symbols_offset, symbols, sizeof(symbols[0]) * symbols_size);
+
+    Bm_Trace_Header header = {
+        .magic = BM_TRACE_MAGIC,
+        .version = BM_TRACE_VERSION,
+        .capacity = ring_capacity,
+        .program_size = bm->program_size,
+        .symbols_size = symbols_size,
+        .ring_offset = ring_offset,
+    };
+    *trace->header = header;
+
+    return true;
+}
+
+void bm_trace_close(Bm_Trace *trace)
+{
+    if (trace->header != NULL) {
+        munmap(trace->header, trace->mapped_size);
+        trace->header = NULL;
+    }
+}
+#else
+bool bm_trace_open(Bm_Trace *trace, const char *file_path, uint64_t capacity,
+                   const Bm *bm, const Bm_Trace_Symbol *symbols, size_t symbols_size,
+                   Bm_Error *error)
+{
+    (void) trace;
+    (void) capacity;
+    (void) bm;
+    (void) symbols;
+    (void) symbols_size;
+    return bm_error(error, "Could not create trace `%s`: tracing is only supported on POSIX systems", file_path);
+}
+
+void bm_trace_close(Bm_Trace *trace)
+{
+    (void) trace;
+}
+#endif // _WIN32
+
+static void bm_trace_push(Bm_Trace *trace, const uint64_t *units, size_t units_count)
+{
+    Bm_Trace_Header *header = trace->header;
+    const uint64_t size = units_count * sizeof(units[0]);
+
+    // NOTE: drop the oldest records until the new one fits
+    while (header->head + size - header->tail > trace->mask + 1) {
+        const Bm_Trace_Record *oldest = (const Bm_Trace_Record *) &trace->ring[header->tail & trace->mask];
+        header->tail += BM_TRACE_RECORD_SIZE(oldest->kind);
+    }
+
+    // NOTE: the records consist of 8 byte units and the capacity is a power
+    // of two, so a unit never crosses the end of the ring
+    for (size_t i = 0; i < units_count; ++i) {
+        memcpy(&trace->ring[(header->head + i * sizeof(units[0])) & trace->mask], &units[i], sizeof(units[i]));
+    }
+
+    header->head += size;
+    header->records += 1;
+}
+
+static uint8_t bm_trace_write_size(Inst_Type type)
+{
+    if (type == INST_WRITE8) {
+        return 1;
+    } else if (type == INST_WRITE16) {
+        return 2;
+    } else if (type == INST_WRITE32) {
+        return 4;
+    } else if (type == INST_WRITE64) {
+        return 8;
+    }
+    return 0;
+}
+
+// NOTE: prepares the record of the instruction that is about to be
+// executed. The written value has to be captured before the write pops it.
+static size_t bm_trace_record(const Bm *bm, Inst inst, uint64_t units[3])
+{
+    const uint8_t write_size = bm_trace_write_size(inst.type);
+
+    Bm_Trace_Record record = {
+        .kind = BM_TRACE_RECORD_INST,
+        .type = (uint8_t) inst.type,
+        .ip = (uint32_t) bm->ip,
+    };
+    size_t units_count = 1;
+
+    if (write_size > 0 && bm->stack_size >= 2) {
+        record.kind = BM_TRACE_RECORD_WRITE;
+        record.write_size = write_size;
+        units[1] = bm->stack[bm->stack_size - 2].as_u64;
+        units[2] = bm->stack[bm->stack_size - 1].as_u64;
+        if (write_size < 8) {
+            units[2] &= (1ULL << (write_size * 8)) - 1;
+        }
+        units_count = 3;
+    }
+
+    memcpy(&units[0], &record, sizeof(record));
+    return units_count;
+}
+
+#define BM_LOOP_NAME bm_trace_loop
+#define BM_LOOP_PARAMS , Bm_Trace *trace
+#define BM_LOOP_BEFORE(bm, inst) \
+    uint64_t units[3] = {0}; \
+    const size_t units_count = bm_trace_record((bm), (inst), units)
+#define BM_LOOP_AFTER(bm, inst) bm_trace_push(trace, units, units_count)
+#include "./inst_loop.h"
+
+Err bm_trace_execute_program(Bm_Trace *trace, Bm *bm, int limit)
+{
+    return bm_trace_loop(bm, limit, trace);
+}
@@ -0,0 +1,85 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "./bm.h"
+
+#define BM_TRACE_MAGIC 0x74726d62
+#define BM_TRACE_VERSION 1
+#define BM_TRACE_DEFAULT_CAPACITY (64 * 1024 * 1024)
+#define BM_TRACE_SYMBOL_NAME_CAPACITY 64
+#define BM_TRACE_ALIGNMENT 4096
+
+// NOTE: A trace (.bmt) is a memory mapped file that the Virtual Machine
+// appends a record to after every executed instruction. It is laid out as
+//
+//   Bm_Trace_Header
+//   Inst program[program_size]
+//   Bm_Trace_Symbol symbols[symbols_size]
+//   padding up to BM_TRACE_ALIGNMENT
+//   uint8_t ring[capacity]
+//
+// The ring keeps the most recent records: the oldest ones are dropped
+// when it is full. The file is written through the mapping, so it can be
+// inspected with bmtrace even if the process crashed.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t capacity;
+    uint64_t program_size;
+    uint64_t symbols_size;
+    uint64_t ring_offset;
+    // NOTE: the ring holds the records in [tail, head). Both of them keep
+    // growing and are wrapped around the capacity only to access the ring.
+    uint64_t head;
+    uint64_t tail;
+    // NOTE: the amount of records ever written, including the dropped ones
+    uint64_t records;
+} Bm_Trace_Header;
+
+typedef enum {
+    BM_TRACE_RECORD_INST = 1,
+    // NOTE: followed by two uint64_t: the address and the value written
+    BM_TRACE_RECORD_WRITE,
+} Bm_Trace_Record_Kind;
+
+// NOTE: 8 bytes. The size of the whole record depends on its kind.
+typedef struct {
+    uint8_t kind;
+    uint8_t type;
+    uint8_t write_size;
+    uint8_t reserved;
+    // NOTE: BM_PROGRAM_CAPACITY is way below 2^32
+    uint32_t ip;
+} Bm_Trace_Record;
+
+static_assert(sizeof(Bm_Trace_Record) == 8,
+              "The records of the trace are expected to consist of 8 byte units");
+
+#define BM_TRACE_RECORD_SIZE(kind) \
+    ((kind) == BM_TRACE_RECORD_WRITE ? sizeof(Bm_Trace_Record) + 2 * sizeof(uint64_t) : sizeof(Bm_Trace_Record))
+
+typedef struct {
+    char name[BM_TRACE_SYMBOL_NAME_CAPACITY];
+    Inst_Addr addr;
+} Bm_Trace_Symbol;
+
+typedef struct {
+    Bm_Trace_Header *header;
+    uint8_t *ring;
+    uint64_t mask;
+    size_t mapped_size;
+} Bm_Trace;
+
+// Creates the trace file for the program currently loaded into `bm`. The
+// capacity of the ring is rounded up to a power of two. The symbols are only
+// used by the decoder to name the addresses. Only POSIX systems are supported.
+bool bm_trace_open(Bm_Trace *trace, const char *file_path, uint64_t capacity,
+                   const Bm *bm, const Bm_Trace_Symbol *symbols, size_t symbols_size,
+                   Bm_Error *error);
+void bm_trace_close(Bm_Trace *trace);
+// Executes the program the same way as bm_execute_program() and records
+// every instruction that succeeded.
+Err bm_trace_execute_program(Bm_Trace *trace, Bm *bm, int limit);
+
+#endif // TRACE_H_
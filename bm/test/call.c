@@ -0,0 +1,106 @@
+#include "./test.h"
+
+// NOTE: the entry point pushes a marker and halts. The exported routines
+// find the return address on top of their arguments.
+static const Inst program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 69}},
+    {.type = INST_HALT},
+    // add: [a b ret] -> [a+b]
+    {.type = INST_SWAP,   .operand = {.as_u64 = 2}},
+    {.type = INST_PLUSI},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_RET},
+    // fail: [ret] -> division by zero
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_DIVI},
+    {.type = INST_RET},
+    // stop: [ret] -> halts with garbage on the stack
+    {.type = INST_PUSH,   .operand = {.as_u64 = 420}},
+    {.type = INST_HALT},
+};
+
+static const Bm_Export exports[] = {
+    {.name = "add",  .addr = 2},
+    {.name = "fail", .addr = 6},
+    {.name = "stop", .addr = 10},
+};
+
+static size_t export_by_name(const Bm *bm, const char *name)
+{
+    size_t export_id = 0;
+    TEST_ASSERT(bm_export_by_name(bm, name, &export_id));
+    return export_id;
+}
+
+int main(void)
+{
+    static Test_Image image = {0};
+    test_image_make(&image, &(Test_Program) {
+        .program = program,
+        .program_size = sizeof(program) / sizeof(program[0]),
+        .exports = exports,
+        .exports_size = sizeof(exports) / sizeof(exports[0]),
+    });
+
+    Bm *bm = test_bm_create(&image);
+    TEST_ASSERT(!bm_export_by_name(bm, "nope", &(size_t) {0}));
+    const size_t add = export_by_name(bm, "add");
+    const size_t fail = export_by_name(bm, "fail");
+    const size_t stop = export_by_name(bm, "stop");
+
+    // NOTE: success, over and over on the same context
+    for (uint64_t i = 0; i < 100; ++i) {
+        const Word args[] = {{.as_u64 = i}, {.as_u64 = 1000}};
+        Word result = {0};
+        TEST_ASSERT_ERR(bm_call(bm, add, args, 2, &result, 1), ERR_OK);
+        TEST_ASSERT(result.as_u64 == i + 1000);
+        TEST_ASSERT(bm->stack_size == 0);
+        TEST_ASSERT(bm->ip == 0);
+        TEST_ASSERT(!bm->halt);
+    }
+
+    TEST_ASSERT_ERR(bm_call(bm, bm->exports_size, NULL, 0, NULL, 0), ERR_ILLEGAL_OPERAND);
+
+    // NOTE: the machine is restored after a failure, so the next call works
+    {
+        TEST_ASSERT_ERR(bm_call(bm, fail, NULL, 0, NULL, 0), ERR_DIV_BY_ZERO);
+        TEST_ASSERT(bm->stack_size == 0);
+        TEST_ASSERT(bm->ip == 0);
+
+        const Word args[] = {{.as_u64 = 2}, {.as_u64 = 3}};
+        Word result = {0};
+        TEST_ASSERT_ERR(bm_call(bm, add, args, 2, &result, 1), ERR_OK);
+        TEST_ASSERT(result.as_u64 == 5);
+    }
+
+    // NOTE: a routine that halts leaves the results untouched and the halt
+    // set, but the stack and the instruction pointer are restored
+    {
+        Word result = {.as_u64 = 1337};
+        TEST_ASSERT_ERR(bm_call(bm, stop, NULL, 0, &result, 1), ERR_OK);
+        TEST_ASSERT(bm->halt);
+        TEST_ASSERT(result.as_u64 == 1337);
+        TEST_ASSERT(bm->stack_size == 0);
+        TEST_ASSERT(bm->ip == 0);
+    }
+
+    // NOTE: the program runs to its end, and its exports are still callable
+    // afterwards without losing the halt
+    {
+        bm->halt = false;
+        TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+        TEST_ASSERT(bm->halt);
+        TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 69);
+
+        const Word args[] = {{.as_u64 = 34}, {.as_u64 = 35}};
+        Word result = {0};
+        TEST_ASSERT_ERR(bm_call(bm, add, args, 2, &result, 1), ERR_OK);
+        TEST_ASSERT(result.as_u64 == 69);
+        TEST_ASSERT(bm->halt);
+        TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 69);
+    }
+
+    bm_destroy(bm);
+    return 0;
+}
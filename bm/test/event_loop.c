@@ -0,0 +1,94 @@
+#include <time.h>
+
+#include "./test.h"
+#include "./event_loop.h"
+
+#define CONTEXTS 8
+#define SLEEP_MS 100
+
+// NOTE: sleeps and halts with the argument of the entry on the stack
+static const Inst sleeper[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = SLEEP_MS}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PLUSI},
+    {.type = INST_HALT},
+};
+
+static const Inst divider[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_DIVI},
+    {.type = INST_HALT},
+};
+
+static const char *const externals[] = {"sleep"};
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static Bm *create(const Inst *program, size_t program_size)
+{
+    static Test_Image image = {0};
+    test_image_make(&image, &(Test_Program) {
+        .program = program,
+        .program_size = program_size,
+        .externals = externals,
+        .externals_size = 1,
+    });
+
+    Bm *bm = test_bm_create(&image);
+    bm_push_native(bm, bm_builtin_native_by_name("sleep"));
+    return bm;
+}
+
+int main(void)
+{
+#ifdef __linux__
+    Bm_Error error = {0};
+    Bm_Event_Loop loop = {0};
+    TEST_ASSERT(bm_event_loop_init(&loop, &error));
+
+    // NOTE: the sleeps of all of the contexts overlap
+    Bm *contexts[CONTEXTS] = {0};
+    for (size_t i = 0; i < CONTEXTS; ++i) {
+        contexts[i] = create(sleeper, sizeof(sleeper) / sizeof(sleeper[0]));
+        contexts[i]->stack[contexts[i]->stack_size++].as_u64 = i;
+        TEST_ASSERT(bm_event_loop_spawn(&loop, contexts[i], &error));
+    }
+
+    const double begin = now();
+    Bm *failed = NULL;
+    TEST_ASSERT_ERR(bm_event_loop_run(&loop, &failed), ERR_OK);
+    const double elapsed = now() - begin;
+    TEST_ASSERT(failed == NULL);
+    TEST_ASSERT(elapsed < (double) (CONTEXTS * SLEEP_MS) / 1000.0 / 2.0);
+
+    for (size_t i = 0; i < CONTEXTS; ++i) {
+        TEST_ASSERT(contexts[i]->halt);
+        TEST_ASSERT(contexts[i]->stack_size == 1);
+        TEST_ASSERT(contexts[i]->stack[0].as_u64 == i + 1);
+        bm_destroy(contexts[i]);
+    }
+
+    // NOTE: the loop stops on the first failure and reports the context
+    Bm *good = create(sleeper, sizeof(sleeper) / sizeof(sleeper[0]));
+    good->stack[good->stack_size++].as_u64 = 0;
+    Bm *bad = create(divider, sizeof(divider) / sizeof(divider[0]));
+    TEST_ASSERT(bm_event_loop_spawn(&loop, good, &error));
+    TEST_ASSERT(bm_event_loop_spawn(&loop, bad, &error));
+    TEST_ASSERT_ERR(bm_event_loop_run(&loop, &failed), ERR_DIV_BY_ZERO);
+    TEST_ASSERT(failed == bad);
+
+    bm_event_loop_free(&loop);
+    bm_destroy(good);
+    bm_destroy(bad);
+#endif // __linux__
+    return 0;
+}
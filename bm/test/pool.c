@@ -0,0 +1,113 @@
+#include "./test.h"
+#include "./pool.h"
+
+#define PAGES 4
+
+// NOTE: [addr value] -> adds the value to the byte at the address and leaves
+// the new byte on the stack
+static const Inst program[] = {
+    {.type = INST_DUP,    .operand = {.as_u64 = 1}},
+    {.type = INST_DUP,    .operand = {.as_u64 = 0}},
+    {.type = INST_READ8U},
+    {.type = INST_DUP,    .operand = {.as_u64 = 2}},
+    {.type = INST_PLUSI},
+    {.type = INST_SWAP,   .operand = {.as_u64 = 1}},
+    {.type = INST_DUP,    .operand = {.as_u64 = 1}},
+    {.type = INST_WRITE8},
+    {.type = INST_HALT},
+};
+
+static Err legacy_poke(Bm *bm)
+{
+    bm->memory[(PAGES - 1) * BM_MEMORY_PAGE_SIZE] = 0xff;
+    return ERR_OK;
+}
+
+static const Inst poker[] = {
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_HALT},
+};
+
+static const char *const externals[] = {"poke"};
+
+static Bm *run(Bm_Pool *pool, uint64_t addr, uint64_t value)
+{
+    Bm *bm = bm_pool_acquire(pool);
+    TEST_ASSERT(bm != NULL);
+    TEST_ASSERT(bm->ip == 0 && bm->stack_size == 0 && !bm->halt);
+    bm->stack[bm->stack_size++].as_u64 = addr;
+    bm->stack[bm->stack_size++].as_u64 = value;
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm->halt);
+    return bm;
+}
+
+int main(void)
+{
+    static uint8_t memory[PAGES * BM_MEMORY_PAGE_SIZE] = {0};
+    memory[BM_MEMORY_PAGE_SIZE] = 40;
+
+    static Test_Image image = {0};
+    test_image_make(&image, &(Test_Program) {
+        .program = program,
+        .program_size = sizeof(program) / sizeof(program[0]),
+        .memory = memory,
+        .memory_size = sizeof(memory),
+        .memory_capacity = sizeof(memory),
+    });
+
+    Bm_Error error = {0};
+    Bm_Pool pool = {0};
+    TEST_ASSERT(bm_pool_init(&pool, image.data, image.size, &error));
+
+    Bm *bm = run(&pool, BM_MEMORY_PAGE_SIZE, 2);
+    TEST_ASSERT(bm->stack[bm->stack_size - 1].as_u64 == 42);
+    bm_pool_release(&pool, bm);
+    TEST_ASSERT(pool.created == 1 && pool.reused == 0);
+    TEST_ASSERT(pool.restored_pages == 1);
+
+    // NOTE: the same context comes back with the memory of the image
+    Bm *again = run(&pool, BM_MEMORY_PAGE_SIZE, 2);
+    TEST_ASSERT(again == bm);
+    TEST_ASSERT(again->stack[again->stack_size - 1].as_u64 == 42);
+    TEST_ASSERT(pool.created == 1 && pool.reused == 1);
+
+    // NOTE: a context that is in use is not handed out twice
+    Bm *other = run(&pool, 0, 7);
+    TEST_ASSERT(other != again);
+    TEST_ASSERT(other->memory[BM_MEMORY_PAGE_SIZE] == 40);
+    bm_pool_release(&pool, again);
+    bm_pool_release(&pool, other);
+    TEST_ASSERT(pool.created == 2);
+    TEST_ASSERT(pool.restored_pages == 3);
+    bm_pool_free(&pool);
+
+    // NOTE: a legacy native that is not tracked gets the whole memory restored
+    test_image_make(&image, &(Test_Program) {
+        .program = poker,
+        .program_size = sizeof(poker) / sizeof(poker[0]),
+        .memory = memory,
+        .memory_size = sizeof(memory),
+        .memory_capacity = sizeof(memory),
+        .externals = externals,
+        .externals_size = 1,
+    });
+    TEST_ASSERT(bm_pool_init(&pool, image.data, image.size, &error));
+
+    bm = bm_pool_acquire(&pool);
+    TEST_ASSERT(bm != NULL && bm->natives_size == 0);
+    bm_push_native(bm, legacy_poke);
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm->memory[(PAGES - 1) * BM_MEMORY_PAGE_SIZE] == 0xff);
+    bm_pool_release(&pool, bm);
+    TEST_ASSERT(bm->memory[(PAGES - 1) * BM_MEMORY_PAGE_SIZE] == 0);
+    TEST_ASSERT(pool.restored_pages >= PAGES);
+
+    // NOTE: the reused context keeps its natives
+    again = bm_pool_acquire(&pool);
+    TEST_ASSERT(again == bm && again->natives_size == 1);
+    bm_pool_release(&pool, again);
+    bm_pool_free(&pool);
+
+    return 0;
+}
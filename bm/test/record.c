@@ -0,0 +1,118 @@
+#include "./test.h"
+#include "./record.h"
+#include "./hash.h"
+
+#define PAGES 3
+
+// NOTE: `counter` is a tracked native that writes through
+// bm_memory_range(), `legacy` writes to the memory directly
+static const Inst program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    {.type = INST_PLUSI},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 1}},
+    {.type = INST_HALT},
+};
+
+static const char *const externals[] = {"counter", "legacy"};
+
+static uint64_t counter = 0;
+
+// NOTE: [addr] -> [counter]. Bumps a counter that lives outside of the
+// Virtual Machine and writes it to the memory.
+static Err native_counter(Bm *bm)
+{
+    counter += 5;
+    uint8_t *data = bm_memory_range(bm, bm->stack[bm->stack_size - 1].as_u64, 1, true);
+    TEST_ASSERT(data != NULL);
+    *data = (uint8_t) counter;
+    bm->stack[bm->stack_size - 1].as_u64 = counter;
+    return ERR_OK;
+}
+
+static Err native_legacy(Bm *bm)
+{
+    bm->memory[2 * BM_MEMORY_PAGE_SIZE + 1] = (uint8_t) counter;
+    return ERR_OK;
+}
+
+static Bm_Recorder recorder = {0};
+static Bm_Native recorded[2] = {native_counter, native_legacy};
+static const bool recorded_tracked[2] = {true, false};
+
+static Err record(Bm *bm)
+{
+    const Native_ID id = bm->program[bm->ip].operand.as_u64;
+    Err err = ERR_OK;
+    Bm_Error error = {0};
+    if (!bm_recorder_call(&recorder, bm, recorded[id], NULL, recorded_tracked[id], &err, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    return err;
+}
+
+static Bm_Replayer replayer = {0};
+
+static Err replay(Bm *bm)
+{
+    Err err = ERR_OK;
+    Bm_Error error = {0};
+    if (!bm_replayer_call(&replayer, bm, &err, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    TEST_ASSERT(argc == 2);
+    const char *record_path = test_path(argv[1], "record.bmn");
+
+    static Test_Image image = {0};
+    test_image_make(&image, &(Test_Program) {
+        .program = program,
+        .program_size = sizeof(program) / sizeof(program[0]),
+        .memory_capacity = PAGES * BM_MEMORY_PAGE_SIZE,
+        .externals = externals,
+        .externals_size = 2,
+    });
+    const uint64_t image_hash = hash_bytes(image.data, image.size);
+
+    Bm_Error error = {0};
+    Bm *bm = test_bm_create(&image);
+    TEST_ASSERT(bm_recorder_open(&recorder, record_path, image_hash, &error));
+    bm_push_tracked_native(bm, record);
+    bm_push_tracked_native(bm, record);
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm_recorder_close(&recorder, &error));
+    TEST_ASSERT(recorder.calls == 3);
+    TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 15);
+    TEST_ASSERT(bm->memory[0] == 10);
+    TEST_ASSERT(bm->memory[2 * BM_MEMORY_PAGE_SIZE + 1] == 10);
+    bm_destroy(bm);
+
+    // NOTE: the natives are not called during the replay, so the counter
+    // stays the same and everything comes from the record
+    counter = 1000;
+    bm = test_bm_create(&image);
+    TEST_ASSERT(bm_replayer_open(&replayer, record_path, image_hash, &error));
+    bm_push_tracked_native(bm, replay);
+    bm_push_tracked_native(bm, replay);
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm_replayer_finished(&replayer));
+    TEST_ASSERT(counter == 1000);
+    TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 15);
+    TEST_ASSERT(bm->memory[0] == 10);
+    TEST_ASSERT(bm->memory[2 * BM_MEMORY_PAGE_SIZE + 1] == 10);
+    bm_replayer_close(&replayer);
+    bm_destroy(bm);
+
+    // NOTE: the record belongs to this very program
+    TEST_ASSERT(!bm_replayer_open(&replayer, record_path, image_hash + 1, &error));
+
+    return 0;
+}
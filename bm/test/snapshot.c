@@ -0,0 +1,113 @@
+#include "./test.h"
+#include "./snapshot.h"
+
+#define PAGES 3
+
+static const char *image_path = NULL;
+static const char *snapshot_path = NULL;
+
+// NOTE: fills the first byte of every page, saves a snapshot in the middle
+// and sums the bytes up after it
+static const Inst program[] = {
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 1}},
+    {.type = INST_WRITE8},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 2 * BM_MEMORY_PAGE_SIZE}},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 2}},
+    {.type = INST_WRITE8},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 100}},
+    {.type = INST_NATIVE, .operand = {.as_u64 = 0}},
+    // NOTE: the snapshot continues from here
+    {.type = INST_PUSH,   .operand = {.as_u64 = 0}},
+    {.type = INST_READ8U},
+    {.type = INST_PLUSI},
+    {.type = INST_PUSH,   .operand = {.as_u64 = BM_MEMORY_PAGE_SIZE}},
+    {.type = INST_READ8U},
+    {.type = INST_PLUSI},
+    {.type = INST_PUSH,   .operand = {.as_u64 = 2 * BM_MEMORY_PAGE_SIZE}},
+    {.type = INST_READ8U},
+    {.type = INST_PLUSI},
+    {.type = INST_HALT},
+};
+
+static const char *const externals[] = {"snapshot"};
+
+static Err save_snapshot(Bm *bm)
+{
+    Bm_Snapshot_Bindings bindings = {0};
+    TEST_ASSERT(strlen(image_path) < BM_SNAPSHOT_PATH_CAPACITY);
+    strcpy(bindings.image_path, image_path);
+
+    Bm_Error error = {0};
+    bm->ip += 1;
+    if (!bm_snapshot_save(bm, &bindings, NULL, snapshot_path, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+    bm->ip -= 1;
+
+    return ERR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    TEST_ASSERT(argc == 2);
+    image_path = test_path(argv[1], "snapshot.bm");
+    snapshot_path = test_path(argv[1], "snapshot.bms");
+
+    // NOTE: the middle page comes from the image and is never written to
+    static uint8_t memory[2 * BM_MEMORY_PAGE_SIZE] = {0};
+    memory[BM_MEMORY_PAGE_SIZE] = 10;
+
+    static Test_Image image = {0};
+    test_image_make(&image, &(Test_Program) {
+        .program = program,
+        .program_size = sizeof(program) / sizeof(program[0]),
+        .memory = memory,
+        .memory_size = sizeof(memory),
+        .memory_capacity = PAGES * BM_MEMORY_PAGE_SIZE,
+        .externals = externals,
+        .externals_size = 1,
+    });
+    test_image_save(&image, image_path);
+
+    Bm *bm = test_bm_create(&image);
+    bm_push_native(bm, save_snapshot);
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 113);
+    bm_destroy(bm);
+
+    Bm_Error error = {0};
+    Bm_Snapshot_Bindings bindings = {0};
+    bm = bm_create();
+    TEST_ASSERT(bm != NULL);
+    if (!bm_snapshot_restore(bm, snapshot_path, &bindings, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    // NOTE: the snapshot stores the absolute path of the image
+    TEST_ASSERT(bindings.image_path[0] == '/');
+    TEST_ASSERT(bindings.objects_size == 0);
+    TEST_ASSERT(bm->ip == 8);
+    TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 100);
+    TEST_ASSERT(bm->memory[0] == 1);
+    TEST_ASSERT(bm->memory[BM_MEMORY_PAGE_SIZE] == 10);
+    TEST_ASSERT(bm->memory[2 * BM_MEMORY_PAGE_SIZE] == 2);
+
+    // NOTE: the natives are bound by the host again
+    bm_push_native(bm, save_snapshot);
+    TEST_ASSERT_ERR(bm_execute_program(bm, -1), ERR_OK);
+    TEST_ASSERT(bm->stack_size == 1 && bm->stack[0].as_u64 == 113);
+    bm_destroy(bm);
+
+    // NOTE: the snapshot is refused once the image has changed
+    image.data[image.size - 1] ^= 1;
+    test_image_save(&image, image_path);
+    bm = bm_create();
+    TEST_ASSERT(bm != NULL);
+    TEST_ASSERT(!bm_snapshot_restore(bm, snapshot_path, &bindings, &error));
+    bm_destroy(bm);
+
+    return 0;
+}
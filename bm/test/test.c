@@ -0,0 +1,69 @@
+#include "./test.h"
+
+static void test_image_push(Test_Image *image, const void *data, size_t size)
+{
+    TEST_ASSERT(image->size + size <= TEST_IMAGE_CAPACITY);
+    if (size > 0) {
+        memcpy(image->data + image->size, data, size);
+    }
+    image->size += size;
+}
+
+void test_image_make(Test_Image *image, const Test_Program *program)
+{
+    Bm_File_Meta meta = {
+        .magic = BM_FILE_MAGIC,
+        .version = BM_FILE_VERSION,
+        .program_size = program->program_size,
+        .entry = program->entry,
+        .memory_size = program->memory_size,
+        .memory_capacity = program->memory_capacity,
+        .externals_size = program->externals_size,
+        .exports_size = program->exports_size,
+    };
+
+    image->size = 0;
+    test_image_push(image, &meta, sizeof(meta));
+    test_image_push(image, program->program, sizeof(program->program[0]) * program->program_size);
+    test_image_push(image, program->memory, program->memory_size);
+    for (size_t i = 0; i < program->externals_size; ++i) {
+        External_Native external = {0};
+        TEST_ASSERT(strlen(program->externals[i]) < NATIVE_NAME_CAPACITY);
+        strcpy(external.name, program->externals[i]);
+        test_image_push(image, &external, sizeof(external));
+    }
+    test_image_push(image, program->exports, sizeof(program->exports[0]) * program->exports_size);
+}
+
+void test_image_save(const Test_Image *image, const char *file_path)
+{
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL || fwrite(image->data, 1, image->size, f) != image->size) {
+        fprintf(stderr, "ERROR: could not write `%s`: %s\n", file_path, strerror(errno));
+        exit(1);
+    }
+    fclose(f);
+}
+
+const char *test_path(const char *dir, const char *file_name)
+{
+    const size_t size = strlen(dir) + 1 + strlen(file_name) + 1;
+    char *path = malloc(size);
+    TEST_ASSERT(path != NULL);
+    snprintf(path, size, "%s/%s", dir, file_name);
+    return path;
+}
+
+Bm *test_bm_create(const Test_Image *image)
+{
+    Bm *bm = bm_create();
+    TEST_ASSERT(bm != NULL);
+
+    Bm_Error error = {0};
+    if (!bm_load_program_from_memory(bm, image->data, image->size, &error)) {
+        fprintf(stderr, "ERROR: %s\n", error.message);
+        exit(1);
+    }
+
+    return bm;
+}
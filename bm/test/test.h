@@ -0,0 +1,59 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include "./bm.h"
+
+// NOTE: The drivers in this folder exercise the embedding API of libbm that
+// the basm test cases can not reach through bmr. Every driver is a separate
+// program that is linked with libbm.a and exits with 1 on the first failed
+// check. `./nobuild test` builds and runs all of them.
+
+#define TEST_IMAGE_CAPACITY (64 * 1024)
+
+#define TEST_ASSERT(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: FAILED: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define TEST_ASSERT_ERR(actual, expected) \
+    do { \
+        const Err test_actual = (actual); \
+        if (test_actual != (expected)) { \
+            fprintf(stderr, "%s:%d: FAILED: expected %s but got %s\n", __FILE__, __LINE__, \
+                    err_as_cstr(expected), err_as_cstr(test_actual)); \
+            exit(1); \
+        } \
+    } while (0)
+
+// NOTE: the content of a .bm file
+typedef struct {
+    uint8_t data[TEST_IMAGE_CAPACITY];
+    size_t size;
+} Test_Image;
+
+typedef struct {
+    const Inst *program;
+    size_t program_size;
+    Inst_Addr entry;
+    // NOTE: the memory is zero initialized up to `memory_capacity`
+    const uint8_t *memory;
+    size_t memory_size;
+    size_t memory_capacity;
+    const char *const *externals;
+    size_t externals_size;
+    const Bm_Export *exports;
+    size_t exports_size;
+} Test_Program;
+
+void test_image_make(Test_Image *image, const Test_Program *program);
+void test_image_save(const Test_Image *image, const char *file_path);
+// Returns `dir/file_name`. The drivers that need files get the folder for them
+// as their only argument.
+const char *test_path(const char *dir, const char *file_name);
+// Creates a context with the image installed or fails the test
+Bm *test_bm_create(const Test_Image *image);
+
+#endif // TEST_H_
@@ -64,7 +64,7 @@ void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment)
                 continue;
             }
         } else {
-            memset(ptr, 0, real_size);
+            memset(ptr, 0, size);
             cur->size += real_size;
             return ptr;
         }
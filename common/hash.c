@@ -0,0 +1,21 @@
+#include "./hash.h"
+
+uint64_t hash_bytes_continue(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= HASH_FNV1A_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hash_bytes(const void *data, size_t size)
+{
+    return hash_bytes_continue(HASH_FNV1A_OFFSET, data, size);
+}
+
+uint64_t hash_sv(String_View sv)
+{
+    return hash_bytes(sv.data, sv.count);
+}
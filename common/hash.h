@@ -0,0 +1,17 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./sv.h"
+
+// NOTE: https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+#define HASH_FNV1A_OFFSET 0xcbf29ce484222325ULL
+#define HASH_FNV1A_PRIME  0x100000001b3ULL
+
+uint64_t hash_bytes(const void *data, size_t size);
+uint64_t hash_bytes_continue(uint64_t hash, const void *data, size_t size);
+uint64_t hash_sv(String_View sv);
+
+#endif // HASH_H_
@@ -8,6 +8,7 @@
                  INCLUDE_FLAG(PATH("..", "bm", "src"))
 #define COMMON_UNITS PATH("..", "common", "sv.c")
 #define BM_UNITS PATH("..", "bm", "src", "bm.c"), \
+                 PATH("..", "bm", "src", "channel.c"), \
                  PATH("..", "bm", "src", "types.c")
 #define UNITS COMMON_UNITS, BM_UNITS
 
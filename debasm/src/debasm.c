@@ -36,6 +36,12 @@ int main(int argc, char *argv[])
             printf("%%entry main:\n");
         }
 
+        for (size_t j = 0; j < bm.exports_size; ++j) {
+            if (bm.exports[j].addr == i) {
+                printf("%%export %s:\n", bm.exports[j].name);
+            }
+        }
+
         Inst_Def inst_def = get_inst_def(bm.program[i].type);
 
         printf("    %s", inst_def.name);